@@ -96,6 +96,9 @@ namespace riscv {
 		abi_errno_ENAMETOOLONG = 36,
 		abi_errno_ENOLCK = 37,
 		abi_errno_ENOSYS = 38,
+		abi_errno_ENOTEMPTY = 39,
+		abi_errno_ELOOP = 40,
+		abi_errno_EOPNOTSUPP = 95,
 
 		abi_fcntl_F_DUPFD = 0,
 		abi_fcntl_F_GETFD = 1,
@@ -419,6 +422,9 @@ namespace riscv {
 			case ENAMETOOLONG: return -abi_errno_ENAMETOOLONG;
 			case ENOLCK:   return -abi_errno_ENOLCK;
 			case ENOSYS:   return -abi_errno_ENOSYS;
+			case ENOTEMPTY: return -abi_errno_ENOTEMPTY;
+			case ELOOP:    return -abi_errno_ELOOP;
+			case EOPNOTSUPP: return -abi_errno_EOPNOTSUPP;
 			default:       return -abi_errno_EINVAL;
 		}
 	}
@@ -1014,6 +1020,7 @@ namespace riscv {
 	template <typename P> void abi_sys_munmap(P &proc)
 	{
 		int ret = guest_munmap((void*)(uintptr_t)proc.ireg[rv_ireg_a0], proc.ireg[rv_ireg_a1]);
+		proc.blocks.flush();
 		if (proc.log & proc_log_syscall) {
 			printf("munmap(0x%lx,%ld) = %d\n",
 				(long)proc.ireg[rv_ireg_a0], (long)proc.ireg[rv_ireg_a1],
@@ -1063,6 +1070,7 @@ namespace riscv {
 		uintptr_t ret = (uintptr_t)guest_mmap(
 			(void*)(uintptr_t)proc.ireg[rv_ireg_a0], proc.ireg[rv_ireg_a1],
 			prot, flags, proc.ireg[rv_ireg_a4], proc.ireg[rv_ireg_a5]);
+		if (flags & MAP_FIXED) proc.blocks.flush();
 		if (proc.log & proc_log_syscall) {
 			printf("mmap(0x%lx,%ld,%ld,%ld,%ld,%ld) = 0x%lx\n",
 				(long)proc.ireg[rv_ireg_a0], (long)proc.ireg[rv_ireg_a1],
@@ -29,6 +29,7 @@
 #include "cmdline.h"
 #include "color.h"
 #include "codec.h"
+#include "decode-batch.h"
 #include "strings.h"
 #include "disasm.h"
 #include "elf.h"
@@ -99,18 +100,20 @@ struct rv_histogram_elf
 	void histogram(map_t &hist, addr_t start, addr_t end)
 	{
 		decode dec;
-		addr_t pc_offset;
-		addr_t pc = start;
-		while (pc < end) {
-			uint64_t inst = inst_fetch(pc, pc_offset);
-			decode_inst_rv64(dec, inst);
+		decode_batch batch;
+		size_t count = decode_inst_batch_rv64(batch, (const uint8_t*)start, end - start);
+		for (size_t i = 0; i < count; i++) {
+			dec.op = batch.op[i];
+			dec.rd = batch.rd[i];
+			dec.rs1 = batch.rs1[i];
+			dec.rs2 = batch.rs2[i];
+			dec.rs3 = batch.rs3[i];
 			if (inst_histogram) {
 				histogram_add(hist, rv_inst_name_sym[dec.op]);
 			}
 			if (regs_histogram) {
 				histogram_add_regs(hist, dec);
 			}
-			pc += pc_offset;
 		}
 	}
 
@@ -26,6 +26,7 @@
 #include <deque>
 #include <map>
 #include <thread>
+#include <mutex>
 #include <atomic>
 #include <type_traits>
 
@@ -68,13 +69,16 @@
 #include "amo.h"
 #include "processor-logging.h"
 #include "processor-base.h"
+#include "block-cache.h"
 #include "processor-impl.h"
 #include "interp.h"
+#include "superinst.h"
 #include "processor-model.h"
 #include "mmu-proxy.h"
 #include "mmap-core.h"
 #include "unknown-abi.h"
 #include "processor-histogram.h"
+#include "clone.h"
 #include "processor-proxy.h"
 #include "debug-cli.h"
 #include "processor-runloop.h"
@@ -128,6 +132,9 @@ struct rv_emulator
 	bool help_or_error = false;
 	bool symbolicate = false;
 	uint64_t initial_seed = 0;
+	uint64_t num_clones = 0;
+	uint64_t clone_instret = 0;
+	std::string clone_output;
 	std::string elf_filename;
 	std::string stats_dirname;
 
@@ -179,6 +186,15 @@ struct rv_emulator
 			{ "-x", "--no-pseudo", cmdline_arg_type_none,
 				"Disable Pseudoinstruction decoding",
 				[&](std::string s) { return (proc_logs |= proc_log_no_pseudo); } },
+			{ "-C", "--clones", cmdline_arg_type_string,
+				"Fork clones when instret reaches --clone-instret",
+				[&](std::string s) { num_clones = strtoull(s.c_str(), nullptr, 10); return true; } },
+			{ "-K", "--clone-instret", cmdline_arg_type_string,
+				"Instruction count at which to fork the clones",
+				[&](std::string s) { clone_instret = strtoull(s.c_str(), nullptr, 10); return true; } },
+			{ "-W", "--clone-output", cmdline_arg_type_string,
+				"Write the output of clone <n> to <string>.<n>",
+				[&](std::string s) { clone_output = s; return true; } },
 			{ "-s", "--seed", cmdline_arg_type_string,
 				"Random seed",
 				[&](std::string s) { initial_seed = strtoull(s.c_str(), nullptr, 10); return true; } },
@@ -194,6 +210,9 @@ struct rv_emulator
 		} else if (result.first.size() < 1 && !help_or_error) {
 			printf("%s: wrong number of arguments\n", argv[0]);
 			help_or_error = true;
+		} else if ((num_clones > 0) != (clone_instret > 0) || (clone_output.size() > 0 && num_clones == 0)) {
+			printf("%s: --clones and --clone-instret must be used together\n", argv[0]);
+			help_or_error = true;
 		}
 
 		if (help_or_error) {
@@ -230,6 +249,11 @@ struct rv_emulator
 		proc.stats_dirname = stats_dirname;
 		if (symbolicate) proc.symlookup = [&](addr_t va) { return proc.symlookup_elf(va); };
 
+		/* set clone options */
+		proc.num_clones = num_clones;
+		proc.clone_instret = clone_instret;
+		proc.clone_output = clone_output;
+
 		/* randomise integer register state with 512 bits of entropy */
 		proc.seed_registers(cpu, initial_seed, 512);
 
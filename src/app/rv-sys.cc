@@ -38,9 +38,17 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <termios.h>
+#include <dirent.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <sys/times.h>
+#include <sys/statvfs.h>
+#include <sys/utsname.h>
+#include <sys/resource.h>
 
 #include "host-endian.h"
 #include "types.h"
@@ -66,13 +74,17 @@
 #include "amo.h"
 #include "processor-logging.h"
 #include "processor-base.h"
+#include "block-cache.h"
 #include "processor-impl.h"
 #include "mmu-memory.h"
 #include "tlb-soft.h"
 #include "mmu-soft.h"
 #include "interp.h"
+#include "superinst.h"
 #include "processor-model.h"
 #include "queue.h"
+#include "event-queue.h"
+#include "unknown-abi.h"
 #include "console.h"
 #include "device-rom-boot.h"
 #include "device-rom-sbi.h"
@@ -86,10 +98,17 @@
 #include "device-gpio.h"
 #include "device-rand.h"
 #include "device-htif.h"
+#include "device-virtio.h"
+#include "device-virtio-blk.h"
+#include "device-virtio-console.h"
+#include "device-virtio-9p.h"
+#include "snapshot.h"
+#include "clone.h"
 #include "processor-histogram.h"
 #include "processor-priv-1.9.h"
 #include "debug-cli.h"
 #include "processor-runloop.h"
+#include "node.h"
 
 #if defined (ENABLE_GPERFTOOL)
 #include "gperftools/profiler.h"
@@ -144,11 +163,23 @@ struct rv_emulator
 	host_cpu &cpu;
 	int proc_logs = 0;
 	bool help_or_error = false;
+	bool fastmem = false;
+	s64 num_harts = 1;
 	addr_t map_physical = 0;
 	s64 ram_boot = 0;
 	uint64_t initial_seed = 0;
 	std::string boot_filename;
 	std::string stats_dirname;
+	std::string disk_image;
+	bool virtio_console = false;
+	std::string share_dir;
+	std::string save_snapshot;
+	s64 snapshot_instret = 0;
+	std::string restore_snapshot;
+	snapshot_file snapshot;
+	s64 num_clones = 0;
+	s64 clone_instret = 0;
+	std::string clone_output;
 
 	std::vector<std::string> host_cmdline;
 	std::vector<std::string> host_env;
@@ -268,6 +299,39 @@ struct rv_emulator
 			{ "-b", "--binary", cmdline_arg_type_string,
 				"Boot Binary ( 32, 64 )",
 				[&](std::string s) { return parse_integral(s, ram_boot); } },
+			{ "-F", "--fastmem", cmdline_arg_type_none,
+				"Map guest physical memory into a host address window",
+				[&](std::string s) { return (fastmem = true); } },
+			{ "-N", "--harts", cmdline_arg_type_string,
+				"Number of harts (each runs on a host thread)",
+				[&](std::string s) { return parse_integral(s, num_harts); } },
+			{ "-k", "--disk", cmdline_arg_type_string,
+				"Attach a virtio block device backed by a disk image",
+				[&](std::string s) { disk_image = s; return true; } },
+			{ "-V", "--virtio-console", cmdline_arg_type_none,
+				"Attach a virtio console (the UART remains the boot console)",
+				[&](std::string s) { return (virtio_console = true); } },
+			{ "-H", "--share", cmdline_arg_type_string,
+				"Export a host directory with a virtio 9P device (mount tag host)",
+				[&](std::string s) { share_dir = s; return true; } },
+			{ "-w", "--save-snapshot", cmdline_arg_type_string,
+				"Save a machine snapshot when instret reaches --snapshot-instret",
+				[&](std::string s) { save_snapshot = s; return true; } },
+			{ "-n", "--snapshot-instret", cmdline_arg_type_string,
+				"Instruction count at which to save the snapshot",
+				[&](std::string s) { return parse_integral(s, snapshot_instret); } },
+			{ "-L", "--restore-snapshot", cmdline_arg_type_string,
+				"Restore a machine snapshot (guest memory is mapped copy-on-write)",
+				[&](std::string s) { restore_snapshot = s; return true; } },
+			{ "-C", "--clones", cmdline_arg_type_string,
+				"Fork clones at the clone checkpoint (HTIF clone request or --clone-instret)",
+				[&](std::string s) { return parse_integral(s, num_clones); } },
+			{ "-K", "--clone-instret", cmdline_arg_type_string,
+				"Instruction count at which to fork the clones",
+				[&](std::string s) { return parse_integral(s, clone_instret); } },
+			{ "-W", "--clone-output", cmdline_arg_type_string,
+				"Write the console output of clone <n> to <string>.<n>",
+				[&](std::string s) { clone_output = s; return true; } },
 			{ "-s", "--seed", cmdline_arg_type_string,
 				"Random seed",
 				[&](std::string s) { initial_seed = strtoull(s.c_str(), nullptr, 10); return true; } },
@@ -280,9 +344,15 @@ struct rv_emulator
 		auto result = cmdline_option::process_options(options, argc, argv);
 		if (!result.second) {
 			help_or_error = true;
-		} else if (result.first.size() < 1 && !help_or_error) {
+		} else if (result.first.size() < 1 && restore_snapshot.size() == 0 && !help_or_error) {
 			printf("%s: wrong number of arguments\n", argv[0]);
 			help_or_error = true;
+		} else if ((save_snapshot.size() > 0) != (snapshot_instret > 0)) {
+			printf("%s: --save-snapshot and --snapshot-instret must be used together\n", argv[0]);
+			help_or_error = true;
+		} else if (num_clones == 0 && (clone_instret > 0 || clone_output.size() > 0)) {
+			printf("%s: --clone-instret and --clone-output require --clones\n", argv[0]);
+			help_or_error = true;
 		}
 
 		if (help_or_error) {
@@ -292,7 +362,9 @@ struct rv_emulator
 		}
 
 		/* get command line options */
-		boot_filename = result.first[0];
+		if (result.first.size() > 0) {
+			boot_filename = result.first[0];
+		}
 		for (size_t i = 0; i < result.first.size(); i++) {
 			host_cmdline.push_back(result.first[i]);
 		}
@@ -305,7 +377,7 @@ struct rv_emulator
 		}
 
 		/* load ELF */
-		if (ram_boot == 0) {
+		if (ram_boot == 0 && restore_snapshot.size() == 0) {
 			elf.load(boot_filename, elf_load_headers);
 		}
 	}
@@ -317,19 +389,30 @@ struct rv_emulator
 		/* setup floating point exception mask */
 		fenv_init();
 
-		/* instantiate processor, set log options and program counter to entry address */
-		P proc;
-		proc.log = proc_logs;
-		proc.mmu.mem->log = (proc.log & proc_log_memory);
-		proc.stats_dirname = stats_dirname;
+		/* instantiate harts sharing the memory map of the boot hart */
+		if (num_harts < 1 || num_harts > mipi_mmio_device<P>::num_harts) {
+			panic("--harts must be between 1 and %d", int(mipi_mmio_device<P>::num_harts));
+		}
+		node<P> harts(num_harts);
+		P &proc = harts.boot_hart();
+		proc.mmu.mem->log = (proc_logs & proc_log_memory);
+
+		for (auto &hart : harts.harts) {
+			/* set log options */
+			hart->log = proc_logs;
+			hart->stats_dirname = stats_dirname;
 
-		/* randomise integer register state with 512 bits of entropy */
-		proc.seed_registers(cpu, initial_seed, 512);
+			/* randomise integer register state with 512 bits of entropy */
+			hart->seed_registers(cpu, initial_seed, 512);
+		}
 
 		/* ROM/FLASH exposed in the Config MMIO region */
 		typename P::ux rom_base = 0, rom_size = 0, rom_entry = 0;
 
-		if (ram_boot == 32 || ram_boot == 64) {
+		if (restore_snapshot.size() > 0) {
+			/* Map RAM and ELF segments copy-on-write from the snapshot */
+			snapshot.map_segments(*proc.mmu.mem);
+		} else if (ram_boot == 32 || ram_boot == 64) {
 			struct stat statbuf;
 			FILE *file = nullptr;
 			memory_segment<typename P::ux> *segment = nullptr;
@@ -380,16 +463,34 @@ struct rv_emulator
 			proc.mmu.mem->add_ram(default_ram_base, default_ram_size);
 		}
 
-		/* Initialize interpreter */
+		/* Move RAM and ELF segments into the fastmem window */
+		if (fastmem) {
+			proc.mmu.mem->enable_fastmem();
+		}
+
+		/* Initialize interpreter (secondary harts initialize on their own threads) */
+		proc.disk_image = disk_image;
+		proc.virtio_console = virtio_console;
+		proc.share_dir = share_dir;
 		proc.init();
 		proc.reset(); /* Reset code calls mapped ROM image */
-		proc.device_config->num_harts = 1;
+		proc.device_config->num_harts = num_harts;
 		proc.device_config->time_base = 1000000000;
 		proc.device_config->rom_base = rom_base;
 		proc.device_config->rom_size = rom_size;
 		proc.device_config->rom_entry = rom_entry;
 		proc.device_config->ram_base = default_ram_base;
 		proc.device_config->ram_size = default_ram_size;
+		proc.snapshot_filename = save_snapshot;
+		proc.snapshot_instret = snapshot_instret;
+		proc.num_clones = num_clones;
+		proc.clone_instret = clone_instret;
+		proc.clone_output = clone_output;
+
+		/* Replace the reset state with the processor and device state of the snapshot */
+		if (restore_snapshot.size() > 0) {
+			proc.restore_snapshot(snapshot);
+		}
 
 #if defined (ENABLE_GPERFTOOL)
 		ProfilerStart("test-emulate.out");
@@ -400,7 +501,7 @@ struct rv_emulator
 		 *
 		 * when --debug flag is present we start in the debugger
 		 */
-		proc.run(proc.log & proc_log_ebreak_cli
+		harts.run(proc.log & proc_log_ebreak_cli
 			? exit_cause_cli : exit_cause_continue);
 
 #if defined (ENABLE_GPERFTOOL)
@@ -419,21 +520,25 @@ struct rv_emulator
 		#endif
 
 		/* execute */
-		if (ram_boot == 0) {
+		int xlen = ram_boot;
+		if (restore_snapshot.size() > 0) {
+			snapshot.open_file(restore_snapshot);
+			xlen = snapshot.header.xlen;
+		} else if (ram_boot == 0) {
 			switch (elf.ei_class) {
-				case ELFCLASS32:
-					start_priv<priv_emulator_rv32imafdc>(); break;
-				case ELFCLASS64:
-					start_priv<priv_emulator_rv64imafdc>(); break;
+				case ELFCLASS32: xlen = 32; break;
+				case ELFCLASS64: xlen = 64; break;
 			}
 		}
-		else if (ram_boot == 32) {
-			start_priv<priv_emulator_rv32imafdc>();
-		}
-		else if (ram_boot == 64) {
-			start_priv<priv_emulator_rv64imafdc>();
-		} else {
-			panic("--boot option must be 32 or 64");
+		switch (xlen) {
+			case 32:
+				start_priv<priv_emulator_rv32imafdc>();
+				break;
+			case 64:
+				start_priv<priv_emulator_rv64imafdc>();
+				break;
+			default:
+				panic("--boot option must be 32 or 64");
 		}
 	}
 };
@@ -0,0 +1,170 @@
+//
+//  test-clone.cc
+//
+
+#undef NDEBUG
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+#include <cinttypes>
+#include <csignal>
+#include <csetjmp>
+#include <cerrno>
+#include <cmath>
+#include <cctype>
+#include <cwchar>
+#include <climits>
+#include <cfloat>
+#include <cfenv>
+#include <limits>
+#include <array>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <deque>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <type_traits>
+
+#include "dense_hash_map"
+
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <termios.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/times.h>
+#include <sys/ioctl.h>
+#include <sys/utsname.h>
+#include <sys/resource.h>
+
+#include "host-endian.h"
+#include "types.h"
+#include "fmt.h"
+#include "bits.h"
+#include "sha512.h"
+#include "format.h"
+#include "meta.h"
+#include "util.h"
+#include "host.h"
+#include "cmdline.h"
+#include "codec.h"
+#include "elf.h"
+#include "elf-file.h"
+#include "elf-format.h"
+#include "strings.h"
+#include "disasm.h"
+#include "alu.h"
+#include "fpu.h"
+#include "pma.h"
+#include "amo.h"
+#include "processor-logging.h"
+#include "processor-base.h"
+#include "block-cache.h"
+#include "processor-impl.h"
+#include "interp.h"
+#include "superinst.h"
+#include "processor-model.h"
+#include "mmu-proxy.h"
+#include "mmap-core.h"
+#include "unknown-abi.h"
+#include "processor-histogram.h"
+#include "clone.h"
+#include "processor-proxy.h"
+#include "debug-cli.h"
+#include "processor-runloop.h"
+#include "assembler.h"
+#include "jit.h"
+
+using namespace riscv;
+
+using proxy_emulator_rv64imafdc = processor_runloop<
+	processor_proxy<processor_rv64imafdc_model<
+	decode, processor_rv64imafd, mmu_proxy_rv64>>>;
+
+static std::string read_file(std::string filename)
+{
+	char buf[64];
+	int fd = open(filename.c_str(), O_RDONLY);
+	assert(fd >= 0);
+	ssize_t len = read(fd, buf, sizeof(buf));
+	close(fd);
+	assert(len >= 0);
+	return std::string(buf, len);
+}
+
+/* write(1, 0x10000000 + offset, 1) */
+static void asm_write_char(assembler &as, int offset)
+{
+	asm_addi(as, rv_ireg_a0, rv_ireg_zero, 1);
+	asm_lui(as, rv_ireg_a1, 0x10000000);
+	asm_addi(as, rv_ireg_a1, rv_ireg_a1, offset);
+	asm_addi(as, rv_ireg_a2, rv_ireg_zero, 1);
+	asm_addi(as, rv_ireg_a7, rv_ireg_zero, 64);
+	asm_ecall(as);
+}
+
+int main(int argc, char *argv[])
+{
+	char prefix[] = "/tmp/test-clone-XXXXXX";
+	assert(mkdtemp(prefix));
+	std::string output = std::string(prefix) + "/out";
+
+	/* write "A", count down from 100, write "B" and exit with status 3 */
+	assembler as;
+	asm_write_char(as, 0);
+	asm_addi(as, rv_ireg_s0, rv_ireg_zero, 100);
+	asm_addi(as, rv_ireg_s0, rv_ireg_s0, -1);
+	asm_bne(as, rv_ireg_s0, rv_ireg_zero, -4);
+	asm_write_char(as, 1);
+	asm_addi(as, rv_ireg_a0, rv_ireg_zero, 3);
+	asm_addi(as, rv_ireg_a7, rv_ireg_zero, 93);
+	asm_ecall(as);
+	as.link();
+
+	// the parent writes "A" and forks 2 clones in the loop that each write "B"
+	pid_t pid = fork();
+	assert(pid >= 0);
+	if (pid == 0) {
+		int fd = open((output + ".0").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		assert(fd >= 0 && dup2(fd, STDOUT_FILENO) >= 0);
+		close(fd);
+
+		proxy_emulator_rv64imafdc proc;
+		proc.mmu.mem->brk = proc.mmu.mem->heap_begin = proc.mmu.mem->heap_end = 0x10000000;
+		proc.ireg[rv_ireg_a0] = 0x20000000;
+		abi_sys_brk(proc);
+		memcpy((void*)0x10000000, "AB", 2);
+		proc.num_clones = 2;
+		proc.clone_instret = 100;
+		proc.clone_output = output;
+		proc.pc = (addr_t)as.get_section(".text")->buf.data();
+		proc.init();
+		proc.run(exit_cause_continue);
+		_exit(1);
+	}
+	int status = 0;
+	assert(waitpid(pid, &status, 0) == pid);
+	assert(WIFEXITED(status) && WEXITSTATUS(status) == 3);
+	assert(read_file(output + ".0") == "A");
+	assert(read_file(output + ".1") == "B");
+	assert(read_file(output + ".2") == "B");
+	printf("PASS clones forked at the instret checkpoint\n");
+
+	for (int n = 0; n <= 2; n++) {
+		unlink((output + "." + std::to_string(n)).c_str());
+	}
+	rmdir(prefix);
+	return 0;
+}
@@ -0,0 +1,119 @@
+//
+//  test-decode.cc
+//
+
+#undef NDEBUG
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cassert>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <vector>
+
+#include "host-endian.h"
+#include "types.h"
+#include "bits.h"
+#include "meta.h"
+#include "codec.h"
+#include "decode-batch.h"
+
+using namespace riscv;
+
+typedef std::chrono::high_resolution_clock clock_type;
+
+/* random text section with a mix of legal compressed and 32-bit instructions */
+
+static std::vector<uint8_t> random_text(size_t len)
+{
+	std::vector<uint8_t> text;
+	std::mt19937 rng(0x5eed);
+	decode dec;
+	text.reserve(len);
+	while (text.size() + 4 <= len) {
+		u32 inst = rng();
+		if (inst & (1 << 31)) {
+			inst &= 0xffff;
+			if ((inst & 0b11) == 0b11) inst &= ~0b1;
+		} else {
+			inst |= 0b11;
+			if ((inst & 0b11100) == 0b11100) inst &= ~0b10000;
+		}
+		decode_inst<decode,false,true,false>(dec, inst);
+		if (dec.op == rv_op_illegal) continue;
+		for (size_t i = 0; i < inst_length(inst); i++) {
+			text.push_back((inst >> (i << 3)) & 0xff);
+		}
+	}
+	return text;
+}
+
+static size_t decode_scalar(std::vector<decode> &decs, const uint8_t *buf, size_t len)
+{
+	addr_t pc = addr_t(buf), end = addr_t(buf + len);
+	addr_t pc_offset;
+	decs.clear();
+	while (pc < end) {
+		decode dec;
+		inst_t inst = inst_fetch(pc, pc_offset);
+		decode_inst<decode,false,true,false>(dec, inst);
+		decompress_inst_rv64(dec);
+		decs.push_back(dec);
+		pc += pc_offset;
+	}
+	return decs.size();
+}
+
+static double mips(size_t count, clock_type::time_point t1, clock_type::time_point t2)
+{
+	auto us = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
+	return us ? double(count) / double(us) : 0;
+}
+
+int main()
+{
+	const size_t len = 16 << 20;
+	const int iters = 4;
+	std::vector<uint8_t> text = random_text(len);
+	std::vector<decode> decs;
+	decode_batch batch;
+
+	/* check the batch decoder against the scalar decoder */
+	size_t count = decode_scalar(decs, text.data(), text.size());
+	assert(decode_inst_batch_rv64(batch, text.data(), text.size()) == count);
+	size_t offset = 0;
+	for (size_t i = 0; i < count; i++) {
+		assert(batch.offset[i] == offset);
+		assert(batch.op[i] == decs[i].op);
+		assert(batch.rd[i] == decs[i].rd);
+		assert(batch.rs1[i] == decs[i].rs1);
+		assert(batch.rs2[i] == decs[i].rs2);
+		assert(batch.imm[i] == decs[i].imm);
+		offset += batch.len[i];
+	}
+	printf("PASS batch decode[insts=%zu]\n", count);
+
+	/* truncated and reserved length encodings */
+	const uint8_t trunc[] = { 0x13, 0x05, 0x15, 0x00, 0x01, 0x00, 0x93, 0x05 };
+	assert(decode_inst_batch_rv64(batch, trunc, sizeof(trunc)) == 2);
+	assert(batch.op[0] == rv_op_addi && batch.len[0] == 4);
+	assert(batch.op[1] == rv_op_addi && batch.len[1] == 2);
+	const uint8_t reserved[] = { 0x7f, 0x00, 0x01, 0x00 };
+	assert(decode_inst_batch_rv64(batch, reserved, sizeof(reserved)) == 2);
+	assert(batch.op[0] == rv_op_illegal && batch.len[0] == 2);
+	printf("PASS batch decode truncated and reserved\n");
+
+	/* throughput */
+	auto t1 = clock_type::now();
+	for (int i = 0; i < iters; i++) decode_scalar(decs, text.data(), text.size());
+	auto t2 = clock_type::now();
+	for (int i = 0; i < iters; i++) decode_inst_batch_rv64(batch, text.data(), text.size());
+	auto t3 = clock_type::now();
+
+	printf("scalar decode %8.1f MInst/sec\n", mips(count * iters, t1, t2));
+	printf("batch  decode %8.1f MInst/sec\n", mips(count * iters, t2, t3));
+
+	return 0;
+}
@@ -35,6 +35,20 @@ template <typename T> void test_imm(bool r, T imm) {
 	);
 }
 
+template <bool rv32, bool rv64> void test_rvc_expand(const char *name) {
+	size_t fail = 0;
+	for (inst_t inst = 0; inst < 65536; inst++) {
+		if ((inst & 0b11) == 0b11) continue;
+		decode dec, exp;
+		decode_inst<decode,rv32,rv64,false>(dec, inst);
+		if (rv32) decompress_inst_rv32(dec); else decompress_inst_rv64(dec);
+		decode_inst_expand<decode,rv32,rv64,false>(exp, inst);
+		if (dec.op != exp.op || dec.codec != exp.codec || dec.rd != exp.rd ||
+			dec.rs1 != exp.rs1 || dec.rs2 != exp.rs2 || dec.imm != exp.imm) fail++;
+	}
+	printf("%s %s rvc expansion table[mismatches=%zu]\n", fail == 0 ? "PASS" : "FAIL", name, fail);
+}
+
 int main()
 {
 	test_imm<simm20>(0, -524289);
@@ -101,4 +115,7 @@ int main()
 	assert(emit_bne(rv_ireg_a4, rv_ireg_a5, 4096) == 0); /* illegal instruciton */
 
 	assert(emit_lbu(rv_ireg_a4, rv_ireg_a5, 20) == 0x0147c703);
+
+	test_rvc_expand<true,false>("rv32");
+	test_rvc_expand<false,true>("rv64");
 }
@@ -2,6 +2,8 @@
 //  test-jit.cc
 //
 
+#undef NDEBUG
+
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
@@ -27,6 +29,9 @@
 #include <deque>
 #include <map>
 #include <thread>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
 #include <atomic>
 #include <type_traits>
 
@@ -37,12 +42,14 @@
 #include <unistd.h>
 #include <libgen.h>
 #include <termios.h>
+#include <dirent.h>
 #include <sys/uio.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <sys/time.h>
 #include <sys/times.h>
+#include <sys/statvfs.h>
 #include <sys/ioctl.h>
 #include <sys/utsname.h>
 #include <sys/resource.h>
@@ -66,18 +73,46 @@
 #include "disasm.h"
 #include "alu.h"
 #include "fpu.h"
+#include "pte.h"
 #include "pma.h"
 #include "amo.h"
 #include "processor-logging.h"
 #include "processor-base.h"
+#include "block-cache.h"
 #include "processor-impl.h"
+#include "mmu-memory.h"
+#include "tlb-soft.h"
+#include "mmu-soft.h"
 #include "interp.h"
+#include "superinst.h"
 #include "processor-model.h"
 #include "mmu-proxy.h"
 #include "mmap-core.h"
+#include "queue.h"
+#include "event-queue.h"
 #include "unknown-abi.h"
+#include "console.h"
+#include "device-rom-boot.h"
+#include "device-rom-sbi.h"
+#include "device-rom-string.h"
+#include "device-config.h"
+#include "device-rtc.h"
+#include "device-timer.h"
+#include "device-plic.h"
+#include "device-uart.h"
+#include "device-mipi.h"
+#include "device-gpio.h"
+#include "device-rand.h"
+#include "device-htif.h"
+#include "device-virtio.h"
+#include "device-virtio-blk.h"
+#include "device-virtio-console.h"
+#include "device-virtio-9p.h"
+#include "snapshot.h"
 #include "processor-histogram.h"
+#include "clone.h"
 #include "processor-proxy.h"
+#include "processor-priv-1.9.h"
 #include "debug-cli.h"
 
 #include "asmjit.h"
@@ -109,6 +144,14 @@ using proxy_jit_rv64imafdc = jit_runloop<
 	jit_tracer<proxy_model_rv64imafdc,jit_isa_rv64>,
 	jit_emitter_rv64<proxy_model_rv64imafdc>>;
 
+using priv_model_rv64imafdc = processor_rv64imafdc_model<
+	jit_decode, processor_priv_rv64imafd, mmu_soft_rv64>;
+
+using priv_jit_rv64imafdc = jit_runloop<
+	processor_privileged<priv_model_rv64imafdc>,
+	jit_tracer<priv_model_rv64imafdc,jit_isa_rv64>,
+	jit_emitter_rv64<priv_model_rv64imafdc>>;
+
 template <typename P>
 struct rv_test_jit
 {
@@ -154,7 +197,7 @@ struct rv_test_jit
 		memset(&proc.ireg[0], 0, regfile_size);
 
 		/* run compiled trace */
-		proc.jit_exec(proc, pc);
+		proc.jit_exec(proc, pc, proc.instret + step);
 
 		/* print result */
 		printf("\n--[ result ]---------------\n");
@@ -1920,6 +1963,148 @@ struct rv_test_jit
 	}
 };
 
+/* device with one register, accessed by translated code via the load store stubs */
+
+template <typename UX>
+struct test_mmio_device : memory_segment<UX>
+{
+	u64 reg;
+
+	test_mmio_device(UX mpa) :
+		memory_segment<UX>("TEST", mpa, /*uva*/0, /*size*/page_size,
+			pma_type_io | pma_prot_read | pma_prot_write), reg(0) {}
+
+	buserror_t load_64(UX va, u64 &val) { val = reg; return 0; }
+	buserror_t store_64(UX va, u64 val) { reg = val; return 0; }
+};
+
+/*
+ * translated loads and stores with the soft MMU in S mode with sv39.
+ * gigapages map RAM read write at 0x80000000, read only at 0xc0000000
+ * and a device at 0x40000000. one trace is recorded and then entered
+ * with the base register pointing at each kind of page
+ */
+template <typename P>
+struct rv_test_jit_mmu
+{
+	enum : addr_t {
+		ram_mpa = 0x80000000,
+		ram_size = 0x200000,
+		root_mpa = 0x80100000,
+		data_va = 0x80010000,
+		ro_va = 0xc0010000,
+		dev_mpa = 0x40000000
+	};
+
+	P proc;
+	std::shared_ptr<test_mmio_device<typename P::ux>> dev;
+	u64 *data;
+	addr_t pc;
+
+	rv_test_jit_mmu() : dev(std::make_shared<test_mmio_device<typename P::ux>>(dev_mpa))
+	{
+		proc.mmu.mem->add_ram(ram_mpa, ram_size);
+		proc.mmu.mem->add_mmio(dev);
+		u8 *ram = (u8*)proc.mmu.mem->segments.front()->uva;
+		data = (u64*)(ram + (data_va - ram_mpa));
+
+		/* sv39 root table with one gigapage leaf per mapping */
+		u64 *root = (u64*)(ram + (root_mpa - ram_mpa));
+		u64 rwx = pte_flag_V | pte_flag_R | pte_flag_W | pte_flag_X | pte_flag_A | pte_flag_D;
+		root[1] = ((dev_mpa >> page_shift) << 10) | pte_flag_V | pte_flag_R | pte_flag_W | pte_flag_A | pte_flag_D;
+		root[2] = ((ram_mpa >> page_shift) << 10) | rwx;
+		root[3] = ((ram_mpa >> page_shift) << 10) | pte_flag_V | pte_flag_R | pte_flag_A;
+
+		/* ld a2, 0(s0); sd a1, 8(s0) */
+		assembler as;
+		asm_ld(as, rv_ireg_a2, rv_ireg_s0, 0);
+		asm_sd(as, rv_ireg_s0, rv_ireg_a1, 8);
+		asm_ebreak(as);
+		as.link();
+		auto &text = as.get_section(".text")->buf;
+		memcpy(ram, text.data(), text.size());
+		pc = ram_mpa;
+
+		proc.mode = rv_mode_S;
+		proc.mstatus.r.vm = rv_vm_sv39;
+		proc.sptbr = root_mpa >> page_shift;
+		jit_singleton::current = &proc;
+	}
+
+	size_t slot(addr_t va) { return size_t(va >> page_shift) & (P::jit_tlb_size - 1); }
+
+	size_t tlb_lookups() { return proc.mmu.l1_dtlb.stats.hits + proc.mmu.l1_dtlb.stats.misses; }
+
+	/* enter the trace and return the cause of a fault or zero */
+	int exec(addr_t base, u64 val)
+	{
+		proc.ireg[rv_ireg_s0] = base;
+		proc.ireg[rv_ireg_a1] = val;
+		proc.ireg[rv_ireg_a2] = 0;
+		proc.pc = pc;
+		int cause = setjmp(proc.env);
+		if (cause) return cause - P::internal_cause_offset;
+		assert(proc.jit_exec(proc, pc, proc.instret + 2));
+		return 0;
+	}
+
+	void test_mmu()
+	{
+		/* the trace is recorded by interpreting it once */
+		data[0] = 0x1111;
+		proc.ireg[rv_ireg_s0] = data_va;
+		proc.ireg[rv_ireg_a1] = 0x2222;
+		proc.pc = pc;
+		proc.jit_trace();
+		assert(data[1] == 0x2222);
+
+		/* miss: both accesses take the stubs, which fill the JIT TLB */
+		assert(exec(data_va, 0x3333) == 0);
+		assert(proc.ireg[rv_ireg_a2].r.xu.val == 0x1111 && data[1] == 0x3333);
+		assert(proc.jit_tlb_read[slot(data_va)] == data_va);
+		assert(proc.jit_tlb_write[slot(data_va)] == data_va);
+		printf("PASS jit mmu miss\n");
+
+		/* hit: accesses are inline and do not look up the soft TLB */
+		size_t lookups = tlb_lookups();
+		data[0] = 0x4444;
+		assert(exec(data_va, 0x5555) == 0);
+		assert(proc.ireg[rv_ireg_a2].r.xu.val == 0x4444 && data[1] == 0x5555);
+		assert(tlb_lookups() == lookups);
+		printf("PASS jit mmu hit\n");
+
+		/* MMIO: device pages are never entered into the JIT TLB */
+		dev->reg = 0x6666;
+		assert(exec(dev_mpa, 0x7777) == 0);
+		assert(proc.ireg[rv_ireg_a2].r.xu.val == 0x6666 && dev->reg == 0x7777);
+		assert(proc.jit_tlb_read[slot(dev_mpa)] != dev_mpa);
+		assert(proc.jit_tlb_write[slot(dev_mpa)] != dev_mpa);
+		printf("PASS jit mmu device\n");
+
+		/* permission fault: the load from the read only alias succeeds and the store faults */
+		assert(exec(ro_va, 0x8888) == rv_cause_fault_store);
+		assert(proc.badaddr == ro_va + 8 && data[1] == 0x5555);
+		assert(proc.ireg[rv_ireg_a2].r.xu.val == 0x4444);
+		assert(proc.jit_tlb_write[slot(ro_va)] != ro_va);
+		printf("PASS jit mmu permission fault\n");
+
+		/* misaligned: the tag test fails on the low address bits */
+		assert(exec(data_va + 4, 0x9999) == rv_cause_misaligned_load);
+		assert(proc.badaddr == data_va + 4 && data[1] == 0x5555);
+		printf("PASS jit mmu misaligned\n");
+
+		/* reservation: the store takes the stub and breaks it (RAM is identity mapped) */
+		assert(exec(data_va, 0xbbbb) == 0);
+		reservation_set &resv = proc.mmu.mem->reservations;
+		resv.acquire(data_va + 8, 1);
+		lookups = tlb_lookups();
+		assert(exec(data_va, 0xaaaa) == 0);
+		assert(data[1] == 0xaaaa && tlb_lookups() != lookups);
+		assert(!resv.any() && !resv.release(data_va + 8, 1));
+		printf("PASS jit mmu reservation\n");
+	}
+};
+
 template <typename T>
 void test(T &test)
 {
@@ -2047,4 +2232,7 @@ int main(int argc, char *argv[])
 		proc.memory_registers = true;
 	}
 	test(proc);
+
+	rv_test_jit_mmu<priv_jit_rv64imafdc> mmu;
+	mmu.test_mmu();
 }
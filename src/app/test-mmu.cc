@@ -9,16 +9,24 @@
 #include <cstdlib>
 #include <cinttypes>
 #include <cstdarg>
+#include <csignal>
 #include <csetjmp>
 #include <cerrno>
 #include <cassert>
 #include <string>
+#include <algorithm>
 #include <memory>
 #include <vector>
 #include <limits>
 #include <map>
+#include <chrono>
+#include <atomic>
+#include <thread>
 
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "host-endian.h"
 #include "types.h"
@@ -30,16 +38,59 @@
 #include "host.h"
 #include "codec.h"
 #include "processor-logging.h"
-#include "processor-base.h"
 #include "pte.h"
 #include "pma.h"
+#include "processor-base.h"
 #include "amo.h"
 #include "mmu-memory.h"
 #include "tlb-soft.h"
 #include "mmu-soft.h"
+#include "event-queue.h"
+#include "snapshot.h"
 
 using namespace riscv;
 
+typedef std::chrono::high_resolution_clock clock_type;
+
+/* device with one register, used to measure MMIO dispatch */
+
+template <typename UX>
+struct test_mmio_device : memory_segment<UX>
+{
+	u64 reg;
+
+	test_mmio_device(UX mpa) :
+		memory_segment<UX>("TEST", mpa, /*uva*/0, /*size*/page_size,
+			pma_type_io | pma_prot_read | pma_prot_write), reg(0) {}
+
+	buserror_t load_64(UX va, u64 &val) { val = reg; return 0; }
+	buserror_t store_64(UX va, u64 val) { reg = val; return 0; }
+};
+
+/* measure 64-bit load and store throughput in million operations per second */
+
+template <typename BUS>
+static void bench_load_store(const char *name, BUS &bus, u64 mpa, size_t span)
+{
+	const size_t count = 1 << 24;
+	u64 sum = 0, val;
+	auto t1 = clock_type::now();
+	for (size_t i = 0; i < count; i++) {
+		bus.store(mpa + ((i << 3) & (span - 1)), u64(i));
+	}
+	auto t2 = clock_type::now();
+	for (size_t i = 0; i < count; i++) {
+		bus.load(mpa + ((i << 3) & (span - 1)), val);
+		sum += val;
+	}
+	auto t3 = clock_type::now();
+	auto store_us = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
+	auto load_us = std::chrono::duration_cast<std::chrono::microseconds>(t3 - t2).count();
+	printf("%-30s: load %8.1f Mops/sec  store %8.1f Mops/sec  (sum=%llu)\n", name,
+		load_us ? double(count) / load_us : 0.0, store_us ? double(count) / store_us : 0.0,
+		(unsigned long long)sum);
+}
+
 int main(int argc, char *argv[])
 {
 	assert(page_shift == 12);
@@ -57,10 +108,11 @@ int main(int argc, char *argv[])
 	assert(sizeof(sv48_pa) == 8);
 	assert(sizeof(sv48_pte) == 8);
 
-	typedef tagged_tlb_rv64<128> tlb_type;
 	typedef mmu_soft_rv64 mmu_type;
+	typedef mmu_type::tlb_type tlb_type;
 
 	printf("tlb_type::size                : %tu\n", tlb_type::size);
+	printf("tlb_type::num_ways            : %zu\n", size_t(tlb_type::num_ways));
 	printf("tlb_type::key_size            : %tu\n", tlb_type::key_size);
 	printf("tlb_type::mask                : 0x%08tx\n", tlb_type::mask);
 
@@ -87,6 +139,62 @@ int main(int argc, char *argv[])
 	// test that invalid_ppn is returned for (VA=0x10000, ASID=0)
 	assert(mmu.l1_dtlb.lookup(/* PDID */ 0, /* ASID */ 0, /* VA */ 0x10000) == nullptr);
 
+	// insert megapage entry for VA 0x200000 into the large page TLB (sv39 level 1, 2MiB)
+	mmu.l1_dtlb.insert_large(/* PDID */ 0, /* ASID */ 0, /* VA */ 0x234000, /* PTE level */ 1,
+		/* level bits */ 9, /* PTE.bits */ 0xff, /* PPN */ 0x400);
+
+	// test that the megapage entry covers VA 0x200000-0x3fffff
+	tlb_ent = mmu.l1_dtlb.lookup_large(/* PDID */ 0, /* ASID */ 0, /* VA */ 0x200000, /* level bits */ 9);
+	assert(tlb_ent != nullptr);
+	assert(tlb_ent->ppn == 0x400);
+	assert(tlb_ent->ptel == 1);
+	assert(mmu.l1_dtlb.lookup_large(0, 0, 0x3ff000, 9) == tlb_ent);
+	assert(mmu.l1_dtlb.lookup_large(0, 0, 0x400000, 9) == nullptr);
+	assert(mmu.l1_dtlb.lookup_large(0, 1, 0x200000, 9) == nullptr);
+
+	// test that reinserting the same megapage replaces the entry
+	assert(mmu.l1_dtlb.insert_large(0, 0, 0x3ff000, 1, 9, 0xff, 0x400) == tlb_ent);
+
+	// flush the L1 DTLB and test that the megapage entry is removed
+	mmu.l1_dtlb.flush(0);
+	assert(mmu.l1_dtlb.lookup_large(0, 0, 0x200000, 9) == nullptr);
+
+	// test that an ASID flush only removes entries for that ASID
+	mmu.l1_dtlb.insert(0, 1, 0x10000, 0, 0xff, 0x1);
+	mmu.l1_dtlb.insert(0, 2, 0x10000, 0, 0xff, 0x2);
+	mmu.l1_dtlb.flush(0, 1);
+	assert(mmu.l1_dtlb.lookup(0, 1, 0x10000) == nullptr);
+	assert(mmu.l1_dtlb.lookup(0, 2, 0x10000) != nullptr);
+	assert(mmu.l1_dtlb.lookup(0, 2, 0x10000)->ppn == 0x2);
+
+	// test that ASID 0 flushes all entries
+	mmu.l1_dtlb.flush(0, 0);
+	assert(mmu.l1_dtlb.lookup(0, 2, 0x10000) == nullptr);
+
+	// test that pages in the same set occupy different ways and the oldest is evicted
+	for (size_t i = 0; i <= tlb_type::num_ways; i++) {
+		mmu.l1_dtlb.insert(0, 0, (0x10 + (i << tlb_type::shift)) << page_shift, 0, 0xff, i);
+	}
+	assert(mmu.l1_dtlb.lookup(0, 0, 0x10 << page_shift) == nullptr);
+	for (size_t i = 1; i <= tlb_type::num_ways; i++) {
+		tlb_ent = mmu.l1_dtlb.lookup(0, 0, (0x10 + (i << tlb_type::shift)) << page_shift);
+		assert(tlb_ent != nullptr);
+		assert(tlb_ent->ppn == i);
+	}
+	assert(mmu.l1_dtlb.stats.evictions == 1);
+	mmu.l1_dtlb.flush(0);
+
+	// test that the page walk cache is keyed by sptbr, level and VA prefix
+	mmu.pwc.insert(/* sptbr */ 0x80001, /* VA */ 0x40201000, /* level */ 0, /* level bits */ 9, /* page table */ 0x5000);
+	mmu.pwc.insert(/* sptbr */ 0x80001, /* VA */ 0x40201000, /* level */ 1, /* level bits */ 9, /* page table */ 0x6000);
+	assert(mmu.pwc.lookup(0x80001, 0x403ff000, 0, 9) == 0x5000);
+	assert(mmu.pwc.lookup(0x80001, 0x7ffff000, 1, 9) == 0x6000);
+	assert(mmu.pwc.lookup(0x80001, 0x40400000, 0, 9) == 0);
+	assert(mmu.pwc.lookup(0x80002, 0x40201000, 0, 9) == 0);
+	mmu.pwc.flush();
+	assert(mmu.pwc.lookup(0x80001, 0x40201000, 0, 9) == 0);
+	assert(mmu.pwc.lookup(0x80001, 0x40201000, 1, 9) == 0);
+
 	// add RAM to the MMU emulation (exclude zero page)
 	mmu.mem->add_ram(0x1000, /*1GB*/0x40000000LL - 0x1000);
 
@@ -95,4 +203,192 @@ int main(int argc, char *argv[])
 	addr_t uva = mmu.mem->mpa_to_uva(segment, 0x1000);
 	assert(segment);
 	assert(uva == mmu.mem->segments.front()->uva + 0x0LL);
+
+	// test that RAM pages have a host page address and unmapped pages do not
+	assert(mmu.mem->mpa_to_host_page(0x1234) == uva + 0x0LL);
+	assert(mmu.mem->mpa_to_host_page(0x2345) == uva + 0x1000LL);
+	assert(mmu.mem->mpa_to_host_page(0x0) == 0);
+	assert(mmu.mem->mpa_to_host_page(0x40000000) == 0);
+
+	// test segments that share a page and addresses in unmapped pages
+	typedef memory_segment<typename tlb_type::UX> segment_type;
+	mmu.mem->add_segment(std::make_shared<segment_type>("A", 0x50000000, 0x10000, 0x800, pma_type_io));
+	mmu.mem->add_segment(std::make_shared<segment_type>("B", 0x50000800, 0x20000, 0x1800, pma_type_io));
+	assert(mmu.mem->mpa_to_uva(segment, 0x50000004) == 0x10004);
+	assert(mmu.mem->mpa_to_uva(segment, 0x50000804) == 0x20004);
+	assert(mmu.mem->mpa_to_uva(segment, 0x50001804) == 0x21004);
+	segment = nullptr;
+	assert(mmu.mem->mpa_to_uva(segment, 0x50002000) == 0 && !segment);
+	assert(mmu.mem->mpa_to_uva(segment, 0x7ffff000) == 0 && !segment);
+	assert(mmu.mem->mpa_to_uva(segment, 0xfffffffffffff000ULL) == 0 && !segment);
+
+	// test RAM and MMIO accesses through the inline path and the memory_bus interface
+	auto dev = std::make_shared<test_mmio_device<typename tlb_type::UX>>(0x60000000);
+	mmu.mem->add_segment(dev);
+	memory_bus<typename tlb_type::UX> &bus = *mmu.mem;
+	u64 val = 0;
+	assert(mmu.mem->store(0x2000, u64(0x1122334455667788ULL)) == 0);
+	assert(bus.load(0x2000, val) == 0 && val == 0x1122334455667788ULL);
+	assert(bus.store(0x2008, u32(0xaabbccdd)) == 0);
+	assert(mmu.mem->load(0x2008, val) == 0 && val == 0xaabbccdd);
+	assert(mmu.mem->store(0x60000000, u64(42)) == 0 && dev->reg == 42);
+	assert(bus.load(0x60000000, val) == 0 && val == 42);
+	assert(mmu.mem->load(0x7ffff000, val) != 0);
+
+	// test device accesses dispatched through the mmio map
+	auto mmio_dev = std::make_shared<test_mmio_device<typename tlb_type::UX>>(0x60001000);
+	mmu.mem->add_mmio(mmio_dev);
+	assert(mmu.mem->mmio_pages.lookup(0x60001ff8) != nullptr);
+	assert(mmu.mem->mmio_pages.lookup(0x60000000) == nullptr);
+	assert(mmu.mem->store(0x60001008, u64(43)) == 0 && mmio_dev->reg == 43);
+	assert(bus.load(0x60001000, val) == 0 && val == 43);
+	u32 val32 = 0;
+	assert(mmu.mem->load(0x60001000, val32) != 0);
+
+	// test that a store or another hart's LR breaks a reservation
+	reservation_set &resv = mmu.mem->reservations;
+	resv.acquire(0x3000, 0);
+	assert(resv.release(0x3000, 0));
+	assert(!resv.release(0x3000, 0));
+	resv.acquire(0x3000, 0);
+	resv.invalidate(0x3038);
+	assert(!resv.release(0x3000, 0));
+	resv.acquire(0x3000, 0);
+	resv.acquire(0x3008, 1);
+	assert(!resv.release(0x3000, 0));
+	assert(resv.release(0x3008, 1));
+	resv.acquire(0x3000, 0);
+	resv.invalidate(0x3040);
+	assert(resv.release(0x3000, 0));
+	assert(!resv.any());
+	resv.acquire(0x3080, 1);
+	resv.invalidate(0x3000, 0x80);
+	assert(resv.any());
+	resv.invalidate(0x3000, 0x81);
+	assert(!resv.any() && !resv.release(0x3080, 1));
+
+	// test host atomic AMOs (sign of min and max, wrap of add) and compare and swap
+	s32 w = -2;
+	assert(amo_host<s32>(amomin, &w, 1) == -2 && w == -2);
+	assert(amo_host<s32>(amominu, &w, 1) == -2 && w == 1);
+	assert(amo_host<s32>(amomax, &w, -5) == 1 && w == 1);
+	assert(amo_host<s32>(amomaxu, &w, -5) == 1 && w == -5);
+	assert(amo_host<s32>(amoadd, &w, std::numeric_limits<s32>::min()) == -5 && w == 0x7ffffffb);
+	assert(amo_host<s32>(amoswap, &w, 7) == 0x7ffffffb && w == 7);
+	assert(!cas_host<s32>(&w, 6, 9) && w == 7);
+	assert(cas_host<s32>(&w, 7, 9) && w == 9);
+
+	// test that concurrent AMOs on guest RAM are not lost
+	s64 *counter = (s64*)(mmu.mem->segments.front()->uva + 0x3000);
+	*counter = 0;
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; t++) {
+		threads.push_back(std::thread([counter] {
+			for (int i = 0; i < 100000; i++) amo_host<s64>(amoadd, counter, 1);
+		}));
+	}
+	for (auto &thread : threads) thread.join();
+	assert(*counter == 400000);
+
+	// test that events pop in deadline order and only when due
+	typedef event_queue<4> queue_type;
+	queue_type events;
+	assert(events.next_deadline() == queue_type::none);
+	assert(events.pop_due(~0ULL) == -1);
+	events.schedule(0, 300);
+	events.schedule(1, 100);
+	events.schedule(2, 200);
+	assert(events.next_deadline() == 100);
+	assert(events.pop_due(99) == -1);
+	assert(events.pop_due(250) == 1);
+	assert(events.pop_due(250) == 2);
+	assert(events.pop_due(250) == -1);
+	assert(events.deadline[1] == queue_type::none && events.deadline[2] == queue_type::none);
+	assert(events.pop_due(300) == 0);
+	assert(events.heap.empty());
+
+	// test that rescheduling and cancelling leave stale entries that are pruned
+	events.schedule(0, 100);
+	events.schedule(1, 200);
+	events.schedule(0, 400);
+	events.schedule(0, 400);
+	assert(events.heap.size() == 3);
+	assert(events.next_deadline() == 200);
+	assert(events.heap.size() == 2);
+	events.cancel(1);
+	assert(events.next_deadline() == 400);
+	assert(events.heap.size() == 1);
+	assert(events.pop_due(1000) == 0);
+	assert(events.next_deadline() == queue_type::none);
+
+	// test that the heap is compacted to the pending events at max_heap_size
+	events.schedule(3, 5000);
+	for (u64 i = 1; i < queue_type::max_heap_size; i++) {
+		events.schedule(2, 1000 + i);
+	}
+	assert(events.heap.size() == queue_type::max_heap_size);
+	events.schedule(2, 900);
+	assert(events.heap.size() == 3);
+	assert(events.pop_due(1000) == 2);
+	assert(events.pop_due(1000) == -1);
+	assert(events.pop_due(5000) == 3);
+	assert(events.next_deadline() == queue_type::none);
+	assert(events.heap.empty());
+
+	// test that a snapshot restores memory and state and leaves zero pages as holes
+	{
+		user_memory<u64> mem;
+		mem.add_ram(0x80000000, 0x100000);
+		mem.add_segment(std::make_shared<segment_type>("A", 0x50000000, 0x10000, 0x800, pma_type_io));
+		u8 *ram = (u8*)mem.segments.front()->uva;
+		for (size_t i = 0; i < page_size; i++) ram[i] = u8(i * 13 + 1);
+		memset(ram + 0x40000, 0xa5, 16);
+		ram[0xfffff] = 0x5a;
+		u64 pc = 0x80000040;
+		u32 regs[4] = { 1, 2, 3, 4 };
+		snapshot_writer out;
+		out.io(pc);
+		out.io(regs);
+		char snap[] = "/tmp/test-mmu-snapshot-XXXXXX";
+		int snap_fd = mkstemp(snap);
+		assert(snap_fd >= 0);
+		close(snap_fd);
+		assert(snapshot_file::save(snap, mem, 64, out.buf));
+		assert(access((std::string(snap) + ".tmp").c_str(), F_OK) < 0);
+
+		snapshot_file file;
+		file.open_file(snap);
+		assert(file.header.xlen == 64 && file.header.num_segments == 1);
+		assert(file.segments[0].mpa == 0x80000000 && file.segments[0].size == 0x100000);
+		assert(file.segments[0].offset % page_size == 0);
+		struct stat st;
+		assert(fstat(file.fd, &st) == 0);
+		assert(u64(st.st_size) == file.segments[0].offset + 0x100000);
+		assert(u64(st.st_blocks) * 512 <= 8 * page_size);
+		u64 pc_in = 0;
+		u32 regs_in[4] = { 0 };
+		snapshot_reader in(file.state.data(), file.state.size());
+		in.io(pc_in);
+		in.io(regs_in);
+		assert(pc_in == pc && memcmp(regs_in, regs, sizeof(regs)) == 0 && in.ptr == in.end);
+
+		user_memory<u64> restored;
+		file.map_segments(restored);
+		memory_segment<u64> *seg = restored.segments.front().get();
+		assert(seg->direct && seg->mpa == 0x80000000 && strcmp(seg->name, "RAM") == 0);
+		assert(memcmp((u8*)seg->uva, ram, 0x100000) == 0);
+
+		// writes to the restored memory are private to the process
+		((u8*)seg->uva)[0] = 0;
+		u8 first = 0xff;
+		assert(pread(file.fd, &first, 1, off_t(file.segments[0].offset)) == 1 && first == 1);
+		unlink(snap);
+	}
+
+	// RAM versus MMIO load and store throughput
+	bench_load_store("RAM  (inline)", *mmu.mem, 0x100000, 0x10000);
+	bench_load_store("RAM  (memory_bus virtual)", bus, 0x100000, 0x10000);
+	bench_load_store("MMIO (inline)", *mmu.mem, 0x60000000, 8);
+	bench_load_store("MMIO (memory_bus virtual)", bus, 0x60000000, 8);
+	bench_load_store("MMIO (mmio map)", *mmu.mem, 0x60001000, 8);
 }
@@ -0,0 +1,612 @@
+//
+//  test-virtio.cc
+//
+
+#undef NDEBUG
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cinttypes>
+#include <cstdarg>
+#include <cerrno>
+#include <csignal>
+#include <climits>
+#include <cassert>
+#include <string>
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <limits>
+#include <map>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <sys/times.h>
+#include <sys/statvfs.h>
+#include <sys/utsname.h>
+#include <sys/resource.h>
+
+#include "host-endian.h"
+#include "types.h"
+#include "bits.h"
+#include "sha512.h"
+#include "format.h"
+#include "meta.h"
+#include "util.h"
+#include "host.h"
+#include "processor-logging.h"
+#include "pma.h"
+#include "mmu-memory.h"
+#include "unknown-abi.h"
+#include "queue.h"
+#include "console.h"
+#include "device-plic.h"
+#include "device-virtio.h"
+#include "device-virtio-blk.h"
+#include "device-virtio-console.h"
+#include "device-virtio-9p.h"
+
+using namespace riscv;
+
+typedef std::chrono::high_resolution_clock clock_type;
+
+/* processor stub with the interface used by the devices */
+
+struct test_proc
+{
+	typedef u64 ux;
+
+	struct {
+		std::shared_ptr<user_memory<u64>> mem;
+	} mmu;
+
+	int log;
+	size_t wakes;
+
+	enum event_id {
+		event_uart,
+		event_virtio_blk,
+		event_virtio_console,
+		event_virtio_9p
+	};
+
+	test_proc() : mmu{std::make_shared<user_memory<u64>>()}, log(0), wakes(0) {}
+
+	void post_device_event(u32 id) { wakes++; }
+};
+
+typedef virtio_mmio_device<test_proc> virtio;
+typedef virtio_blk_mmio_device<test_proc> virtio_blk;
+typedef virtio_console_mmio_device<test_proc> virtio_console;
+typedef virtio_9p_mmio_device<test_proc> virtio_9p;
+
+enum : u64 {
+	ram_base = 0x80000000,
+	ram_size = 0x400000,
+	dev_base = 0x40007000,
+	console_base = 0x40009000,
+	p9_base = 0x4000a000,
+	queue_size = 16,
+	desc_base = ram_base,
+	avail_base = ram_base + 0x1000,
+	used_base = ram_base + 0x2000,
+	buf_base = ram_base + 0x10000,
+	image_sectors = 256
+};
+
+/* guest driver for a single queue */
+
+struct test_driver
+{
+	test_proc &proc;
+	virtio &dev;
+	u32 queue;
+	u64 desc_addr, avail_addr, used_addr;
+	u16 next_desc, avail_idx;
+
+	test_driver(test_proc &proc, virtio &dev, u32 queue = 0, u64 ring_base = ram_base) :
+		proc(proc), dev(dev), queue(queue), desc_addr(ring_base),
+		avail_addr(ring_base + 0x1000), used_addr(ring_base + 0x2000),
+		next_desc(0), avail_idx(0) {}
+
+	template <typename T> T* ptr(u64 mpa)
+	{
+		memory_segment<u64> *seg = nullptr;
+		return (T*)proc.mmu.mem->mpa_to_uva(seg, mpa);
+	}
+
+	u32 reg(u32 offset) { u32 val; dev.load_32(offset, val); return val; }
+	void reg(u32 offset, u32 val) { dev.store_32(offset, val); }
+
+	void init(u32 features = virtio_blk::VIRTIO_BLK_F_FLUSH)
+	{
+		reg(virtio::REG_STATUS, 0);
+		reg(virtio::REG_STATUS, virtio::STATUS_ACKNOWLEDGE | virtio::STATUS_DRIVER);
+		reg(virtio::REG_DEVICE_FEATURES_SEL, 1);
+		assert(reg(virtio::REG_DEVICE_FEATURES) & 1);
+		reg(virtio::REG_DRIVER_FEATURES_SEL, 1);
+		reg(virtio::REG_DRIVER_FEATURES, 1);
+		reg(virtio::REG_DRIVER_FEATURES_SEL, 0);
+		reg(virtio::REG_DRIVER_FEATURES, features);
+		reg(virtio::REG_STATUS, virtio::STATUS_ACKNOWLEDGE | virtio::STATUS_DRIVER | virtio::STATUS_FEATURES_OK);
+		assert(reg(virtio::REG_STATUS) & virtio::STATUS_FEATURES_OK);
+		setup();
+		reg(virtio::REG_STATUS, virtio::STATUS_ACKNOWLEDGE | virtio::STATUS_DRIVER |
+			virtio::STATUS_FEATURES_OK | virtio::STATUS_DRIVER_OK);
+	}
+
+	void setup()
+	{
+		reg(virtio::REG_QUEUE_SEL, queue);
+		assert(reg(virtio::REG_QUEUE_NUM_MAX) >= queue_size);
+		reg(virtio::REG_QUEUE_NUM, queue_size);
+		reg(virtio::REG_QUEUE_DESC_LOW, u32(desc_addr));
+		reg(virtio::REG_QUEUE_DESC_HIGH, u32(desc_addr >> 32));
+		reg(virtio::REG_QUEUE_AVAIL_LOW, u32(avail_addr));
+		reg(virtio::REG_QUEUE_AVAIL_HIGH, u32(avail_addr >> 32));
+		reg(virtio::REG_QUEUE_USED_LOW, u32(used_addr));
+		reg(virtio::REG_QUEUE_USED_HIGH, u32(used_addr >> 32));
+		reg(virtio::REG_QUEUE_READY, 1);
+		next_desc = avail_idx = 0;
+	}
+
+	u16 desc(u64 addr, u32 len, u16 flags)
+	{
+		u16 i = next_desc++ % queue_size;
+		auto d = ptr<virtio::virtq_desc>(desc_addr) + i;
+		d->addr = addr;
+		d->len = len;
+		d->flags = flags;
+		d->next = (i + 1) % queue_size;
+		return i;
+	}
+
+	/* queue a request with one data buffer; header and status follow the data */
+	u16 request(u32 type, u64 sector, u64 data, u32 len)
+	{
+		u64 hdr = data + len, status = hdr + 16;
+		auto req = ptr<virtio_blk::virtio_blk_req>(hdr);
+		req->type = type;
+		req->reserved = 0;
+		req->sector = sector;
+		*ptr<u8>(status) = 0xff;
+		u16 head = desc(hdr, sizeof(virtio_blk::virtio_blk_req), virtio::VIRTQ_DESC_F_NEXT);
+		if (len) {
+			desc(data, len, virtio::VIRTQ_DESC_F_NEXT |
+				(type == virtio_blk::VIRTIO_BLK_T_OUT ? 0 : virtio::VIRTQ_DESC_F_WRITE));
+		}
+		desc(status, 1, virtio::VIRTQ_DESC_F_WRITE);
+		return publish(head);
+	}
+
+	/* queue a chain with a single buffer */
+	u16 buffer(u64 addr, u32 len, u16 flags)
+	{
+		return publish(desc(addr, len, flags));
+	}
+
+	u16 publish(u16 head)
+	{
+		auto avail = ptr<virtio::virtq_avail>(avail_addr);
+		avail->ring[avail_idx++ % queue_size] = head;
+		avail->idx = avail_idx;
+		return head;
+	}
+
+	void notify() { reg(virtio::REG_QUEUE_NOTIFY, queue); }
+	u16 used_idx() { return ptr<virtio::virtq_used>(used_addr)->idx; }
+	u8 status(u64 data, u32 len) { return *ptr<u8>(data + len + 16); }
+};
+
+/* 9P client using one chain per request: request, response header and data */
+
+struct test_p9_client
+{
+	test_driver &drv;
+	std::vector<u8> msg;
+	u64 out, in;
+	u16 tag;
+
+	test_p9_client(test_driver &drv, u64 out, u64 in) : drv(drv), out(out), in(in), tag(0) {}
+
+	template <typename T> test_p9_client& put(T val)
+	{
+		size_t off = msg.size();
+		msg.resize(off + sizeof(T));
+		memcpy(msg.data() + off, &val, sizeof(T));
+		return *this;
+	}
+
+	test_p9_client& str(std::string s)
+	{
+		put(u16(s.size()));
+		msg.insert(msg.end(), s.begin(), s.end());
+		return *this;
+	}
+
+	test_p9_client& begin(u8 type)
+	{
+		msg.assign(virtio_9p::p9_hdr_size, 0);
+		msg[4] = type;
+		return *this;
+	}
+
+	/* send the request, wait for the worker thread and return the response type */
+	u8 send(u32 in_len = 0x1000, u32 hdr_len = 0)
+	{
+		u32 size = u32(msg.size());
+		memcpy(msg.data(), &size, sizeof(size));
+		memcpy(msg.data() + 5, &tag, sizeof(tag));
+		tag++;
+		memcpy(drv.ptr<u8>(out), msg.data(), size);
+		u16 head = drv.desc(out, size, virtio::VIRTQ_DESC_F_NEXT);
+		if (hdr_len) {
+			drv.desc(in, hdr_len, virtio::VIRTQ_DESC_F_WRITE | virtio::VIRTQ_DESC_F_NEXT);
+			drv.desc(in + 0x1000, in_len - hdr_len, virtio::VIRTQ_DESC_F_WRITE);
+		} else {
+			drv.desc(in, in_len, virtio::VIRTQ_DESC_F_WRITE);
+		}
+		u16 idx = drv.used_idx() + 1;
+		drv.publish(head);
+		drv.notify();
+		for (int i = 0; i < 100000 && drv.used_idx() != idx; i++) usleep(10);
+		assert(drv.used_idx() == idx);
+		return *drv.ptr<u8>(in + 4);
+	}
+
+	virtio_9p::p9_reader reply(size_t len = 0x1000)
+	{
+		return virtio_9p::p9_reader(drv.ptr<u8>(in) + virtio_9p::p9_hdr_size, drv.ptr<u8>(in) + len);
+	}
+
+	u32 error() { return reply().u32_(); }
+};
+
+static std::string make_image()
+{
+	char path[] = "/tmp/test-virtio-XXXXXX";
+	int fd = mkstemp(path);
+	assert(fd >= 0);
+	std::vector<u8> sector(virtio_blk::sector_size);
+	for (u32 i = 0; i < image_sectors; i++) {
+		std::fill(sector.begin(), sector.end(), u8(i));
+		assert(write(fd, sector.data(), sector.size()) == ssize_t(sector.size()));
+	}
+	close(fd);
+	return path;
+}
+
+static double mbs(size_t bytes, clock_type::time_point t1, clock_type::time_point t2)
+{
+	auto us = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
+	return us ? double(bytes) / double(us) : 0;
+}
+
+int main()
+{
+	std::string image = make_image();
+	test_proc proc;
+	proc.mmu.mem->add_ram(ram_base, ram_size);
+	auto plic = std::make_shared<plic_mmio_device<test_proc>>(proc, 0x40002000);
+	auto dev = std::make_shared<virtio_blk>(proc, dev_base, plic, 5, image);
+	test_driver drv(proc, *dev);
+
+	/* identification and config space */
+	assert(drv.reg(virtio::REG_MAGIC_VALUE) == virtio::MAGIC_VALUE);
+	assert(drv.reg(virtio::REG_VERSION) == 2);
+	assert(drv.reg(virtio::REG_DEVICE_ID) == virtio_blk::VIRTIO_ID_BLOCK);
+	assert(drv.reg(virtio::REG_CONFIG) == image_sectors);
+	assert(drv.reg(virtio::REG_CONFIG + 4) == 0);
+	printf("PASS virtio identification and config\n");
+
+	/* batch of read, write and get id completes with one used index update */
+	drv.init();
+	size_t wakes = proc.wakes;
+	drv.request(virtio_blk::VIRTIO_BLK_T_IN, 3, buf_base, 1024);
+	drv.request(virtio_blk::VIRTIO_BLK_T_OUT, 7, buf_base + 0x1000, 512);
+	drv.request(virtio_blk::VIRTIO_BLK_T_GET_ID, 0, buf_base + 0x2000, 20);
+	memset(drv.ptr<u8>(buf_base + 0x1000), 0xa5, 512);
+	drv.notify();
+	assert(drv.used_idx() == 3);
+	assert(drv.status(buf_base, 1024) == virtio_blk::VIRTIO_BLK_S_OK);
+	assert(drv.status(buf_base + 0x1000, 512) == virtio_blk::VIRTIO_BLK_S_OK);
+	assert(drv.status(buf_base + 0x2000, 20) == virtio_blk::VIRTIO_BLK_S_OK);
+	assert(drv.ptr<u8>(buf_base)[0] == 3 && drv.ptr<u8>(buf_base)[1023] == 4);
+	assert(strcmp(drv.ptr<char>(buf_base + 0x2000), "rv-sys-virtio-blk") == 0);
+	auto used = drv.ptr<virtio::virtq_used>(used_base);
+	assert(used->ring[0].id == 0 && used->ring[0].len == 1025);
+	assert(used->ring[1].id == 3 && used->ring[1].len == 1);
+	assert(dev->image[7 * 512] == 0xa5 && dev->image[8 * 512] == 8);
+	assert(proc.wakes == wakes + 1);
+	printf("PASS virtio-blk batched requests\n");
+
+	/* completion interrupt is routed through the PLIC and acknowledged */
+	assert(drv.reg(virtio::REG_INTERRUPT_STATUS) == virtio::INTERRUPT_USED_BUFFER);
+	dev->service();
+	assert(plic->irq_pending());
+	drv.reg(virtio::REG_INTERRUPT_ACK, virtio::INTERRUPT_USED_BUFFER);
+	dev->service();
+	assert(!plic->irq_pending());
+	printf("PASS virtio-blk completion interrupt\n");
+
+	/* suppressed interrupts, flush, out of range and unsupported requests */
+	drv.ptr<virtio::virtq_avail>(avail_base)->flags = virtio::VIRTQ_AVAIL_F_NO_INTERRUPT;
+	drv.request(virtio_blk::VIRTIO_BLK_T_FLUSH, 0, buf_base, 0);
+	drv.request(virtio_blk::VIRTIO_BLK_T_IN, image_sectors - 1, buf_base + 0x1000, 1024);
+	drv.request(0x42, 0, buf_base + 0x2000, 0);
+	drv.notify();
+	assert(drv.used_idx() == 6);
+	assert(drv.status(buf_base, 0) == virtio_blk::VIRTIO_BLK_S_OK);
+	assert(drv.status(buf_base + 0x1000, 1024) == virtio_blk::VIRTIO_BLK_S_IOERR);
+	assert(drv.status(buf_base + 0x2000, 0) == virtio_blk::VIRTIO_BLK_S_UNSUPP);
+	assert(drv.reg(virtio::REG_INTERRUPT_STATUS) == 0);
+	drv.ptr<virtio::virtq_avail>(avail_base)->flags = 0;
+	printf("PASS virtio-blk flush, errors and interrupt suppression\n");
+
+	/* descriptors outside RAM mark the device as needing reset */
+	u16 head = drv.request(virtio_blk::VIRTIO_BLK_T_IN, 0, buf_base, 512);
+	drv.ptr<virtio::virtq_desc>(desc_base)[(head + 1) % queue_size].addr = 0x10000000;
+	drv.notify();
+	assert(drv.used_idx() == 6);
+	assert(drv.reg(virtio::REG_STATUS) & virtio::STATUS_NEEDS_RESET);
+	drv.reg(virtio::REG_STATUS, 0);
+	assert(drv.reg(virtio::REG_STATUS) == 0 && drv.reg(virtio::REG_INTERRUPT_STATUS) == 0);
+	printf("PASS virtio-blk bad descriptor and reset\n");
+
+	/* throughput of batches of 4KB reads */
+	const int iters = 4096, batch = queue_size / 3;
+	memset(drv.ptr<u8>(used_base), 0, 0x1000);
+	drv.init();
+	auto t1 = clock_type::now();
+	for (int i = 0; i < iters; i++) {
+		for (int j = 0; j < batch; j++) {
+			drv.request(virtio_blk::VIRTIO_BLK_T_IN, (j * 8) % image_sectors, buf_base + j * 0x2000, 4096);
+		}
+		drv.notify();
+	}
+	auto t2 = clock_type::now();
+	assert(drv.used_idx() == u16(iters * batch));
+	printf("virtio-blk read %8.1f MB/sec\n", mbs(size_t(iters) * batch * 4096, t1, t2));
+
+	/* virtio console driven directly rather than from the console thread */
+	auto console = std::make_shared<console_device<test_proc>>(proc);
+	auto con = std::make_shared<virtio_console>(proc, console_base, plic, 6, console);
+	console->set_ring(nullptr);
+	test_driver rx(proc, *con, virtio_console::receiveq, ram_base + 0x100000);
+	test_driver tx(proc, *con, virtio_console::transmitq, ram_base + 0x104000);
+	assert(rx.reg(virtio::REG_DEVICE_ID) == virtio_console::VIRTIO_ID_CONSOLE);
+	assert(rx.reg(virtio::REG_CONFIG + 4) == 1);
+	assert(!con->ring_active());
+	rx.init(0);
+	tx.setup();
+	assert(con->ring_active() && !con->ring_input_ready());
+	printf("PASS virtio-console identification and config\n");
+
+	/* pending transmit chains are written with one writev and completed together */
+	int fds[2];
+	assert(pipe(fds) == 0);
+	const char *words[] = { "hello ", "virtio ", "console" };
+	for (int i = 0; i < 3; i++) {
+		strcpy(tx.ptr<char>(buf_base + i * 0x100), words[i]);
+		tx.buffer(buf_base + i * 0x100, strlen(words[i]), 0);
+	}
+	wakes = proc.wakes;
+	tx.notify();
+	assert(tx.used_idx() == 0);
+	con->ring_output(fds[1]);
+	char text[64] = {};
+	assert(read(fds[0], text, sizeof(text)) == 20 && strcmp(text, "hello virtio console") == 0);
+	assert(tx.used_idx() == 3 && proc.wakes == wakes + 1);
+	printf("PASS virtio-console batched transmit\n");
+
+	/* one readv fills receive chains in order and returns the unused chains */
+	rx.buffer(buf_base + 0x1000, 4, virtio::VIRTQ_DESC_F_WRITE);
+	rx.buffer(buf_base + 0x1100, 16, virtio::VIRTQ_DESC_F_WRITE);
+	rx.buffer(buf_base + 0x1200, 16, virtio::VIRTQ_DESC_F_WRITE);
+	assert(con->ring_input_ready());
+	assert(write(fds[1], "abcdefgh", 8) == 8);
+	assert(con->ring_input(fds[0]) == 8);
+	used = rx.ptr<virtio::virtq_used>(rx.used_addr);
+	assert(rx.used_idx() == 2 && used->ring[0].len == 4 && used->ring[1].len == 4);
+	assert(memcmp(rx.ptr<char>(buf_base + 0x1000), "abcd", 4) == 0);
+	assert(memcmp(rx.ptr<char>(buf_base + 0x1100), "efgh", 4) == 0);
+	assert(con->ring_input_ready());
+	assert(write(fds[1], "ij", 2) == 2);
+	assert(con->ring_input(fds[0]) == 2);
+	assert(rx.used_idx() == 3 && used->ring[2].id == 2 && used->ring[2].len == 2);
+	assert(!con->ring_input_ready());
+	printf("PASS virtio-console batched receive\n");
+	close(fds[0]);
+	close(fds[1]);
+
+	/* throughput of batches of 1KB console writes */
+	int null_fd = open("/dev/null", O_WRONLY);
+	assert(null_fd >= 0);
+	t1 = clock_type::now();
+	for (int i = 0; i < iters; i++) {
+		for (int j = 0; j < int(queue_size); j++) {
+			tx.buffer(buf_base + j * 0x400, 1024, 0);
+		}
+		tx.notify();
+		con->ring_output(null_fd);
+	}
+	t2 = clock_type::now();
+	assert(tx.used_idx() == u16(3 + iters * queue_size));
+	printf("virtio-console write %8.1f MB/sec\n", mbs(size_t(iters) * queue_size * 1024, t1, t2));
+	close(null_fd);
+
+	con.reset();
+	console.reset();
+
+	/* virtio 9P exports a host directory */
+	char dir[] = "/tmp/test-virtio-9p-XXXXXX";
+	assert(mkdtemp(dir));
+	std::string root = dir;
+	std::vector<u8> data(0x10000);
+	for (size_t i = 0; i < data.size(); i++) data[i] = u8(i * 7 + (i >> 8));
+	int data_fd = open((root + "/data.bin").c_str(), O_CREAT | O_WRONLY, 0644);
+	assert(data_fd >= 0 && write(data_fd, data.data(), data.size()) == ssize_t(data.size()));
+	close(data_fd);
+	assert(mkdir((root + "/sub").c_str(), 0755) == 0);
+	auto p9 = std::make_shared<virtio_9p>(proc, p9_base, plic, 7, root, "host");
+	test_driver fs(proc, *p9, 0, ram_base + 0x200000);
+	assert(fs.reg(virtio::REG_DEVICE_ID) == virtio_9p::VIRTIO_ID_9P);
+	assert((fs.reg(virtio::REG_CONFIG) & 0xffff) == 4);
+	assert(memcmp(p9->config_space() + 2, "host", 4) == 0);
+	fs.init(virtio_9p::VIRTIO_9P_MOUNT_TAG);
+	test_p9_client c(fs, buf_base + 0x40000, buf_base + 0x60000);
+	assert(c.begin(virtio_9p::P9_TVERSION).put(u32(0x20000)).str("9P2000.L").send() == virtio_9p::P9_TVERSION + 1);
+	auto r = c.reply();
+	assert(r.u32_() == 0x20000 && r.str() == "9P2000.L");
+	assert(c.begin(virtio_9p::P9_TATTACH).put(u32(1)).put(u32(~0u)).str("root").str("").put(u32(0)).send() ==
+		virtio_9p::P9_TATTACH + 1);
+	assert(c.reply().u8_() == virtio_9p::P9_QTDIR);
+	printf("PASS virtio-9p version and attach\n");
+
+	/* walks stay within the exported directory */
+	assert(c.begin(virtio_9p::P9_TWALK).put(u32(1)).put(u32(2)).put(u16(1)).str("data.bin").send() ==
+		virtio_9p::P9_TWALK + 1);
+	assert(c.reply().u16_() == 1);
+	assert(c.begin(virtio_9p::P9_TWALK).put(u32(1)).put(u32(3)).put(u16(2)).str("..").str("sub").send() ==
+		virtio_9p::P9_TWALK + 1);
+	r = c.reply();
+	assert(r.u16_() == 2 && r.u8_() == virtio_9p::P9_QTDIR);
+	assert(c.begin(virtio_9p::P9_TWALK).put(u32(1)).put(u32(4)).put(u16(1)).str("missing").send() ==
+		virtio_9p::P9_RLERROR);
+	assert(c.error() == abi_errno_ENOENT);
+	assert(c.begin(virtio_9p::P9_TGETATTR).put(u32(2)).put(u64(virtio_9p::P9_GETATTR_BASIC)).send() ==
+		virtio_9p::P9_TGETATTR + 1);
+	r = c.reply();
+	r.u64_(); r.u8_(); r.u32_(); r.u64_();
+	assert(S_ISREG(r.u32_()));
+	r.u32_(); r.u32_(); r.u64_(); r.u64_();
+	assert(r.u64_() == data.size());
+	printf("PASS virtio-9p walk and getattr\n");
+
+	/* reads land directly in the data buffer that follows the response header */
+	assert(c.begin(virtio_9p::P9_TLOPEN).put(u32(2)).put(u32(0)).send() == virtio_9p::P9_TLOPEN + 1);
+	assert(c.begin(virtio_9p::P9_TREAD).put(u32(2)).put(u64(0x1000)).put(u32(0x2000)).send(
+		0x2000 + virtio_9p::p9_read_hdr_size, virtio_9p::p9_read_hdr_size) == virtio_9p::P9_TREAD + 1);
+	assert(c.reply().u32_() == 0x2000);
+	assert(memcmp(fs.ptr<u8>(c.in + 0x1000), data.data() + 0x1000, 0x2000) == 0);
+	printf("PASS virtio-9p read\n");
+
+	/* create, write and readdir */
+	assert(c.begin(virtio_9p::P9_TWALK).put(u32(3)).put(u32(5)).put(u16(0)).send() == virtio_9p::P9_TWALK + 1);
+	assert(c.begin(virtio_9p::P9_TLCREATE).put(u32(5)).str("out.txt").put(u32(2)).put(u32(0644)).put(u32(0)).send() ==
+		virtio_9p::P9_TLCREATE + 1);
+	assert(c.begin(virtio_9p::P9_TWRITE).put(u32(5)).put(u64(0)).put(u32(12)).send() == virtio_9p::P9_RLERROR);
+	assert(c.error() == abi_errno_EINVAL);
+	c.begin(virtio_9p::P9_TWRITE).put(u32(5)).put(u64(0)).put(u32(12));
+	c.msg.insert(c.msg.end(), (const u8*)"hello, world", (const u8*)"hello, world" + 12);
+	assert(c.send() == virtio_9p::P9_TWRITE + 1 && c.reply().u32_() == 12);
+	memset(text, 0, sizeof(text));
+	int out_fd = open((root + "/sub/out.txt").c_str(), O_RDONLY);
+	assert(out_fd >= 0 && read(out_fd, text, sizeof(text)) == 12 && strcmp(text, "hello, world") == 0);
+	close(out_fd);
+	assert(c.begin(virtio_9p::P9_TWALK).put(u32(1)).put(u32(6)).put(u16(0)).send() == virtio_9p::P9_TWALK + 1);
+	assert(c.begin(virtio_9p::P9_TLOPEN).put(u32(6)).put(u32(0)).send() == virtio_9p::P9_TLOPEN + 1);
+	assert(c.begin(virtio_9p::P9_TREADDIR).put(u32(6)).put(u64(0)).put(u32(0x1000)).send() ==
+		virtio_9p::P9_TREADDIR + 1);
+	r = c.reply();
+	u32 count = r.u32_();
+	std::vector<std::string> names;
+	for (const u8 *end = r.p + count; r.p < end; ) {
+		r.u8_(); r.u32_(); r.u64_(); r.u64_(); r.u8_();
+		names.push_back(r.str());
+	}
+	std::sort(names.begin(), names.end());
+	assert(r.ok && names == std::vector<std::string>({ ".", "..", "data.bin", "sub" }));
+	printf("PASS virtio-9p create, write and readdir\n");
+
+	/* unlink and remove directories, then clunk */
+	assert(c.begin(virtio_9p::P9_TUNLINKAT).put(u32(1)).str("sub").put(u32(virtio_9p::P9_DOTL_AT_REMOVEDIR)).send() ==
+		virtio_9p::P9_RLERROR);
+	assert(c.error() == abi_errno_ENOTEMPTY);
+	assert(c.begin(virtio_9p::P9_TUNLINKAT).put(u32(3)).str("out.txt").put(u32(0)).send() ==
+		virtio_9p::P9_TUNLINKAT + 1);
+	assert(c.begin(virtio_9p::P9_TUNLINKAT).put(u32(1)).str("sub").put(u32(virtio_9p::P9_DOTL_AT_REMOVEDIR)).send() ==
+		virtio_9p::P9_TUNLINKAT + 1);
+	assert(c.begin(virtio_9p::P9_TCLUNK).put(u32(5)).send() == virtio_9p::P9_TCLUNK + 1);
+	assert(c.begin(virtio_9p::P9_TCLUNK).put(u32(5)).send() == virtio_9p::P9_RLERROR);
+	assert(c.error() == abi_errno_EBADF);
+	printf("PASS virtio-9p unlink and clunk\n");
+
+	/* symbolic links are never followed by the host */
+	char out_dir[] = "/tmp/test-virtio-9p-out-XXXXXX";
+	assert(mkdtemp(out_dir) && chmod(out_dir, 0700) == 0);
+	std::string secret = std::string(out_dir) + "/secret";
+	int secret_fd = open(secret.c_str(), O_CREAT | O_WRONLY, 0600);
+	assert(secret_fd >= 0);
+	close(secret_fd);
+	assert(c.begin(virtio_9p::P9_TSYMLINK).put(u32(1)).str("esc").str("/").put(u32(0)).send() ==
+		virtio_9p::P9_TSYMLINK + 1);
+	assert(c.begin(virtio_9p::P9_TSYMLINK).put(u32(1)).str("out").str(out_dir).put(u32(0)).send() ==
+		virtio_9p::P9_TSYMLINK + 1);
+	assert(c.begin(virtio_9p::P9_TWALK).put(u32(1)).put(u32(7)).put(u16(2)).str("esc").str("etc").send() ==
+		virtio_9p::P9_TWALK + 1);
+	assert(c.reply().u16_() == 1);
+	assert(c.begin(virtio_9p::P9_TLOPEN).put(u32(7)).put(u32(0)).send() == virtio_9p::P9_RLERROR);
+	assert(c.error() == abi_errno_EBADF);
+	assert(c.begin(virtio_9p::P9_TWALK).put(u32(1)).put(u32(7)).put(u16(1)).str("esc").send() ==
+		virtio_9p::P9_TWALK + 1);
+	r = c.reply();
+	assert(r.u16_() == 1 && r.u8_() == virtio_9p::P9_QTSYMLINK);
+	assert(c.begin(virtio_9p::P9_TLOPEN).put(u32(7)).put(u32(0)).send() == virtio_9p::P9_RLERROR);
+	assert(c.error() == abi_errno_ELOOP);
+	assert(c.begin(virtio_9p::P9_TREADLINK).put(u32(7)).send() == virtio_9p::P9_TREADLINK + 1);
+	assert(c.reply().str() == "/");
+	assert(c.begin(virtio_9p::P9_TWALK).put(u32(1)).put(u32(8)).put(u16(2)).str("out").str("secret").send() ==
+		virtio_9p::P9_TWALK + 1);
+	assert(c.reply().u16_() == 1);
+	assert(c.begin(virtio_9p::P9_TWALK).put(u32(1)).put(u32(8)).put(u16(1)).str("out").send() ==
+		virtio_9p::P9_TWALK + 1);
+	c.begin(virtio_9p::P9_TSETATTR).put(u32(8)).put(u32(virtio_9p::P9_SETATTR_MODE)).put(u32(0777));
+	c.put(u32(0)).put(u32(0)).put(u64(0)).put(u64(0)).put(u64(0)).put(u64(0)).put(u64(0));
+	assert(c.send() == virtio_9p::P9_RLERROR);
+	struct stat out_st;
+	assert(stat(out_dir, &out_st) == 0 && (out_st.st_mode & 07777) == 0700);
+	assert(c.begin(virtio_9p::P9_TLCREATE).put(u32(8)).str("new").put(u32(2)).put(u32(0644)).put(u32(0)).send() ==
+		virtio_9p::P9_RLERROR);
+	assert(access((std::string(out_dir) + "/new").c_str(), F_OK) < 0);
+	assert(c.begin(virtio_9p::P9_TCLUNK).put(u32(7)).send() == virtio_9p::P9_TCLUNK + 1);
+	assert(c.begin(virtio_9p::P9_TCLUNK).put(u32(8)).send() == virtio_9p::P9_TCLUNK + 1);
+	assert(c.begin(virtio_9p::P9_TUNLINKAT).put(u32(1)).str("esc").put(u32(0)).send() == virtio_9p::P9_TUNLINKAT + 1);
+	assert(c.begin(virtio_9p::P9_TUNLINKAT).put(u32(1)).str("out").put(u32(0)).send() == virtio_9p::P9_TUNLINKAT + 1);
+	assert(stat(secret.c_str(), &out_st) == 0);
+	unlink(secret.c_str());
+	rmdir(out_dir);
+	printf("PASS virtio-9p symbolic links\n");
+
+	/* throughput of 32KB reads */
+	t1 = clock_type::now();
+	for (int i = 0; i < 4096; i++) {
+		c.begin(virtio_9p::P9_TREAD).put(u32(2)).put(u64((i & 1) * 0x8000)).put(u32(0x8000));
+		c.send(0x8000 + virtio_9p::p9_read_hdr_size, virtio_9p::p9_read_hdr_size);
+	}
+	t2 = clock_type::now();
+	assert(c.reply().u32_() == 0x8000);
+	printf("virtio-9p read %8.1f MB/sec\n", mbs(size_t(4096) * 0x8000, t1, t2));
+
+	p9.reset();
+	unlink((root + "/data.bin").c_str());
+	rmdir(dir);
+
+	dev.reset();
+	unlink(image.c_str());
+	return 0;
+}
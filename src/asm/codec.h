@@ -28,6 +28,10 @@
  *   template <typename T> inline void riscv::decode_inst_rv32(T &dec, riscv::inst_t inst)
  *   template <typename T> inline void riscv::decode_inst_rv64(T &dec, riscv::inst_t inst)
  *
+ * The rv32, rv64 and rv128 decode functions also decompress compressed
+ * instructions using a 65536 entry expansion table indexed by the 16-bit
+ * encoding, so decoding a compressed instruction is a single load.
+ *
  * Encoding instructions
  * =====================
  * The encode function encodes the operands in struct rv_decode using:
@@ -218,25 +222,88 @@ namespace riscv
 		decode_inst_type<T>(dec, inst);
 	}
 
+	/* Compressed Instruction Expansion Table */
+
+	struct rvc_expand_ent
+	{
+		int32_t  imm;        /* decoded immediate */
+		uint16_t op;         /* expanded opcode */
+		uint8_t  codec;      /* expanded codec */
+		uint8_t  rd;
+		uint8_t  rs1;
+		uint8_t  rs2;
+	};
+
+	/*
+	 * Maps every 16-bit encoding to its decoded and decompressed form so
+	 * that decoding a compressed instruction is a single table lookup.
+	 * Entries with inst[1:0] == 0b11 are not compressed and are unused.
+	 * One table is built lazily on first use for each ISA combination.
+	 */
+
+	template <bool rv32, bool rv64, bool rv128, bool rvi, bool rvm, bool rva, bool rvs, bool rvf, bool rvd, bool rvq, bool rvc>
+	struct rvc_expand_table
+	{
+		enum { size = 65536 };
+
+		rvc_expand_ent ents[size];
+
+		rvc_expand_table()
+		{
+			for (size_t inst = 0; inst < size; inst++) {
+				decode dec;
+				decode_inst<decode,rv32,rv64,rv128,rvi,rvm,rva,rvs,rvf,rvd,rvq,rvc>(dec, inst);
+				if (rv32) decompress_inst_rv32<decode>(dec);
+				else if (rv64) decompress_inst_rv64<decode>(dec);
+				else if (rv128) decompress_inst_rv128<decode>(dec);
+				ents[inst] = rvc_expand_ent{ dec.imm, uint16_t(dec.op), uint8_t(dec.codec),
+					dec.rd, dec.rs1, dec.rs2 };
+			}
+		}
+
+		static const rvc_expand_table& get()
+		{
+			static const rvc_expand_table table;
+			return table;
+		}
+	};
+
+	/* Decode and Decompress Instruction */
+
+	template <typename T, bool rv32, bool rv64, bool rv128, bool rvi = true, bool rvm = true, bool rva = true, bool rvs = true, bool rvf = true, bool rvd = true, bool rvq = true, bool rvc = true>
+	inline void decode_inst_expand(T &dec, inst_t inst)
+	{
+		if (rvc && (inst & 0b11) != 0b11) {
+			const rvc_expand_ent &ent = rvc_expand_table<rv32,rv64,rv128,rvi,rvm,rva,rvs,rvf,rvd,rvq,rvc>
+				::get().ents[inst & 0xffff];
+			dec.op = ent.op;
+			dec.codec = ent.codec;
+			dec.rd = ent.rd;
+			dec.rs1 = ent.rs1;
+			dec.rs2 = ent.rs2;
+			dec.imm = ent.imm;
+		} else {
+			/* instructions longer than 16 bits are never compressed */
+			decode_inst<T,rv32,rv64,rv128,rvi,rvm,rva,rvs,rvf,rvd,rvq,rvc>(dec, inst);
+		}
+	}
+
 	template <typename T>
 	inline void decode_inst_rv32(T &dec, inst_t inst)
 	{
-		decode_inst<T,true,false,false>(dec, inst);
-		decompress_inst_rv32<T>(dec);
+		decode_inst_expand<T,true,false,false>(dec, inst);
 	}
 
 	template <typename T>
 	inline void decode_inst_rv64(T &dec, inst_t inst)
 	{
-		decode_inst<T,false,true,false>(dec, inst);
-		decompress_inst_rv64<T>(dec);
+		decode_inst_expand<T,false,true,false>(dec, inst);
 	}
 
 	template <typename T>
 	inline void decode_inst_rv128(T &dec, inst_t inst)
 	{
-		decode_inst<T,false,false,true>(dec, inst);
-		decompress_inst_rv128<T>(dec);
+		decode_inst_expand<T,false,false,true>(dec, inst);
 	}
 
 
@@ -0,0 +1,145 @@
+//
+//  decode-batch.h
+//
+
+#ifndef rv_decode_batch_h
+#define rv_decode_batch_h
+
+#if defined __GNUC__ && defined __SSE2__ && _BYTE_ORDER == _LITTLE_ENDIAN
+#include <emmintrin.h>
+#define HAVE_SSE2_DECODE
+#endif
+
+/*
+ * Batch Decoding
+ * ==============
+ * Decodes a buffer of instructions, such as a text section, into a
+ * structure of arrays. Returns the number of instructions decoded.
+ *
+ *   template <bool rv32, bool rv64, bool rv128, ...>
+ *   inline size_t riscv::decode_inst_batch(riscv::decode_batch &batch,
+ *       const uint8_t *buf, size_t len)
+ *
+ * Instruction lengths are classified 16 parcels at a time using SSE2
+ * when available. Compressed instructions are expanded using the RVC
+ * expansion table and longer instructions are decoded with decode_inst.
+ * Reserved length encodings are recorded as rv_op_illegal with a length
+ * of 2 so that decoding always makes progress. Decoding stops before
+ * an instruction truncated by the end of the buffer.
+ */
+
+namespace riscv
+{
+
+	/* Decoded instructions as a structure of arrays */
+
+	struct decode_batch
+	{
+		std::vector<uint32_t> offset;  /* byte offset from start of buffer */
+		std::vector<uint16_t> op;      /* decompressed opcode */
+		std::vector<uint8_t>  rd;
+		std::vector<uint8_t>  rs1;
+		std::vector<uint8_t>  rs2;
+		std::vector<uint8_t>  rs3;
+		std::vector<int32_t>  imm;
+		std::vector<uint8_t>  len;     /* instruction length in bytes */
+
+		size_t size() const { return op.size(); }
+
+		void resize(size_t n)
+		{
+			offset.resize(n);
+			op.resize(n);
+			rd.resize(n);
+			rs1.resize(n);
+			rs2.resize(n);
+			rs3.resize(n);
+			imm.resize(n);
+			len.resize(n);
+		}
+	};
+
+	/* Mask of parcels with inst[1:0] == 0b11 (the start of a 32-bit or longer instruction) */
+
+	inline uint32_t decode_batch_long_mask(const uint8_t *p, size_t nparcels)
+	{
+	#if defined HAVE_SSE2_DECODE
+		if (nparcels == 16) {
+			const __m128i three = _mm_set1_epi16(0b11);
+			__m128i lo = _mm_loadu_si128((const __m128i*)p);
+			__m128i hi = _mm_loadu_si128((const __m128i*)(p + 16));
+			lo = _mm_cmpeq_epi16(_mm_and_si128(lo, three), three);
+			hi = _mm_cmpeq_epi16(_mm_and_si128(hi, three), three);
+			return uint32_t(_mm_movemask_epi8(_mm_packs_epi16(lo, hi)));
+		}
+	#endif
+		uint32_t mask = 0;
+		for (size_t i = 0; i < nparcels; i++) {
+			if ((htole16(*(uint16_t*)(p + (i << 1))) & 0b11) == 0b11) {
+				mask |= 1U << i;
+			}
+		}
+		return mask;
+	}
+
+	template <bool rv32, bool rv64, bool rv128, bool rvi = true, bool rvm = true, bool rva = true, bool rvs = true, bool rvf = true, bool rvd = true, bool rvq = true, bool rvc = true>
+	inline size_t decode_inst_batch(decode_batch &batch, const uint8_t *buf, size_t len)
+	{
+		const size_t nparcels = len >> 1;
+		size_t i = 0, n = 0;
+
+		/* every instruction is at least one parcel */
+		batch.resize(nparcels);
+
+		while (i < nparcels) {
+			size_t chunk = std::min(nparcels - i, size_t(16));
+			uint32_t mask = decode_batch_long_mask(buf + (i << 1), chunk);
+			size_t j = 0;
+			while (j < chunk) {
+				const uint8_t *p = buf + ((i + j) << 1);
+				inst_t inst = htole16(*(uint16_t*)p);
+				size_t inst_len = 2;
+				decode dec;
+				if (!(mask & (1U << j))) {
+					decode_inst_expand<decode,rv32,rv64,rv128,rvi,rvm,rva,rvs,rvf,rvd,rvq,rvc>(dec, inst);
+				} else if ((inst_len = inst_length(inst)) == 0) {
+					inst_len = 2; /* reserved length encoding */
+				} else if (i + j + (inst_len >> 1) > nparcels) {
+					goto out; /* truncated */
+				} else {
+					for (size_t k = 1; k < (inst_len >> 1); k++) {
+						inst |= inst_t(htole16(*(uint16_t*)(p + (k << 1)))) << (k << 4);
+					}
+					decode_inst_expand<decode,rv32,rv64,rv128,rvi,rvm,rva,rvs,rvf,rvd,rvq,rvc>(dec, inst);
+				}
+				batch.offset[n] = uint32_t((i + j) << 1);
+				batch.op[n] = dec.op;
+				batch.rd[n] = dec.rd;
+				batch.rs1[n] = dec.rs1;
+				batch.rs2[n] = dec.rs2;
+				batch.rs3[n] = dec.rs3;
+				batch.imm[n] = dec.imm;
+				batch.len[n] = uint8_t(inst_len);
+				n++;
+				j += inst_len >> 1;
+			}
+			i += j;
+		}
+	out:
+		batch.resize(n);
+		return n;
+	}
+
+	inline size_t decode_inst_batch_rv32(decode_batch &batch, const uint8_t *buf, size_t len)
+	{
+		return decode_inst_batch<true,false,false>(batch, buf, len);
+	}
+
+	inline size_t decode_inst_batch_rv64(decode_batch &batch, const uint8_t *buf, size_t len)
+	{
+		return decode_inst_batch<false,true,false>(batch, buf, len);
+	}
+
+}
+
+#endif
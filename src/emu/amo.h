@@ -61,6 +61,34 @@ namespace riscv {
 		}
 		return 0;
 	}
+
+	/*
+	 * host atomic AMO on guest RAM (returns the old value)
+	 *
+	 * T is the signed access type. min and max are not host atomic
+	 * operations so they retry a compare and swap until it succeeds.
+	 */
+	template <typename T> T amo_host(amo_op op, T *ptr, T val) {
+		typedef typename std::make_unsigned<T>::type UT;
+		switch (op) {
+			case amoswap: return __atomic_exchange_n(ptr, val, __ATOMIC_SEQ_CST);
+			case amoadd:  return T(__atomic_fetch_add((UT*)ptr, UT(val), __ATOMIC_SEQ_CST));
+			case amoxor:  return __atomic_fetch_xor(ptr, val, __ATOMIC_SEQ_CST);
+			case amoor:   return __atomic_fetch_or (ptr, val, __ATOMIC_SEQ_CST);
+			case amoand:  return __atomic_fetch_and(ptr, val, __ATOMIC_SEQ_CST);
+			default: break;
+		}
+		T old = __atomic_load_n(ptr, __ATOMIC_RELAXED);
+		while (!__atomic_compare_exchange_n(ptr, &old, T(amo_fn<UT>(op, UT(old), UT(val))),
+			true, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+		return old;
+	}
+
+	/* host atomic compare and swap on guest RAM (returns true on success) */
+	template <typename T> bool cas_host(T *ptr, T expected, T desired) {
+		return __atomic_compare_exchange_n(ptr, &expected, desired,
+			false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+	}
 }
 
 #endif
@@ -0,0 +1,172 @@
+//
+//  block-cache.h
+//
+
+#ifndef rv_block_cache_h
+#define rv_block_cache_h
+
+namespace riscv {
+
+	/*
+	 * block_cache
+	 *
+	 * direct mapped cache of pre-decoded basic blocks
+	 *
+	 * blocks are keyed by the address of their first instruction; the
+	 * proxy MMU uses the program counter and the soft MMU uses the
+	 * machine physical address so blocks survive address space switches.
+	 * a block ends at a control transfer, a system instruction, a page
+	 * boundary or after block_size instructions.
+	 *
+	 * blocks are recorded in place while they are interpreted. only
+	 * retired instructions are counted so a trap part way through a
+	 * block commits the prefix that has already executed. on commit,
+	 * adjacent pairs found by the fuse function are marked so they
+	 * execute as one superinstruction (see superinst.h).
+	 */
+
+	template <typename T, const size_t cache_size = 1024, const size_t block_size = 32>
+	struct block_cache
+	{
+		static_assert(ispow2(cache_size), "cache_size must be a power of 2");
+
+		enum : addr_t { invalid_key = addr_t(-1) };
+
+		struct block_inst
+		{
+			T       dec;           /* decoded instruction */
+			inst_t  inst;          /* source instruction */
+			u8      len;           /* instruction length */
+			u16     fused;         /* superinstruction with the next entry */
+		};
+
+		struct block_ent
+		{
+			addr_t  key;           /* address of first instruction */
+			size_t  count;         /* number of instructions */
+			block_inst insts[block_size];
+
+			block_ent() : key(invalid_key), count(0) {}
+		};
+
+		std::vector<block_ent> blocks;
+		block_ent *recording;      /* block being recorded or nullptr */
+		addr_t record_key;         /* key of the block being recorded */
+		size_t record_generation;  /* generation when recording started */
+		size_t generation;         /* incremented on every flush */
+		int (*fuse)(int, int);     /* superinstruction lookup or nullptr */
+
+		block_cache() :
+			blocks(cache_size),
+			recording(nullptr),
+			record_key(invalid_key),
+			record_generation(0),
+			generation(0),
+			fuse(nullptr) {}
+
+		static bool is_terminator(const T &dec)
+		{
+			switch (dec.op) {
+				case rv_op_jal:
+				case rv_op_jalr:
+				case rv_op_beq:
+				case rv_op_bne:
+				case rv_op_blt:
+				case rv_op_bge:
+				case rv_op_bltu:
+				case rv_op_bgeu:
+				case rv_op_fence_i:
+				case rv_op_ecall:
+				case rv_op_ebreak:
+				case rv_op_uret:
+				case rv_op_sret:
+				case rv_op_hret:
+				case rv_op_mret:
+				case rv_op_dret:
+				case rv_op_sfence_vm:
+				case rv_op_wfi:
+				case rv_op_csrrw:
+				case rv_op_csrrs:
+				case rv_op_csrrc:
+				case rv_op_csrrwi:
+				case rv_op_csrrsi:
+				case rv_op_csrrci:
+					return true;
+				default:
+					return false;
+			}
+		}
+
+		/* instructions that straddle a page boundary are never cached */
+		static bool straddles_page(addr_t pc, size_t len)
+		{
+			return (pc & addr_t(page_mask)) != ((pc + addr_t(len) - 1) & addr_t(page_mask));
+		}
+
+		block_ent* lookup(addr_t key)
+		{
+			block_ent *ent = &blocks[(key >> 1) & (cache_size - 1)];
+			return ent->key == key ? ent : nullptr;
+		}
+
+		/* start recording a block, evicting the block in the same slot */
+		block_ent* begin(addr_t key)
+		{
+			recording = &blocks[(key >> 1) & (cache_size - 1)];
+			recording->key = invalid_key;
+			recording->count = 0;
+			record_key = key;
+			record_generation = generation;
+			return recording;
+		}
+
+		/* retire the instruction decoded in place; returns true if the block is complete */
+		bool append(addr_t pc, size_t len)
+		{
+			block_inst &bi = recording->insts[recording->count++];
+			bi.len = u8(len);
+			bi.fused = 0;
+			return is_terminator(bi.dec) ||
+				recording->count == block_size ||
+				((pc + addr_t(len)) & ~addr_t(page_mask)) == 0;
+		}
+
+		/* replace adjacent instruction pairs with superinstructions */
+		void fuse_block(block_ent *ent)
+		{
+			for (size_t i = 0; i + 1 < ent->count; i++) {
+				int si = fuse(ent->insts[i].dec.op, ent->insts[i + 1].dec.op);
+				if (si) {
+					ent->insts[i++].fused = u16(si);
+				}
+			}
+		}
+
+		/* commit the retired instructions unless the cache was flushed meanwhile */
+		void commit()
+		{
+			if (recording && recording->count > 0 && generation == record_generation) {
+				if (fuse) fuse_block(recording);
+				recording->key = record_key;
+			}
+			recording = nullptr;
+		}
+
+		/* discard the block being recorded */
+		void abandon()
+		{
+			recording = nullptr;
+		}
+
+		void flush()
+		{
+			for (auto &ent : blocks) {
+				ent.key = invalid_key;
+			}
+			generation++;
+		}
+	};
+
+}
+
+#endif
@@ -0,0 +1,121 @@
+//
+//  clone.h
+//
+
+#ifndef rv_clone_h
+#define rv_clone_h
+
+namespace riscv {
+
+	/*
+	 * machine clones
+	 *
+	 * a machine that reaches its clone checkpoint forks a number of host
+	 * processes that each continue independently from the checkpoint.
+	 * guest RAM and the JIT code cache are private mappings so the clones
+	 * share them copy-on-write with the parent and each other.
+	 *
+	 * each clone reads its console input from /dev/null and, when an
+	 * output prefix is given, writes its console output to <prefix>.<n>.
+	 * the parent does not continue the machine; it waits for the clones
+	 * and exits with the first non-zero clone status. clones run in their
+	 * own process group so terminal signals only reach the parent, which
+	 * forwards termination signals to the clones.
+	 */
+
+	struct clone_group
+	{
+		static std::vector<pid_t>& clone_pids()
+		{
+			static std::vector<pid_t> pids;
+			return pids;
+		}
+
+		static void forward_signal(int signum)
+		{
+			for (auto pid : clone_pids()) kill(pid, signum);
+		}
+
+		static void signal_set(sigset_t *set)
+		{
+			sigemptyset(set);
+			sigaddset(set, SIGTERM);
+			sigaddset(set, SIGQUIT);
+			sigaddset(set, SIGINT);
+			sigaddset(set, SIGHUP);
+		}
+
+		/* fork count clones, returning the clone number (1..count) in each clone */
+		static size_t fork_clones(size_t count, std::string output)
+		{
+			auto &pids = clone_pids();
+			sigset_t set, oldset;
+
+			/* buffered output would be written by every clone */
+			fflush(stdout);
+			fflush(stderr);
+
+			/* signals are held until the parent has installed its forwarding handlers */
+			signal_set(&set);
+			if (pthread_sigmask(SIG_BLOCK, &set, &oldset) != 0) {
+				panic("clone: can't set thread signal mask: %s", strerror(errno));
+			}
+			for (size_t n = 1; n <= count; n++) {
+				pid_t pid = fork();
+				if (pid < 0) {
+					debug("clone: fork: %s", strerror(errno));
+					break;
+				}
+				if (pid == 0) {
+					pids.clear();
+					setpgid(0, 0);
+					open_console(n, output);
+					pthread_sigmask(SIG_SETMASK, &oldset, nullptr);
+					return n;
+				}
+				pids.push_back(pid);
+			}
+
+			struct sigaction sa;
+			memset(&sa, 0, sizeof(sa));
+			sa.sa_handler = &clone_group::forward_signal;
+			for (int signum : { SIGTERM, SIGQUIT, SIGINT, SIGHUP }) {
+				sigaction(signum, &sa, nullptr);
+			}
+			pthread_sigmask(SIG_SETMASK, &oldset, nullptr);
+
+			int rc = pids.size() == count ? 0 : 1;
+			for (size_t i = 0; i < pids.size(); i++) {
+				int status = 0;
+				while (waitpid(pids[i], &status, 0) < 0 && errno == EINTR);
+				int code = WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+				if (code != 0) {
+					debug("clone: %zu: exited with status %d", i + 1, code);
+					if (rc == 0) rc = code;
+				}
+			}
+			::exit(rc);
+		}
+
+		/* redirect the console of clone n */
+		static void open_console(size_t n, std::string output)
+		{
+			int fd = open("/dev/null", O_RDONLY);
+			if (fd < 0 || dup2(fd, STDIN_FILENO) < 0) {
+				panic("clone: %zu: /dev/null: %s", n, strerror(errno));
+			}
+			close(fd);
+			if (output.size() == 0) return;
+
+			std::string filename = output + "." + std::to_string(n);
+			fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			if (fd < 0 || dup2(fd, STDOUT_FILENO) < 0 || dup2(fd, STDERR_FILENO) < 0) {
+				panic("clone: %zu: %s: %s", n, filename.c_str(), strerror(errno));
+			}
+			close(fd);
+		}
+	};
+
+}
+
+#endif
@@ -7,6 +7,26 @@
 
 namespace riscv {
 
+	/*
+	 * Console ring
+	 *
+	 * bulk console client such as the virtio console. the console thread
+	 * fills its receive buffers from stdin with readv (ring_input returns
+	 * the readv result so end of file can be detected) and drains its
+	 * transmit buffers to stdout with writev. while the ring is active
+	 * console input goes to the ring instead of the UART byte queue and
+	 * stdin is not polled when the ring has no receive buffers.
+	 */
+
+	struct console_ring
+	{
+		virtual ~console_ring() {}
+		virtual bool ring_active() = 0;
+		virtual bool ring_input_ready() = 0;
+		virtual ssize_t ring_input(int fd) = 0;
+		virtual void ring_output(int fd) = 0;
+	};
+
 	/* Console Thread */
 
 	template <typename P>
@@ -15,39 +35,61 @@ namespace riscv {
 		P &proc;
 		struct termios old_tio, new_tio;
 		int pipefds[2];
+		int kickfds[2];
 		std::vector<struct pollfd> pollfds;
+		std::mutex ring_mutex;
+		console_ring *ring;
 		queue_atomic<char> queue;
 		volatile bool running;
 		volatile bool suspended;
+		bool input_eof;
 		std::thread thread;
 
 		console_device(P &proc) :
 			proc(proc),
 			pipefds{0},
+			kickfds{0},
 			pollfds(),
+			ring(nullptr),
 			queue(1024),
-			running(true),
+			running(false),
 			suspended(false),
-			thread(&console_device::mainloop, this)
-		{}
+			input_eof(false)
+		{
+			start();
+		}
 
 		~console_device()
 		{
 			shutdown();
 		}
 
+		/* the pipes are non-blocking so output is drained until EAGAIN */
 		void process_output()
 		{
 			char buf[256];
 			ssize_t ret;
 
-			if (pollfds[0].revents & POLLIN) {
-				if ((ret = read(pipefds[0], buf, (sizeof(buf)))) < 0) {
-					debug("console: socket: read: %s", strerror(errno));
-				} else if (write(STDIN_FILENO, buf, ret) < 0) {
+			while ((ret = read(pipefds[0], buf, (sizeof(buf)))) > 0) {
+				if (write(STDOUT_FILENO, buf, ret) < 0) {
 					debug("console: socket: write: %s", strerror(errno));
+					break;
 				}
 			}
+			if (ret < 0 && errno != EAGAIN) {
+				debug("console: socket: read: %s", strerror(errno));
+			}
+		}
+
+		void process_ring()
+		{
+			char buf[256];
+
+			while (read(kickfds[0], buf, sizeof(buf)) > 0);
+			std::lock_guard<std::mutex> lock(ring_mutex);
+			if (ring) {
+				ring->ring_output(STDOUT_FILENO);
+			}
 		}
 
 		void process_input()
@@ -56,15 +98,22 @@ namespace riscv {
 			ssize_t ret;
 
 			if (pollfds[1].revents & POLLIN) {
+				std::unique_lock<std::mutex> lock(ring_mutex);
+				if (ring && ring->ring_active()) {
+					if (ring->ring_input(STDIN_FILENO) == 0) input_eof = true;
+					return;
+				}
+				lock.unlock();
 				if ((ret = read(STDIN_FILENO, buf, (sizeof(buf)))) < 0) {
 					debug("console: stdin: read: %s", strerror(errno));
+				} else if (ret == 0) {
+					/* stop polling stdin at end of file */
+					input_eof = true;
 				} else {
-					proc.intr_mutex.lock();
 					for (ssize_t i = 0; i < ret; i++) {
 						queue.push_back(buf[i]);
 					}
-					proc.intr_cond.notify_one();
-					proc.intr_mutex.unlock();
+					proc.post_device_event(P::event_uart);
 				}
 			}
 		}
@@ -72,26 +121,33 @@ namespace riscv {
 		void mainloop()
 		{
 			block_signals();
-			open_pipe();
 			configure_console();
 			while (running) {
-				pollfds.resize(2);
+				pollfds.resize(3);
 				pollfds[0].fd = pipefds[0];
 				pollfds[0].events = POLLIN;
 				pollfds[0].revents = 0;
-				pollfds[1].fd = STDIN_FILENO;
+				pollfds[1].fd = input_ready() ? STDIN_FILENO : -1;
 				pollfds[1].events = POLLIN;
 				pollfds[1].revents = 0;
+				pollfds[2].fd = kickfds[0];
+				pollfds[2].events = POLLIN;
+				pollfds[2].revents = 0;
 				if (poll(pollfds.data(), pollfds.size(), -1) < 0 && errno != EINTR) {
 					panic("console poll failed: %s", strerror(errno));
 				}
 				process_output();
+				process_ring();
 				if (!running) break;
 				if (suspended) continue;
 				process_input();
 			}
+			/* write output that was pending when the thread was stopped */
+			process_output();
+			process_ring();
 			restore_console();
-			close_pipe();
+			close_pipe(pipefds);
+			close_pipe(kickfds);
 		}
 
 		void block_signals()
@@ -112,29 +168,29 @@ namespace riscv {
 			}
 		}
 
-		void open_pipe()
+		void open_pipe(int fds[2])
 		{
 			/* create socketpair */
-			if (pipe(pipefds) < 0) {
+			if (pipe(fds) < 0) {
 				panic("pipe failed: %s", strerror(errno));
 			}
-			if (fcntl(pipefds[0], F_SETFD, FD_CLOEXEC) < 0) {
+			if (fcntl(fds[0], F_SETFD, FD_CLOEXEC) < 0) {
 				panic("console fcntl(F_SETFD, FD_CLOEXEC) failed: %s", strerror(errno));
 			}
-			if (fcntl(pipefds[0], F_SETFL, O_NONBLOCK) < 0) {
+			if (fcntl(fds[0], F_SETFL, O_NONBLOCK) < 0) {
 				panic("console fcntl(F_SETFL, O_NONBLOCK) failed: %s", strerror(errno));
 			}
-			if (fcntl(pipefds[1], F_SETFD, FD_CLOEXEC) < 0) {
+			if (fcntl(fds[1], F_SETFD, FD_CLOEXEC) < 0) {
 				panic("console fcntl(F_SETFD, FD_CLOEXEC) failed: %s", strerror(errno));
 			}
-			if (fcntl(pipefds[1], F_SETFL, O_NONBLOCK) < 0) {
+			if (fcntl(fds[1], F_SETFL, O_NONBLOCK) < 0) {
 				panic("console fcntl(F_SETFL, O_NONBLOCK) failed: %s", strerror(errno));
 			}
 		}
 
-		void close_pipe() {
-			close(pipefds[0]);
-			close(pipefds[1]);
+		void close_pipe(int fds[2]) {
+			close(fds[0]);
+			close(fds[1]);
 		}
 
 		/* setup console */
@@ -167,18 +223,54 @@ namespace riscv {
 			suspended = false;
 		}
 
-		/* shutdown console thread */
+		/* start console thread */
+		void start()
+		{
+			/* pipes are created before the thread so kick and write_char can be used at once */
+			running = true;
+			input_eof = false;
+			open_pipe(pipefds);
+			open_pipe(kickfds);
+			thread = std::thread(&console_device::mainloop, this);
+		}
+
+		/* shutdown console thread (pending output is written before it exits) */
 		void shutdown()
 		{
-			/* set running flag to false and write a null byte to the FIFO */
+			if (!thread.joinable()) return;
+
+			/* set running flag to false and kick the console thread so it checks running and exits */
 			running = false;
+			kick();
+			/* wait for the console thread to finish */
+			thread.join();
+		}
+
+		/* attach or detach (nullptr) the bulk console ring */
+		void set_ring(console_ring *r)
+		{
+			{
+				std::lock_guard<std::mutex> lock(ring_mutex);
+				ring = r;
+			}
+			kick();
+		}
+
+		/* wake the console thread to service the ring */
+		void kick()
+		{
 			unsigned char c = 0;
-			/* wake up the console thread so it checks running and exits */
-			if (write(pipefds[1], &c, 1) < 0) {
+			if (write(kickfds[1], &c, 1) < 0 && errno != EAGAIN) {
 				debug("console: socket: write: %s", strerror(errno));
 			}
-			/* wait for the console thread to finish */
-			thread.join();
+		}
+
+		/* poll stdin unless it is at end of file or the active ring has no receive buffers */
+		bool input_ready()
+		{
+			if (input_eof) return false;
+			std::lock_guard<std::mutex> lock(ring_mutex);
+			return !ring || !ring->ring_active() || ring->ring_input_ready();
 		}
 
 		/* check if data is available */
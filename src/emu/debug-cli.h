@@ -32,6 +32,15 @@ namespace riscv {
 			debug_cli *cli;
 		};
 
+		/*
+		 * harts of a node share one CLI. one hart at a time holds the CLI
+		 * and the other harts are paused by debug_enter until it leaves.
+		 * commands inspect the selected hart while run steps the hart that
+		 * entered the CLI.
+		 */
+		std::vector<P*> harts;
+		std::mutex cli_mutex;
+
 		cmd_map map;
 		char line_buf[256];
 
@@ -56,6 +65,7 @@ namespace riscv {
 			add_command(cmd_dev,    1, 1, "dev",    "",                 "Show Devices");
 			add_command(cmd_disasm, 2, 2, "disasm", "<addr>",           "Disassemble Memory");
 			add_command(cmd_help,   1, 1, "help",   "",                 "Help");
+			add_command(cmd_hart,   1, 2, "hart",   "[<n>]",            "Select or list harts");
 			add_command(cmd_hex,    2, 3, "hex",    "<addr> [b|s|w|d]", "Hex Dump Memory");
 			add_command(cmd_ascii,  2, 2, "ascii",  "<addr>",           "ASCII Dump Memory");
 			add_command(cmd_break,  1, 2, "break",  "[<addr>]",         "Set or display breakpoint");
@@ -64,6 +74,7 @@ namespace riscv {
 			add_command(cmd_quit,   1, 1, "quit",   "",                 "End Simulation");
 			add_command(cmd_reg,    1, 1, "reg",    "",                 "Show Registers");
 			add_command(cmd_run,    1, 2, "run",    "[count]",          "Step processor");
+			add_command(cmd_snapshot, 2, 2, "snapshot", "<file>",       "Save machine snapshot");
 		}
 
 		void add_command(cmd_fn fn, size_t min_args, size_t max_args,
@@ -140,6 +151,27 @@ namespace riscv {
 			return 0;
 		}
 
+		static size_t cmd_hart(cmd_state &st, args_t &args)
+		{
+			auto &harts = st.cli->harts;
+			if (args.size() == 2) {
+				s64 hart_id;
+				if (!parse_integral(args[1], hart_id) ||
+					hart_id < 0 || size_t(hart_id) >= harts.size())
+				{
+					printf("%s: invalid hart: %s\n",
+						args[0].c_str(), args[1].c_str());
+					return 0;
+				}
+				st.proc = harts[hart_id];
+			}
+			for (auto hart : harts) {
+				printf("%c hart %-4zu pc 0x%s\n", hart == st.proc ? '*' : ' ',
+					size_t(hart->hart_id), format_addr(P::xlen, hart->pc).c_str());
+			}
+			return 0;
+		}
+
 		static size_t cmd_hex(cmd_state &st, args_t &args)
 		{
 			addr_t addr;
@@ -273,6 +305,15 @@ namespace riscv {
 			return 0;
 		}
 
+		static size_t cmd_snapshot(cmd_state &st, args_t &args)
+		{
+			if (!st.proc->save_snapshot(args[1])) {
+				printf("%s: unable to save snapshot: %s\n",
+					args[0].c_str(), args[1].c_str());
+			}
+			return 0;
+		}
+
 		static size_t cmd_hist(cmd_state &st, args_t &args)
 		{
 			bool hist_pc = (args[1] == "pc");
@@ -321,6 +362,8 @@ namespace riscv {
 			size_t inst_step;
 			char *buf;
 
+			std::lock_guard<std::mutex> lock(cli_mutex);
+			if (harts.empty()) harts.push_back(proc);
 			proc->debug_enter();
 			while ((buf = getline(proc)) != NULL) {
 				auto line = ltrim(rtrim(buf));
@@ -57,6 +57,19 @@ namespace riscv {
 			debug("cfg_mmio :ram_size         0x%llx", ram_size);
 		}
 
+		/* serialize device state */
+		template <typename S>
+		void snapshot(S &s)
+		{
+			s.io(num_harts);
+			s.io(time_base);
+			s.io(rom_base);
+			s.io(rom_size);
+			s.io(rom_entry);
+			s.io(ram_base);
+			s.io(ram_size);
+		}
+
 		/* Config MMIO */
 
 		buserror_t load_8 (UX va, u8  &val)
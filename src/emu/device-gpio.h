@@ -7,7 +7,13 @@
 
 namespace riscv {
 
-	/* GPIO MMIO device */
+	/*
+	 * GPIO MMIO device
+	 *
+	 * the registers are accessed by any hart and by the boot hart when
+	 * it services devices, so they are guarded by a mutex. poweroff and
+	 * reset longjmp to the step loop so they are triggered unlocked.
+	 */
 
 	template <typename P>
 	struct gpio_mmio_device : memory_segment<typename P::ux>
@@ -18,6 +24,7 @@ namespace riscv {
 		P &proc;
 		plic_mmio_device_ptr plic;
 		UX irq;
+		std::mutex gpio_mutex;
 
 		/* GPIO registers */
 
@@ -57,23 +64,34 @@ namespace riscv {
 
 		void print_registers()
 		{
+			std::lock_guard<std::mutex> lock(gpio_mutex);
 			debug("gpio_mmio:ie               0x%08x", gpio.ie);
 			debug("gpio_mmio:ip               0x%08x", gpio.ip);
 			debug("gpio_mmio:in               0x%08x", gpio.in);
 			debug("gpio_mmio:out              0x%08x", gpio.out);
 		}
 
+		/* serialize device state */
+		template <typename S>
+		void snapshot(S &s)
+		{
+			std::lock_guard<std::mutex> lock(gpio_mutex);
+			s.io(gpio);
+		}
+
 		void service()
 		{
+			std::lock_guard<std::mutex> lock(gpio_mutex);
 			plic->set_irq(irq, (gpio.ie & gpio.ip) ? 1 : 0);
 		}
 
-		void trigger()
+		void trigger(u32 out)
 		{
-			if (gpio.out & OUT_POWER_OFF) {
-				proc.raise(P::internal_cause_poweroff, proc.pc);
+			proc.post_device_event(P::event_gpio);
+			if (out & OUT_POWER_OFF) {
+				proc.poweroff();
 			}
-			if (gpio.out & OUT_RESET) {
+			if (out & OUT_RESET) {
 				proc.reset();
 			}
 		}
@@ -82,6 +100,7 @@ namespace riscv {
 
 		buserror_t load_8 (UX va, u8  &val)
 		{
+			std::lock_guard<std::mutex> lock(gpio_mutex);
 			val = (va < total_size) ? *(as_u8() + va) : 0;
 			if (proc.log & proc_log_mmio) {
 				printf("gpio_mmio:0x%04llx -> 0x%02hhx\n", addr_t(va), val);
@@ -91,6 +110,7 @@ namespace riscv {
 
 		buserror_t load_16(UX va, u16 &val)
 		{
+			std::lock_guard<std::mutex> lock(gpio_mutex);
 			val = (va < total_size - 1) ? *(as_u16() + (va>>1)) : 0;
 			if (proc.log & proc_log_mmio) {
 				printf("gpio_mmio:0x%04llx -> 0x%04hx\n", addr_t(va), val);
@@ -100,6 +120,7 @@ namespace riscv {
 
 		buserror_t load_32(UX va, u32 &val)
 		{
+			std::lock_guard<std::mutex> lock(gpio_mutex);
 			val = (va < total_size - 3) ? *(as_u32() + (va>>2)) : 0;
 			if (proc.log & proc_log_mmio) {
 				printf("gpio_mmio:0x%04llx -> 0x%08x\n", addr_t(va), val);
@@ -109,6 +130,7 @@ namespace riscv {
 
 		buserror_t load_64(UX va, u64 &val)
 		{
+			std::lock_guard<std::mutex> lock(gpio_mutex);
 			val = (va < total_size - 7) ? *(as_u64() + (va>>3)) : 0;
 			if (proc.log & proc_log_mmio) {
 				printf("gpio_mmio:0x%04llx -> 0x%016llx\n", addr_t(va), val);
@@ -121,8 +143,13 @@ namespace riscv {
 			if (proc.log & proc_log_mmio) {
 				printf("gpio_mmio:0x%04llx <- 0x%02hhx\n", addr_t(va), val);
 			}
-			if (va < total_size) *(as_u8() + va) = val;
-			trigger();
+			u32 out;
+			{
+				std::lock_guard<std::mutex> lock(gpio_mutex);
+				if (va < total_size) *(as_u8() + va) = val;
+				out = gpio.out;
+			}
+			trigger(out);
 			return 0;
 		}
 
@@ -131,8 +158,13 @@ namespace riscv {
 			if (proc.log & proc_log_mmio) {
 				printf("gpio_mmio:0x%04llx <- 0x%04hx\n", addr_t(va), val);
 			}
-			if (va < total_size - 1) *(as_u16() + (va>>1)) = val;
-			trigger();
+			u32 out;
+			{
+				std::lock_guard<std::mutex> lock(gpio_mutex);
+				if (va < total_size - 1) *(as_u16() + (va>>1)) = val;
+				out = gpio.out;
+			}
+			trigger(out);
 			return 0;
 		}
 
@@ -141,8 +173,13 @@ namespace riscv {
 			if (proc.log & proc_log_mmio) {
 				printf("gpio_mmio:0x%04llx <- 0x%08x\n", addr_t(va), val);
 			}
-			if (va < total_size - 3) *(as_u32() + (va>>2)) = val;
-			trigger();
+			u32 out;
+			{
+				std::lock_guard<std::mutex> lock(gpio_mutex);
+				if (va < total_size - 3) *(as_u32() + (va>>2)) = val;
+				out = gpio.out;
+			}
+			trigger(out);
 			return 0;
 		}
 
@@ -151,8 +188,13 @@ namespace riscv {
 			if (proc.log & proc_log_mmio) {
 				printf("gpio_mmio:0x%04llx <- 0x%016llx\n", addr_t(va), val);
 			}
-			if (va < total_size - 7) *(as_u64() + (va>>3)) = val;
-			trigger();
+			u32 out;
+			{
+				std::lock_guard<std::mutex> lock(gpio_mutex);
+				if (va < total_size - 7) *(as_u64() + (va>>3)) = val;
+				out = gpio.out;
+			}
+			trigger(out);
 			return 0;
 		}
 
@@ -16,7 +16,8 @@ namespace riscv {
 		typedef std::shared_ptr<console_device<P>> console_device_ptr;
 
 		enum {
-			total_size = sizeof(u64) * 2
+			total_size = sizeof(u64) * 2,
+			htif_dev_clone = 2
 		};
 
 		P &proc;
@@ -26,6 +27,9 @@ namespace riscv {
 		u64 htif_tohost;
 		u64 htif_fromhost;
 
+		/* clone request awaiting its reply */
+		bool clone_pending;
+
 		console_device_ptr console;
 
 		/* HTIF constructor */
@@ -36,6 +40,7 @@ namespace riscv {
 			proc(proc),
 			htif_tohost(0),
 			htif_fromhost(0),
+			clone_pending(false),
 			console(console)
 		{}
 
@@ -47,6 +52,14 @@ namespace riscv {
 			debug("htif_mmio:htif_fromhost    %llu", htif_fromhost);
 		}
 
+		/* serialize device state */
+		template <typename S>
+		void snapshot(S &s)
+		{
+			s.io(htif_tohost);
+			s.io(htif_fromhost);
+		}
+
 		inline u64 htif_device_command(u8 device, u8 command) {
 			return ((u64)device << 56) | ((u64)command << 48);
 		}
@@ -57,7 +70,7 @@ namespace riscv {
 		void handle_output()
 		{
 			if (htif_tohost == 1) {
-				proc.raise(P::internal_cause_poweroff, proc.pc);
+				proc.poweroff();
 			}
 			u8 device = htif_device(htif_tohost);
 			u8 command = htif_command(htif_tohost);
@@ -77,6 +90,20 @@ namespace riscv {
 						break;
 				}
 			}
+			else if (device == htif_dev_clone && command == 0) {
+				/* the reply is sent when the machine is cloned at the end of the step */
+				htif_tohost = 0;
+				clone_pending = true;
+				proc.request_clone();
+			}
+		}
+
+		/* reply to a clone request with the clone number (0 if not cloned) */
+		void clone_done(size_t n)
+		{
+			if (!clone_pending) return;
+			clone_pending = false;
+			htif_fromhost = htif_device_command(htif_dev_clone, 0) | n;
 		}
 
 		void handle_input()
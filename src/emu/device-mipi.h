@@ -7,24 +7,40 @@
 
 namespace riscv {
 
-	/* MIPI MMIO device */
-
-	template <typename P, const int NUM_HARTS = 4>
+	/*
+	 * MIPI MMIO device
+	 *
+	 * one IPI register per hart followed by one remote fence request
+	 * register per hart. a hart sends an IPI by writing a non-zero value
+	 * to the target's IPI register and the target clears it to acknowledge.
+	 * remote fences are requested by writing fence bits to the target's
+	 * fence register, which the target clears once it has fenced.
+	 */
+
+	template <typename P, const int NUM_HARTS = 8>
 	struct mipi_mmio_device : memory_segment<typename P::ux>
 	{
 		typedef typename P::ux UX;
 
 		enum {
-			bits_per_word = sizeof(u32) << 3,
 			num_harts = NUM_HARTS,
-			total_size = bits_per_word * num_harts
+			fence_offset = 0x80,
+			total_size = fence_offset << 1
+		};
+
+		enum : u32 {
+			fence_vm = 1,   /* flush the TLBs (sfence.vm) */
+			fence_i = 2     /* flush cached instructions (fence.i) */
 		};
 
+		static_assert(num_harts * sizeof(u32) <= fence_offset, "too many harts");
+
 		P &proc;
 
 		/* MIPI registers */
 
-		u32 hart[NUM_HARTS];
+		u32 hart[fence_offset / sizeof(u32)];
+		u32 fence[fence_offset / sizeof(u32)];
 
 		constexpr u8* as_u8() { return (u8*)&hart[0]; }
 		constexpr u16* as_u16() { return (u16*)&hart[0]; }
@@ -36,7 +52,7 @@ namespace riscv {
 		mipi_mmio_device(P &proc, UX mpa) :
 			memory_segment<UX>("IPI", mpa, /*uva*/0, /*size*/total_size,
 				pma_type_io | pma_prot_read | pma_prot_write), proc(proc),
-				hart{} {}
+				hart{}, fence{} {}
 
 		/* MIPI interface */
 
@@ -44,19 +60,37 @@ namespace riscv {
 		{
 			for (size_t i = 0; i < num_harts; i++) {
 				debug("mipi_mmio:hart[%04d]       0x%x", i, hart[i]);
+				debug("mipi_mmio:fence[%04d]      0x%x", i, fence[i]);
 			}
 		}
 
+		/* serialize device state */
+		template <typename S>
+		void snapshot(S &s)
+		{
+			s.io(hart);
+			s.io(fence);
+		}
+
 		void signal_ipi(UX hart_id, u32 value)
 		{
 			if (hart_id >= num_harts) return;
-			hart[num_harts] |= (1ULL << (hart_id & (bits_per_word-1)));
+			__atomic_store_n(&hart[hart_id], value, __ATOMIC_RELEASE);
+			proc.wake_harts();
 		}
 
 		bool ipi_pending(UX hart_id)
 		{
 			if (hart_id >= num_harts) return false;
-			return hart[hart_id] > 0;
+			return __atomic_load_n(&hart[hart_id], __ATOMIC_ACQUIRE) > 0;
+		}
+
+		/* return and acknowledge the fences requested for a hart */
+		u32 fence_pending(UX hart_id)
+		{
+			if (hart_id >= num_harts) return 0;
+			if (__atomic_load_n(&fence[hart_id], __ATOMIC_ACQUIRE) == 0) return 0;
+			return __atomic_exchange_n(&fence[hart_id], 0, __ATOMIC_ACQ_REL);
 		}
 
 		/* MIPI MMIO */
@@ -103,6 +137,7 @@ namespace riscv {
 				printf("mipi_mmio:0x%04llx <- 0x%02hhx\n", addr_t(va), val);
 			}
 			if (va < total_size) *(as_u8() + va) = val;
+			proc.wake_harts();
 			return 0;
 		}
 
@@ -112,6 +147,7 @@ namespace riscv {
 				printf("mipi_mmio:0x%04llx <- 0x%04hx\n", addr_t(va), val);
 			}
 			if (va < total_size - 1) *(as_u16() + (va>>1)) = val;
+			proc.wake_harts();
 			return 0;
 		}
 
@@ -121,6 +157,7 @@ namespace riscv {
 				printf("mipi_mmio:0x%04llx <- 0x%08x\n", addr_t(va), val);
 			}
 			if (va < total_size - 3) *(as_u32() + (va>>2)) = val;
+			proc.wake_harts();
 			return 0;
 		}
 
@@ -130,6 +167,7 @@ namespace riscv {
 				printf("mipi_mmio:0x%04llx <- 0x%016llx\n", addr_t(va), val);
 			}
 			if (va < total_size - 7) *(as_u64() + (va>>3)) = val;
+			proc.wake_harts();
 			return 0;
 		}
 
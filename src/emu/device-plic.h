@@ -7,7 +7,12 @@
 
 namespace riscv {
 
-	/* PLIC MMIO device */
+	/*
+	 * PLIC MMIO device
+	 *
+	 * interrupt lines are set by device service routines and claimed by
+	 * any hart, so the pending and served masks are guarded by a mutex.
+	 */
 
 	template <typename P, const int NUM_IRQS = 64>
 	struct plic_mmio_device : memory_segment<typename P::ux>
@@ -21,6 +26,8 @@ namespace riscv {
 		u32 pending;
 		u32 served;
 
+		std::mutex plic_mutex;
+
 		/* PLIC constructor */
 
 		plic_mmio_device(P &proc, UX mpa) :
@@ -34,12 +41,23 @@ namespace riscv {
 
 		void print_registers()
 		{
+			std::lock_guard<std::mutex> lock(plic_mutex);
 			debug("plic_mmio:pending          0x%016llx", pending);
 			debug("plic_mmio:served           0b%016llx", served);
 		}
 
+		/* serialize device state */
+		template <typename S>
+		void snapshot(S &s)
+		{
+			std::lock_guard<std::mutex> lock(plic_mutex);
+			s.io(pending);
+			s.io(served);
+		}
+
 		void set_irq(UX irq, int val)
 		{
+			std::lock_guard<std::mutex> lock(plic_mutex);
 			if (val) {
 				pending |= (1 << irq);
 			} else {
@@ -49,6 +67,7 @@ namespace riscv {
 
 		bool irq_pending()
 		{
+			std::lock_guard<std::mutex> lock(plic_mutex);
 			return (pending & ~served) > 0;
 		}
 
@@ -56,6 +75,7 @@ namespace riscv {
 
 		buserror_t load_32(UX va, u32 &val)
 		{
+			std::lock_guard<std::mutex> lock(plic_mutex);
 			if (va == 4) {
 				u32 mask = pending & ~served;
 				if (mask != 0) {
@@ -76,6 +96,7 @@ namespace riscv {
 
 		buserror_t load_64(UX va, u64 &val)
 		{
+			std::lock_guard<std::mutex> lock(plic_mutex);
 			if (va == 0) {
 				u32 mask = pending & ~served;
 				if (mask != 0) {
@@ -96,6 +117,7 @@ namespace riscv {
 
 		buserror_t store_32(UX va, u32 val)
 		{
+			std::lock_guard<std::mutex> lock(plic_mutex);
 			if (proc.log & proc_log_mmio) {
 				printf("plic_mmio:0x%04llx <- 0x%08x\n", addr_t(va), val);
 			}
@@ -110,6 +132,7 @@ namespace riscv {
 
 		buserror_t store_64(UX va, u64 val)
 		{
+			std::lock_guard<std::mutex> lock(plic_mutex);
 			if (proc.log & proc_log_mmio) {
 				printf("plic_mmio:0x%04llx <- 0x%016llx\n", addr_t(va), val);
 			}
@@ -40,6 +40,13 @@ namespace riscv {
 			debug("rtc_mmio:time              0x%llx", mtime);
 		}
 
+		/* serialize device state */
+		template <typename S>
+		void snapshot(S &s)
+		{
+			s.io(mtime);
+		}
+
 		void update_time(UX time)
 		{
 			mtime = time;
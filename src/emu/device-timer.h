@@ -9,15 +9,14 @@ namespace riscv {
 
 	/* Timer MMIO device */
 
-	template <typename P, const int NUM_HARTS = 4>
+	template <typename P, const int NUM_HARTS = 8>
 	struct timer_mmio_device : memory_segment<typename P::ux>
 	{
 		typedef typename P::ux UX;
 
 		enum {
-			bits_per_word = sizeof(u64) << 3,
 			num_harts = NUM_HARTS,
-			total_size = bits_per_word * num_harts
+			total_size = sizeof(u64) * num_harts
 		};
 
 		P &proc;
@@ -54,6 +53,23 @@ namespace riscv {
 			}
 		}
 
+		/* serialize device state */
+		template <typename S>
+		void snapshot(S &s)
+		{
+			s.io(timecmp);
+			s.io(claimed);
+		}
+
+		/* time the timer of a hart is next due or none if it has fired */
+		u64 deadline(UX hart_id)
+		{
+			if (hart_id >= num_harts || claimed[hart_id] > 0) {
+				return std::numeric_limits<u64>::max();
+			}
+			return timecmp[hart_id];
+		}
+
 		bool timer_pending(UX hart_id, u64 time)
 		{
 			if (hart_id >= num_harts || claimed[hart_id] > 0) return false;
@@ -111,6 +127,7 @@ namespace riscv {
 			if (va < total_size) {
 				*(as_u8() + va) = val;
 				claimed[va >> 3] = 0;
+				proc.wake_harts();
 			}
 			return 0;
 		}
@@ -123,6 +140,7 @@ namespace riscv {
 			if (va < total_size - 1) {
 				*(as_u16() + (va>>1)) = val;
 				claimed[va >> 3] = 0;
+				proc.wake_harts();
 			}
 			return 0;
 		}
@@ -135,6 +153,7 @@ namespace riscv {
 			if (va < total_size - 3) {
 				*(as_u32() + (va>>2)) = val;
 				claimed[va >> 3] = 0;
+				proc.wake_harts();
 			}
 			return 0;
 		}
@@ -147,6 +166,7 @@ namespace riscv {
 			if (va < total_size - 7) {
 				*(as_u64() + (va>>3)) = val;
 				claimed[va >> 3] = 0;
+				proc.wake_harts();
 			}
 			return 0;
 		}
@@ -7,7 +7,13 @@
 
 namespace riscv {
 
-	/* UART MMIO device */
+	/*
+	 * UART MMIO device
+	 *
+	 * the registers are accessed by any hart and by the boot hart when
+	 * it services devices, so they are guarded by a mutex. the PLIC is
+	 * only locked with the UART mutex held, never the other way round.
+	 */
 
 	template <typename P>
 	struct uart_mmio_device : memory_segment<typename P::ux>
@@ -20,6 +26,7 @@ namespace riscv {
 		plic_mmio_device_ptr plic;
 		UX irq;
 		console_device_ptr console;
+		std::mutex uart_mutex;
 
 		/*
 		 * UART Registers
@@ -135,11 +142,13 @@ namespace riscv {
 
 		void service()
 		{
+			std::lock_guard<std::mutex> lock(uart_mutex);
 			plic->set_irq(irq, ((com.ier & IER_ERBDA) && console->has_char()) ? 1 : 0);
 		}
 
 		void print_registers()
 		{
+			std::lock_guard<std::mutex> lock(uart_mutex);
 			debug("uart_mmio:rbr              %d", com.rbr);
 			debug("uart_mmio:thr              %d", com.thr);
 			debug("uart_mmio:ier              %d", com.ier);
@@ -154,10 +163,19 @@ namespace riscv {
 			debug("uart_mmio:dlm              %d", com.dlm);
 		}
 
+		/* serialize device state */
+		template <typename S>
+		void snapshot(S &s)
+		{
+			std::lock_guard<std::mutex> lock(uart_mutex);
+			s.io(com);
+		}
+
 		/* UART MMIO interface */
 
 		buserror_t load_8 (UX va, u8  &val)
 		{
+			std::lock_guard<std::mutex> lock(uart_mutex);
 			if (com.lcr & LCR_DLAB) {
 				switch (va) {
 				case REG_DLL: /* Divisor Latch LSB */
@@ -180,6 +198,7 @@ namespace riscv {
 				case REG_RBR: /* Recieve Buffer Register */
 					if (console->has_char()) com.rbr = console->read_char();
 					val = com.rbr;
+					proc.post_device_event(P::event_uart);
 					break;
 				case REG_IER: /* Interrupt Enable Register */
 					val = com.ier;
@@ -214,6 +233,7 @@ namespace riscv {
 
 		buserror_t store_8 (UX va, u8  val)
 		{
+			std::lock_guard<std::mutex> lock(uart_mutex);
 			if (proc.log & proc_log_mmio) {
 				printf("uart_mmio:0x%04llx <- 0x%hhx\n", addr_t(va), val);
 			}
@@ -241,7 +261,11 @@ namespace riscv {
 					console->write_char(val);
 					break;
 				case REG_IER: /* Interrupt Enable Register */
-					com.ier = val & IER_MASK;
+					/* only rescan interrupts when the enables change */
+					if (com.ier != (val & IER_MASK)) {
+						com.ier = val & IER_MASK;
+						proc.post_device_event(P::event_uart);
+					}
 					break;
 				case REG_FCR: /* FIFO Control Register */
 					/* ignore writes */
@@ -0,0 +1,938 @@
+//
+//  device-virtio-9p.h
+//
+
+#ifndef rv_device_virtio_9p_h
+#define rv_device_virtio_9p_h
+
+namespace riscv {
+
+	/*
+	 * virtio 9P device
+	 *
+	 * exports a host directory to the guest using the 9P2000.L protocol.
+	 * notifications wake a host worker thread which serves each batch of
+	 * requests with the host calls wrapped by the proxy ABI. file data is
+	 * transferred with preadv and pwritev directly between the file and
+	 * the guest buffers. paths are resolved one component at a time
+	 * beneath the exported directory with O_NOFOLLOW, so the host never
+	 * follows a symbolic link; the guest resolves them with TREADLINK.
+	 *
+	 * Reference: https://github.com/chaos/diod/blob/master/protocol.md
+	 */
+
+	template <typename P>
+	struct virtio_9p_mmio_device : virtio_mmio_device<P>
+	{
+		typedef typename P::ux UX;
+		typedef virtio_mmio_device<P> virtio;
+		typedef typename virtio::virtio_buffer virtio_buffer;
+		typedef std::shared_ptr<plic_mmio_device<P>> plic_mmio_device_ptr;
+
+		enum : u32 {
+			VIRTIO_ID_9P         = 9,
+			VIRTIO_9P_MOUNT_TAG  = 1 << 0,
+
+			P9_RLERROR           = 7,
+			P9_TSTATFS           = 8,
+			P9_TLOPEN            = 12,
+			P9_TLCREATE          = 14,
+			P9_TSYMLINK          = 16,
+			P9_TRENAME           = 20,
+			P9_TREADLINK         = 22,
+			P9_TGETATTR          = 24,
+			P9_TSETATTR          = 26,
+			P9_TXATTRWALK        = 30,
+			P9_TREADDIR          = 40,
+			P9_TFSYNC            = 50,
+			P9_TLOCK             = 52,
+			P9_TGETLOCK          = 54,
+			P9_TLINK             = 70,
+			P9_TMKDIR            = 72,
+			P9_TRENAMEAT         = 74,
+			P9_TUNLINKAT         = 76,
+			P9_TVERSION          = 100,
+			P9_TATTACH           = 104,
+			P9_TFLUSH            = 108,
+			P9_TWALK             = 110,
+			P9_TREAD             = 116,
+			P9_TWRITE            = 118,
+			P9_TCLUNK            = 120,
+			P9_TREMOVE           = 122,
+
+			P9_QTDIR             = 0x80,
+			P9_QTSYMLINK         = 0x02,
+			P9_QTFILE            = 0x00,
+
+			P9_GETATTR_BASIC     = 0x7ff,
+
+			P9_SETATTR_MODE      = 1 << 0,
+			P9_SETATTR_UID       = 1 << 1,
+			P9_SETATTR_GID       = 1 << 2,
+			P9_SETATTR_SIZE      = 1 << 3,
+			P9_SETATTR_ATIME     = 1 << 4,
+			P9_SETATTR_MTIME     = 1 << 5,
+			P9_SETATTR_ATIME_SET = 1 << 7,
+			P9_SETATTR_MTIME_SET = 1 << 8,
+
+			P9_LOCK_SUCCESS      = 0,
+			P9_LOCK_TYPE_UNLCK   = 2,
+
+			P9_DOTL_AT_REMOVEDIR = 0x200,
+			P9_STATFS_MAGIC      = 0x01021997,
+			P9_MAXWELEM          = 16,
+
+			p9_hdr_size          = 7,
+			p9_read_hdr_size     = 11,
+			p9_write_hdr_size    = 23,
+			p9_msize_max         = 1 << 19,
+			mount_tag_max        = 32
+		};
+
+		/* 9P message decoder (fields are little endian) */
+
+		struct p9_reader {
+			const u8 *p, *end;
+			bool ok;
+
+			p9_reader(const u8 *p, const u8 *end) : p(p), end(end), ok(true) {}
+
+			template <typename T> T get()
+			{
+				T val = 0;
+				if (size_t(end - p) < sizeof(T)) { ok = false; return val; }
+				memcpy(&val, p, sizeof(T));
+				p += sizeof(T);
+				return val;
+			}
+
+			u8 u8_() { return get<u8>(); }
+			u16 u16_() { return get<u16>(); }
+			u32 u32_() { return get<u32>(); }
+			u64 u64_() { return get<u64>(); }
+
+			std::string str()
+			{
+				u16 len = u16_();
+				if (size_t(end - p) < len) { ok = false; return std::string(); }
+				std::string s((const char*)p, len);
+				p += len;
+				return s;
+			}
+		};
+
+		struct p9_fid {
+			std::string path;
+			int fd;
+			DIR *dir;
+		};
+
+		struct p9_request {
+			u16 head;
+			u32 len;
+			std::vector<virtio_buffer> bufs;
+		};
+
+		struct {
+			u16 tag_len;
+			char tag[mount_tag_max];
+		} p9_config;
+
+		std::string root_dir;
+		int root_fd;
+		u32 msize;
+		std::map<u32,p9_fid> fids;
+		std::vector<u8> req;
+		std::vector<u8> resp;
+		std::vector<struct iovec> iov;
+		std::vector<virtio_buffer> bufs;
+
+		/* reset generation, to drop requests and fids of a previous driver */
+		u64 reset_count;
+		u64 fid_reset_count;
+
+		std::mutex worker_mutex;
+		std::condition_variable worker_cond;
+		bool worker_pending;
+		bool worker_running;
+		std::thread worker;
+
+		/* virtio 9P constructor */
+
+		virtio_9p_mmio_device(P &proc, UX mpa, plic_mmio_device_ptr plic, UX irq,
+				std::string root_dir, std::string mount_tag) :
+			virtio(proc, "VIRTIO-9P", mpa, plic, irq, P::event_virtio_9p, VIRTIO_ID_9P,
+				VIRTIO_9P_MOUNT_TAG, /*num_queues*/1),
+			p9_config{},
+			root_dir(root_dir),
+			root_fd(-1),
+			msize(p9_msize_max),
+			reset_count(0),
+			fid_reset_count(0),
+			worker_pending(false),
+			worker_running(true)
+		{
+			root_fd = open(root_dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+			if (root_fd < 0) {
+				panic("virtio-9p: error: open: %s: %s", root_dir.c_str(), strerror(errno));
+			}
+			p9_config.tag_len = u16(std::min(mount_tag.size(), size_t(mount_tag_max)));
+			memcpy(p9_config.tag, mount_tag.data(), p9_config.tag_len);
+			worker = std::thread(&virtio_9p_mmio_device::mainloop, this);
+		}
+
+		~virtio_9p_mmio_device()
+		{
+			{
+				std::lock_guard<std::mutex> lock(worker_mutex);
+				worker_running = false;
+			}
+			worker_cond.notify_one();
+			worker.join();
+			clunk_all();
+			close(root_fd);
+		}
+
+		u8* config_space() { return (u8*)&p9_config; }
+		size_t config_size() { return sizeof(p9_config.tag_len) + p9_config.tag_len; }
+
+		void device_reset() { reset_count++; }
+
+		/* requests are served on the worker thread */
+		void queue_notify(u32 queue)
+		{
+			{
+				std::lock_guard<std::mutex> lock(worker_mutex);
+				worker_pending = true;
+			}
+			worker_cond.notify_one();
+		}
+
+		void mainloop()
+		{
+			for (;;) {
+				{
+					std::unique_lock<std::mutex> lock(worker_mutex);
+					worker_cond.wait(lock, [&] { return worker_pending || !worker_running; });
+					if (!worker_running) break;
+					worker_pending = false;
+				}
+				while (service_requests());
+			}
+		}
+
+		/* serve all available requests and complete them as one batch */
+		bool service_requests()
+		{
+			std::vector<p9_request> batch;
+			u64 batch_reset_count;
+			{
+				std::lock_guard<std::mutex> lock(virtio::virtio_mutex);
+				auto &q = virtio::queues[0];
+				if (!(virtio::status & virtio::STATUS_DRIVER_OK) || !q.ready) return false;
+				u16 head;
+				while (virtio::queue_pop(q, head, bufs)) {
+					batch.push_back(p9_request{ head, 0, bufs });
+				}
+				batch_reset_count = reset_count;
+			}
+			if (batch.size() == 0) return false;
+			if (fid_reset_count != batch_reset_count) {
+				clunk_all();
+				fid_reset_count = batch_reset_count;
+			}
+			for (auto &r : batch) {
+				r.len = request(r.bufs);
+			}
+			std::lock_guard<std::mutex> lock(virtio::virtio_mutex);
+			if (reset_count != batch_reset_count) return true;
+			auto &q = virtio::queues[0];
+			u16 used_idx = virtio::queue_used_idx(q);
+			for (auto &r : batch) {
+				virtio::queue_push(q, used_idx, r.head, r.len);
+			}
+			virtio::queue_publish(q, used_idx);
+			return true;
+		}
+
+		/* descriptor chain byte streams */
+
+		/* iovecs covering a range of the readable or writable buffers of a chain */
+		static size_t stream_iov(std::vector<virtio_buffer> &bufs, bool write,
+			size_t offset, size_t len, std::vector<struct iovec> &iov)
+		{
+			size_t total = 0;
+			iov.clear();
+			for (auto &buf : bufs) {
+				if (buf.write != write) continue;
+				if (offset >= buf.len) {
+					offset -= buf.len;
+					continue;
+				}
+				size_t n = std::min(size_t(buf.len) - offset, len - total);
+				if (n == 0) break;
+				iov.push_back(iovec{ buf.addr + offset, n });
+				total += n;
+				offset = 0;
+			}
+			return total;
+		}
+
+		size_t stream_read(std::vector<virtio_buffer> &bufs, size_t offset, u8 *data, size_t len)
+		{
+			size_t total = stream_iov(bufs, false, offset, len, iov);
+			for (auto &v : iov) {
+				memcpy(data, v.iov_base, v.iov_len);
+				data += v.iov_len;
+			}
+			return total;
+		}
+
+		size_t stream_write(std::vector<virtio_buffer> &bufs, size_t offset, const u8 *data, size_t len)
+		{
+			size_t total = stream_iov(bufs, true, offset, len, iov);
+			for (auto &v : iov) {
+				memcpy(v.iov_base, data, v.iov_len);
+				data += v.iov_len;
+			}
+			return total;
+		}
+
+		/* 9P message encoder */
+
+		template <typename T> void put(T val)
+		{
+			size_t off = resp.size();
+			resp.resize(off + sizeof(T));
+			memcpy(resp.data() + off, &val, sizeof(T));
+		}
+
+		void put_str(const std::string &s)
+		{
+			put(u16(s.size()));
+			resp.insert(resp.end(), s.begin(), s.end());
+		}
+
+		void put_qid(struct stat &st)
+		{
+			put(u8(S_ISDIR(st.st_mode) ? P9_QTDIR : S_ISLNK(st.st_mode) ? P9_QTSYMLINK : P9_QTFILE));
+			put(u32(0));
+			put(u64(st.st_ino));
+		}
+
+		void put_header(u32 size, u8 type, u16 tag)
+		{
+			memcpy(resp.data(), &size, sizeof(size));
+			resp[4] = type;
+			memcpy(resp.data() + 5, &tag, sizeof(tag));
+		}
+
+		/* paths and fids */
+
+		static int host_error() { return -cvt_error(-1); }
+
+		static bool valid_name(const std::string &name)
+		{
+			return name.size() > 0 && name != "." && name != ".." &&
+				name.find('/') == std::string::npos && name.find('\0') == std::string::npos;
+		}
+
+		static std::string join(const std::string &dir, const std::string &name)
+		{
+			return dir.empty() ? name : dir + "/" + name;
+		}
+
+		/* directory holding the last component of a path, and that component */
+		struct p9_at
+		{
+			int fd;
+			std::string name;
+
+			p9_at() : fd(-1) {}
+			p9_at(const p9_at&) = delete;
+			p9_at& operator=(const p9_at&) = delete;
+			~p9_at() { if (fd >= 0) close(fd); }
+
+			const char* c_str() const { return name.c_str(); }
+		};
+
+		/*
+		 * open each directory in the path with O_NOFOLLOW and return the
+		 * last one with the final component, which the caller passes to
+		 * the *at call with AT_SYMLINK_NOFOLLOW or O_NOFOLLOW. fid paths
+		 * only hold names accepted by valid_name so they cannot use "..".
+		 */
+		int resolve(const std::string &path, p9_at &at)
+		{
+			#if defined (O_PATH)
+			const int dir_flags = O_PATH | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC;
+			#else
+			const int dir_flags = O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC;
+			#endif
+			at.fd = openat(root_fd, ".", dir_flags);
+			if (at.fd < 0) return host_error();
+			size_t start = 0, slash;
+			while ((slash = path.find('/', start)) != std::string::npos) {
+				int fd = openat(at.fd, path.substr(start, slash - start).c_str(), dir_flags);
+				if (fd < 0) return host_error();
+				close(at.fd);
+				at.fd = fd;
+				start = slash + 1;
+			}
+			at.name = path.empty() ? "." : path.substr(start);
+			return 0;
+		}
+
+		int stat_path(const std::string &path, struct stat &st)
+		{
+			p9_at at;
+			int err = resolve(path, at);
+			if (err) return err;
+			return fstatat(at.fd, at.c_str(), &st, AT_SYMLINK_NOFOLLOW) < 0 ? host_error() : 0;
+		}
+
+		p9_fid* lookup(u32 fid)
+		{
+			auto fi = fids.find(fid);
+			return fi == fids.end() ? nullptr : &fi->second;
+		}
+
+		int stat_fid(p9_fid *f, struct stat &st)
+		{
+			if (f->fd < 0) return stat_path(f->path, st);
+			return fstat(f->fd, &st) < 0 ? host_error() : 0;
+		}
+
+		void clunk(p9_fid &f)
+		{
+			if (f.dir) closedir(f.dir);
+			else if (f.fd >= 0) close(f.fd);
+			f.dir = nullptr;
+			f.fd = -1;
+		}
+
+		void clunk_all()
+		{
+			for (auto &fi : fids) clunk(fi.second);
+			fids.clear();
+		}
+
+		/* process one request and return the number of bytes written to the chain */
+		u32 request(std::vector<virtio_buffer> &bufs)
+		{
+			u8 hdr[p9_hdr_size];
+			if (stream_read(bufs, 0, hdr, p9_hdr_size) < p9_hdr_size) return 0;
+			u32 size;
+			memcpy(&size, hdr, sizeof(size));
+			u8 type = hdr[4];
+			u16 tag;
+			memcpy(&tag, hdr + 5, sizeof(tag));
+			if (size < p9_hdr_size || size > msize) return 0;
+
+			/* write payloads are not copied, they are written from the chain */
+			req.resize(type == P9_TWRITE ? std::min(size, u32(p9_write_hdr_size)) : size);
+			if (stream_read(bufs, 0, req.data(), req.size()) < req.size()) return 0;
+			p9_reader r(req.data() + p9_hdr_size, req.data() + req.size());
+
+			if (type == P9_TREAD) return p9_read(r, tag, bufs);
+
+			resp.resize(p9_hdr_size);
+			int err;
+			switch (type) {
+				case P9_TVERSION:   err = p9_version(r); break;
+				case P9_TATTACH:    err = p9_attach(r); break;
+				case P9_TWALK:      err = p9_walk(r); break;
+				case P9_TLOPEN:     err = p9_lopen(r); break;
+				case P9_TLCREATE:   err = p9_lcreate(r); break;
+				case P9_TWRITE:     err = p9_write(r, bufs); break;
+				case P9_TCLUNK:     err = p9_clunk(r); break;
+				case P9_TREMOVE:    err = p9_remove(r); break;
+				case P9_TGETATTR:   err = p9_getattr(r); break;
+				case P9_TSETATTR:   err = p9_setattr(r); break;
+				case P9_TREADDIR:   err = p9_readdir(r); break;
+				case P9_TSTATFS:    err = p9_statfs(r); break;
+				case P9_TMKDIR:     err = p9_mkdir(r); break;
+				case P9_TSYMLINK:   err = p9_symlink(r); break;
+				case P9_TREADLINK:  err = p9_readlink(r); break;
+				case P9_TLINK:      err = p9_link(r); break;
+				case P9_TRENAME:    err = p9_rename(r); break;
+				case P9_TRENAMEAT:  err = p9_renameat(r); break;
+				case P9_TUNLINKAT:  err = p9_unlinkat(r); break;
+				case P9_TFSYNC:     err = p9_fsync(r); break;
+				case P9_TLOCK:      err = p9_lock(r); break;
+				case P9_TGETLOCK:   err = p9_getlock(r); break;
+				case P9_TFLUSH:     err = 0; break;
+				default:            err = abi_errno_EOPNOTSUPP; break;
+			}
+			if (err == 0 && !r.ok) err = abi_errno_EINVAL;
+			u8 rtype = type + 1;
+			if (err) {
+				resp.resize(p9_hdr_size);
+				put(u32(err));
+				rtype = P9_RLERROR;
+			}
+			put_header(u32(resp.size()), rtype, tag);
+			return u32(stream_write(bufs, 0, resp.data(), resp.size()));
+		}
+
+		/* 9P2000.L operations, returning a Linux errno on failure */
+
+		int p9_version(p9_reader &r)
+		{
+			u32 client_msize = r.u32_();
+			std::string version = r.str();
+			if (client_msize < 4096) return abi_errno_EINVAL;
+			msize = std::min(client_msize, u32(p9_msize_max));
+			clunk_all();
+			put(msize);
+			put_str(version == "9P2000.L" ? version : "unknown");
+			return 0;
+		}
+
+		int p9_attach(p9_reader &r)
+		{
+			u32 fid = r.u32_();
+			r.u32_(); r.str(); r.str(); r.u32_(); /* afid, uname, aname, n_uname */
+			struct stat st;
+			if (fstat(root_fd, &st) < 0) return host_error();
+			if (lookup(fid)) clunk(fids[fid]);
+			fids[fid] = p9_fid{ "", -1, nullptr };
+			put_qid(st);
+			return 0;
+		}
+
+		int p9_walk(p9_reader &r)
+		{
+			u32 fid = r.u32_(), newfid = r.u32_();
+			u16 nwname = r.u16_();
+			p9_fid *f = lookup(fid);
+			if (!f) return abi_errno_EBADF;
+			if (newfid != fid && lookup(newfid)) return abi_errno_EBADF;
+			if (nwname > P9_MAXWELEM) return abi_errno_EINVAL;
+			std::string path = f->path;
+			std::vector<struct stat> qids;
+			for (u16 i = 0; i < nwname; i++) {
+				std::string name = r.str();
+				if (!r.ok) return abi_errno_EINVAL;
+				if (name == "..") {
+					size_t slash = path.rfind('/');
+					path = slash == std::string::npos ? "" : path.substr(0, slash);
+				} else if (name != ".") {
+					if (!valid_name(name)) return abi_errno_ENOENT;
+					path = join(path, name);
+				}
+				struct stat st;
+				int err = stat_path(path, st);
+				if (err) {
+					if (i == 0) return err;
+					break;
+				}
+				qids.push_back(st);
+			}
+			if (qids.size() == nwname) {
+				if (newfid == fid) clunk(*f);
+				fids[newfid] = p9_fid{ path, -1, nullptr };
+			}
+			put(u16(qids.size()));
+			for (auto &st : qids) put_qid(st);
+			return 0;
+		}
+
+		int p9_lopen(p9_reader &r)
+		{
+			u32 fid = r.u32_(), flags = r.u32_();
+			p9_fid *f = lookup(fid);
+			if (!f || f->fd >= 0) return abi_errno_EBADF;
+			struct stat st;
+			int err = stat_fid(f, st);
+			if (err) return err;
+			int hostflags = S_ISDIR(st.st_mode) ? O_RDONLY | O_DIRECTORY :
+				cvt_open_flags(flags) & ~(O_CREAT | O_EXCL);
+			p9_at at;
+			err = resolve(f->path, at);
+			if (err) return err;
+			f->fd = openat(at.fd, at.c_str(), hostflags | O_NOFOLLOW | O_CLOEXEC);
+			if (f->fd < 0) return host_error();
+			put_qid(st);
+			put(u32(0)); /* iounit */
+			return 0;
+		}
+
+		int p9_lcreate(p9_reader &r)
+		{
+			u32 fid = r.u32_();
+			std::string name = r.str();
+			u32 flags = r.u32_(), mode = r.u32_();
+			r.u32_(); /* gid */
+			p9_fid *f = lookup(fid);
+			if (!f || f->fd >= 0) return abi_errno_EBADF;
+			if (!valid_name(name)) return abi_errno_EINVAL;
+			std::string path = join(f->path, name);
+			p9_at at;
+			int err = resolve(path, at);
+			if (err) return err;
+			int fd = openat(at.fd, at.c_str(), cvt_open_flags(flags) | O_CREAT | O_NOFOLLOW | O_CLOEXEC, mode & 07777);
+			if (fd < 0) return host_error();
+			struct stat st;
+			if (fstat(fd, &st) < 0) {
+				err = host_error();
+				close(fd);
+				return err;
+			}
+			f->path = path;
+			f->fd = fd;
+			put_qid(st);
+			put(u32(0)); /* iounit */
+			return 0;
+		}
+
+		u32 p9_read(p9_reader &r, u16 tag, std::vector<virtio_buffer> &bufs)
+		{
+			u32 fid = r.u32_();
+			u64 offset = r.u64_();
+			u32 count = std::min(r.u32_(), msize - p9_read_hdr_size);
+			p9_fid *f = lookup(fid);
+			int err = !r.ok ? abi_errno_EINVAL : !f || f->fd < 0 ? abi_errno_EBADF : 0;
+			ssize_t ret = 0;
+			if (!err) {
+				stream_iov(bufs, true, p9_read_hdr_size, count, iov);
+				ret = preadv(f->fd, iov.data(), int(std::min(iov.size(), size_t(IOV_MAX))), off_t(offset));
+				if (ret < 0) err = host_error();
+			}
+			resp.resize(p9_hdr_size);
+			if (err) {
+				put(u32(err));
+				put_header(u32(resp.size()), P9_RLERROR, tag);
+				return u32(stream_write(bufs, 0, resp.data(), resp.size()));
+			}
+			put(u32(ret));
+			put_header(u32(resp.size() + ret), P9_TREAD + 1, tag);
+			return u32(stream_write(bufs, 0, resp.data(), resp.size()) + ret);
+		}
+
+		int p9_write(p9_reader &r, std::vector<virtio_buffer> &bufs)
+		{
+			u32 fid = r.u32_();
+			u64 offset = r.u64_();
+			u32 count = r.u32_();
+			if (!r.ok) return abi_errno_EINVAL;
+			p9_fid *f = lookup(fid);
+			if (!f || f->fd < 0) return abi_errno_EBADF;
+			if (stream_iov(bufs, false, p9_write_hdr_size, count, iov) < count) return abi_errno_EINVAL;
+			ssize_t ret = pwritev(f->fd, iov.data(), int(std::min(iov.size(), size_t(IOV_MAX))), off_t(offset));
+			if (ret < 0) return host_error();
+			put(u32(ret));
+			return 0;
+		}
+
+		int p9_clunk(p9_reader &r)
+		{
+			u32 fid = r.u32_();
+			p9_fid *f = lookup(fid);
+			if (!f) return abi_errno_EBADF;
+			clunk(*f);
+			fids.erase(fid);
+			return 0;
+		}
+
+		int p9_remove(p9_reader &r)
+		{
+			u32 fid = r.u32_();
+			p9_fid *f = lookup(fid);
+			if (!f) return abi_errno_EBADF;
+			struct stat st;
+			p9_at at;
+			int err = stat_fid(f, st);
+			if (!err) err = resolve(f->path, at);
+			if (!err && unlinkat(at.fd, at.c_str(), S_ISDIR(st.st_mode) ? AT_REMOVEDIR : 0) < 0) {
+				err = host_error();
+			}
+			clunk(*f);
+			fids.erase(fid);
+			return err;
+		}
+
+		int p9_getattr(p9_reader &r)
+		{
+			u32 fid = r.u32_();
+			r.u64_(); /* request_mask */
+			p9_fid *f = lookup(fid);
+			if (!f) return abi_errno_EBADF;
+			struct stat st;
+			int err = stat_fid(f, st);
+			if (err) return err;
+			put(u64(P9_GETATTR_BASIC));
+			put_qid(st);
+			put(u32(st.st_mode));
+			put(u32(st.st_uid));
+			put(u32(st.st_gid));
+			put(u64(st.st_nlink));
+			put(u64(st.st_rdev));
+			put(u64(st.st_size));
+			put(u64(st.st_blksize));
+			put(u64(st.st_blocks));
+			put(u64(st.st_atim.tv_sec));
+			put(u64(st.st_atim.tv_nsec));
+			put(u64(st.st_mtim.tv_sec));
+			put(u64(st.st_mtim.tv_nsec));
+			put(u64(st.st_ctim.tv_sec));
+			put(u64(st.st_ctim.tv_nsec));
+			put(u64(0)); put(u64(0)); /* btime */
+			put(u64(0)); put(u64(0)); /* gen, data_version */
+			return 0;
+		}
+
+		int p9_setattr(p9_reader &r)
+		{
+			u32 fid = r.u32_(), valid = r.u32_(), mode = r.u32_(), uid = r.u32_(), gid = r.u32_();
+			u64 size = r.u64_();
+			struct timespec ts[2];
+			ts[0].tv_sec = time_t(r.u64_());
+			ts[0].tv_nsec = long(r.u64_());
+			ts[1].tv_sec = time_t(r.u64_());
+			ts[1].tv_nsec = long(r.u64_());
+			if (!r.ok) return abi_errno_EINVAL;
+			p9_fid *f = lookup(fid);
+			if (!f) return abi_errno_EBADF;
+			p9_at at;
+			int err = resolve(f->path, at);
+			if (err) return err;
+			if ((valid & P9_SETATTR_MODE) && fchmodat(at.fd, at.c_str(), mode & 07777, AT_SYMLINK_NOFOLLOW) < 0) {
+				return host_error();
+			}
+			if ((valid & (P9_SETATTR_UID | P9_SETATTR_GID)) &&
+				fchownat(at.fd, at.c_str(), valid & P9_SETATTR_UID ? uid_t(uid) : uid_t(-1),
+					valid & P9_SETATTR_GID ? gid_t(gid) : gid_t(-1), AT_SYMLINK_NOFOLLOW) < 0) {
+				return host_error();
+			}
+			if (valid & P9_SETATTR_SIZE) {
+				int fd = openat(at.fd, at.c_str(), O_WRONLY | O_NOFOLLOW | O_CLOEXEC);
+				if (fd < 0) return host_error();
+				int ret = ftruncate(fd, off_t(size));
+				err = ret < 0 ? host_error() : 0;
+				close(fd);
+				if (err) return err;
+			}
+			if (valid & (P9_SETATTR_ATIME | P9_SETATTR_MTIME)) {
+				if (!(valid & P9_SETATTR_ATIME)) ts[0].tv_nsec = UTIME_OMIT;
+				else if (!(valid & P9_SETATTR_ATIME_SET)) ts[0].tv_nsec = UTIME_NOW;
+				if (!(valid & P9_SETATTR_MTIME)) ts[1].tv_nsec = UTIME_OMIT;
+				else if (!(valid & P9_SETATTR_MTIME_SET)) ts[1].tv_nsec = UTIME_NOW;
+				if (utimensat(at.fd, at.c_str(), ts, AT_SYMLINK_NOFOLLOW) < 0) return host_error();
+			}
+			return 0;
+		}
+
+		int p9_readdir(p9_reader &r)
+		{
+			u32 fid = r.u32_();
+			u64 offset = r.u64_();
+			u32 count = std::min(r.u32_(), msize - p9_read_hdr_size);
+			p9_fid *f = lookup(fid);
+			if (!f || f->fd < 0) return abi_errno_EBADF;
+			if (!f->dir) {
+				if (!(f->dir = fdopendir(f->fd))) return host_error();
+			}
+			if (offset == 0) rewinddir(f->dir);
+			else seekdir(f->dir, long(offset));
+			put(u32(0));
+			size_t start = resp.size();
+			for (;;) {
+				long pos = telldir(f->dir);
+				struct dirent *ent = readdir(f->dir);
+				if (!ent) break;
+				size_t namelen = strlen(ent->d_name);
+				if (resp.size() - start + 13 + 8 + 1 + 2 + namelen > count) {
+					seekdir(f->dir, pos);
+					break;
+				}
+				put(u8(ent->d_type == DT_DIR ? P9_QTDIR : ent->d_type == DT_LNK ? P9_QTSYMLINK : P9_QTFILE));
+				put(u32(0));
+				put(u64(ent->d_ino));
+				put(u64(telldir(f->dir)));
+				put(u8(ent->d_type));
+				put_str(std::string(ent->d_name, namelen));
+			}
+			u32 len = u32(resp.size() - start);
+			memcpy(resp.data() + start - sizeof(len), &len, sizeof(len));
+			return 0;
+		}
+
+		int p9_statfs(p9_reader &r)
+		{
+			u32 fid = r.u32_();
+			if (!lookup(fid)) return abi_errno_EBADF;
+			struct statvfs sv;
+			if (fstatvfs(root_fd, &sv) < 0) return host_error();
+			put(u32(P9_STATFS_MAGIC));
+			put(u32(sv.f_bsize));
+			put(u64(sv.f_blocks));
+			put(u64(sv.f_bfree));
+			put(u64(sv.f_bavail));
+			put(u64(sv.f_files));
+			put(u64(sv.f_ffree));
+			put(u64(sv.f_fsid));
+			put(u32(sv.f_namemax));
+			return 0;
+		}
+
+		int p9_mkdir(p9_reader &r)
+		{
+			u32 dfid = r.u32_();
+			std::string name = r.str();
+			u32 mode = r.u32_();
+			r.u32_(); /* gid */
+			p9_fid *d = lookup(dfid);
+			if (!d) return abi_errno_EBADF;
+			if (!valid_name(name)) return abi_errno_EINVAL;
+			p9_at at;
+			int err = resolve(join(d->path, name), at);
+			if (err) return err;
+			struct stat st;
+			if (mkdirat(at.fd, at.c_str(), mode & 07777) < 0 ||
+				fstatat(at.fd, at.c_str(), &st, AT_SYMLINK_NOFOLLOW) < 0) return host_error();
+			put_qid(st);
+			return 0;
+		}
+
+		int p9_symlink(p9_reader &r)
+		{
+			u32 fid = r.u32_();
+			std::string name = r.str(), target = r.str();
+			r.u32_(); /* gid */
+			p9_fid *d = lookup(fid);
+			if (!d) return abi_errno_EBADF;
+			if (!valid_name(name)) return abi_errno_EINVAL;
+			p9_at at;
+			int err = resolve(join(d->path, name), at);
+			if (err) return err;
+			/* the target is only read back by the guest, the host never follows it */
+			struct stat st;
+			if (symlinkat(target.c_str(), at.fd, at.c_str()) < 0 ||
+				fstatat(at.fd, at.c_str(), &st, AT_SYMLINK_NOFOLLOW) < 0) return host_error();
+			put_qid(st);
+			return 0;
+		}
+
+		int p9_readlink(p9_reader &r)
+		{
+			u32 fid = r.u32_();
+			p9_fid *f = lookup(fid);
+			if (!f) return abi_errno_EBADF;
+			p9_at at;
+			int err = resolve(f->path, at);
+			if (err) return err;
+			char buf[abi_PATH_MAX];
+			ssize_t len = readlinkat(at.fd, at.c_str(), buf, sizeof(buf));
+			if (len < 0) return host_error();
+			put_str(std::string(buf, len));
+			return 0;
+		}
+
+		int p9_link(p9_reader &r)
+		{
+			u32 dfid = r.u32_(), fid = r.u32_();
+			std::string name = r.str();
+			p9_fid *d = lookup(dfid), *f = lookup(fid);
+			if (!d || !f) return abi_errno_EBADF;
+			if (!valid_name(name)) return abi_errno_EINVAL;
+			p9_at from, to;
+			int err = resolve(f->path, from);
+			if (!err) err = resolve(join(d->path, name), to);
+			if (err) return err;
+			if (linkat(from.fd, from.c_str(), to.fd, to.c_str(), 0) < 0) return host_error();
+			return 0;
+		}
+
+		int p9_rename(p9_reader &r)
+		{
+			u32 fid = r.u32_(), dfid = r.u32_();
+			std::string name = r.str();
+			p9_fid *f = lookup(fid), *d = lookup(dfid);
+			if (!f || !d) return abi_errno_EBADF;
+			if (!valid_name(name)) return abi_errno_EINVAL;
+			std::string path = join(d->path, name);
+			p9_at from, to;
+			int err = resolve(f->path, from);
+			if (!err) err = resolve(path, to);
+			if (err) return err;
+			if (renameat(from.fd, from.c_str(), to.fd, to.c_str()) < 0) return host_error();
+			f->path = path;
+			return 0;
+		}
+
+		int p9_renameat(p9_reader &r)
+		{
+			u32 olddirfid = r.u32_();
+			std::string oldname = r.str();
+			u32 newdirfid = r.u32_();
+			std::string newname = r.str();
+			p9_fid *od = lookup(olddirfid), *nd = lookup(newdirfid);
+			if (!od || !nd) return abi_errno_EBADF;
+			if (!valid_name(oldname) || !valid_name(newname)) return abi_errno_EINVAL;
+			p9_at from, to;
+			int err = resolve(join(od->path, oldname), from);
+			if (!err) err = resolve(join(nd->path, newname), to);
+			if (err) return err;
+			if (renameat(from.fd, from.c_str(), to.fd, to.c_str()) < 0) return host_error();
+			return 0;
+		}
+
+		int p9_unlinkat(p9_reader &r)
+		{
+			u32 dfid = r.u32_();
+			std::string name = r.str();
+			u32 flags = r.u32_();
+			p9_fid *d = lookup(dfid);
+			if (!d) return abi_errno_EBADF;
+			if (!valid_name(name)) return abi_errno_EINVAL;
+			p9_at at;
+			int err = resolve(join(d->path, name), at);
+			if (err) return err;
+			if (unlinkat(at.fd, at.c_str(), flags & P9_DOTL_AT_REMOVEDIR ? AT_REMOVEDIR : 0) < 0) return host_error();
+			return 0;
+		}
+
+		int p9_fsync(p9_reader &r)
+		{
+			u32 fid = r.u32_(), datasync = r.u32_();
+			p9_fid *f = lookup(fid);
+			if (!f || f->fd < 0) return abi_errno_EBADF;
+			if ((datasync ? fdatasync(f->fd) : fsync(f->fd)) < 0) return host_error();
+			return 0;
+		}
+
+		/* locks are advisory and local to the guest */
+		int p9_lock(p9_reader &r)
+		{
+			if (!lookup(r.u32_())) return abi_errno_EBADF;
+			put(u8(P9_LOCK_SUCCESS));
+			return 0;
+		}
+
+		int p9_getlock(p9_reader &r)
+		{
+			if (!lookup(r.u32_())) return abi_errno_EBADF;
+			r.u8_(); /* type */
+			u64 start = r.u64_(), length = r.u64_();
+			u32 proc_id = r.u32_();
+			std::string client_id = r.str();
+			put(u8(P9_LOCK_TYPE_UNLCK));
+			put(start);
+			put(length);
+			put(proc_id);
+			put_str(client_id);
+			return 0;
+		}
+
+		void print_registers()
+		{
+			virtio::print_registers();
+			debug("virtio_9p:root             %s", root_dir.c_str());
+			debug("virtio_9p:fids             %llu", u64(fids.size()));
+		}
+	};
+
+}
+
+#endif
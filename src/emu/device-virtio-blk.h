@@ -0,0 +1,206 @@
+//
+//  device-virtio-blk.h
+//
+
+#ifndef rv_device_virtio_blk_h
+#define rv_device_virtio_blk_h
+
+namespace riscv {
+
+	/*
+	 * virtio block device
+	 *
+	 * the disk image is mapped shared into the emulator so requests are
+	 * served with memcpy between the image and guest buffers and writes
+	 * reach the file through the page cache. the image is opened read
+	 * only when it is not writable and VIRTIO_BLK_F_RO is offered.
+	 */
+
+	template <typename P>
+	struct virtio_blk_mmio_device : virtio_mmio_device<P>
+	{
+		typedef typename P::ux UX;
+		typedef virtio_mmio_device<P> virtio;
+		typedef typename virtio::virtio_buffer virtio_buffer;
+		typedef std::shared_ptr<plic_mmio_device<P>> plic_mmio_device_ptr;
+
+		enum : u32 {
+			VIRTIO_ID_BLOCK      = 2,
+
+			VIRTIO_BLK_F_SEG_MAX = 1 << 2,
+			VIRTIO_BLK_F_RO      = 1 << 5,
+			VIRTIO_BLK_F_FLUSH   = 1 << 9,
+
+			VIRTIO_BLK_T_IN      = 0,
+			VIRTIO_BLK_T_OUT     = 1,
+			VIRTIO_BLK_T_FLUSH   = 4,
+			VIRTIO_BLK_T_GET_ID  = 8,
+
+			VIRTIO_BLK_S_OK      = 0,
+			VIRTIO_BLK_S_IOERR   = 1,
+			VIRTIO_BLK_S_UNSUPP  = 2,
+
+			VIRTIO_BLK_ID_BYTES  = 20,
+
+			sector_shift         = 9,
+			sector_size          = 1 << sector_shift
+		};
+
+		struct virtio_blk_req {
+			u32 type;
+			u32 reserved;
+			u64 sector;
+		};
+
+		struct {
+			u64 capacity;
+			u32 size_max;
+			u32 seg_max;
+		} blk_config;
+
+		std::string filename;
+		u8 *image;
+		size_t image_size;
+		bool readonly;
+		std::vector<virtio_buffer> bufs;
+
+		/* virtio block constructor */
+
+		virtio_blk_mmio_device(P &proc, UX mpa, plic_mmio_device_ptr plic, UX irq, std::string filename) :
+			virtio(proc, "VIRTIO-BLK", mpa, plic, irq, P::event_virtio_blk, VIRTIO_ID_BLOCK,
+				VIRTIO_BLK_F_SEG_MAX | VIRTIO_BLK_F_FLUSH, /*num_queues*/1),
+			blk_config{},
+			filename(filename),
+			image(nullptr),
+			image_size(0),
+			readonly(false)
+		{
+			int fd = open(filename.c_str(), O_RDWR);
+			if (fd < 0 && (errno == EACCES || errno == EROFS)) {
+				fd = open(filename.c_str(), O_RDONLY);
+				readonly = true;
+			}
+			if (fd < 0) {
+				panic("virtio-blk: error: open: %s: %s", filename.c_str(), strerror(errno));
+			}
+			struct stat statbuf;
+			if (fstat(fd, &statbuf) < 0) {
+				panic("virtio-blk: error: fstat: %s: %s", filename.c_str(), strerror(errno));
+			}
+			image_size = statbuf.st_size & ~size_t(sector_size - 1);
+			if (image_size == 0) {
+				panic("virtio-blk: error: %s: image is smaller than one sector", filename.c_str());
+			}
+			void *addr = mmap(nullptr, image_size,
+				readonly ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			close(fd);
+			if (addr == MAP_FAILED) {
+				panic("virtio-blk: error: mmap: %s: %s", filename.c_str(), strerror(errno));
+			}
+			image = (u8*)addr;
+			if (readonly) virtio::device_features |= VIRTIO_BLK_F_RO;
+			blk_config.capacity = image_size >> sector_shift;
+			blk_config.seg_max = virtio::queue_num_max - 2;
+		}
+
+		~virtio_blk_mmio_device()
+		{
+			munmap(image, image_size);
+		}
+
+		/* remap the image copy-on-write so the writes of a clone are private */
+		void clone_image()
+		{
+			int fd = open(filename.c_str(), O_RDONLY);
+			if (fd < 0) {
+				panic("virtio-blk: error: open: %s: %s", filename.c_str(), strerror(errno));
+			}
+			void *addr = mmap(image, image_size, readonly ? PROT_READ : PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_FIXED, fd, 0);
+			close(fd);
+			if (addr == MAP_FAILED) {
+				panic("virtio-blk: error: mmap: %s: %s", filename.c_str(), strerror(errno));
+			}
+		}
+
+		u8* config_space() { return (u8*)&blk_config; }
+		size_t config_size() { return sizeof(blk_config); }
+
+		/* copy between the image and the data buffers of a request */
+		u8 transfer(u32 type, u64 sector, u32 &written)
+		{
+			if (sector > (image_size >> sector_shift)) return VIRTIO_BLK_S_IOERR;
+			size_t offset = sector << sector_shift;
+			for (size_t i = 1; i < bufs.size() - 1; i++) {
+				auto &buf = bufs[i];
+				if (buf.len > image_size - offset) return VIRTIO_BLK_S_IOERR;
+				if (type == VIRTIO_BLK_T_IN) {
+					if (!buf.write) return VIRTIO_BLK_S_IOERR;
+					memcpy(buf.addr, image + offset, buf.len);
+					written += buf.len;
+				} else {
+					if (readonly) return VIRTIO_BLK_S_IOERR;
+					memcpy(image + offset, buf.addr, buf.len);
+				}
+				offset += buf.len;
+			}
+			return VIRTIO_BLK_S_OK;
+		}
+
+		/* process one request: header, data buffers and status byte */
+		u32 request()
+		{
+			if (bufs.size() < 2 || bufs.front().len < sizeof(virtio_blk_req) ||
+				!bufs.back().write || bufs.back().len < 1) return 0;
+			virtio_blk_req req;
+			memcpy(&req, bufs.front().addr, sizeof(req));
+			u32 written = 0;
+			u8 status;
+			switch (req.type) {
+				case VIRTIO_BLK_T_IN:
+				case VIRTIO_BLK_T_OUT:
+					status = transfer(req.type, req.sector, written);
+					break;
+				case VIRTIO_BLK_T_FLUSH:
+					status = readonly || msync(image, image_size, MS_SYNC) == 0 ?
+						VIRTIO_BLK_S_OK : VIRTIO_BLK_S_IOERR;
+					break;
+				case VIRTIO_BLK_T_GET_ID:
+					if (bufs.size() == 3 && bufs[1].write) {
+						char id[VIRTIO_BLK_ID_BYTES] = "rv-sys-virtio-blk";
+						written = std::min(u32(sizeof(id)), bufs[1].len);
+						memcpy(bufs[1].addr, id, written);
+						status = VIRTIO_BLK_S_OK;
+					} else {
+						status = VIRTIO_BLK_S_IOERR;
+					}
+					break;
+				default:
+					status = VIRTIO_BLK_S_UNSUPP;
+					break;
+			}
+			*bufs.back().addr = status;
+			return written + 1;
+		}
+
+		/* consume all available requests and complete them as one batch */
+		void queue_notify(u32 queue)
+		{
+			auto &q = virtio::queues[queue];
+			u16 head, used_idx = virtio::queue_used_idx(q);
+			while (virtio::queue_pop(q, head, bufs)) {
+				virtio::queue_push(q, used_idx, head, request());
+			}
+			virtio::queue_publish(q, used_idx);
+		}
+
+		void print_registers()
+		{
+			virtio::print_registers();
+			debug("virtio_blk:capacity        %llu", blk_config.capacity);
+		}
+	};
+
+}
+
+#endif
@@ -0,0 +1,212 @@
+//
+//  device-virtio-console.h
+//
+
+#ifndef rv_device_virtio_console_h
+#define rv_device_virtio_console_h
+
+namespace riscv {
+
+	/*
+	 * virtio console device
+	 *
+	 * guest notifications only kick the console thread, which drains all
+	 * pending transmit buffers with writev and fills receive buffers with
+	 * readv, completing each batch with one used ring update and one
+	 * interrupt. the UART remains the boot console.
+	 */
+
+	template <typename P>
+	struct virtio_console_mmio_device : virtio_mmio_device<P>, console_ring
+	{
+		typedef typename P::ux UX;
+		typedef virtio_mmio_device<P> virtio;
+		typedef typename virtio::virtio_buffer virtio_buffer;
+		typedef typename virtio::virtqueue virtqueue;
+		typedef std::shared_ptr<plic_mmio_device<P>> plic_mmio_device_ptr;
+		typedef std::shared_ptr<console_device<P>> console_device_ptr;
+
+		enum : u32 {
+			VIRTIO_ID_CONSOLE    = 3,
+
+			VIRTIO_CONSOLE_F_SIZE = 1 << 0,
+
+			receiveq             = 0,
+			transmitq            = 1,
+
+			iov_max              = 256
+		};
+
+		struct {
+			u16 cols;
+			u16 rows;
+			u32 max_nr_ports;
+			u32 emerg_wr;
+		} console_config;
+
+		console_device_ptr console;
+		std::vector<virtio_buffer> bufs;
+		std::vector<struct iovec> iov;
+		std::vector<u16> heads;
+
+		/* virtio console constructor */
+
+		virtio_console_mmio_device(P &proc, UX mpa, plic_mmio_device_ptr plic, UX irq, console_device_ptr console) :
+			virtio(proc, "VIRTIO-CONSOLE", mpa, plic, irq, P::event_virtio_console, VIRTIO_ID_CONSOLE,
+				VIRTIO_CONSOLE_F_SIZE, /*num_queues*/2),
+			console_config{80, 24, 1, 0},
+			console(console)
+		{
+			struct winsize ws;
+			if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col && ws.ws_row) {
+				console_config.cols = ws.ws_col;
+				console_config.rows = ws.ws_row;
+			}
+			console->set_ring(this);
+		}
+
+		~virtio_console_mmio_device()
+		{
+			console->set_ring(nullptr);
+		}
+
+		u8* config_space() { return (u8*)&console_config; }
+		size_t config_size() { return sizeof(console_config); }
+
+		/* notifications and status changes are serviced on the console thread */
+		void queue_notify(u32 queue) { console->kick(); }
+		void device_status() { console->kick(); }
+
+		bool queue_active(virtqueue &q)
+		{
+			return (virtio::status & virtio::STATUS_DRIVER_OK) &&
+				!(virtio::status & virtio::STATUS_NEEDS_RESET) && q.ready;
+		}
+
+		/* console ring interface (called on the console thread) */
+
+		bool ring_active()
+		{
+			std::lock_guard<std::mutex> lock(virtio::virtio_mutex);
+			return queue_active(virtio::queues[receiveq]);
+		}
+
+		bool ring_input_ready()
+		{
+			std::lock_guard<std::mutex> lock(virtio::virtio_mutex);
+			auto &q = virtio::queues[receiveq];
+			if (!queue_active(q)) return false;
+			auto avail = (typename virtio::virtq_avail*)virtio::guest_buffer(q.avail, sizeof(typename virtio::virtq_avail));
+			return avail && q.last_avail_idx != __atomic_load_n(&avail->idx, __ATOMIC_ACQUIRE);
+		}
+
+		/* fill the available receive buffers with a single readv */
+		ssize_t ring_input(int fd)
+		{
+			std::lock_guard<std::mutex> lock(virtio::virtio_mutex);
+			auto &q = virtio::queues[receiveq];
+			if (!queue_active(q)) return -1;
+			u16 head, used_idx = virtio::queue_used_idx(q);
+			iov.clear();
+			heads.clear();
+			while (iov.size() < iov_max && virtio::queue_pop(q, head, bufs)) {
+				heads.push_back(head);
+				for (auto &buf : bufs) {
+					if (buf.write && buf.len) iov.push_back(iovec{ buf.addr, buf.len });
+				}
+			}
+			if (iov.size() == 0) {
+				for (auto h : heads) virtio::queue_push(q, used_idx, h, 0);
+				virtio::queue_publish(q, used_idx);
+				return -1;
+			}
+			ssize_t ret = readv(fd, iov.data(), int(std::min(iov.size(), size_t(IOV_MAX))));
+			size_t remaining = ret > 0 ? size_t(ret) : 0;
+			if (ret < 0 && errno != EAGAIN && errno != EINTR) {
+				debug("virtio-console: readv: %s", strerror(errno));
+			}
+
+			/* complete the chains that received data and return the rest */
+			size_t consumed = 0;
+			u16 last_avail_idx = q.last_avail_idx - u16(heads.size());
+			for (auto h : heads) {
+				if (remaining == 0) break;
+				u32 len = 0;
+				auto desc = (typename virtio::virtq_desc*)virtio::guest_buffer(q.desc, q.num * sizeof(typename virtio::virtq_desc));
+				for (u32 i = h; desc && remaining > 0; i = desc[i].next) {
+					if (desc[i].flags & virtio::VIRTQ_DESC_F_WRITE) {
+						u32 n = u32(std::min(size_t(desc[i].len), remaining));
+						len += n;
+						remaining -= n;
+					}
+					if (!(desc[i].flags & virtio::VIRTQ_DESC_F_NEXT)) break;
+				}
+				virtio::queue_push(q, used_idx, h, len);
+				consumed++;
+			}
+			q.last_avail_idx = last_avail_idx + u16(consumed);
+			virtio::queue_publish(q, used_idx);
+			return ret;
+		}
+
+		/* drain all pending transmit buffers with writev */
+		void ring_output(int fd)
+		{
+			std::lock_guard<std::mutex> lock(virtio::virtio_mutex);
+			auto &q = virtio::queues[transmitq];
+			if (!queue_active(q)) return;
+			u16 head, used_idx = virtio::queue_used_idx(q);
+			for (;;) {
+				iov.clear();
+				heads.clear();
+				while (iov.size() < iov_max && virtio::queue_pop(q, head, bufs)) {
+					heads.push_back(head);
+					for (auto &buf : bufs) {
+						if (!buf.write && buf.len) iov.push_back(iovec{ buf.addr, buf.len });
+					}
+				}
+				if (heads.size() == 0) break;
+				write_all(fd, iov.data(), iov.size());
+				for (auto h : heads) virtio::queue_push(q, used_idx, h, 0);
+			}
+			virtio::queue_publish(q, used_idx);
+		}
+
+		/* writev until all buffers are written, advancing over short writes */
+		static void write_all(int fd, struct iovec *v, size_t n)
+		{
+			while (n > 0) {
+				ssize_t ret = writev(fd, v, int(std::min(n, size_t(IOV_MAX))));
+				if (ret < 0) {
+					if (errno == EINTR) continue;
+					if (errno == EAGAIN) {
+						struct pollfd pfd = { fd, POLLOUT, 0 };
+						poll(&pfd, 1, -1);
+						continue;
+					}
+					debug("virtio-console: writev: %s", strerror(errno));
+					return;
+				}
+				size_t written = size_t(ret);
+				while (n > 0 && written >= v->iov_len) {
+					written -= v->iov_len;
+					v++, n--;
+				}
+				if (n > 0) {
+					v->iov_base = (u8*)v->iov_base + written;
+					v->iov_len -= written;
+				}
+			}
+		}
+
+		void print_registers()
+		{
+			virtio::print_registers();
+			debug("virtio_console:cols        %u", console_config.cols);
+			debug("virtio_console:rows        %u", console_config.rows);
+		}
+	};
+
+}
+
+#endif
@@ -0,0 +1,420 @@
+//
+//  device-virtio.h
+//
+
+#ifndef rv_device_virtio_h
+#define rv_device_virtio_h
+
+namespace riscv {
+
+	/*
+	 * virtio MMIO transport (version 2)
+	 *
+	 * Reference: http://docs.oasis-open.org/virtio/virtio/v1.0/virtio-v1.0.html
+	 *
+	 * the transport implements the register file, feature negotiation and
+	 * split virtqueues. device types derive from it and process descriptor
+	 * chains in queue_notify. requests are processed on the thread of the
+	 * hart that writes QueueNotify; all available chains are consumed and
+	 * the used ring index is published once per notify, so a batch of
+	 * requests costs one completion interrupt. interrupt status changes
+	 * post the device event, which the boot hart dispatches from its event
+	 * queue to update the PLIC interrupt line.
+	 *
+	 * guest buffers are accessed directly in host memory and must lie in
+	 * a RAM segment. the transport is shared by all harts and serialized
+	 * with a mutex. completed chains break LR reservations on their device
+	 * writable buffers and on the used ring, as a hart store would.
+	 */
+
+	template <typename P>
+	struct virtio_mmio_device : memory_segment<typename P::ux>
+	{
+		typedef typename P::ux UX;
+		typedef std::shared_ptr<plic_mmio_device<P>> plic_mmio_device_ptr;
+
+		enum : u32 {
+			REG_MAGIC_VALUE          = 0x000,
+			REG_VERSION              = 0x004,
+			REG_DEVICE_ID            = 0x008,
+			REG_VENDOR_ID            = 0x00c,
+			REG_DEVICE_FEATURES      = 0x010,
+			REG_DEVICE_FEATURES_SEL  = 0x014,
+			REG_DRIVER_FEATURES      = 0x020,
+			REG_DRIVER_FEATURES_SEL  = 0x024,
+			REG_QUEUE_SEL            = 0x030,
+			REG_QUEUE_NUM_MAX        = 0x034,
+			REG_QUEUE_NUM            = 0x038,
+			REG_QUEUE_READY          = 0x044,
+			REG_QUEUE_NOTIFY         = 0x050,
+			REG_INTERRUPT_STATUS     = 0x060,
+			REG_INTERRUPT_ACK        = 0x064,
+			REG_STATUS               = 0x070,
+			REG_QUEUE_DESC_LOW       = 0x080,
+			REG_QUEUE_DESC_HIGH      = 0x084,
+			REG_QUEUE_AVAIL_LOW      = 0x090,
+			REG_QUEUE_AVAIL_HIGH     = 0x094,
+			REG_QUEUE_USED_LOW       = 0x0a0,
+			REG_QUEUE_USED_HIGH      = 0x0a4,
+			REG_CONFIG_GENERATION    = 0x0fc,
+			REG_CONFIG               = 0x100,
+
+			MAGIC_VALUE              = 0x74726976, /* "virt" */
+			VERSION                  = 2,
+			VENDOR_ID                = 0x554d4551, /* "QEMU" */
+
+			STATUS_ACKNOWLEDGE       = 1,
+			STATUS_DRIVER            = 2,
+			STATUS_DRIVER_OK         = 4,
+			STATUS_FEATURES_OK       = 8,
+			STATUS_NEEDS_RESET       = 64,
+			STATUS_FAILED            = 128,
+
+			INTERRUPT_USED_BUFFER    = 1,
+			INTERRUPT_CONFIG_CHANGE  = 2,
+
+			VIRTQ_DESC_F_NEXT        = 1,
+			VIRTQ_DESC_F_WRITE       = 2,
+			VIRTQ_AVAIL_F_NO_INTERRUPT = 1,
+
+			queue_num_max            = 256,
+			total_size               = page_size
+		};
+
+		static constexpr u64 VIRTIO_F_VERSION_1 = u64(1) << 32;
+
+		/* split virtqueue layout in guest memory */
+
+		struct virtq_desc {
+			u64 addr;
+			u32 len;
+			u16 flags;
+			u16 next;
+		};
+
+		struct virtq_avail {
+			u16 flags;
+			u16 idx;
+			u16 ring[];
+		};
+
+		struct virtq_used_elem {
+			u32 id;
+			u32 len;
+		};
+
+		struct virtq_used {
+			u16 flags;
+			u16 idx;
+			virtq_used_elem ring[];
+		};
+
+		struct virtqueue {
+			u32 num;
+			u32 ready;
+			u64 desc;
+			u64 avail;
+			u64 used;
+			u16 last_avail_idx;
+		};
+
+		/* one host buffer of a descriptor chain */
+
+		struct virtio_buffer {
+			u8 *addr;
+			u32 len;
+			bool write;
+		};
+
+		P &proc;
+		plic_mmio_device_ptr plic;
+		UX irq;
+		u32 event;
+		u32 device_id;
+		u64 device_features;
+		u64 driver_features;
+		u32 device_features_sel;
+		u32 driver_features_sel;
+		u32 queue_sel;
+		u32 status;
+		u32 interrupt_status;
+		u32 config_generation;
+		std::vector<virtqueue> queues;
+		std::mutex virtio_mutex;
+
+		/* virtio constructor */
+
+		virtio_mmio_device(P &proc, const char *name, UX mpa, plic_mmio_device_ptr plic, UX irq,
+				u32 event, u32 device_id, u64 device_features, size_t num_queues) :
+			memory_segment<UX>(name, mpa, /*uva*/0, /*size*/total_size,
+				pma_type_io | pma_prot_read | pma_prot_write),
+			proc(proc),
+			plic(plic),
+			irq(irq),
+			event(event),
+			device_id(device_id),
+			device_features(device_features | VIRTIO_F_VERSION_1),
+			driver_features(0),
+			device_features_sel(0),
+			driver_features_sel(0),
+			queue_sel(0),
+			status(0),
+			interrupt_status(0),
+			config_generation(0),
+			queues(num_queues)
+		{
+			reset_device();
+		}
+
+		virtual ~virtio_mmio_device() {}
+
+		/* device type interface */
+
+		virtual void queue_notify(u32 queue) = 0;
+		virtual void device_reset() {}
+		virtual void device_status() {}
+		virtual u8* config_space() = 0;
+		virtual size_t config_size() = 0;
+
+		/* virtio interface */
+
+		void print_registers()
+		{
+			debug("%s:status           0x%08x", memory_segment<UX>::name, status);
+			debug("%s:interrupt_status 0x%08x", memory_segment<UX>::name, interrupt_status);
+			debug("%s:driver_features  0x%016llx", memory_segment<UX>::name, driver_features);
+		}
+
+		/* serialize device state */
+		template <typename S>
+		void snapshot(S &s)
+		{
+			std::lock_guard<std::mutex> lock(virtio_mutex);
+			s.io(driver_features);
+			s.io(device_features_sel);
+			s.io(driver_features_sel);
+			s.io(queue_sel);
+			s.io(status);
+			s.io(interrupt_status);
+			s.io(config_generation);
+			for (auto &q : queues) {
+				s.io(q);
+			}
+		}
+
+		void service()
+		{
+			std::lock_guard<std::mutex> lock(virtio_mutex);
+			plic->set_irq(irq, interrupt_status ? 1 : 0);
+		}
+
+		void reset_device()
+		{
+			for (auto &q : queues) {
+				q = virtqueue{ queue_num_max, 0, 0, 0, 0, 0 };
+			}
+			driver_features = 0;
+			device_features_sel = driver_features_sel = queue_sel = 0;
+			status = 0;
+			interrupt_status = 0;
+			device_reset();
+		}
+
+		/* return host address of a guest physical buffer in RAM or nullptr */
+		u8* guest_buffer(u64 mpa, size_t len)
+		{
+			memory_segment<UX> *seg = nullptr;
+			addr_t uva = proc.mmu.mem->mpa_to_uva(seg, UX(mpa));
+			if (!seg || !seg->direct || UX(mpa) != mpa ||
+				size_t(mpa - seg->mpa) + len > seg->size) return nullptr;
+			return (u8*)uva;
+		}
+
+		/*
+		 * pop the next available descriptor chain of a queue into bufs.
+		 * returns false when the queue is empty. a malformed chain marks
+		 * the device as needing reset and is not returned.
+		 */
+		bool queue_pop(virtqueue &q, u16 &head, std::vector<virtio_buffer> &bufs)
+		{
+			bufs.clear();
+			auto avail = (virtq_avail*)guest_buffer(q.avail, sizeof(virtq_avail) + q.num * sizeof(u16));
+			auto desc = (virtq_desc*)guest_buffer(q.desc, q.num * sizeof(virtq_desc));
+			if (!avail || !desc) goto bad;
+			if (q.last_avail_idx == __atomic_load_n(&avail->idx, __ATOMIC_ACQUIRE)) return false;
+			head = avail->ring[q.last_avail_idx++ % q.num];
+			for (u32 i = head, n = 0; ; i = desc[i].next) {
+				if (i >= q.num || n++ == q.num) goto bad;
+				u8 *addr = guest_buffer(desc[i].addr, desc[i].len);
+				if (!addr) goto bad;
+				bufs.push_back(virtio_buffer{ addr, desc[i].len, (desc[i].flags & VIRTQ_DESC_F_WRITE) != 0 });
+				if (!(desc[i].flags & VIRTQ_DESC_F_NEXT)) break;
+			}
+			return true;
+		bad:
+			status |= STATUS_NEEDS_RESET;
+			interrupt_status |= INTERRUPT_CONFIG_CHANGE;
+			proc.post_device_event(event);
+			return false;
+		}
+
+		/* break reservations on the device writable buffers of a chain */
+		void queue_invalidate(virtqueue &q, u16 head)
+		{
+			auto &resv = proc.mmu.mem->reservations;
+			if (likely(!resv.any())) return;
+			auto desc = (virtq_desc*)guest_buffer(q.desc, q.num * sizeof(virtq_desc));
+			if (!desc) return;
+			for (u32 i = head, n = 0; i < q.num && n++ < q.num; i = desc[i].next) {
+				if (desc[i].flags & VIRTQ_DESC_F_WRITE) resv.invalidate(desc[i].addr, desc[i].len);
+				if (!(desc[i].flags & VIRTQ_DESC_F_NEXT)) break;
+			}
+		}
+
+		/* add a completed chain to the used ring (published by queue_publish) */
+		void queue_push(virtqueue &q, u16 &used_idx, u16 head, u32 len)
+		{
+			auto used = (virtq_used*)guest_buffer(q.used, sizeof(virtq_used) + q.num * sizeof(virtq_used_elem));
+			if (!used) return;
+			queue_invalidate(q, head);
+			used->ring[used_idx++ % q.num] = virtq_used_elem{ head, len };
+		}
+
+		/* publish the used ring index and raise the interrupt unless suppressed */
+		void queue_publish(virtqueue &q, u16 used_idx)
+		{
+			auto used = (virtq_used*)guest_buffer(q.used, sizeof(virtq_used));
+			auto avail = (virtq_avail*)guest_buffer(q.avail, sizeof(virtq_avail));
+			if (!used || !avail || used->idx == used_idx) return;
+			__atomic_store_n(&used->idx, used_idx, __ATOMIC_RELEASE);
+			proc.mmu.mem->reservations.invalidate(q.used, sizeof(virtq_used) + q.num * sizeof(virtq_used_elem));
+			if (!(avail->flags & VIRTQ_AVAIL_F_NO_INTERRUPT)) {
+				interrupt_status |= INTERRUPT_USED_BUFFER;
+				proc.post_device_event(event);
+			}
+		}
+
+		u16 queue_used_idx(virtqueue &q)
+		{
+			auto used = (virtq_used*)guest_buffer(q.used, sizeof(virtq_used));
+			return used ? used->idx : 0;
+		}
+
+		/* virtio MMIO */
+
+		u32 read_reg(UX va)
+		{
+			virtqueue *q = queue_sel < queues.size() ? &queues[queue_sel] : nullptr;
+			switch (va) {
+				case REG_MAGIC_VALUE:         return MAGIC_VALUE;
+				case REG_VERSION:             return VERSION;
+				case REG_DEVICE_ID:           return device_id;
+				case REG_VENDOR_ID:           return VENDOR_ID;
+				case REG_DEVICE_FEATURES:     return device_features_sel == 0 ? u32(device_features) :
+				                                     device_features_sel == 1 ? u32(device_features >> 32) : 0;
+				case REG_QUEUE_NUM_MAX:       return q ? queue_num_max : 0;
+				case REG_QUEUE_READY:         return q ? q->ready : 0;
+				case REG_INTERRUPT_STATUS:    return interrupt_status;
+				case REG_STATUS:              return status;
+				case REG_CONFIG_GENERATION:   return config_generation;
+				default:                      return 0;
+			}
+		}
+
+		void write_reg(UX va, u32 val)
+		{
+			virtqueue *q = queue_sel < queues.size() ? &queues[queue_sel] : nullptr;
+			switch (va) {
+				case REG_DEVICE_FEATURES_SEL: device_features_sel = val; break;
+				case REG_DRIVER_FEATURES_SEL: driver_features_sel = val; break;
+				case REG_DRIVER_FEATURES:
+					if (driver_features_sel < 2) {
+						u32 shift = driver_features_sel << 5;
+						driver_features = (driver_features & ~(u64(0xffffffff) << shift)) | (u64(val) << shift);
+					}
+					break;
+				case REG_QUEUE_SEL:           queue_sel = val; break;
+				case REG_QUEUE_NUM:           if (q && val && val <= queue_num_max && !(val & (val - 1))) q->num = val; break;
+				case REG_QUEUE_READY:         if (q) q->ready = val & 1; break;
+				case REG_QUEUE_DESC_LOW:      if (q) q->desc = (q->desc & ~u64(0xffffffff)) | val; break;
+				case REG_QUEUE_DESC_HIGH:     if (q) q->desc = (q->desc & 0xffffffff) | (u64(val) << 32); break;
+				case REG_QUEUE_AVAIL_LOW:     if (q) q->avail = (q->avail & ~u64(0xffffffff)) | val; break;
+				case REG_QUEUE_AVAIL_HIGH:    if (q) q->avail = (q->avail & 0xffffffff) | (u64(val) << 32); break;
+				case REG_QUEUE_USED_LOW:      if (q) q->used = (q->used & ~u64(0xffffffff)) | val; break;
+				case REG_QUEUE_USED_HIGH:     if (q) q->used = (q->used & 0xffffffff) | (u64(val) << 32); break;
+				case REG_QUEUE_NOTIFY:
+					if (val < queues.size() && queues[val].ready && (status & STATUS_DRIVER_OK)) {
+						queue_notify(val);
+					}
+					break;
+				case REG_INTERRUPT_ACK:
+					interrupt_status &= ~val;
+					proc.post_device_event(event);
+					break;
+				case REG_STATUS:
+					if (val == 0) {
+						reset_device();
+						proc.post_device_event(event);
+					} else {
+						if ((val & STATUS_FEATURES_OK) && (driver_features & ~device_features)) {
+							val &= ~STATUS_FEATURES_OK;
+						}
+						status = val;
+					}
+					device_status();
+					break;
+				default: break;
+			}
+		}
+
+		template <typename T>
+		buserror_t load(UX va, T &val)
+		{
+			std::lock_guard<std::mutex> lock(virtio_mutex);
+			if (va >= REG_CONFIG) {
+				size_t offset = va - REG_CONFIG;
+				val = 0;
+				if (offset + sizeof(T) <= config_size()) {
+					memcpy(&val, config_space() + offset, sizeof(T));
+				}
+			} else {
+				val = (sizeof(T) == 4 && (va & 3) == 0) ? T(read_reg(va)) : 0;
+			}
+			if (proc.log & proc_log_mmio) {
+				printf("virtio_mmio:0x%04llx -> 0x%llx\n", addr_t(va), u64(val));
+			}
+			return 0;
+		}
+
+		template <typename T>
+		buserror_t store(UX va, T val)
+		{
+			if (proc.log & proc_log_mmio) {
+				printf("virtio_mmio:0x%04llx <- 0x%llx\n", addr_t(va), u64(val));
+			}
+			std::lock_guard<std::mutex> lock(virtio_mutex);
+			if (va >= REG_CONFIG) {
+				size_t offset = va - REG_CONFIG;
+				if (offset + sizeof(T) <= config_size()) {
+					memcpy(config_space() + offset, &val, sizeof(T));
+				}
+			} else if (sizeof(T) == 4 && (va & 3) == 0) {
+				write_reg(va, u32(val));
+			}
+			return 0;
+		}
+
+		buserror_t load_8 (UX va, u8  &val) { return load(va, val); }
+		buserror_t load_16(UX va, u16 &val) { return load(va, val); }
+		buserror_t load_32(UX va, u32 &val) { return load(va, val); }
+		buserror_t load_64(UX va, u64 &val) { return load(va, val); }
+
+		buserror_t store_8 (UX va, u8  val) { return store(va, val); }
+		buserror_t store_16(UX va, u16 val) { return store(va, val); }
+		buserror_t store_32(UX va, u32 val) { return store(va, val); }
+		buserror_t store_64(UX va, u64 val) { return store(va, val); }
+	};
+
+}
+
+#endif
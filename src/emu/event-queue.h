@@ -0,0 +1,115 @@
+//
+//  event-queue.h
+//
+
+#ifndef rv_event_queue_h
+#define rv_event_queue_h
+
+namespace riscv {
+
+	/*
+	 * event_queue
+	 *
+	 * deadline ordered queue of device events for one hart, kept as a
+	 * binary heap. each event source has a small integer id and at most
+	 * one pending deadline. rescheduling or cancelling an event leaves its
+	 * old heap entry in place and the stale entry is discarded when it
+	 * reaches the top of the heap. the run loop asks for the next deadline
+	 * to bound the number of instructions in a step and pops due events
+	 * when the step ends.
+	 */
+
+	template <const size_t NUM_EVENTS>
+	struct event_queue
+	{
+		static constexpr u64 none = std::numeric_limits<u64>::max();
+
+		enum : size_t {
+			num_events = NUM_EVENTS,
+			max_heap_size = 16 * NUM_EVENTS
+		};
+
+		struct event
+		{
+			u64 deadline;
+			u32 id;
+		};
+
+		std::vector<event> heap;
+		u64 deadline[num_events];
+
+		event_queue() : heap()
+		{
+			for (size_t id = 0; id < num_events; id++) {
+				deadline[id] = none;
+			}
+		}
+
+		static bool later(const event &a, const event &b)
+		{
+			return a.deadline > b.deadline;
+		}
+
+		bool stale(const event &ev)
+		{
+			return deadline[ev.id] != ev.deadline;
+		}
+
+		/* set the deadline of an event (none cancels the event) */
+		void schedule(u32 id, u64 when)
+		{
+			if (deadline[id] == when) return;
+			deadline[id] = when;
+			if (when == none) return;
+			if (heap.size() >= max_heap_size) compact();
+			heap.push_back(event{when, id});
+			std::push_heap(heap.begin(), heap.end(), later);
+		}
+
+		void cancel(u32 id)
+		{
+			deadline[id] = none;
+		}
+
+		/* rebuild the heap from the pending deadlines */
+		void compact()
+		{
+			heap.clear();
+			for (size_t id = 0; id < num_events; id++) {
+				if (deadline[id] != none) heap.push_back(event{deadline[id], u32(id)});
+			}
+			std::make_heap(heap.begin(), heap.end(), later);
+		}
+
+		/* discard stale events at the top of the heap */
+		void prune()
+		{
+			while (!heap.empty() && stale(heap.front())) {
+				std::pop_heap(heap.begin(), heap.end(), later);
+				heap.pop_back();
+			}
+		}
+
+		/* deadline of the next event or none */
+		u64 next_deadline()
+		{
+			prune();
+			return heap.empty() ? none : heap.front().deadline;
+		}
+
+		/* remove the next event due at time now and return its id or -1 */
+		int pop_due(u64 now)
+		{
+			prune();
+			if (heap.empty() || heap.front().deadline > now) return -1;
+			u32 id = heap.front().id;
+			std::pop_heap(heap.begin(), heap.end(), later);
+			heap.pop_back();
+			deadline[id] = none;
+			return int(id);
+		}
+	};
+
+}
+
+#endif
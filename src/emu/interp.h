@@ -245,12 +245,12 @@ typename P::ux exec_inst_rv32(T &dec, P &proc, typename P::ux pc_offset)
 			break;
 		case rv_op_lr_w:
 			if (rva) {
-				proc.lr = proc.ireg[dec.rs1]; s32 t; proc.mmu.template load<P,s32>(proc, proc.ireg[dec.rs1], t); proc.ireg[dec.rd] = (dec.rd == 0) ? 0 : t;
+				s32 t; proc.mmu.template lr<P,s32>(proc, proc.ireg[dec.rs1], t); proc.ireg[dec.rd] = (dec.rd == 0) ? 0 : t;
 			};
 			break;
 		case rv_op_sc_w:
 			if (rva) {
-				ux res = 0; if (proc.lr != proc.ireg[dec.rs1]) res = 1; else proc.mmu.template store<P,s32>(proc, proc.ireg[dec.rs1], proc.ireg[dec.rs2].r.w.val); proc.ireg[dec.rd] = (dec.rd == 0) ? 0 : res;
+				ux res = proc.mmu.template sc<P,s32>(proc, proc.ireg[dec.rs1], proc.ireg[dec.rs2].r.w.val); proc.ireg[dec.rd] = (dec.rd == 0) ? 0 : res;
 			};
 			break;
 		case rv_op_amoswap_w:
@@ -886,12 +886,12 @@ typename P::ux exec_inst_rv64(T &dec, P &proc, typename P::ux pc_offset)
 			break;
 		case rv_op_lr_w:
 			if (rva) {
-				proc.lr = proc.ireg[dec.rs1]; s32 t; proc.mmu.template load<P,s32>(proc, proc.ireg[dec.rs1], t); proc.ireg[dec.rd] = (dec.rd == 0) ? 0 : t;
+				s32 t; proc.mmu.template lr<P,s32>(proc, proc.ireg[dec.rs1], t); proc.ireg[dec.rd] = (dec.rd == 0) ? 0 : t;
 			};
 			break;
 		case rv_op_sc_w:
 			if (rva) {
-				ux res = 0; if (proc.lr != proc.ireg[dec.rs1]) res = 1; else proc.mmu.template store<P,s32>(proc, proc.ireg[dec.rs1], proc.ireg[dec.rs2].r.w.val); proc.ireg[dec.rd] = (dec.rd == 0) ? 0 : res;
+				ux res = proc.mmu.template sc<P,s32>(proc, proc.ireg[dec.rs1], proc.ireg[dec.rs2].r.w.val); proc.ireg[dec.rd] = (dec.rd == 0) ? 0 : res;
 			};
 			break;
 		case rv_op_amoswap_w:
@@ -941,12 +941,12 @@ typename P::ux exec_inst_rv64(T &dec, P &proc, typename P::ux pc_offset)
 			break;
 		case rv_op_lr_d:
 			if (rva) {
-				proc.lr = proc.ireg[dec.rs1]; s64 t; proc.mmu.template load<P,s64>(proc, proc.ireg[dec.rs1], t); proc.ireg[dec.rd] = (dec.rd == 0) ? 0 : t;
+				s64 t; proc.mmu.template lr<P,s64>(proc, proc.ireg[dec.rs1], t); proc.ireg[dec.rd] = (dec.rd == 0) ? 0 : t;
 			};
 			break;
 		case rv_op_sc_d:
 			if (rva) {
-				ux res = 0; if (proc.lr != proc.ireg[dec.rs1]) res = 1; else proc.mmu.template store<P,s64>(proc, proc.ireg[dec.rs1], proc.ireg[dec.rs2].r.l.val); proc.ireg[dec.rd] = (dec.rd == 0) ? 0 : res;
+				ux res = proc.mmu.template sc<P,s64>(proc, proc.ireg[dec.rs1], proc.ireg[dec.rs2].r.l.val); proc.ireg[dec.rd] = (dec.rd == 0) ? 0 : res;
 			};
 			break;
 		case rv_op_amoswap_d:
@@ -1632,12 +1632,12 @@ typename P::ux exec_inst_rv128(T &dec, P &proc, typename P::ux pc_offset)
 			break;
 		case rv_op_lr_w:
 			if (rva) {
-				proc.lr = proc.ireg[dec.rs1]; s32 t; proc.mmu.template load<P,s32>(proc, proc.ireg[dec.rs1], t); proc.ireg[dec.rd] = (dec.rd == 0) ? 0 : t;
+				s32 t; proc.mmu.template lr<P,s32>(proc, proc.ireg[dec.rs1], t); proc.ireg[dec.rd] = (dec.rd == 0) ? 0 : t;
 			};
 			break;
 		case rv_op_sc_w:
 			if (rva) {
-				ux res = 0; if (proc.lr != proc.ireg[dec.rs1]) res = 1; else proc.mmu.template store<P,s32>(proc, proc.ireg[dec.rs1], proc.ireg[dec.rs2].r.w.val); proc.ireg[dec.rd] = (dec.rd == 0) ? 0 : res;
+				ux res = proc.mmu.template sc<P,s32>(proc, proc.ireg[dec.rs1], proc.ireg[dec.rs2].r.w.val); proc.ireg[dec.rd] = (dec.rd == 0) ? 0 : res;
 			};
 			break;
 		case rv_op_amoswap_w:
@@ -1687,12 +1687,12 @@ typename P::ux exec_inst_rv128(T &dec, P &proc, typename P::ux pc_offset)
 			break;
 		case rv_op_lr_d:
 			if (rva) {
-				proc.lr = proc.ireg[dec.rs1]; s64 t; proc.mmu.template load<P,s64>(proc, proc.ireg[dec.rs1], t); proc.ireg[dec.rd] = (dec.rd == 0) ? 0 : t;
+				s64 t; proc.mmu.template lr<P,s64>(proc, proc.ireg[dec.rs1], t); proc.ireg[dec.rd] = (dec.rd == 0) ? 0 : t;
 			};
 			break;
 		case rv_op_sc_d:
 			if (rva) {
-				ux res = 0; if (proc.lr != proc.ireg[dec.rs1]) res = 1; else proc.mmu.template store<P,s64>(proc, proc.ireg[dec.rs1], proc.ireg[dec.rs2].r.l.val); proc.ireg[dec.rd] = (dec.rd == 0) ? 0 : res;
+				ux res = proc.mmu.template sc<P,s64>(proc, proc.ireg[dec.rs1], proc.ireg[dec.rs2].r.l.val); proc.ireg[dec.rd] = (dec.rd == 0) ? 0 : res;
 			};
 			break;
 		case rv_op_amoswap_d:
@@ -51,50 +51,369 @@ namespace riscv {
 		addr_t uva;       /* segment user virtual address     (host) */
 		size_t size;      /* segment size */
 		uint32_t flags;   /* segment PMA flags */
+		bool direct;      /* segment is host memory accessed directly at uva */
 
-		memory_segment(const char *name, UX mpa, addr_t uva, size_t size, UX flags) :
-			name(name), mpa(mpa), uva(uva), size(size), flags(flags) {}
+		memory_segment(const char *name, UX mpa, addr_t uva, size_t size, UX flags, bool direct = false) :
+			name(name), mpa(mpa), uva(uva), size(size), flags(flags), direct(direct) {}
 
 		virtual ~memory_segment() {}
 	};
 
 	/*  user memory segment contains one mapping from a segment of emulated machine
-	    physical address space to user virtual address in the emulator process */
+	    physical address space to user virtual address in the emulator process.
+
+	    the direct load and store templates are resolved at compile time so
+	    user_memory can access RAM inline; the virtual methods are only used
+	    when the segment is accessed through the memory_bus interface */
 	template <typename UX>
-	struct mmap_memory_segment : memory_segment<UX>
+	struct mmap_memory_segment final : memory_segment<UX>
 	{
 		mmap_memory_segment(const char*name, UX mpa, addr_t uva, size_t size, UX flags) :
-			memory_segment<UX>(name, mpa, uva, size, flags) {}
+			memory_segment<UX>(name, mpa, uva, size, flags, /*direct*/true) {}
 
 		~mmap_memory_segment()
 		{
 			munmap((void*)memory_segment<UX>::uva, memory_segment<UX>::size);
 		}
 
-		virtual buserror_t load_8 (UX va, u8  &val) { val = *static_cast<u8*>((void*)(addr_t)va); return 0; }
-		virtual buserror_t load_16(UX va, u16 &val) { val = *static_cast<u16*>((void*)(addr_t)va); return 0; }
-		virtual buserror_t load_32(UX va, u32 &val) { val = *static_cast<u32*>((void*)(addr_t)va); return 0; }
-		virtual buserror_t load_64(UX va, u64 &val) { val = *static_cast<u64*>((void*)(addr_t)va); return 0; }
+		template <typename T> static void load_direct(addr_t uva, T &val) { val = *static_cast<T*>((void*)uva); }
+		template <typename T> static void store_direct(addr_t uva, T val) { *static_cast<T*>((void*)uva) = val; }
+
+		virtual buserror_t load_8 (UX va, u8  &val) { load_direct(addr_t(va), val); return 0; }
+		virtual buserror_t load_16(UX va, u16 &val) { load_direct(addr_t(va), val); return 0; }
+		virtual buserror_t load_32(UX va, u32 &val) { load_direct(addr_t(va), val); return 0; }
+		virtual buserror_t load_64(UX va, u64 &val) { load_direct(addr_t(va), val); return 0; }
+
+		virtual buserror_t store_8 (UX va, u8  val) { store_direct(addr_t(va), val); return 0; }
+		virtual buserror_t store_16(UX va, u16 val) { store_direct(addr_t(va), val); return 0; }
+		virtual buserror_t store_32(UX va, u32 val) { store_direct(addr_t(va), val); return 0; }
+		virtual buserror_t store_64(UX va, u64 val) { store_direct(addr_t(va), val); return 0; }
+	};
+
+
+	/*  mmio_ops holds direct entry points for each access size of a device
+	    type. the entry points are instantiated for the concrete device so
+	    the device method is called without virtual dispatch */
+	template <typename UX>
+	struct mmio_ops
+	{
+		buserror_t (*load_8) (memory_segment<UX> *seg, UX va, u8  &val);
+		buserror_t (*load_16)(memory_segment<UX> *seg, UX va, u16 &val);
+		buserror_t (*load_32)(memory_segment<UX> *seg, UX va, u32 &val);
+		buserror_t (*load_64)(memory_segment<UX> *seg, UX va, u64 &val);
+
+		buserror_t (*store_8) (memory_segment<UX> *seg, UX va, u8  val);
+		buserror_t (*store_16)(memory_segment<UX> *seg, UX va, u16 val);
+		buserror_t (*store_32)(memory_segment<UX> *seg, UX va, u32 val);
+		buserror_t (*store_64)(memory_segment<UX> *seg, UX va, u64 val);
+
+		template <typename T>
+		buserror_t load(memory_segment<UX> *seg, UX va, T &val) const
+		{
+			if (sizeof(T) == 1) { return load_8(seg, va, *(u8*)&val); }
+			else if (sizeof(T) == 2) { return load_16(seg, va, *(u16*)&val); }
+			else if (sizeof(T) == 4) { return load_32(seg, va, *(u32*)&val); }
+			else if (sizeof(T) == 8) { return load_64(seg, va, *(u64*)&val); }
+			else return -1;
+		}
+
+		template <typename T>
+		buserror_t store(memory_segment<UX> *seg, UX va, T val) const
+		{
+			if (sizeof(T) == 1) { return store_8(seg, va, val); }
+			else if (sizeof(T) == 2) { return store_16(seg, va, val); }
+			else if (sizeof(T) == 4) { return store_32(seg, va, val); }
+			else if (sizeof(T) == 8) { return store_64(seg, va, val); }
+			else return -1;
+		}
+	};
+
+	template <typename UX, typename D>
+	struct mmio_dispatch
+	{
+		static buserror_t load_8 (memory_segment<UX> *seg, UX va, u8  &val) { return static_cast<D*>(seg)->D::load_8(va, val); }
+		static buserror_t load_16(memory_segment<UX> *seg, UX va, u16 &val) { return static_cast<D*>(seg)->D::load_16(va, val); }
+		static buserror_t load_32(memory_segment<UX> *seg, UX va, u32 &val) { return static_cast<D*>(seg)->D::load_32(va, val); }
+		static buserror_t load_64(memory_segment<UX> *seg, UX va, u64 &val) { return static_cast<D*>(seg)->D::load_64(va, val); }
+
+		static buserror_t store_8 (memory_segment<UX> *seg, UX va, u8  val) { return static_cast<D*>(seg)->D::store_8(va, val); }
+		static buserror_t store_16(memory_segment<UX> *seg, UX va, u16 val) { return static_cast<D*>(seg)->D::store_16(va, val); }
+		static buserror_t store_32(memory_segment<UX> *seg, UX va, u32 val) { return static_cast<D*>(seg)->D::store_32(va, val); }
+		static buserror_t store_64(memory_segment<UX> *seg, UX va, u64 val) { return static_cast<D*>(seg)->D::store_64(va, val); }
+
+		static const mmio_ops<UX>* ops()
+		{
+			static const mmio_ops<UX> ops = {
+				load_8, load_16, load_32, load_64,
+				store_8, store_16, store_32, store_64
+			};
+			return &ops;
+		}
+	};
+
+
+	/*  mmio_map is the device dispatch table indexed by machine physical
+	    page number. pages are hashed into an open addressed table with
+	    linear probing; each entry caches the bounds of its segment and the
+	    direct entry points for the device type. a page is claimed by the
+	    first device added, accesses outside its segment are left to the
+	    segment search in user_memory */
+	template <typename UX>
+	struct mmio_map
+	{
+		enum : size_t {
+			size = 256,
+			mask = size - 1
+		};
+
+		struct entry
+		{
+			UX tag;                     /* page address | 1 (0 when empty) */
+			UX mpa;                     /* segment machine physical address */
+			UX limit;                   /* segment size */
+			addr_t uva;                 /* segment user virtual address */
+			memory_segment<UX> *seg;
+			const mmio_ops<UX> *ops;
+		};
+
+		entry ent[size];
+		size_t count;
+
+		mmio_map() : ent(), count(0) {}
+
+		static size_t index(UX mpa)
+		{
+			return size_t((u64(mpa >> page_shift) * 0x9e3779b97f4a7c15ULL) >> 56) & mask;
+		}
+
+		static UX tag(UX mpa)
+		{
+			return (mpa & UX(page_mask)) | 1;
+		}
+
+		/* find the entry for the page containing mpa or nullptr */
+		entry* lookup(UX mpa)
+		{
+			UX t = tag(mpa);
+			for (size_t i = index(mpa); ; i = (i + 1) & mask) {
+				entry *e = &ent[i];
+				if (likely(e->tag == t)) return e;
+				if (e->tag == 0) return nullptr;
+			}
+		}
 
-		virtual buserror_t store_8 (UX va, u8  val) { *static_cast<u8*>((void*)(addr_t)va) = val; return 0; }
-		virtual buserror_t store_16(UX va, u16 val) { *static_cast<u16*>((void*)(addr_t)va) = val; return 0; }
-		virtual buserror_t store_32(UX va, u32 val) { *static_cast<u32*>((void*)(addr_t)va) = val; return 0; }
-		virtual buserror_t store_64(UX va, u64 val) { *static_cast<u64*>((void*)(addr_t)va) = val; return 0; }
+		/* add the page containing mpa unless it is already present */
+		void insert(UX mpa, memory_segment<UX> *seg, const mmio_ops<UX> *ops)
+		{
+			if (lookup(mpa)) return;
+			if (count == size - 1) {
+				panic("memory: error: mmio map full");
+			}
+			size_t i = index(mpa);
+			while (ent[i].tag) i = (i + 1) & mask;
+			ent[i] = entry{ tag(mpa), seg->mpa, UX(seg->size), seg->uva, seg, ops };
+			count++;
+		}
+
+		void clear()
+		{
+			for (auto &e : ent) e = entry();
+			count = 0;
+		}
 	};
 
 
+	/*  page_map is a radix tree indexed by machine physical page number.
+	    RV64 uses 4 levels of 13 bits and RV32 uses 2 levels of 10 bits.
+	    Nodes are only allocated for regions that contain mappings */
+	template <typename UX, typename T>
+	struct page_map
+	{
+		enum : size_t {
+			pn_bits = (sizeof(UX) << 3) - page_shift,
+			level_bits = pn_bits > 20 ? 13 : 10,
+			levels = (pn_bits + level_bits - 1) / level_bits,
+			level_size = size_t(1) << level_bits,
+			level_mask = level_size - 1
+		};
+
+		struct node
+		{
+			void *ent[level_size];
+
+			node() : ent() {}
+		};
+
+		std::vector<std::unique_ptr<node>> nodes;
+		node *root;
+
+		page_map() : root(alloc()) {}
+
+		node* alloc()
+		{
+			nodes.emplace_back(new node());
+			return nodes.back().get();
+		}
+
+		static size_t index(UX pn, size_t level)
+		{
+			return size_t(pn >> (level_bits * (levels - 1 - level))) & level_mask;
+		}
+
+		/* find the value for the page containing mpa or nullptr */
+		T* lookup(UX mpa)
+		{
+			UX pn = mpa >> page_shift;
+			node *n = root;
+			for (size_t level = 0; level < levels - 1; level++) {
+				n = static_cast<node*>(n->ent[index(pn, level)]);
+				if (!n) return nullptr;
+			}
+			return static_cast<T*>(n->ent[index(pn, levels - 1)]);
+		}
+
+		/* set the value for the page containing mpa unless it is already set */
+		void insert(UX mpa, T *val)
+		{
+			UX pn = mpa >> page_shift;
+			node *n = root;
+			for (size_t level = 0; level < levels - 1; level++) {
+				void* &ent = n->ent[index(pn, level)];
+				if (!ent) ent = alloc();
+				n = static_cast<node*>(ent);
+			}
+			void* &ent = n->ent[index(pn, levels - 1)];
+			if (!ent) ent = val;
+		}
+
+		void clear()
+		{
+			nodes.clear();
+			root = alloc();
+		}
+	};
+
+
+	/*  reservation_set holds the load reservations of all harts sharing a
+	    memory map. reservations are on 64 byte granules of machine physical
+	    memory hashed into a table of owner hart ids. LR claims the slot for
+	    its granule, stores clear it and SC succeeds only if the hart still
+	    owns the slot. harts whose granules alias in the table steal each
+	    other's reservations, which the ISA permits as a spurious SC failure.
+	    SC also compares and swaps the value loaded by LR so a store that
+	    changes the word between the slot check and the SC is detected.
+	    live counts the occupied slots so that stores skip the table with
+	    a relaxed load while no hart holds a reservation */
+	struct reservation_set
+	{
+		enum : size_t {
+			granule_shift = 6,
+			granule_size = size_t(1) << granule_shift,
+			size = 4096,
+			mask = size - 1
+		};
+
+		std::atomic<u32> owner[size];
+		std::atomic<u32> live;
+
+		reservation_set() : owner(), live(0) {}
+
+		static size_t index(addr_t mpa)
+		{
+			return size_t(mpa >> granule_shift) & mask;
+		}
+
+		/* test if any hart may hold a reservation */
+		bool any() const
+		{
+			return live.load(std::memory_order_relaxed) != 0;
+		}
+
+		/* reserve the granule containing mpa for hart_id */
+		void acquire(addr_t mpa, u32 hart_id)
+		{
+			/* count before the slot is visible so stores never miss it */
+			live.fetch_add(1, std::memory_order_acq_rel);
+			if (owner[index(mpa)].exchange(hart_id + 1, std::memory_order_acq_rel)) {
+				live.fetch_sub(1, std::memory_order_relaxed);
+			}
+		}
+
+		/* release the reservation of hart_id (returns false if it was lost) */
+		bool release(addr_t mpa, u32 hart_id)
+		{
+			u32 expected = hart_id + 1;
+			if (!owner[index(mpa)].compare_exchange_strong(expected, 0,
+				std::memory_order_acq_rel)) return false;
+			live.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+
+		/* invalidate any reservation on the granule containing mpa */
+		void invalidate(addr_t mpa)
+		{
+			if (likely(!any())) return;
+			std::atomic<u32> &slot = owner[index(mpa)];
+			if (unlikely(slot.load(std::memory_order_relaxed)) &&
+				slot.exchange(0, std::memory_order_acq_rel)) {
+				live.fetch_sub(1, std::memory_order_relaxed);
+			}
+		}
+
+		/* invalidate reservations on the granules overlapping [mpa, mpa + len) */
+		void invalidate(addr_t mpa, size_t len)
+		{
+			if (likely(!any()) || len == 0) return;
+			addr_t end = mpa + len;
+			for (mpa &= ~addr_t(granule_size - 1); mpa < end && any(); mpa += granule_size) {
+				invalidate(mpa);
+			}
+		}
+	};
+
 	/*  user_memory device contains mappings for mulitple segments of emulated
-	    physical address space to user virtual address space */
+	    physical address space to user virtual address space.
+
+	    segments are indexed by physical page so that address decoding is a
+	    radix tree lookup. a page shared by several segments maps to the
+	    first segment added and addresses outside of it fall back to a
+	    linear search of the segments. device segments added with add_mmio
+	    are also entered into the mmio map, which is checked first so that
+	    device accesses are a hashed page lookup and a direct call.
+
+	    fastmem mode reserves a host window covering machine physical
+	    addresses below the end of the highest host memory segment and
+	    moves the host memory segments into it, so that machine physical
+	    address mpa is at fastmem_base + mpa. device holes in the window
+	    are left inaccessible and a bitmap marks the pages that hold host
+	    memory, so device accesses are sent to the memory bus without
+	    touching the window. accesses that still fault raise SIGSEGV and
+	    are retried through the memory bus with the window disabled. the
+	    window is enabled per hart in the soft mmu as the memory map may
+	    be shared by several harts, which also share its reservation set */
 	template <typename UX>
 	struct user_memory : memory_bus<UX>
 	{
 		typedef std::shared_ptr<memory_segment<UX>> memory_segment_type;
 
 		std::vector<memory_segment_type> segments;
+		page_map<UX,memory_segment<UX>> page_segments;
+		mmio_map<UX> mmio_pages;
+		addr_t fastmem_base;   /* host address of the fastmem window */
+		size_t fastmem_size;   /* size of the fastmem window */
+		std::vector<u64> fastmem_map; /* bit per window page set for host memory */
+		reservation_set reservations;
 		bool log;
 
-		user_memory() : log(false) {}
-		~user_memory() { clear_segments(); }
+		user_memory() : fastmem_base(0), fastmem_size(0), log(false) {}
+
+		~user_memory()
+		{
+			clear_segments();
+			if (fastmem_base) {
+				munmap((void*)fastmem_base, fastmem_size);
+			}
+		}
 
 		/* print memory */
 		void print_memory_map()
@@ -122,11 +441,28 @@ namespace riscv {
 		void add_segment(memory_segment_type seg)
 		{
 			segments.push_back(seg);
+			size_t pages = (size_t((seg->mpa & ~UX(page_mask)) + seg->size) + page_size - 1) >> page_shift;
+			for (size_t i = 0; i < pages; i++) {
+				page_segments.insert(seg->mpa + UX(i << page_shift), seg.get());
+			}
 			if (log) {
 				print_memory_segment(seg);
 			}
 		}
 
+		/* add device segment and enter its pages into the mmio map */
+		template <typename D>
+		void add_mmio(std::shared_ptr<D> dev)
+		{
+			add_segment(dev);
+			memory_segment<UX> *seg = dev.get();
+			const mmio_ops<UX> *ops = mmio_dispatch<UX,D>::ops();
+			size_t pages = (size_t((seg->mpa & ~UX(page_mask)) + seg->size) + page_size - 1) >> page_shift;
+			for (size_t i = 0; i < pages; i++) {
+				mmio_pages.insert(seg->mpa + UX(i << page_shift), seg, ops);
+			}
+		}
+
 		void add_mmap(UX mpa, intptr_t uva, size_t size, UX flags)
 		{
 			add_segment(std::make_shared<mmap_memory_segment<UX>>("ELF", mpa, uva, size, flags));
@@ -144,89 +480,176 @@ namespace riscv {
 				pma_type_main | pma_prot_read | pma_prot_write | pma_prot_execute));
 		}
 
-		/* Unmap memory segments */
-		void clear_segments()
+		/* move host memory segments into a fastmem window (call after adding segments) */
+		void enable_fastmem()
 		{
-			segments.clear();
-		}
+		#if defined __linux__
+			for (auto &seg : segments) {
+				if (seg->direct && size_t(seg->mpa) + seg->size > fastmem_size) {
+					fastmem_size = round_up(size_t(seg->mpa) + seg->size, size_t(page_size));
+				}
+			}
+			if (fastmem_size == 0) return;
+			void *addr = mmap(nullptr, fastmem_size, PROT_NONE,
+				MAP_ANONYMOUS | MAP_PRIVATE | MAP_NORESERVE, -1, 0);
+			if (addr == MAP_FAILED) {
+				panic("memory: error: fastmem: mmap: %s", strerror(errno));
+			}
+			fastmem_base = addr_t(addr);
+
+			/* the first segment added takes precedence so move segments in reverse */
+			for (auto si = segments.rbegin(); si != segments.rend(); si++) {
+				auto &seg = *si;
+				if (!seg->direct || (seg->mpa & ~UX(page_mask)) || (seg->size & ~size_t(page_mask))) continue;
+				addr = mremap((void*)seg->uva, seg->size, seg->size,
+					MREMAP_MAYMOVE | MREMAP_FIXED, (void*)(fastmem_base + seg->mpa));
+				if (addr == MAP_FAILED) {
+					panic("memory: error: fastmem: mremap: %s", strerror(errno));
+				}
+				seg->uva = addr_t(addr);
+			}
 
-		/* convert machine physical address to user virtual address */
-		addr_t mpa_to_uva(memory_segment<UX>* &out_seg, UX mpa)
-		{
+			/* mark the pages that hold host memory */
+			fastmem_map.assign(((fastmem_size >> page_shift) + 63) >> 6, 0);
 			for (auto &seg : segments) {
-				if (mpa >= seg->mpa && /* note the upper limit may wrap to 0 */
-					((mpa < seg->mpa + seg->size) || (seg->mpa + seg->size == 0))) {
-					out_seg = seg.get();
-					return seg->uva + (mpa - seg->mpa);
+				if (!seg->direct || seg->uva != addr_t(fastmem_base + seg->mpa)) continue;
+				for (size_t page = size_t(seg->mpa) >> page_shift,
+					end = page + (seg->size >> page_shift); page < end; page++) {
+					fastmem_map[page >> 6] |= u64(1) << (page & 63);
 				}
 			}
-			return 0;
+			if (log) {
+				debug("soft-mmu :fastmem window 0x%016llx-0x%016llx",
+					(u64)fastmem_base, (u64)fastmem_base + fastmem_size);
+			}
+		#else
+			panic("memory: error: fastmem is only supported on Linux");
+		#endif
 		}
 
-		virtual buserror_t load_8(UX va, u8 &val)
+		/* test if mpa (below fastmem_size) is host memory in the fastmem window */
+		bool fastmem_page(addr_t mpa)
 		{
-			memory_segment<UX> *segment = nullptr;
-			addr_t uva = mpa_to_uva(segment, va);
-			if (unlikely(!segment)) return -1;
-			return segment->load_8(uva, val);
+			size_t page = size_t(mpa) >> page_shift;
+			return (fastmem_map[page >> 6] >> (page & 63)) & 1;
 		}
 
-		virtual buserror_t load_16(UX va, u16 &val)
+		/* test if a host fault address is within the fastmem window */
+		bool fastmem_contains(addr_t addr)
 		{
-			memory_segment<UX> *segment = nullptr;
-			addr_t uva = mpa_to_uva(segment, va);
-			if (unlikely(!segment)) return -1;
-			return segment->load_16(uva, val);
+			return size_t(addr - fastmem_base) < fastmem_size;
 		}
 
-		virtual buserror_t load_32(UX va, u32 &val)
+		/* Unmap memory segments */
+		void clear_segments()
 		{
-			memory_segment<UX> *segment = nullptr;
-			addr_t uva = mpa_to_uva(segment, va);
-			if (unlikely(!segment)) return -1;
-			return segment->load_32(uva, val);
+			segments.clear();
+			page_segments.clear();
+			mmio_pages.clear();
 		}
 
-		virtual buserror_t load_64(UX va, u64 &val)
+		static bool segment_contains(memory_segment<UX> *seg, UX mpa)
 		{
-			memory_segment<UX> *segment = nullptr;
-			addr_t uva = mpa_to_uva(segment, va);
-			if (unlikely(!segment)) return -1;
-			return segment->load_64(uva, val);
+			return mpa >= seg->mpa && /* note the upper limit may wrap to 0 */
+				((mpa < seg->mpa + seg->size) || (seg->mpa + seg->size == 0));
 		}
 
-		virtual buserror_t store_8 (UX va, u8  val)
+		/* convert machine physical address to user virtual address */
+		addr_t mpa_to_uva(memory_segment<UX>* &out_seg, UX mpa)
 		{
-			memory_segment<UX> *segment = nullptr;
-			addr_t uva = mpa_to_uva(segment, va);
-			if (unlikely(!segment)) return -1;
-			return segment->store_8(uva, val);
+			memory_segment<UX> *seg = page_segments.lookup(mpa);
+			if (likely(seg && segment_contains(seg, mpa))) {
+				out_seg = seg;
+				return seg->uva + (mpa - seg->mpa);
+			}
+			return seg ? mpa_to_uva_search(out_seg, mpa) : 0;
 		}
 
-		virtual buserror_t store_16(UX va, u16 val)
+		/* convert machine physical address to user virtual address (linear search) */
+		addr_t mpa_to_uva_search(memory_segment<UX>* &out_seg, UX mpa)
 		{
-			memory_segment<UX> *segment = nullptr;
-			addr_t uva = mpa_to_uva(segment, va);
-			if (unlikely(!segment)) return -1;
-			return segment->store_16(uva, val);
+			for (auto &seg : segments) {
+				if (segment_contains(seg.get(), mpa)) {
+					out_seg = seg.get();
+					return seg->uva + (mpa - seg->mpa);
+				}
+			}
+			return 0;
 		}
 
-		virtual buserror_t store_32(UX va, u32 val)
+		/* convert machine physical address to the user virtual address of its page
+		   (returns 0 unless the whole page is in a direct host memory segment) */
+		addr_t mpa_to_host_page(UX mpa)
 		{
-			memory_segment<UX> *segment = nullptr;
-			addr_t uva = mpa_to_uva(segment, va);
+			memory_segment<UX> *seg = nullptr;
+			UX page_mpa = mpa & UX(page_mask);
+			addr_t uva = mpa_to_uva(seg, page_mpa);
+			if (!seg || !seg->direct || size_t(page_mpa - seg->mpa) + page_size > seg->size) return 0;
+			return uva;
+		}
+
+		/* load from RAM inline, from a device in the mmio map or from
+		   any other segment via virtual dispatch. RAM is resolved first
+		   through the page map so RAM accesses never probe the mmio map */
+		template <typename T>
+		buserror_t load(UX mpa, T &val)
+		{
+			memory_segment<UX> *segment = page_segments.lookup(mpa);
+			if (unlikely(!segment)) return -1;
+			if (likely(segment->direct && segment_contains(segment, mpa))) {
+				mmap_memory_segment<UX>::load_direct(segment->uva + (mpa - segment->mpa), val);
+				return 0;
+			}
+			typename mmio_map<UX>::entry *ent = mmio_pages.lookup(mpa);
+			if (ent && likely(UX(mpa - ent->mpa) < ent->limit)) {
+				return ent->ops->load(ent->seg, UX(ent->uva + (mpa - ent->mpa)), val);
+			}
+			segment = nullptr;
+			addr_t uva = mpa_to_uva(segment, mpa);
 			if (unlikely(!segment)) return -1;
-			return segment->store_32(uva, val);
+			if (segment->direct) {
+				mmap_memory_segment<UX>::load_direct(uva, val);
+				return 0;
+			}
+			return segment->load(uva, val);
 		}
 
-		virtual buserror_t store_64(UX va, u64 val)
+		/* store to RAM inline, to a device in the mmio map or to
+		   any other segment via virtual dispatch. RAM is resolved first
+		   through the page map so RAM accesses never probe the mmio map */
+		template <typename T>
+		buserror_t store(UX mpa, T val)
 		{
-			memory_segment<UX> *segment = nullptr;
-			addr_t uva = mpa_to_uva(segment, va);
+			memory_segment<UX> *segment = page_segments.lookup(mpa);
+			if (unlikely(!segment)) return -1;
+			if (likely(segment->direct && segment_contains(segment, mpa))) {
+				mmap_memory_segment<UX>::store_direct(segment->uva + (mpa - segment->mpa), val);
+				return 0;
+			}
+			typename mmio_map<UX>::entry *ent = mmio_pages.lookup(mpa);
+			if (ent && likely(UX(mpa - ent->mpa) < ent->limit)) {
+				return ent->ops->store(ent->seg, UX(ent->uva + (mpa - ent->mpa)), val);
+			}
+			segment = nullptr;
+			addr_t uva = mpa_to_uva(segment, mpa);
 			if (unlikely(!segment)) return -1;
-			return segment->store_64(uva, val);
+			if (segment->direct) {
+				mmap_memory_segment<UX>::store_direct(uva, val);
+				return 0;
+			}
+			return segment->store(uva, val);
 		}
 
+		virtual buserror_t load_8 (UX va, u8  &val) { return load(va, val); }
+		virtual buserror_t load_16(UX va, u16 &val) { return load(va, val); }
+		virtual buserror_t load_32(UX va, u32 &val) { return load(va, val); }
+		virtual buserror_t load_64(UX va, u64 &val) { return load(va, val); }
+
+		virtual buserror_t store_8 (UX va, u8  val) { return store(va, val); }
+		virtual buserror_t store_16(UX va, u16 val) { return store(va, val); }
+		virtual buserror_t store_32(UX va, u32 val) { return store(va, val); }
+		virtual buserror_t store_64(UX va, u64 val) { return store(va, val); }
+
 	};
 
 }
@@ -33,6 +33,10 @@ namespace riscv {
 
 		static const bool enfore_memory_top = false;
 
+		/* translated code accesses the proxy address space directly */
+
+		static const bool jit_use_mmu = false;
+
 		typedef std::shared_ptr<MEMORY> memory_type;
 
 		enum : addr_t {
@@ -47,10 +51,23 @@ namespace riscv {
 		mmu_proxy() : mem(std::make_shared<MEMORY>()) {}
 		mmu_proxy(memory_type mem) : mem(mem) {}
 
-		template <typename P> inst_t inst_fetch(P &proc, UX pc, typename P::ux &pc_offset)
+		/*
+		 * hist_pc=false compiles out the pc histogram check for
+		 * step loops that are only selected when it is disabled
+		 */
+
+		template <const bool hist_pc = true, typename P>
+		inst_t inst_fetch(P &proc, UX pc, typename P::ux &pc_offset)
+		{
+			return riscv::inst_fetch(inst_translate<hist_pc>(proc, pc), pc_offset);
+		}
+
+		/* translate instruction address (key for the decoded block cache) */
+		template <const bool hist_pc = true, typename P>
+		addr_t inst_translate(P &proc, UX pc)
 		{
 			/* record pc histogram using machine physical address */
-			if (proc.log & proc_log_hist_pc) {
+			if (hist_pc && (proc.log & proc_log_hist_pc)) {
 				size_t iters = proc.histogram_add_pc(pc);
 				if (proc.log & proc_log_jit_trap) {
 					switch (iters) {
@@ -64,17 +81,43 @@ namespace riscv {
 					}
 				}
 			}
-			return riscv::inst_fetch(pc, pc_offset);
+			return pc;
+		}
+
+		/* JIT trace cache key (the address space never changes) */
+		template <typename P> addr_t trace_key(P &proc, UX pc)
+		{
+			return pc;
 		}
 
+		/* JIT TLB hooks (translated code accesses the proxy address space directly) */
+
+		template <typename P> void jit_tlb_sync(P &proc) {}
+		template <typename P> void jit_tlb_fill(P &proc, UX va, bool store) {}
+
 		/* Note: in this simple proxy MMU model, stores beyond memory top wrap */
 
 		template <typename P, typename T>
 		void amo(P &proc, const amo_op a_op, UX va, T &val1, T val2)
 		{
-			val1 = UX(*(T*)addr_t(va & (memory_top - 1)));
-			val2 = amo_fn<UX>(a_op, val1, val2);
-			*((T*)addr_t(va & (memory_top - 1))) = val2;
+			val1 = amo_host<T>(a_op, (T*)addr_t(va & (memory_top - 1)), val2);
+		}
+
+		/* the proxy address space is host memory so SC compares and swaps the LR value */
+
+		template <typename P, typename T> void lr(P &proc, UX va, T &val)
+		{
+			val = __atomic_load_n((T*)addr_t(va & (memory_top - 1)), __ATOMIC_SEQ_CST);
+			proc.lr = va;
+			proc.lr_val = val;
+		}
+
+		template <typename P, typename T> UX sc(P &proc, UX va, T val)
+		{
+			UX lr_va = proc.lr;
+			proc.lr = -1;
+			if (lr_va != va) return 1;
+			return cas_host<T>((T*)addr_t(va & (memory_top - 1)), T(proc.lr_val), val) ? 0 : 1;
 		}
 
 		template <typename P, typename T> void load(P &proc, UX va, T &val)
@@ -12,26 +12,64 @@ namespace riscv {
 	{
 		typedef TLB    tlb_type;
 		typedef PMA    pma_type;
+		typedef page_walk_cache<UX> pwc_type;
 
 		typedef std::shared_ptr<MEMORY> memory_type;
 
+		/* translated loads and stores are checked by the MMU */
+
+		static const bool jit_use_mmu = true;
+
 		enum mmu_op {
 			op_fetch,
 			op_load,
 			op_store
 		};
 
+		/* instruction fetch page cache */
+
+		struct fetch_page_t
+		{
+			UX      va;                 /* virtual page address (not page aligned if invalid) */
+			UX      mode;               /* privilege mode */
+			UX      sptbr;              /* Supervisor Page Table Base Register */
+			UX      vm;                 /* virtual memory mode */
+			addr_t  mpa;                /* machine physical page address */
+			addr_t  uva;                /* user virtual page address (0 for MMIO) */
+
+			fetch_page_t() : va(UX(-1)), mode(0), sptbr(0), vm(0), mpa(0), uva(0) {}
+		};
+
+		/* JIT TLB translation context */
+
+		struct jit_ctx_t
+		{
+			UX      mode;               /* privilege mode */
+			UX      sptbr;              /* Supervisor Page Table Base Register */
+			UX      vm;                 /* virtual memory mode */
+			UX      mprv;               /* modify privilege */
+			UX      mpp;                /* machine previous privilege mode */
+			UX      pum;                /* protect user memory */
+			UX      mxr;                /* make executable readable */
+
+			jit_ctx_t() : mode(UX(-1)), sptbr(0), vm(0), mprv(0), mpp(0), pum(0), mxr(0) {}
+		};
+
 		/* MMU properties */
 
 		tlb_type       l1_itlb;     /* L1 Instruction TLB */
 		tlb_type       l1_dtlb;     /* L1 Data TLB */
+		pwc_type       pwc;         /* Page Walk Cache */
 		pma_type       pma;         /* PMA table */
 		memory_type    mem;         /* memory device */
+		fetch_page_t   fetch_page;  /* current instruction page */
+		jit_ctx_t      jit_ctx;     /* context of the JIT TLB entries */
+		size_t         fastmem_limit; /* fastmem window size if enabled otherwise 0 */
 
 		/* MMU constructor */
 
-		mmu_soft() : mem(std::make_shared<MEMORY>()) {}
-		mmu_soft(memory_type mem) : mem(mem) {}
+		mmu_soft() : mem(std::make_shared<MEMORY>()), fastmem_limit(0) {}
+		mmu_soft(memory_type mem) : mem(mem), fastmem_limit(0) {}
 
 		/* MMU methods */
 
@@ -97,11 +135,163 @@ namespace riscv {
 			);
 		}
 
-		/* instruction fetch */
+		/* translate instruction address using the fetch page cache
+		   (raises exception on translation fault or execute permission fault) */
 		template <typename P, const mmu_op op = op_fetch>
-		inst_t inst_fetch(P &proc, UX pc, typename P::ux &pc_offset)
+		addr_t fetch_translate(P &proc, UX va)
+		{
+			typename tlb_type::tlb_entry_t* tlb_ent = nullptr;
+			UX va_page = va & UX(page_mask);
+
+			/* translation is valid if mode, sptbr and vm are unchanged */
+			if (likely(fetch_page.va == va_page &&
+				fetch_page.mode == proc.mode &&
+				fetch_page.sptbr == proc.sptbr &&
+				fetch_page.vm == proc.mstatus.r.vm))
+			{
+				return fetch_page.mpa + (va & ~UX(page_mask));
+			}
+
+			/* translate to machine physical (raises exception on fault) */
+			addr_t mpa = translate_addr<P,op>(proc, va, tlb_ent);
+			if (!mpa) return 0;
+
+			/* check execute permissions */
+			if (unlikely(fetch_access_fault(proc, proc.mode, tlb_ent))) {
+				proc.raise(rv_cause_fault_fetch, va);
+				return 0;
+			}
+
+			/* cache the translation and host address of the page */
+			fetch_page.va = va_page;
+			fetch_page.mode = proc.mode;
+			fetch_page.sptbr = proc.sptbr;
+			fetch_page.vm = proc.mstatus.r.vm;
+			fetch_page.mpa = mpa & addr_t(page_mask);
+			fetch_page.uva = mem->mpa_to_host_page(mpa);
+
+			return mpa;
+		}
+
+		/* fetch 16-bit instruction parcel from host memory or via the memory bus */
+		buserror_t fetch_parcel(addr_t mpa, u16 &parcel)
+		{
+			if (likely(fetch_page.uva && (mpa & addr_t(page_mask)) == fetch_page.mpa)) {
+				parcel = *static_cast<u16*>((void*)(fetch_page.uva + (mpa & ~addr_t(page_mask))));
+				return 0;
+			}
+			return mem->load(mpa, parcel);
+		}
+
+		/* invalidate the fetch page cache */
+		void flush_fetch_page()
+		{
+			fetch_page = fetch_page_t();
+		}
+
+		/*
+		 * the JIT TLB in the processor is tagged by virtual page only, so it
+		 * is flushed whenever the translation context differs from the one
+		 * its entries were filled in. the context can only change outside
+		 * of translated code, so the run loop syncs before entering a trace.
+		 * the sync also points translated stores at the live reservation
+		 * count of the memory map
+		 */
+		template <typename P> void jit_tlb_sync(P &proc)
+		{
+			proc.jit_reservations = &mem->reservations.live;
+			if (likely(jit_ctx.mode == proc.mode &&
+				jit_ctx.sptbr == proc.sptbr &&
+				jit_ctx.vm == proc.mstatus.r.vm &&
+				jit_ctx.mprv == proc.mstatus.r.mprv &&
+				jit_ctx.mpp == proc.mstatus.r.mpp &&
+				jit_ctx.pum == proc.mstatus.r.pum &&
+				jit_ctx.mxr == proc.mstatus.r.mxr))
+			{
+				return;
+			}
+			proc.jit_tlb_flush();
+			jit_ctx.mode = proc.mode;
+			jit_ctx.sptbr = proc.sptbr;
+			jit_ctx.vm = proc.mstatus.r.vm;
+			jit_ctx.mprv = proc.mstatus.r.mprv;
+			jit_ctx.mpp = proc.mstatus.r.mpp;
+			jit_ctx.pum = proc.mstatus.r.pum;
+			jit_ctx.mxr = proc.mstatus.r.mxr;
+		}
+
+		/* fill the JIT TLB after a load or store from translated code has completed */
+		template <typename P> void jit_tlb_fill(P &proc, UX va, bool store)
 		{
 			typename tlb_type::tlb_entry_t* tlb_ent = nullptr;
+
+			/* the access succeeded so the translation and permission checks pass */
+			jit_tlb_sync(proc);
+			addr_t mpa = store ?
+				translate_addr<P,op_store>(proc, va, tlb_ent) :
+				translate_addr<P,op_load>(proc, va, tlb_ent);
+			addr_t uva = tlb_ent ? tlb_ent->uva : mem->mpa_to_host_page(mpa);
+
+			/* MMIO is always accessed via the load store stubs */
+			if (!uva) return;
+
+			/* entries hold one host page so evict both tags if the page differs */
+			u64 va_page = u64(va & UX(page_mask));
+			size_t i = size_t(va >> page_shift) & (P::jit_tlb_size - 1);
+			if (proc.jit_tlb_read[i] != va_page && proc.jit_tlb_write[i] != va_page) {
+				proc.jit_tlb_clear(i);
+			}
+			proc.jit_tlb_host[i] = u64(uva);
+			if (store) {
+				proc.jit_tlb_write[i] = va_page;
+			} else {
+				proc.jit_tlb_read[i] = va_page;
+			}
+		}
+
+		/* translate instruction address (key for the decoded block cache) */
+		template <const bool hist_pc = true, typename P, const mmu_op op = op_fetch>
+		addr_t inst_translate(P &proc, UX pc)
+		{
+			/* raise exception if address is misalligned */
+			if (unlikely(misaligned<u16>(pc))) {
+				proc.raise(rv_cause_misaligned_fetch, pc);
+				return 0;
+			}
+
+			/* translate to machine physical (raises exception on fault) */
+			addr_t mpa = fetch_translate<P,op>(proc, pc);
+			if (hist_pc && mpa) histogram_pc(proc, pc, mpa);
+			return mpa;
+		}
+
+		/* record pc histogram using machine physical address and trap hotspots */
+		template <typename P> void histogram_pc(P &proc, UX pc, addr_t mpa)
+		{
+			if (!(proc.log & proc_log_hist_pc)) return;
+			size_t iters = proc.histogram_add_pc(mpa);
+			if ((proc.log & proc_log_jit_trap) &&
+				iters != P::hostspot_trace_skip && iters >= proc.trace_iters)
+			{
+				proc.raise(P::internal_cause_hotspot, pc);
+			}
+		}
+
+		/*
+		 * JIT trace cache key. traces are keyed by machine physical
+		 * address so they survive address space switches, and by
+		 * privilege mode as translated loads and stores are checked
+		 * against the mode they were traced in
+		 */
+		template <typename P> addr_t trace_key(P &proc, UX pc)
+		{
+			return fetch_translate<P>(proc, pc) | (addr_t(proc.mode) << 62);
+		}
+
+		/* instruction fetch (hist_pc=false compiles out the pc histogram check) */
+		template <const bool hist_pc = true, typename P, const mmu_op op = op_fetch>
+		inst_t inst_fetch(P &proc, UX pc, typename P::ux &pc_offset)
+		{
 			inst_t inst = 0;
 			u16 inst_16;
 
@@ -112,68 +302,86 @@ namespace riscv {
 			}
 
 			/* translate to machine physical (raises exception on fault) */
-			addr_t mpa = translate_addr<P,op>(proc, pc, tlb_ent);
+			addr_t mpa = fetch_translate<P,op>(proc, pc);
 			if (!mpa) return 0;
 
-			/* check execute permissions and fetch first 16 bits */
-			if (unlikely(fetch_access_fault(proc, proc.mode, tlb_ent) || mem->load(mpa, inst_16))) {
+			/* fetch first 16 bits */
+			if (unlikely(fetch_parcel(mpa, inst_16))) {
 				proc.raise(rv_cause_fault_fetch, pc);
 				return 0;
 			}
 
 			/* record pc histogram using machine physical address */
-			if (proc.log & proc_log_hist_pc) {
-				proc.histogram_add_pc(mpa);
-			}
+			if (hist_pc) histogram_pc(proc, pc, mpa);
 
-			/* decode length and fetch any remaining instruction bytes */
+			/* decode length */
 			inst = htole16(inst_16);
 			if ((inst & 0b11) != 0b11) {
 				pc_offset = 2;
 			} else if ((inst & 0b11100) != 0b11100) {
-				if (unlikely(mem->load(mpa + 2, inst_16))) {
-					proc.raise(rv_cause_fault_fetch, pc);
-					return 0;
-				}
-				inst |= inst_t(htole16(inst_16)) << 16;
 				pc_offset = 4;
 			} else if ((inst & 0b111111) == 0b011111) {
-				if (unlikely(mem->load(mpa + 2, inst_16))) {
-					proc.raise(rv_cause_fault_fetch, pc);
-					return 0;
-				}
-				inst |= inst_t(htole16(inst_16)) << 16;
-				if (unlikely(mem->load(mpa + 4, inst_16))) {
-					proc.raise(rv_cause_fault_fetch, pc);
-					return 0;
-				}
-				inst |= inst_t(htole16(inst_16)) << 32;
 				pc_offset = 6;
 			} else if ((inst & 0b1111111) == 0b0111111) {
-				if (unlikely(mem->load(mpa + 2, inst_16))) {
-					proc.raise(rv_cause_fault_fetch, pc);
-					return 0;
-				}
-				inst |= inst_t(htole16(inst_16)) << 16;
-				if (unlikely(mem->load(mpa + 4, inst_16))) {
-					proc.raise(rv_cause_fault_fetch, pc);
-					return 0;
-				}
-				inst |= inst_t(htole16(inst_16)) << 32;
-				if (unlikely(mem->load(mpa + 6, inst_16))) {
-					proc.raise(rv_cause_fault_fetch, pc);
-					return 0;
-				}
-				inst |= inst_t(htole16(inst_16)) << 48;
 				pc_offset = 8;
 			} else {
 				proc.raise(rv_cause_fault_fetch, pc);
 				return 0;
 			}
+
+			/* fetch remaining instruction bytes, translating the next page
+			   if the instruction crosses a page boundary */
+			for (UX i = 2; i < pc_offset; i += 2) {
+				UX va = pc + i;
+				if (unlikely((va & ~UX(page_mask)) == 0)) {
+					mpa = fetch_translate<P,op>(proc, va);
+					if (!mpa) return 0;
+				} else {
+					mpa += 2;
+				}
+				if (unlikely(fetch_parcel(mpa, inst_16))) {
+					proc.raise(rv_cause_fault_fetch, va);
+					return 0;
+				}
+				inst |= inst_t(htole16(inst_16)) << (i << 3);
+			}
 			return inst;
 		}
 
-		/* amo */
+		/* load from the fastmem window if enabled and mpa is RAM otherwise via the memory bus */
+		template <typename T> buserror_t mem_load(addr_t mpa, T &val)
+		{
+			if (size_t(mpa) < fastmem_limit && mem->fastmem_page(mpa)) {
+				val = *static_cast<T*>((void*)(mem->fastmem_base + mpa));
+				return 0;
+			}
+			return mem->load(mpa, val);
+		}
+
+		/* store to the fastmem window if enabled and mpa is RAM otherwise via the memory bus */
+		template <typename T> buserror_t mem_store(addr_t mpa, T val)
+		{
+			if (size_t(mpa) < fastmem_limit && mem->fastmem_page(mpa)) {
+				*static_cast<T*>((void*)(mem->fastmem_base + mpa)) = val;
+				return 0;
+			}
+			return mem->store(mpa, val);
+		}
+
+		/* host address of guest RAM at mpa for atomic access (0 for device memory) */
+		addr_t mem_host_addr(typename tlb_type::tlb_entry_t* tlb_ent, UX va, addr_t mpa)
+		{
+			if (tlb_ent && tlb_ent->uva) {
+				return tlb_ent->uva + (va & ~UX(page_mask));
+			}
+			if (size_t(mpa) < fastmem_limit && mem->fastmem_page(mpa)) {
+				return mem->fastmem_base + mpa;
+			}
+			addr_t uva = mem->mpa_to_host_page(mpa);
+			return uva ? uva + (mpa & ~addr_t(page_mask)) : 0;
+		}
+
+		/* amo (host atomic on RAM, load and store via the memory bus for devices) */
 		template <typename P, typename T, const mmu_op op = op_store>
 		void amo(P &proc, const amo_op a_op, UX va, T &val1, T val2)
 		{
@@ -189,21 +397,104 @@ namespace riscv {
 			addr_t mpa = translate_addr<P,op>(proc, va, tlb_ent);
 			if (!mpa) return;
 
-			/* TODO - plumb amo interface into the memory bus */
-
-			/* Check read permissions and perform load */
-			if (unlikely(load_access_fault(proc, proc.mode, tlb_ent) || mem->load(mpa, val1))) {
+			/* check read and write permissions */
+			if (unlikely(load_access_fault(proc, proc.mode, tlb_ent) ||
+				store_access_fault(proc, proc.mode, tlb_ent))) {
 				proc.raise(rv_cause_fault_store, va);
 				return;
 			}
 
-			/* execute atomic op */
+			/* execute atomic op on host memory */
+			addr_t uva = mem_host_addr(tlb_ent, va, mpa);
+			if (likely(uva)) {
+				val1 = amo_host<T>(a_op, static_cast<T*>((void*)uva), val2);
+				mem->reservations.invalidate(mpa);
+				return;
+			}
+
+			/* perform load, atomic op and store via the memory bus */
+			if (unlikely(mem_load(mpa, val1))) {
+				proc.raise(rv_cause_fault_store, va);
+				return;
+			}
 			val2 = amo_fn<UX>(a_op, val1, val2);
+			if (unlikely(mem_store(mpa, val2))) {
+				proc.raise(rv_cause_fault_store, va);
+			}
+		}
+
+		/* load reserved (reserves the granule in the reservation set of the memory map) */
+		template <typename P, typename T, const mmu_op op = op_load>
+		void lr(P &proc, UX va, T &val)
+		{
+			typename tlb_type::tlb_entry_t* tlb_ent = nullptr;
+
+			/* raise exception if address is misalligned */
+			if (unlikely(misaligned<T>(va))) {
+				proc.raise(rv_cause_misaligned_load, va);
+				return;
+			}
+
+			/* translate to physical (raises exception on fault) */
+			addr_t mpa = translate_addr<P,op>(proc, va, tlb_ent);
+			if (!mpa) return;
+
+			/* check read permissions */
+			if (unlikely(load_access_fault(proc, proc.mode, tlb_ent))) {
+				proc.raise(rv_cause_fault_load, va);
+				return;
+			}
+
+			/* reserve before loading so an intervening store is observed */
+			mem->reservations.acquire(mpa, proc.hart_id);
+			addr_t uva = mem_host_addr(tlb_ent, va, mpa);
+			if (likely(uva)) {
+				val = __atomic_load_n(static_cast<T*>((void*)uva), __ATOMIC_SEQ_CST);
+			} else if (unlikely(mem_load(mpa, val))) {
+				proc.raise(rv_cause_fault_load, va);
+				return;
+			}
+			proc.lr = mpa;
+			proc.lr_val = val;
+		}
 
-			/* Check write permissions and perform store */
-			if (unlikely(store_access_fault(proc, proc.mode, tlb_ent) || mem->store(mpa, val2))) {
+		/* store conditional (returns 0 on success and 1 on failure) */
+		template <typename P, typename T, const mmu_op op = op_store>
+		UX sc(P &proc, UX va, T val)
+		{
+			typename tlb_type::tlb_entry_t* tlb_ent = nullptr;
+
+			/* raise exception if address is misalligned */
+			if (unlikely(misaligned<T>(va))) {
+				proc.raise(rv_cause_misaligned_store, va);
+				return 1;
+			}
+
+			/* translate to physical (raises exception on fault) */
+			addr_t mpa = translate_addr<P,op>(proc, va, tlb_ent);
+			if (!mpa) return 1;
+
+			/* check write permissions */
+			if (unlikely(store_access_fault(proc, proc.mode, tlb_ent))) {
+				proc.raise(rv_cause_fault_store, va);
+				return 1;
+			}
+
+			/* fail if this hart has no reservation on the address or lost it */
+			addr_t lr_mpa = proc.lr;
+			proc.lr = -1;
+			if (lr_mpa != mpa || !mem->reservations.release(mpa, proc.hart_id)) {
+				return 1;
+			}
+
+			/* store if memory still holds the value loaded by LR */
+			addr_t uva = mem_host_addr(tlb_ent, va, mpa);
+			if (likely(uva)) {
+				return cas_host<T>(static_cast<T*>((void*)uva), T(proc.lr_val), val) ? 0 : 1;
+			} else if (unlikely(mem_store(mpa, val))) {
 				proc.raise(rv_cause_fault_store, va);
 			}
+			return 0;
 		}
 
 		/* load */
@@ -222,8 +513,16 @@ namespace riscv {
 			addr_t mpa = translate_addr<P,op>(proc, va, tlb_ent);
 			if (!mpa) return;
 
-			/* check read permissions and perform load */
-			if (unlikely(load_access_fault(proc, proc.mode, tlb_ent)|| mem->load(mpa, val))) {
+			/* check read permissions */
+			if (unlikely(load_access_fault(proc, proc.mode, tlb_ent))) {
+				proc.raise(rv_cause_fault_load, va);
+				return;
+			}
+
+			/* perform load directly from host memory or via the memory bus */
+			if (likely(tlb_ent && tlb_ent->uva)) {
+				val = *static_cast<T*>((void*)(tlb_ent->uva + (va & ~UX(page_mask))));
+			} else if (unlikely(mem_load(mpa, val))) {
 				proc.raise(rv_cause_fault_load, va);
 			}
 		}
@@ -244,9 +543,22 @@ namespace riscv {
 			addr_t mpa = translate_addr<P,op>(proc, va, tlb_ent);
 			if (!mpa) return;
 
-			/* check write permissions and perform store */
-			if (unlikely(store_access_fault(proc, proc.mode, tlb_ent) || mem->store(mpa, val))) {
+			/* check write permissions */
+			if (unlikely(store_access_fault(proc, proc.mode, tlb_ent))) {
 				proc.raise(rv_cause_fault_store, va);
+				return;
+			}
+
+			/* perform store directly to host memory or via the memory bus */
+			if (likely(tlb_ent && tlb_ent->uva)) {
+				*static_cast<T*>((void*)(tlb_ent->uva + (va & ~UX(page_mask)))) = val;
+			} else if (unlikely(mem_store(mpa, val))) {
+				proc.raise(rv_cause_fault_store, va);
+			}
+
+			/* break reservations on the granule (a relaxed load while none are held) */
+			if (unlikely(mem->reservations.any())) {
+				mem->reservations.invalidate(mpa);
 			}
 		}
 
@@ -307,10 +619,10 @@ namespace riscv {
 		{
 			tlb_ent = tlb.lookup(proc.pdid, proc.sptbr >> tlb_type::ppn_bits, va);
 			if (tlb_ent) {
-				/* check if accessed and dirty flags are up-to-date */
+				/* translate if accessed and dirty flags are up-to-date, otherwise
+				   rewalk the page table to find the PTE address and update flags */
 				uintptr_t ad_flags = pte_flag_A | (op == op_store ? pte_flag_D : 0);
-				if ((tlb_ent->pteb & ad_flags) != ad_flags) {
-					/* rewalk the page table to find the PTE address and update flags */
+				if ((tlb_ent->pteb & ad_flags) == ad_flags) {
 					return page_translate_offset<PTM>(tlb_ent->ppn, va, tlb_ent->ptel);
 				}
 			}
@@ -323,26 +635,39 @@ namespace riscv {
 			P &proc, UX va, mmu_op op,
 			tlb_type &tlb, typename tlb_type::tlb_entry_t* &tlb_ent)
 		{
-			/*
-			 * The simple direct mapped TLB implementation currently maps page_size
-			 * entries so as a byproduct, the code will rewalk the page table every
-			 * page_size interval, even if the PTE points to a megapage or gigapage.
-			 * Can be solved by adding a secondary TLB with larger scoped entries.
-			 */
-
 			typename PTM::pte_type pte;
+			UX asid = proc.sptbr >> tlb_type::ppn_bits;
 			UX level;
 
-			/* TODO: TLB statistics */
+			/*
+			 * The direct mapped TLB maps page_size entries, so refill it from
+			 * the large page TLB if the address is within a megapage or gigapage
+			 * and the accessed and dirty flags are up-to-date
+			 */
+			uintptr_t ad_flags = pte_flag_A | (op == op_store ? pte_flag_D : 0);
+			tlb_ent = tlb.lookup_large(proc.pdid, asid, va, PTM::bits);
+			if (tlb_ent && (tlb_ent->pteb & ad_flags) == ad_flags) {
+				tlb_ent = tlb.insert(proc.pdid, asid, va, tlb_ent->ptel, tlb_ent->pteb, tlb_ent->ppn);
+				tlb.stats.large_hits++;
+				addr_t pa = page_translate_offset<PTM>(tlb_ent->ppn, va, tlb_ent->ptel);
+				tlb_ent->uva = mem->mpa_to_host_page(pa);
+				return pa;
+			}
 
 			/* Walk the page table to find a leaf PTE entry
 			 * (access fault is raised if leaf PTE is not found) */
 			addr_t pa = walk_page_table<P,PTM>(proc, va, op, tlb, tlb_ent, pte, level);
 			if (!pa) return 0;
 
-			/* Insert the virtual to physical mapping into the TLB */
-			tlb_ent = tlb.insert(proc.pdid, proc.sptbr >> tlb_type::ppn_bits,
-				va, level, pte.val.flags, pte.val.ppn);
+			/* Insert superpage mappings into the large page TLB */
+			if (level > 0) {
+				tlb.insert_large(proc.pdid, asid, va, level, PTM::bits, pte.val.flags, pte.val.ppn);
+			}
+
+			/* Insert the virtual to physical mapping into the TLB, caching
+			   the host address if the page is main memory */
+			tlb_ent = tlb.insert(proc.pdid, asid, va, level, pte.val.flags, pte.val.ppn);
+			tlb_ent->uva = mem->mpa_to_host_page(pa);
 
 			return pa;
 		}
@@ -363,8 +688,20 @@ namespace riscv {
 
 			/* TODO: canonical address check */
 
+			/* start from the deepest page table in the page walk cache */
+			level = PTM::levels - 1;
+			for (UX pwc_level = 0; pwc_level < PTM::levels - 1; pwc_level++) {
+				addr_t pt_mpa = pwc.lookup(proc.sptbr, va, pwc_level, PTM::bits);
+				if (pt_mpa) {
+					ppn = pt_mpa;
+					level = pwc_level;
+					break;
+				}
+			}
+			if (level == PTM::levels - 1) pwc.misses++; else pwc.hits++;
+
 			/* walk the page table */
-			for (level = PTM::levels - 1; level >= 0; level--) {
+			for (; level >= 0; level--) {
 
 				/* calculate the shift for this page table level */
 				shift = PTM::bits * level + page_shift;
@@ -372,14 +709,17 @@ namespace riscv {
 				pte_mpa = ppn + vpn * sizeof(pte_type);
 
 				/* load the PTE from memory */
-				if (unlikely(mem->load(pte_mpa, *(typename PTM::size_type*)&pte))) goto fault;
+				if (unlikely(mem_load(pte_mpa, *(typename PTM::size_type*)&pte))) goto fault;
 
 				/* check if this is a pointer PTE */
 				if ((((pte.xu.val >> pte_shift_R) |
 					  (pte.xu.val >> pte_shift_W) |
 					  (pte.xu.val >> pte_shift_X)) & 1) == 0)
 				{
+					/* a pointer PTE in the last level is invalid */
+					if (level == 0) goto fault;
 					ppn = pte.val.ppn << page_shift;
+					pwc.insert(proc.sptbr, va, level - 1, PTM::bits, ppn);
 					continue;
 				};
 
@@ -396,9 +736,19 @@ namespace riscv {
 					/* check if we need to update PTE accessed and dirty flags */
 					uintptr_t ad_flags = pte_flag_A | (op == op_store ? pte_flag_D : 0);
 					if ((pte.val.flags & ad_flags) != ad_flags) {
+						typename PTM::size_type old_pte = *(typename PTM::size_type*)&pte;
 						pte.val.flags |= ad_flags;
-						/* update PTE (note this reall needs to be atomic) */
-						if (unlikely(mem->store(pte_mpa, *(typename PTM::size_type*)&pte))) goto fault;
+						/* update PTE atomically and reread this level if another hart changed it */
+						addr_t pte_uva = mem_host_addr(nullptr, 0, pte_mpa);
+						if (likely(pte_uva)) {
+							if (!cas_host(static_cast<typename PTM::size_type*>((void*)pte_uva),
+								old_pte, *(typename PTM::size_type*)&pte)) {
+								level++;
+								continue;
+							}
+						} else if (unlikely(mem_store(pte_mpa, *(typename PTM::size_type*)&pte))) {
+							goto fault;
+						}
 					}
 
 					if (proc.log & proc_log_pagewalk) {
@@ -432,8 +782,8 @@ namespace riscv {
 		}
 	};
 
-	typedef tagged_tlb_rv32<128> tlb_type_rv32;
-	typedef tagged_tlb_rv64<128> tlb_type_rv64;
+	typedef tagged_tlb_rv32<256,4> tlb_type_rv32;
+	typedef tagged_tlb_rv64<256,4> tlb_type_rv64;
 
 	typedef pma_table<u32,8> pma_table_rv32;
 	typedef pma_table<u64,8> pma_table_rv64;
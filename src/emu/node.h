@@ -8,112 +8,98 @@
 namespace riscv {
 
 	/*
-	 * work-in-progress node class for eventual SMP implementation
+	 * node
 	 *
-	 * TODO
+	 * a node is a set of harts that share guest RAM and devices. each
+	 * hart runs its step loop on its own host thread.
 	 *
-	 *  - change rv-sys to create a node with n harts
-	 *  - move the shared memory map into the node class
-	 *  - rewire debug CLI to node and allow selection of hart
+	 * hart 0 is the boot hart. it runs on the thread that calls run,
+	 * creates the devices in init and receives asynchronous signals
+	 * such as SIGINT for the debug CLI. secondary harts share the memory
+	 * map of the boot hart, pick up its devices in init and run with
+	 * asynchronous signals blocked. synchronous signals (SIGSEGV from
+	 * the fastmem window) are delivered to the hart that faulted.
+	 *
+	 * harts stop when the boot hart powers off or any hart writes the
+	 * poweroff GPIO or HTIF register; the node then joins the threads.
+	 *
+	 * the harts share the debug CLI of the boot hart, which lists them
+	 * for the hart command. the hart in the CLI pauses the others.
 	 */
 
 	template <typename P>
-	struct node_processor : P, std::thread
+	struct node
 	{
-		node_processor() : P(), std::thread(&node_processor::mainloop) {}
+		std::vector<std::shared_ptr<P>> harts;
+		std::vector<std::thread> threads;
 
-		void mainloop()
+		node(size_t num_harts)
 		{
-			P::init();
-			P::run();
-		}
-	};
-
-	struct node_fault
-	{
-		static node_fault *current;
-	};
-
-	node_fault* node_fault::current = nullptr;
-
-	template <typename P>
-	struct node : node_fault
-	{
-		std::vector<std::shared_ptr<P>> nodes;
-
-		node(size_t num_nodes)
-		{
-			init();
-			for (size_t i = 0; i < num_nodes; i++) {
-				nodes.push_back(std::make_shared<P>());
+			for (size_t i = 0; i < num_harts; i++) {
+				auto hart = std::make_shared<P>();
+				hart->hart_id = i;
+				hart->num_harts = num_harts;
+				if (i > 0) {
+					hart->boot_hart = harts[0].get();
+					hart->mmu.mem = harts[0]->mmu.mem;
+					hart->cli = harts[0]->cli;
+				}
+				hart->cli->harts.push_back(hart.get());
+				harts.push_back(hart);
 			}
 		}
 
-		static void signal_handler(int signum, siginfo_t *info, void *)
+		/* secondary harts hold the devices of the boot hart so are released first */
+		~node()
 		{
-			static_cast<node<P>*>
-				(node_fault::current)->signal_dispatch(signum, info);
+			while (harts.size() > 1) harts.pop_back();
 		}
 
-		void signal_dispatch(int signum, siginfo_t *info)
-		{
-			printf("SIGNAL   :%s\n", signal_name(signum));
-		}
+		P& boot_hart() { return *harts[0]; }
 
-		void init()
+		static void block_async_signals(int how)
 		{
-			/*
-			 * Note: the processor currently runs in the main thread.
-			 * When SMP is implemented, hart threads will be changed
-			 * to block all interrupts except for SIGSEGV and the main
-			 * thread will be configured to monitor for interrupts and
-			 * signals to deliver to the hart threads.
-			 */
-
-			// block signals before so we don't deadlock in signal handlers
 			sigset_t set;
 			sigemptyset(&set);
-			sigaddset(&set, SIGSEGV);
 			sigaddset(&set, SIGTERM);
 			sigaddset(&set, SIGQUIT);
 			sigaddset(&set, SIGINT);
 			sigaddset(&set, SIGHUP);
 			sigaddset(&set, SIGUSR1);
-			if (pthread_sigmask(SIG_BLOCK, &set, NULL) != 0) {
+			if (pthread_sigmask(how, &set, NULL) != 0) {
 				panic("can't set thread signal mask: %s", strerror(errno));
 			}
+		}
 
-			// disable unwanted signals
-			sigset_t sigpipe_set;
-			sigemptyset(&sigpipe_set);
-			sigaddset(&sigpipe_set, SIGPIPE);
-			sigprocmask(SIG_BLOCK, &sigpipe_set, nullptr);
-
-			// install signal handler
-			struct sigaction sigaction_handler;
-			memset(&sigaction_handler, 0, sizeof(sigaction_handler));
-			sigaction_handler.sa_sigaction = &node<P>::signal_handler;
-			sigaction_handler.sa_flags = SA_SIGINFO;
-			sigaction(SIGSEGV, &sigaction_handler, nullptr);
-			sigaction(SIGTERM, &sigaction_handler, nullptr);
-			sigaction(SIGQUIT, &sigaction_handler, nullptr);
-			sigaction(SIGINT, &sigaction_handler, nullptr);
-			sigaction(SIGHUP, &sigaction_handler, nullptr);
-			sigaction(SIGUSR1, &sigaction_handler, nullptr);
-			node_fault::current = this;
+		static void secondary_main(std::shared_ptr<P> hart)
+		{
+			hart->init();
+			hart->reset();
+			hart->run();
+		}
 
-			/* unblock signals */
-			if (pthread_sigmask(SIG_UNBLOCK, &set, NULL) != 0) {
-				panic("can't set thread signal mask: %s", strerror(errno));
+		/* run all harts until poweroff (call after the boot hart is initialized) */
+		void run(exit_cause ex = exit_cause_continue)
+		{
+			/* secondary harts inherit the blocked asynchronous signals */
+			block_async_signals(SIG_BLOCK);
+			for (size_t i = 1; i < harts.size(); i++) {
+				threads.push_back(std::thread(&node::secondary_main, harts[i]));
 			}
+			block_async_signals(SIG_UNBLOCK);
+
+			boot_hart().run(ex);
+			shutdown();
 		}
 
 		void shutdown()
 		{
-			for (auto &node : nodes) {
-				node->shutdown();
-				node->join();
+			boot_hart().powerdown = true;
+			boot_hart().wake_harts();
+			for (auto &thread : threads) {
+				thread.join();
 			}
+			threads.clear();
 		}
 	};
 
@@ -149,7 +149,8 @@ namespace riscv {
 			xlen = sizeof(ux) << 3,   /* Size of integer register in bits */
 			ireg_count = IREG_COUNT,  /* Number of integer registers  */
 			freg_count = FREG_COUNT,  /* Number of floating point registers */
-			trace_l1_size = 1024
+			trace_l1_size = 1024,
+			jit_tlb_size = 256
 		};
 
 		/* Registers */
@@ -163,7 +164,8 @@ namespace riscv {
 		u16 node_id;                  /* Node Identifier */
 		u16 hart_id;                  /* Hardware Thread Identifier */
 		u32 log;                      /* Log flags */
-		SX lr;                        /* Load Reservation (TODO - global) */
+		SX lr;                        /* Load Reservation address (-1 if none) */
+		SX lr_val;                    /* Load Reservation value */
 		SX cause;                     /* Fault cause */
 		SX badaddr;                   /* Fault address */
 		jmp_buf env;                  /* Fault handler */
@@ -173,12 +175,21 @@ namespace riscv {
 		UX exceptions       : 1;      /* Trap on exceptions */
 		UX update_instret   : 1;      /* Update instret (JIT) */
 		UX memory_registers : 1;      /* Memory backed registers (JIT) */
+		UX trace_flush      : 1;      /* Flush trace cache (JIT) */
 		UX breakpoint;                /* Breakpoint */
 		UX trace_iters;               /* Trace iterations (JIT) */
+		u64 jit_inststop;             /* Trace instruction budget (JIT) */
 
 		u64 trace_pc[trace_l1_size];
 		u64 trace_fn[trace_l1_size];
 
+		/* JIT TLB (filled by the soft MMU, probed inline by JIT loads and stores) */
+
+		u64 jit_tlb_read[jit_tlb_size];   /* virtual page tag for loads */
+		u64 jit_tlb_write[jit_tlb_size];  /* virtual page tag for stores */
+		u64 jit_tlb_host[jit_tlb_size];   /* host page address */
+		const std::atomic<u32> *jit_reservations; /* live LR reservations (stores take the stub if any) */
+
 		/* Base ISA Control and Status Registers */
 
 		u64 time;                     /* User Time Register */
@@ -186,11 +197,15 @@ namespace riscv {
 		u32 fcsr;                     /* Floating-Point Control and Status Register */
 
 		processor_base() : pc(0), ireg(), freg(),
-			node_id(0), hart_id(0), log(0), lr(0), cause(0), badaddr(0), env(),
+			node_id(0), hart_id(0), log(0), lr(-1), lr_val(0), cause(0), badaddr(0), env(),
 			running(true), debugging(false), exceptions(true),
-			update_instret(false), memory_registers(false),
-			breakpoint(0), trace_iters(0), trace_pc(), trace_fn(),
-			time(0), instret(0), fcsr(0) {}
+			update_instret(false), memory_registers(false), trace_flush(false),
+			breakpoint(0), trace_iters(0), jit_inststop(0), trace_pc(), trace_fn(),
+			jit_tlb_read(), jit_tlb_write(), jit_tlb_host(), jit_reservations(nullptr),
+			time(0), instret(0), fcsr(0)
+		{
+			jit_tlb_flush();
+		}
 
 		/* Internal setjmp/longjump causes */
 
@@ -201,7 +216,8 @@ namespace riscv {
 			internal_cause_cli      = 0x1001,
 			internal_cause_poweroff = 0x1002,
 			internal_cause_fatal    = 0x1003,
-			internal_cause_hotspot  = 0x1004
+			internal_cause_hotspot  = 0x1004,
+			internal_cause_fastmem  = 0x1005
 		};
 
 		/* program counter histogram sentinels */
@@ -220,6 +236,26 @@ namespace riscv {
 				cause = ex_cause;
 			}
 		}
+
+		/* an invalid tag has a page number that does not index its own slot */
+		void jit_tlb_clear(size_t i)
+		{
+			jit_tlb_read[i] = jit_tlb_write[i] = u64(i + 1) << page_shift;
+		}
+
+		void jit_tlb_flush()
+		{
+			for (size_t i = 0; i < jit_tlb_size; i++) {
+				jit_tlb_clear(i);
+			}
+		}
+
+		/* interrupt hook (processors without interrupts never have one pending) */
+		bool interrupt_pending() { return false; }
+
+		/* fastmem hooks (processors without a fastmem window ignore them) */
+		bool fastmem_fault(siginfo_t *info) { return false; }
+		void set_fastmem(bool enable) {}
 	};
 
 	using processor_rv32imafd = processor_base<s32,u32,ireg_rv32,32,freg_fp64,32>;
@@ -190,6 +190,60 @@ namespace riscv {
 		}
 		fclose(file);
 	}
+
+	template <typename P>
+	void histogram_ipair_print(P &proc, bool reverse_sort, size_t limit = 64)
+	{
+		size_t max = 0, total = 0;
+		std::vector<hist_ipair_pair_t> hist_ipair_s;
+		for (auto ent : proc.hist_ipair) {
+			if (ent.second > max) max = ent.second;
+			total += ent.second;
+			hist_ipair_s.push_back(ent);
+		}
+
+		std::sort(hist_ipair_s.begin(), hist_ipair_s.end(), [&] (const hist_ipair_pair_t &a, const hist_ipair_pair_t &b) {
+			return reverse_sort ? a.second < b.second : a.second > b.second;
+		});
+
+		size_t i = 0;
+		for (auto ent : hist_ipair_s) {
+			if (i == limit) break;
+			printf("%5lu. %-10s %-10s %5.2f%% [%-9lu] %s\n",
+				++i,
+				rv_inst_name_sym[ent.first >> 16],
+				rv_inst_name_sym[ent.first & 0xffff],
+				(float)ent.second / (float)total * 100.0f,
+				ent.second,
+				repeat_str("#", ent.second * (max_chars - 1) / max).c_str());
+		}
+	}
+
+	template <typename P>
+	void histogram_ipair_save(P &proc, std::string filename)
+	{
+		std::vector<hist_ipair_pair_t> hist_ipair_s;
+		for (auto ent : proc.hist_ipair) {
+			hist_ipair_s.push_back(ent);
+		}
+
+		std::sort(hist_ipair_s.begin(), hist_ipair_s.end(), [&] (const hist_ipair_pair_t &a, const hist_ipair_pair_t &b) {
+			return a.second > b.second;
+		});
+
+		FILE *file;
+		if ((file = fopen(filename.c_str(), "w")) == nullptr) {
+			panic("histogram_ipair_save: unable to open: %s: %s",
+				filename.c_str(), strerror(errno));
+		}
+		fprintf(file, "first\tsecond\tcount\n");
+		for (auto ent : hist_ipair_s) {
+			fprintf(file, "%s\t%s\t%lu\n",
+				rv_inst_name_sym[ent.first >> 16],
+				rv_inst_name_sym[ent.first & 0xffff], ent.second);
+		}
+		fclose(file);
+	}
 }
 
 #endif
@@ -41,6 +41,8 @@ namespace riscv {
 	typedef std::pair<addr_t,size_t> hist_pc_pair_t;
 	typedef std::pair<size_t,size_t> hist_reg_pair_t;
 	typedef std::pair<size_t,size_t> hist_inst_pair_t;
+	typedef google::dense_hash_map<u32,size_t> hist_ipair_map_t;
+	typedef std::pair<u32,size_t> hist_ipair_pair_t;
 
 	template<typename T, typename P, typename M>
 	struct processor_impl : P
@@ -53,14 +55,18 @@ namespace riscv {
 		hist_pc_map_t hist_pc;
 		hist_reg_map_t hist_reg;
 		hist_inst_map_t hist_inst;
+		hist_ipair_map_t hist_ipair;
+		u32 hist_prev_op;
+		block_cache<T> blocks;
 		std::function<const char*(addr_t)> symlookup;
 
-		processor_impl() : P()
+		processor_impl() : P(), hist_prev_op(rv_op_illegal)
 		{
 			hist_pc.set_empty_key(0);
 			hist_pc.set_deleted_key(-1);
 			hist_reg.set_empty_key(-1);
 			hist_inst.set_empty_key(-1);
+			hist_ipair.set_empty_key(-1);
 		}
 
 		std::string format_inst(inst_t inst)
@@ -139,6 +145,15 @@ namespace riscv {
 			auto hi = hist_inst.find(op);
 			if (hi == hist_inst.end()) hist_inst.insert(hist_inst_pair_t(op, 1));
 			else hi->second++;
+
+			/* record instruction pairs for superinstruction profiles */
+			if (hist_prev_op != rv_op_illegal) {
+				u32 pair = (hist_prev_op << 16) | u32(op);
+				auto pi = hist_ipair.find(pair);
+				if (pi == hist_ipair.end()) hist_ipair.insert(hist_ipair_pair_t(pair, 1));
+				else pi->second++;
+			}
+			hist_prev_op = u32(op);
 		}
 
 		void seed_registers(host_cpu &cpu, uint64_t initial_seed, size_t n)
@@ -262,6 +277,11 @@ namespace riscv {
 
 		void print_device_registers() {}
 
+		bool save_snapshot(std::string filename) { return false; }
+
+		/* guest time of the cycle counter */
+		u64 cycle_time() { return cpu_cycle_clock(); }
+
 		void print_csr_registers()
 		{
 			printf("%s %s\n", format_reg("instret", P::instret, true).c_str(),
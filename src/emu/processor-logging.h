@@ -35,6 +35,13 @@ namespace riscv {
 		proc_log_exit_save_stats = 1<<22,      /* Save statistics on interpreter exit */
 	};
 
+	/* Logging flags that require the per instruction interpreter path */
+
+	enum {
+		proc_log_per_inst = proc_log_inst | proc_log_operands | proc_log_int_reg |
+			proc_log_hist_reg | proc_log_hist_pc | proc_log_hist_inst | proc_log_jit_audit
+	};
+
 }
 
 #endif
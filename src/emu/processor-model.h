@@ -42,6 +42,14 @@ namespace riscv {
 		addr_t inst_exec(T &dec, addr_t pc_offset) {
 			return exec_inst_rv32<RV_I>(dec, *this, pc_offset);
 		}
+
+		addr_t inst_exec_fused(int si, T &dec0, T &dec1, addr_t pc_offset0, addr_t pc_offset) {
+			return exec_superinst_rv32<RV_I>(si, dec0, dec1, *this, pc_offset0, pc_offset);
+		}
+
+		static int inst_fuse(int op1, int op2) {
+			return fuse_inst_rv32(op1, op2);
+		}
 	};
 
 	template <typename T, typename P, typename M, typename B = processor_impl<T,P,M>>
@@ -61,6 +69,14 @@ namespace riscv {
 		addr_t inst_exec(T &dec, addr_t pc_offset) {
 			return exec_inst_rv32<RV_IMA>(dec, *this, pc_offset);
 		}
+
+		addr_t inst_exec_fused(int si, T &dec0, T &dec1, addr_t pc_offset0, addr_t pc_offset) {
+			return exec_superinst_rv32<RV_IMA>(si, dec0, dec1, *this, pc_offset0, pc_offset);
+		}
+
+		static int inst_fuse(int op1, int op2) {
+			return fuse_inst_rv32(op1, op2);
+		}
 	};
 
 	template <typename T, typename P, typename M, typename B = processor_impl<T,P,M>>
@@ -74,13 +90,20 @@ namespace riscv {
 			| EXT('I') | EXT('M') | EXT('A') | EXT('C');
 
 		void inst_decode(T &dec, inst_t inst) {
-			decode_inst<T,RV_32,RV_IMAC>(dec, inst);
-			decompress_inst_rv32<T>(dec);
+			decode_inst_expand<T,RV_32,RV_IMAC>(dec, inst);
 		}
 
 		addr_t inst_exec(T &dec, addr_t pc_offset) {
 			return exec_inst_rv32<RV_IMAC>(dec, *this, pc_offset);
 		}
+
+		addr_t inst_exec_fused(int si, T &dec0, T &dec1, addr_t pc_offset0, addr_t pc_offset) {
+			return exec_superinst_rv32<RV_IMAC>(si, dec0, dec1, *this, pc_offset0, pc_offset);
+		}
+
+		static int inst_fuse(int op1, int op2) {
+			return fuse_inst_rv32(op1, op2);
+		}
 	};
 
 	template <typename T, typename P, typename M, typename B = processor_impl<T,P,M>>
@@ -100,6 +123,14 @@ namespace riscv {
 		addr_t inst_exec(T &dec, addr_t pc_offset) {
 			return exec_inst_rv32<RV_IMAFD>(dec, *this, pc_offset);
 		}
+
+		addr_t inst_exec_fused(int si, T &dec0, T &dec1, addr_t pc_offset0, addr_t pc_offset) {
+			return exec_superinst_rv32<RV_IMAFD>(si, dec0, dec1, *this, pc_offset0, pc_offset);
+		}
+
+		static int inst_fuse(int op1, int op2) {
+			return fuse_inst_rv32(op1, op2);
+		}
 	};
 
 	template <typename T, typename P, typename M, typename B = processor_impl<T,P,M>>
@@ -113,13 +144,20 @@ namespace riscv {
 			| EXT('I') | EXT('M') | EXT('A') | EXT('F') | EXT('D') | EXT('C');
 
 		void inst_decode(T &dec, inst_t inst) {
-			decode_inst<T,RV_32,RV_IMAFDC>(dec, inst);
-			decompress_inst_rv32<T>(dec);
+			decode_inst_expand<T,RV_32,RV_IMAFDC>(dec, inst);
 		}
 
 		addr_t inst_exec(T &dec, addr_t pc_offset) {
 			return exec_inst_rv32<RV_IMAFDC>(dec, *this, pc_offset);
 		}
+
+		addr_t inst_exec_fused(int si, T &dec0, T &dec1, addr_t pc_offset0, addr_t pc_offset) {
+			return exec_superinst_rv32<RV_IMAFDC>(si, dec0, dec1, *this, pc_offset0, pc_offset);
+		}
+
+		static int inst_fuse(int op1, int op2) {
+			return fuse_inst_rv32(op1, op2);
+		}
 	};
 
 
@@ -142,6 +180,14 @@ namespace riscv {
 		addr_t inst_exec(T &dec, addr_t pc_offset) {
 			return exec_inst_rv64<RV_I>(dec, *this, pc_offset);
 		}
+
+		addr_t inst_exec_fused(int si, T &dec0, T &dec1, addr_t pc_offset0, addr_t pc_offset) {
+			return exec_superinst_rv64<RV_I>(si, dec0, dec1, *this, pc_offset0, pc_offset);
+		}
+
+		static int inst_fuse(int op1, int op2) {
+			return fuse_inst_rv64(op1, op2);
+		}
 	};
 
 	template <typename T, typename P, typename M, typename B = processor_impl<T,P,M>>
@@ -161,6 +207,14 @@ namespace riscv {
 		addr_t inst_exec(T &dec, addr_t pc_offset) {
 			return exec_inst_rv64<RV_IMA>(dec, *this, pc_offset);
 		}
+
+		addr_t inst_exec_fused(int si, T &dec0, T &dec1, addr_t pc_offset0, addr_t pc_offset) {
+			return exec_superinst_rv64<RV_IMA>(si, dec0, dec1, *this, pc_offset0, pc_offset);
+		}
+
+		static int inst_fuse(int op1, int op2) {
+			return fuse_inst_rv64(op1, op2);
+		}
 	};
 
 	template <typename T, typename P, typename M, typename B = processor_impl<T,P,M>>
@@ -174,13 +228,20 @@ namespace riscv {
 			| EXT('I') | EXT('M') | EXT('A') | EXT('C');
 
 		void inst_decode(T &dec, inst_t inst) {
-			decode_inst<T,RV_64,RV_IMAC>(dec, inst);
-			decompress_inst_rv64<T>(dec);
+			decode_inst_expand<T,RV_64,RV_IMAC>(dec, inst);
 		}
 
 		addr_t inst_exec(T &dec, addr_t pc_offset) {
 			return exec_inst_rv64<RV_IMAC>(dec, *this, pc_offset);
 		}
+
+		addr_t inst_exec_fused(int si, T &dec0, T &dec1, addr_t pc_offset0, addr_t pc_offset) {
+			return exec_superinst_rv64<RV_IMAC>(si, dec0, dec1, *this, pc_offset0, pc_offset);
+		}
+
+		static int inst_fuse(int op1, int op2) {
+			return fuse_inst_rv64(op1, op2);
+		}
 	};
 
 	template <typename T, typename P, typename M, typename B = processor_impl<T,P,M>>
@@ -200,6 +261,14 @@ namespace riscv {
 		addr_t inst_exec(T &dec, addr_t pc_offset) {
 			return exec_inst_rv64<RV_IMAFD>(dec, *this, pc_offset);
 		}
+
+		addr_t inst_exec_fused(int si, T &dec0, T &dec1, addr_t pc_offset0, addr_t pc_offset) {
+			return exec_superinst_rv64<RV_IMAFD>(si, dec0, dec1, *this, pc_offset0, pc_offset);
+		}
+
+		static int inst_fuse(int op1, int op2) {
+			return fuse_inst_rv64(op1, op2);
+		}
 	};
 
 	template <typename T, typename P, typename M, typename B = processor_impl<T,P,M>>
@@ -213,13 +282,20 @@ namespace riscv {
 			| EXT('I') | EXT('M') | EXT('A') | EXT('F') | EXT('D') | EXT('C');
 
 		void inst_decode(T &dec, inst_t inst) {
-			decode_inst<T,RV_64,RV_IMAFDC>(dec, inst);
-			decompress_inst_rv64<T>(dec);
+			decode_inst_expand<T,RV_64,RV_IMAFDC>(dec, inst);
 		}
 
 		addr_t inst_exec(T &dec, addr_t pc_offset) {
 			return exec_inst_rv64<RV_IMAFDC>(dec, *this, pc_offset);
 		}
+
+		addr_t inst_exec_fused(int si, T &dec0, T &dec1, addr_t pc_offset0, addr_t pc_offset) {
+			return exec_superinst_rv64<RV_IMAFDC>(si, dec0, dec1, *this, pc_offset0, pc_offset);
+		}
+
+		static int inst_fuse(int op1, int op2) {
+			return fuse_inst_rv64(op1, op2);
+		}
 	};
 
 
@@ -242,6 +318,14 @@ namespace riscv {
 		addr_t inst_exec(T &dec, addr_t pc_offset) {
 			return exec_inst_rv128<RV_I>(dec, *this, pc_offset);
 		}
+
+		addr_t inst_exec_fused(int si, T &dec0, T &dec1, addr_t pc_offset0, addr_t pc_offset) {
+			return exec_superinst_rv128<RV_I>(si, dec0, dec1, *this, pc_offset0, pc_offset);
+		}
+
+		static int inst_fuse(int op1, int op2) {
+			return fuse_inst_rv128(op1, op2);
+		}
 	};
 
 	template <typename T, typename P, typename M, typename B = processor_impl<T,P,M>>
@@ -261,6 +345,14 @@ namespace riscv {
 		addr_t inst_exec(T &dec, addr_t pc_offset) {
 			return exec_inst_rv128<RV_IMA>(dec, *this, pc_offset);
 		}
+
+		addr_t inst_exec_fused(int si, T &dec0, T &dec1, addr_t pc_offset0, addr_t pc_offset) {
+			return exec_superinst_rv128<RV_IMA>(si, dec0, dec1, *this, pc_offset0, pc_offset);
+		}
+
+		static int inst_fuse(int op1, int op2) {
+			return fuse_inst_rv128(op1, op2);
+		}
 	};
 
 	template <typename T, typename P, typename M, typename B = processor_impl<T,P,M>>
@@ -274,13 +366,20 @@ namespace riscv {
 			| EXT('I') | EXT('M') | EXT('A') | EXT('C');
 
 		void inst_decode(T &dec, inst_t inst) {
-			decode_inst<T,RV_128,RV_IMAC>(dec, inst);
-			decompress_inst_rv128<T>(dec);
+			decode_inst_expand<T,RV_128,RV_IMAC>(dec, inst);
 		}
 
 		addr_t inst_exec(T &dec, addr_t pc_offset) {
 			return exec_inst_rv128<RV_IMAC>(dec, *this, pc_offset);
 		}
+
+		addr_t inst_exec_fused(int si, T &dec0, T &dec1, addr_t pc_offset0, addr_t pc_offset) {
+			return exec_superinst_rv128<RV_IMAC>(si, dec0, dec1, *this, pc_offset0, pc_offset);
+		}
+
+		static int inst_fuse(int op1, int op2) {
+			return fuse_inst_rv128(op1, op2);
+		}
 	};
 
 	template <typename T, typename P, typename M, typename B = processor_impl<T,P,M>>
@@ -300,6 +399,14 @@ namespace riscv {
 		addr_t inst_exec(T &dec, addr_t pc_offset) {
 			return exec_inst_rv128<RV_IMAFD>(dec, *this, pc_offset);
 		}
+
+		addr_t inst_exec_fused(int si, T &dec0, T &dec1, addr_t pc_offset0, addr_t pc_offset) {
+			return exec_superinst_rv128<RV_IMAFD>(si, dec0, dec1, *this, pc_offset0, pc_offset);
+		}
+
+		static int inst_fuse(int op1, int op2) {
+			return fuse_inst_rv128(op1, op2);
+		}
 	};
 
 	template <typename T, typename P, typename M, typename B = processor_impl<T,P,M>>
@@ -313,13 +420,20 @@ namespace riscv {
 			| EXT('I') | EXT('M') | EXT('A') | EXT('F') | EXT('D') | EXT('C');
 
 		void inst_decode(T &dec, inst_t inst) {
-			decode_inst<T,RV_128,RV_IMAFDC>(dec, inst);
-			decompress_inst_rv128<T>(dec);
+			decode_inst_expand<T,RV_128,RV_IMAFDC>(dec, inst);
 		}
 
 		addr_t inst_exec(T &dec, addr_t pc_offset) {
 			return exec_inst_rv128<RV_IMAFDC>(dec, *this, pc_offset);
 		}
+
+		addr_t inst_exec_fused(int si, T &dec0, T &dec1, addr_t pc_offset0, addr_t pc_offset) {
+			return exec_superinst_rv128<RV_IMAFDC>(si, dec0, dec1, *this, pc_offset0, pc_offset);
+		}
+
+		static int inst_fuse(int op1, int op2) {
+			return fuse_inst_rv128(op1, op2);
+		}
 	};
 
 }
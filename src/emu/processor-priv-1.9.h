@@ -256,27 +256,99 @@ namespace riscv {
 		std::shared_ptr<htif_mmio_device<processor_privileged>> device_htif;
 		std::shared_ptr<config_mmio_device<processor_privileged>> device_config;
 		std::shared_ptr<string_mmio_device<processor_privileged>> device_string;
+		std::shared_ptr<virtio_blk_mmio_device<processor_privileged>> device_virtio_blk;
+		std::shared_ptr<virtio_console_mmio_device<processor_privileged>> device_virtio_console;
+		std::shared_ptr<virtio_9p_mmio_device<processor_privileged>> device_virtio_9p;
 
-		u64 intr_sleep_time, intr_powerdown_delay;
 		std::vector<struct pollfd> pollfds;
 
 		std::mutex intr_mutex;
 		std::condition_variable intr_cond;
 
+		/*
+		 * harts in a node share RAM and the devices of the boot hart, which
+		 * also owns the interrupt condition variable and the powerdown flag
+		 */
+		processor_privileged *boot_hart;
+		size_t num_harts;
+		std::atomic<bool> powerdown;
+
+		/* the hart in the debug CLI, which other harts wait for in isr */
+		std::atomic<processor_privileged*> debug_hart;
+		size_t debug_parked;
+
+		/*
+		 * devices post asynchronous events by incrementing the event epoch
+		 * of the boot hart. each hart ends its step at the next block
+		 * boundary when the epoch changes and only then rearms its events.
+		 * timed events are kept in a deadline ordered queue which bounds
+		 * the number of instructions in a step. devices connected to the
+		 * PLIC set their bit in the device event mask, which the boot hart
+		 * moves into its queue as events due now, so it only services the
+		 * devices whose interrupt lines may have changed.
+		 */
+		enum event_id {
+			event_timer,
+			event_uart,
+			event_gpio,
+			event_virtio_blk,
+			event_virtio_console,
+			event_virtio_9p,
+			event_count
+		};
+
+		std::atomic<u64> event_epoch;
+		u64 event_epoch_seen;
+		std::atomic<u32> device_events;
+		event_queue<event_count> events;
+
+		/* instructions per 1024 cycle clock ticks measured over the last step */
+		u64 step_time, step_instret, step_rate;
+
+		/* cycle clock and host time at init, to convert timer deadlines to sleeps */
+		u64 clock_cycles, clock_ns;
+
+		/* offsets from the host clocks to guest time, so time continues after a restore */
+		u64 cycle_offset, rtc_offset;
+
+		/* save a snapshot to snapshot_filename when instret reaches snapshot_instret */
+		std::string snapshot_filename;
+		u64 snapshot_instret;
+
+		/* fork num_clones clones at clone_instret or when the guest requests it via HTIF */
+		size_t num_clones;
+		std::string clone_output;
+		u64 clone_instret;
+		bool clone_requested;
+
+		/* hart executing on this host thread */
+		static thread_local processor_privileged *current_hart;
+
 		std::string stats_dirname;
+		std::string disk_image;
+		bool virtio_console;
+		std::string share_dir;
 
 		const char* name() { return "rv-sys"; }
 
 		const u64 RTC_FREQ = 10000000;
 		const u64 RTC_DIV = 1000000000 / RTC_FREQ;
 
-		const u64 POWERDOWN_DELAY_INTERRUPT = 30000000;
-		const u64 POWERDOWN_DELAY_DEFAULT = 10000;
-		const u64 POWERDOWN_SLEEP_DEFAULT = 1000000;
+		enum : size_t { step_min = 64 };
 
-		processor_privileged() : intr_sleep_time(0), intr_powerdown_delay(1000), pollfds() {}
+		/* longest wfi sleep, which bounds the latency of asynchronous signals */
+		enum : u64 { wait_max_ns = 100000000 };
 
-		u64 get_time()
+		processor_privileged() : pollfds(),
+			boot_hart(this), num_harts(1), powerdown(false),
+			debug_hart(nullptr), debug_parked(0),
+			event_epoch(0), event_epoch_seen(-1), device_events(0), events(),
+			step_time(0), step_instret(0), step_rate(0),
+			clock_cycles(0), clock_ns(0), cycle_offset(0), rtc_offset(0),
+			snapshot_instret(0), num_clones(0), clone_instret(0), clone_requested(false),
+			virtio_console(false) {}
+
+		u64 host_time()
 		{
 			/*
 			 * TODO - add hz to config string
@@ -285,6 +357,18 @@ namespace riscv {
 			return host_cpu::get_instance().get_time_ns() / RTC_DIV;
 		}
 
+		/* guest time read by the time CSR */
+		u64 get_time()
+		{
+			return host_time() + rtc_offset;
+		}
+
+		/* guest time of the RTC and timer devices */
+		u64 cycle_time()
+		{
+			return cpu_cycle_clock() + cycle_offset;
+		}
+
 		std::string create_config_string()
 		{
 			typename P::ux ram_base = 0;
@@ -318,15 +402,23 @@ ram {
     size 0x%x;
   };
 };
-core {
-  0 {
+core {)CONFIG";
+			static const char* kCoreFormat =
+R"CONFIG(
+  %d {
     0 {
       isa rv64imafd;
       ipi 0x%x;
       timecmp 0x%x;
     };
-  };
-};)CONFIG";
+  };)CONFIG";
+			static const char* kVirtioFormat =
+R"CONFIG(
+  %s {
+    addr 0x%x;
+    size 0x%x;
+    irq %d;
+  };)CONFIG";
 			std::string cfg_str;
 			sprintf(cfg_str, kConfigFormat,
 				device_rtc->mpa,
@@ -334,16 +426,70 @@ core {
 				device_uart->mpa,
 				device_htif->mpa,
 				device_htif->mpa + 8,
-				ram_base, ram_size,
-				device_mipi->mpa,
-				device_timer->mpa);
+				ram_base, ram_size);
+			for (size_t i = 0; i < num_harts; i++) {
+				std::string core_str;
+				sprintf(core_str, kCoreFormat, i,
+					device_mipi->mpa + i * sizeof(u32),
+					device_timer->mpa + i * sizeof(u64));
+				cfg_str += core_str;
+			}
+			cfg_str += "\n};";
+			if (device_virtio_blk || device_virtio_console || device_virtio_9p) {
+				cfg_str += "\nvirtio {";
+				if (device_virtio_blk) {
+					std::string virtio_str;
+					sprintf(virtio_str, kVirtioFormat, "blk", device_virtio_blk->mpa,
+						device_virtio_blk->size, device_virtio_blk->irq);
+					cfg_str += virtio_str;
+				}
+				if (device_virtio_console) {
+					std::string virtio_str;
+					sprintf(virtio_str, kVirtioFormat, "console", device_virtio_console->mpa,
+						device_virtio_console->size, device_virtio_console->irq);
+					cfg_str += virtio_str;
+				}
+				if (device_virtio_9p) {
+					std::string virtio_str;
+					sprintf(virtio_str, kVirtioFormat, "9p", device_virtio_9p->mpa,
+						device_virtio_9p->size, device_virtio_9p->irq);
+					cfg_str += virtio_str;
+				}
+				cfg_str += "\n};";
+			}
 			return cfg_str;
 		}
 
 		void init()
 		{
-			/* set initial value for misa register */
+			/* set initial value for misa and mhartid registers */
 			P::misa = P::misa_default;
+			P::mhartid = P::hart_id;
+			current_hart = this;
+			set_fastmem(true);
+			clock_cycles = cpu_cycle_clock();
+			clock_ns = host_cpu::get_instance().get_time_ns();
+
+			/* secondary harts use the devices of the boot hart */
+			if (boot_hart != this) {
+				console = boot_hart->console;
+				device_sbi = boot_hart->device_sbi;
+				device_boot = boot_hart->device_boot;
+				device_rtc = boot_hart->device_rtc;
+				device_mipi = boot_hart->device_mipi;
+				device_plic = boot_hart->device_plic;
+				device_uart = boot_hart->device_uart;
+				device_timer = boot_hart->device_timer;
+				device_gpio = boot_hart->device_gpio;
+				device_rand = boot_hart->device_rand;
+				device_htif = boot_hart->device_htif;
+				device_config = boot_hart->device_config;
+				device_string = boot_hart->device_string;
+				device_virtio_blk = boot_hart->device_virtio_blk;
+				device_virtio_console = boot_hart->device_virtio_console;
+				device_virtio_9p = boot_hart->device_virtio_9p;
+				return;
+			}
 
 			/* create TIME, MIPI, PLIC and UART devices */
 			console = std::make_shared<console_device<processor_privileged>>(*this);
@@ -358,6 +504,15 @@ core {
 			device_rand = std::make_shared<rand_mmio_device<processor_privileged>>(*this, 0x40006000);
 			device_htif = std::make_shared<htif_mmio_device<processor_privileged>>(*this, 0x40008000, console);
 			device_config = std::make_shared<config_mmio_device<processor_privileged>>(*this, 0x4000f000);
+			if (disk_image.size() > 0) {
+				device_virtio_blk = std::make_shared<virtio_blk_mmio_device<processor_privileged>>(*this, 0x40007000, device_plic, 5, disk_image);
+			}
+			if (virtio_console) {
+				device_virtio_console = std::make_shared<virtio_console_mmio_device<processor_privileged>>(*this, 0x40009000, device_plic, 6, console);
+			}
+			if (share_dir.size() > 0) {
+				device_virtio_9p = std::make_shared<virtio_9p_mmio_device<processor_privileged>>(*this, 0x4000a000, device_plic, 7, share_dir, "host");
+			}
 			device_string  = std::make_shared<string_mmio_device<processor_privileged>>(*this, 0x40010000, create_config_string());
 
 			if (P::log & proc_log_config) {
@@ -365,18 +520,27 @@ core {
 			}
 
 			/* Add TIME, MIPI, PLIC and UART devices to the mmu */
-			P::mmu.mem->add_segment(device_sbi);
-			P::mmu.mem->add_segment(device_boot);
-			P::mmu.mem->add_segment(device_rtc);
-			P::mmu.mem->add_segment(device_mipi);
-			P::mmu.mem->add_segment(device_plic);
-			P::mmu.mem->add_segment(device_uart);
-			P::mmu.mem->add_segment(device_timer);
-			P::mmu.mem->add_segment(device_gpio);
-			P::mmu.mem->add_segment(device_rand);
-			P::mmu.mem->add_segment(device_htif);
-			P::mmu.mem->add_segment(device_config);
-			P::mmu.mem->add_segment(device_string);
+			P::mmu.mem->add_mmio(device_sbi);
+			P::mmu.mem->add_mmio(device_boot);
+			P::mmu.mem->add_mmio(device_rtc);
+			P::mmu.mem->add_mmio(device_mipi);
+			P::mmu.mem->add_mmio(device_plic);
+			P::mmu.mem->add_mmio(device_uart);
+			P::mmu.mem->add_mmio(device_timer);
+			P::mmu.mem->add_mmio(device_gpio);
+			P::mmu.mem->add_mmio(device_rand);
+			P::mmu.mem->add_mmio(device_htif);
+			P::mmu.mem->add_mmio(device_config);
+			P::mmu.mem->add_mmio(device_string);
+			if (device_virtio_blk) {
+				P::mmu.mem->add_mmio(device_virtio_blk);
+			}
+			if (device_virtio_console) {
+				P::mmu.mem->add_mmio(device_virtio_console);
+			}
+			if (device_virtio_9p) {
+				P::mmu.mem->add_mmio(device_virtio_9p);
+			}
 		}
 
 		void exit(int rc)
@@ -401,6 +565,16 @@ core {
 				printf("~~~~~~~~~~~~~~~~~~~\n");
 				print_device_registers();
 
+				/* print TLB statistics */
+				printf("\n");
+				printf("tlb statistics\n");
+				printf("~~~~~~~~~~~~~~\n");
+				print_tlb_stats("l1_itlb", P::mmu.l1_itlb);
+				print_tlb_stats("l1_dtlb", P::mmu.l1_dtlb);
+				printf("%-8s : size=%zu levels=%zu hits=%zu misses=%zu flushes=%zu\n",
+					"pwc", size_t(P::mmu_type::pwc_type::size), size_t(P::mmu_type::pwc_type::levels),
+					P::mmu.pwc.hits, P::mmu.pwc.misses, P::mmu.pwc.flushes);
+
 				/* print program counter histogram */
 				if (P::log & proc_log_hist_pc) {
 					printf("\n");
@@ -425,6 +599,10 @@ core {
 					printf("~~~~~~~~~~~~~~~~~~~~~~~~~~~\n");
 					histogram_inst_print(*this, false);
 					printf("\n");
+					printf("instruction pair histogram\n");
+					printf("~~~~~~~~~~~~~~~~~~~~~~~~~~\n");
+					histogram_ipair_print(*this, false);
+					printf("\n");
 				}
 			}
 
@@ -440,34 +618,163 @@ core {
 				if (P::log & proc_log_hist_inst) {
 					std::string filename = stats_dirname + "/" + "hist-inst.csv";
 					histogram_inst_save(*this, filename);
+					filename = stats_dirname + "/" + "hist-pair.csv";
+					histogram_ipair_save(*this, filename);
 				}
 			}
 		}
 
-		void wait_for_interrupt()
+		/* post an asynchronous event to all harts */
+		void post_event()
+		{
+			boot_hart->event_epoch.fetch_add(1, std::memory_order_release);
+		}
+
+		/* test if an event was posted since the last interrupt service */
+		bool event_pending()
 		{
-			auto &cpu = host_cpu::get_instance();
+			return boot_hart->event_epoch.load(std::memory_order_relaxed) != event_epoch_seen;
+		}
 
-			/* get time in nanoseconds */
-			u64 t = cpu.get_time_ns();
+		/* post an event and wake harts sleeping in wait_for_interrupt */
+		void wake_harts()
+		{
+			post_event();
+			std::lock_guard<std::mutex> intr_lock(boot_hart->intr_mutex);
+			boot_hart->intr_cond.notify_all();
+		}
 
-			/* spin for intr_powerdown_delay after last interrupt */
-			if (t - intr_sleep_time < intr_powerdown_delay) {
-				std::this_thread::yield();
-				return;
+		/* post a device event for the boot hart to dispatch from its event queue */
+		void post_device_event(u32 id)
+		{
+			boot_hart->device_events.fetch_or(1u << id, std::memory_order_relaxed);
+			wake_harts();
+		}
+
+		/* instructions to run before the next event (at most count) */
+		size_t step_budget(size_t count)
+		{
+			/* end the step where a snapshot is to be saved or the machine cloned */
+			if (snapshot_instret > P::instret) {
+				count = size_t(std::min(u64(count), snapshot_instret - P::instret));
+			}
+			if (clone_instret > P::instret) {
+				count = size_t(std::min(u64(count), clone_instret - P::instret));
 			}
 
-			/* sleep on interrupt condition variable */
-			std::unique_lock<std::mutex> intr_lock(intr_mutex);
-			if (intr_cond.wait_for(intr_lock, std::chrono::nanoseconds
-				(POWERDOWN_SLEEP_DEFAULT)) == std::cv_status::no_timeout)
-			{
-				intr_powerdown_delay = POWERDOWN_DELAY_INTERRUPT;
-			} else {
-				intr_powerdown_delay = POWERDOWN_DELAY_DEFAULT;
+			/* estimate the instruction rate from the last step */
+			if (P::time > step_time && P::instret > step_instret) {
+				step_rate = std::max(u64(1), ((P::instret - step_instret) << 10) / (P::time - step_time));
+			}
+			step_time = P::time;
+			step_instret = P::instret;
+
+			u64 deadline = events.next_deadline();
+			if (deadline == events.none) return count;
+			if (deadline <= P::time || step_rate == 0) return std::min(count, size_t(step_min));
+			u64 ticks = deadline - P::time;
+			if (ticks >= (u64(count) << 10) / step_rate) return count;
+			size_t budget = size_t((ticks * step_rate) >> 10);
+			return std::min(count, budget < size_t(step_min) ? size_t(step_min) : budget);
+		}
+
+		/* power off all harts and longjmp the hart on this thread back to its step loop */
+		void poweroff()
+		{
+			boot_hart->powerdown = true;
+			wake_harts();
+			current_hart->raise(P::internal_cause_poweroff, current_hart->pc);
+		}
+
+		/* flush translations (asid 0 flushes all address spaces) */
+		void flush_tlb(typename P::ux asid)
+		{
+			P::mmu.l1_itlb.flush(P::pdid, asid);
+			P::mmu.l1_dtlb.flush(P::pdid, asid);
+			P::mmu.pwc.flush();
+			P::mmu.flush_fetch_page();
+			P::jit_tlb_flush();
+			P::trace_flush = 1;
+		}
+
+		/* perform fences that other harts requested through the MIPI device */
+		void service_fences()
+		{
+			u32 fence = device_mipi->fence_pending(P::hart_id);
+			if (fence & mipi_mmio_device<processor_privileged>::fence_vm) {
+				flush_tlb(0);
+			}
+			if (fence & mipi_mmio_device<processor_privileged>::fence_i) {
+				P::blocks.flush();
+			}
+		}
+
+		/* convert cycle clock ticks to nanoseconds using the rate measured since init */
+		u64 cycles_to_ns(u64 cycles)
+		{
+			u64 elapsed_cycles = cpu_cycle_clock() - clock_cycles;
+			u64 elapsed_ns = host_cpu::get_instance().get_time_ns() - clock_ns;
+			if (elapsed_cycles == 0 || elapsed_ns == 0) return cycles;
+			return u64(double(cycles) * double(elapsed_ns) / double(elapsed_cycles));
+		}
+
+		/* wfi wakes on pending interrupts even if they are globally disabled */
+		bool wake_pending()
+		{
+			return boot_hart->powerdown || event_pending() ||
+				(P::mip.xu.val & P::mie.xu.val) != 0;
+		}
+
+		/* block asynchronous signals, which must not longjmp out of a wait */
+		static void hold_async_signals(sigset_t &oldset)
+		{
+			sigset_t set;
+			sigemptyset(&set);
+			sigaddset(&set, SIGTERM);
+			sigaddset(&set, SIGQUIT);
+			sigaddset(&set, SIGINT);
+			sigaddset(&set, SIGHUP);
+			sigaddset(&set, SIGUSR1);
+			pthread_sigmask(SIG_BLOCK, &set, &oldset);
+		}
+
+		/*
+		 * block the hart thread until the next timer deadline, a pending
+		 * interrupt or a posted event. the console thread and devices post
+		 * events with wake_harts, which notifies the condition variable of
+		 * the boot hart, so idle harts use no host CPU. the step ends on
+		 * return so that isr delivers the interrupt immediately.
+		 *
+		 * asynchronous signals longjmp back to the step loop, which must
+		 * not happen inside the condition variable wait, so they are held
+		 * during the wait and it is bounded to take them promptly.
+		 */
+		void wait_for_interrupt()
+		{
+			/* stop when the node is powered off */
+			if (boot_hart->powerdown) {
+				P::raise(P::internal_cause_poweroff, P::pc);
+			}
+
+			sigset_t oldset;
+			hold_async_signals(oldset);
+
+			std::unique_lock<std::mutex> intr_lock(boot_hart->intr_mutex);
+			u64 deadline = events.next_deadline(), now = cycle_time();
+			u64 timeout_ns = wait_max_ns;
+			if (deadline != events.none) {
+				timeout_ns = deadline > now ? std::min(timeout_ns, cycles_to_ns(deadline - now)) : 0;
+			}
+			if (timeout_ns > 0) {
+				boot_hart->intr_cond.wait_for(intr_lock, std::chrono::nanoseconds(timeout_ns),
+					[this] { return wake_pending(); });
 			}
 			intr_lock.unlock();
-			intr_sleep_time = cpu.get_time_ns();
+
+			pthread_sigmask(SIG_SETMASK, &oldset, nullptr);
+
+			/* end the step and rearm events */
+			event_epoch_seen = -1;
 		}
 
 		void print_device_registers()
@@ -480,6 +787,22 @@ core {
 			device_gpio->print_registers();
 			device_htif->print_registers();
 			device_config->print_registers();
+			if (device_virtio_blk) device_virtio_blk->print_registers();
+			if (device_virtio_console) device_virtio_console->print_registers();
+			if (device_virtio_9p) device_virtio_9p->print_registers();
+		}
+
+		template <typename TLB>
+		void print_tlb_stats(const char *name, TLB &tlb)
+		{
+			size_t lookups = tlb.stats.hits + tlb.stats.misses;
+			printf("%-8s : size=%zu ways=%zu hits=%zu misses=%zu hit-rate=%5.2f%% "
+				"large-hits=%zu flushes=%zu asid-flushes=%zu evictions=%zu\n",
+				name, size_t(TLB::size), size_t(TLB::num_ways),
+				tlb.stats.hits, tlb.stats.misses,
+				lookups ? (double)tlb.stats.hits / (double)lookups * 100.0 : 0.0,
+				tlb.stats.large_hits, tlb.stats.flushes,
+				tlb.stats.asid_flushes, tlb.stats.evictions);
 		}
 
 		const char* colorize(int val)
@@ -726,7 +1049,13 @@ core {
 				case rv_csr_sepc:     P::set_csr(dec, P::mode, op, csr, P::sepc, value);       break;
 				case rv_csr_scause:   P::set_csr(dec, P::mode, op, csr, P::scause, value);     break;
 				case rv_csr_sbadaddr: P::set_csr(dec, P::mode, op, csr, P::sbadaddr, value);   break;
-				case rv_csr_sptbr:    P::set_csr(dec, P::mode, op, csr, P::sptbr, value);      break;
+				case rv_csr_sptbr: {
+					/* translated traces follow virtual control flow */
+					typename P::ux sptbr = P::sptbr;
+					P::set_csr(dec, P::mode, op, csr, P::sptbr, value);
+					if (P::sptbr != sptbr) P::trace_flush = 1;
+					break;
+				}
 				default: return -1; /* illegal instruction */
 			}
 			return pc_offset;
@@ -763,8 +1092,7 @@ core {
 					}
 				case rv_op_sfence_vm:
 					if (P::mode >= rv_mode_S) {
-						P::mmu.l1_itlb.flush(P::pdid, P::sptbr >> P::mmu_type::tlb_type::ppn_bits);
-						P::mmu.l1_dtlb.flush(P::pdid, P::sptbr >> P::mmu_type::tlb_type::ppn_bits);
+						flush_tlb(P::sptbr >> P::mmu_type::tlb_type::ppn_bits);
 						return pc_offset;
 					} else {
 						return -1; /* illegal instruction */
@@ -779,6 +1107,7 @@ core {
 				case rv_op_fence:
 					return pc_offset;
 				case rv_op_fence_i:
+					P::blocks.flush();
 					return pc_offset;
 				default: break;
 			}
@@ -813,26 +1142,109 @@ core {
 			}
 		}
 
+		/* test for an interrupt that isr would take (checked at JIT trace boundaries) */
+		bool interrupt_pending()
+		{
+			typename P::ux pending = P::mip.xu.val & P::mie.xu.val;
+			typename P::ux m_bits = (1 << me_shift) | (1 << mt_shift) | (1 << ms_shift);
+			typename P::ux s_bits = (1 << se_shift) | (1 << st_shift) | (1 << ss_shift);
+			return (P::mstatus.r.mie && (pending & m_bits)) ||
+				(P::mstatus.r.sie && (pending & s_bits));
+		}
+
 		void isr()
 		{
-			/* service all external devices connected to the PLIC */
+			/* pause while another hart is in the debug CLI */
+			processor_privileged *debugger = boot_hart->debug_hart;
+			if (debugger && debugger != this) {
+				debug_wait();
+			}
+
+			/* stop when another hart has powered off the node */
+			if (boot_hart->powerdown) {
+				P::running = false;
+				return;
+			}
+
+			/* save a snapshot at the requested instret before taking interrupts */
+			if (snapshot_instret && P::instret >= snapshot_instret) {
+				snapshot_instret = 0;
+				save_snapshot(snapshot_filename);
+			}
+
+			/* fork the clones at the clone checkpoint */
+			if (clone_requested || (clone_instret && P::instret >= clone_instret)) {
+				clone_requested = false;
+				clone_instret = 0;
+				clone_machine();
+			}
+
+			/* queue device events and rearm events when an event has been posted */
+			bool boot = (boot_hart == this);
+			if (event_pending()) {
+				event_epoch_seen = boot_hart->event_epoch.load(std::memory_order_acquire);
+
+				/* perform fences requested by other harts */
+				service_fences();
+
+				/* queue the device events posted since the last service */
+				if (boot) {
+					u32 posted = device_events.exchange(0, std::memory_order_acquire);
+					for (u32 id = 0; posted; id++, posted >>= 1) {
+						if (posted & 1) events.schedule(id, P::time);
+					}
+				}
 
-			device_uart->service();
-			device_gpio->service();
+				/* timecmp may have been written */
+				events.schedule(event_timer, device_timer->deadline(P::hart_id));
+			}
+
+			/*
+			 * dispatch due events. devices update their PLIC interrupt
+			 * lines and the timer event tests the timer interrupt
+			 */
+			device_rtc->update_time(P::time);
+			bool tip = false;
+			for (int id; (id = events.pop_due(P::time)) >= 0; ) {
+				switch (id) {
+					case event_timer:
+						tip = device_timer->timer_pending(P::hart_id, P::time);
+						break;
+					case event_uart:
+						device_uart->service();
+						break;
+					case event_gpio:
+						device_gpio->service();
+						break;
+					case event_virtio_blk:
+						if (device_virtio_blk) device_virtio_blk->service();
+						break;
+					case event_virtio_console:
+						if (device_virtio_console) device_virtio_console->service();
+						break;
+					case event_virtio_9p:
+						if (device_virtio_9p) device_virtio_9p->service();
+						break;
+				}
+			}
 
 			/*
 			 * service external interrupts from the PLIC if enabled
 			 */
 
 			/* NOTE: delegation is implicit based on enable bits in this model */
-			bool eip = device_plic->irq_pending();
+			/* NOTE: external interrupts and the console are routed to the boot hart */
+			/* NOTE: a timer event due with an external interrupt is requeued */
+			bool eip = boot && device_plic->irq_pending();
 			if (eip) {
 				P::mip.r.meip = 1;
 				P::mip.r.seip = 1;
 				if (P::mstatus.r.mie && P::mie.r.meie) {
+					if (tip) events.schedule(event_timer, P::time);
 					mtrap(rv_intr_m_external, true);
 					return;
 				} else if (P::mstatus.r.sie && P::mie.r.seie) {
+					if (tip) events.schedule(event_timer, P::time);
 					strap(rv_intr_s_external, true);
 					return;
 				}
@@ -846,8 +1258,6 @@ core {
 			 */
 
 			/* NOTE: delegation is implicit based on enable bits in this model */
-			device_rtc->update_time(P::time);
-			bool tip = device_timer->timer_pending(P::hart_id, P::time);
 			if (tip) {
 				P::mip.r.mtip = 1;
 				P::mip.r.stip = 1;
@@ -868,7 +1278,7 @@ core {
 			 */
 
 			/* NOTE: delegation is implicit based on enable bits in this model */
-			bool sip = device_mipi->ipi_pending(P::hart_id) || console->has_char();
+			bool sip = device_mipi->ipi_pending(P::hart_id) || (boot && console->has_char());
 			if (sip) {
 				P::mip.r.msip = 1;
 				P::mip.r.ssip = 1;
@@ -886,18 +1296,206 @@ core {
 
 		}
 
+		/* bitmask of the optional devices, which must match on restore */
+		u32 snapshot_devices()
+		{
+			return (device_virtio_blk ? 1 : 0) |
+				(device_virtio_console ? 2 : 0) |
+				(device_virtio_9p ? 4 : 0);
+		}
+
+		/* serialize processor and device state */
+		template <typename S>
+		void snapshot(S &s)
+		{
+			u64 harts = num_harts;
+			u32 devices = snapshot_devices();
+			s.io(harts);
+			s.io(devices);
+			if (harts != num_harts || devices != snapshot_devices()) {
+				panic("snapshot: restore: options differ from the saved machine (%llu harts%s%s%s)",
+					harts, (devices & 1) ? ", --disk" : "", (devices & 2) ? ", --virtio-console" : "",
+					(devices & 4) ? ", --share" : "");
+			}
+
+			/* guest time is saved and the offsets rebased to the host clocks */
+			u64 now = cpu_cycle_clock(), rtc_now = host_time();
+			u64 cycle = now + cycle_offset, rtc = rtc_now + rtc_offset;
+			s.io(cycle);
+			s.io(rtc);
+			cycle_offset = cycle - now;
+			rtc_offset = rtc - rtc_now;
+
+			s.io(P::pc);
+			s.io(P::ireg);
+			s.io(P::freg);
+			s.io(P::fcsr);
+			s.io(P::instret);
+			s.io(P::pdid);
+			s.io(P::mode);
+			s.io(P::resetvec);
+			s.io(P::misa);
+			s.io(P::mvendorid);
+			s.io(P::marchid);
+			s.io(P::mimpid);
+			s.io(P::mhartid);
+			s.io(P::mstatus);
+			s.io(P::mtvec);
+			s.io(P::medeleg);
+			s.io(P::mideleg);
+			s.io(P::mip);
+			s.io(P::mie);
+			s.io(P::mhcounteren);
+			s.io(P::mscounteren);
+			s.io(P::mucounteren);
+			s.io(P::mscratch);
+			s.io(P::mepc);
+			s.io(P::mcause);
+			s.io(P::mbadaddr);
+			s.io(P::mbase);
+			s.io(P::mbound);
+			s.io(P::mibase);
+			s.io(P::mibound);
+			s.io(P::mdbase);
+			s.io(P::mdbound);
+			s.io(P::stvec);
+			s.io(P::sedeleg);
+			s.io(P::sideleg);
+			s.io(P::sscratch);
+			s.io(P::sepc);
+			s.io(P::scause);
+			s.io(P::sbadaddr);
+			s.io(P::sptbr);
+
+			device_rtc->snapshot(s);
+			device_mipi->snapshot(s);
+			device_plic->snapshot(s);
+			device_uart->snapshot(s);
+			device_timer->snapshot(s);
+			device_gpio->snapshot(s);
+			device_htif->snapshot(s);
+			device_config->snapshot(s);
+			if (device_virtio_blk) device_virtio_blk->snapshot(s);
+			if (device_virtio_console) device_virtio_console->snapshot(s);
+		}
+
+		/* save processor, device and memory state at a step boundary */
+		bool save_snapshot(std::string filename)
+		{
+			if (num_harts > 1) {
+				debug("snapshot: only single hart machines can be saved");
+				return false;
+			}
+			if (device_virtio_9p) {
+				debug("snapshot: machines with a 9P share can not be saved");
+				return false;
+			}
+			snapshot_writer writer;
+			snapshot(writer);
+			if (!snapshot_file::save(filename, *P::mmu.mem, P::xlen, writer.buf)) {
+				return false;
+			}
+			debug("snapshot: saved %s at instret %llu", filename.c_str(), P::instret);
+			return true;
+		}
+
+		/* restore processor and device state (call after init and reset) */
+		void restore_snapshot(snapshot_file &file)
+		{
+			snapshot_reader reader(file.state.data(), file.state.size());
+			snapshot(reader);
+			fenv_setrm((P::fcsr >> 5) & 0x7);
+			P::lr = -1;
+			event_epoch_seen = -1;
+			for (u32 id = event_uart; id < event_count; id++) {
+				post_device_event(id);
+			}
+			if (device_virtio_console) console->kick();
+		}
+
+		/* clone the machine at the end of the step (called by the HTIF device) */
+		void request_clone()
+		{
+			clone_requested = true;
+			post_event();
+		}
+
+		/*
+		 * fork the clones, which continue from this point with their own
+		 * console thread and a private view of the disk image. the parent
+		 * exits once all clones have exited. without --clones the machine
+		 * continues as clone 0.
+		 */
+		void clone_machine()
+		{
+			size_t n = 0;
+			if (num_clones == 0) {
+				/* not cloning */
+			} else if (num_harts > 1) {
+				debug("clone: only single hart machines can be cloned");
+			} else if (device_virtio_9p) {
+				debug("clone: machines with a 9P share can not be cloned");
+			} else {
+				/* threads do not survive fork so the console thread is restarted */
+				console->shutdown();
+				n = clone_group::fork_clones(num_clones, clone_output);
+				console->start();
+				if (device_virtio_blk) device_virtio_blk->clone_image();
+				if (device_virtio_console) console->kick();
+			}
+			device_htif->clone_done(n);
+		}
+
+		/*
+		 * the hart entering the debug CLI posts an event so the other harts
+		 * end their step and wait in isr until it leaves. the wait for them
+		 * is bounded as a hart may have stopped after a fatal trap.
+		 */
 		void debug_enter()
 		{
 			/* suspend uart console reads */
 			device_uart->console->suspend();
+
+			/* pause the other harts */
+			if (num_harts == 1) return;
+			boot_hart->debug_hart = this;
+			wake_harts();
+			std::unique_lock<std::mutex> intr_lock(boot_hart->intr_mutex);
+			boot_hart->intr_cond.wait_for(intr_lock, std::chrono::seconds(1), [this] {
+				return boot_hart->debug_parked == num_harts - 1 || boot_hart->powerdown;
+			});
 		}
 
 		void debug_leave()
 		{
+			/* resume the other harts */
+			if (num_harts > 1) {
+				boot_hart->debug_hart = nullptr;
+				wake_harts();
+			}
+
 			/* restart uart console reads */
 			device_uart->console->resume();
 		}
 
+		/* wait while another hart is in the debug CLI */
+		void debug_wait()
+		{
+			sigset_t oldset;
+			hold_async_signals(oldset);
+
+			std::unique_lock<std::mutex> intr_lock(boot_hart->intr_mutex);
+			boot_hart->debug_parked++;
+			boot_hart->intr_cond.notify_all();
+			boot_hart->intr_cond.wait(intr_lock, [this] {
+				return !boot_hart->debug_hart || boot_hart->powerdown;
+			});
+			boot_hart->debug_parked--;
+			intr_lock.unlock();
+
+			pthread_sigmask(SIG_SETMASK, &oldset, nullptr);
+		}
+
 		void trap(typename P::decode_type &dec, int cause)
 		{
 			/* check for reset */
@@ -983,6 +1581,28 @@ core {
 			}
 		}
 
+		/* retry device accesses that fault in the fastmem window */
+		bool fastmem_fault(siginfo_t *info)
+		{
+			if (!P::mmu.fastmem_limit || !P::mmu.mem->fastmem_contains(addr_t(info->si_addr))) return false;
+
+			/* SIGSEGV stays blocked after longjmp from the signal handler */
+			sigset_t set;
+			sigemptyset(&set);
+			sigaddset(&set, SIGSEGV);
+			pthread_sigmask(SIG_UNBLOCK, &set, nullptr);
+
+			/* longjmp back to the step loop */
+			P::raise(P::internal_cause_fastmem, P::pc);
+			return true;
+		}
+
+		/* enable or disable the fastmem window for this hart */
+		void set_fastmem(bool enable)
+		{
+			P::mmu.fastmem_limit = enable ? P::mmu.mem->fastmem_size : 0;
+		}
+
 		void signal(int signum, siginfo_t *info)
 		{
 			/* longjmp back to the step loop */
@@ -1017,6 +1637,9 @@ core {
 
 	};
 
+	template <typename P>
+	thread_local processor_privileged<P>* processor_privileged<P>::current_hart = nullptr;
+
 }
 
 #endif
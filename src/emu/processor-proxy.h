@@ -20,6 +20,13 @@ namespace riscv {
 		addr_t imagebase;
 		std::string stats_dirname;
 
+		/* fork num_clones clones when instret reaches clone_instret */
+		size_t num_clones;
+		std::string clone_output;
+		u64 clone_instret;
+
+		processor_proxy() : num_clones(0), clone_instret(0) {}
+
 		const char* name() { return "rv-sim"; }
 
 		void init() {}
@@ -81,6 +88,10 @@ namespace riscv {
 					printf("~~~~~~~~~~~~~~~~~~~~~~~~~~~\n");
 					histogram_inst_print(*this, false);
 					printf("\n");
+					printf("instruction pair histogram\n");
+					printf("~~~~~~~~~~~~~~~~~~~~~~~~~~\n");
+					histogram_ipair_print(*this, false);
+					printf("\n");
 				}
 			}
 
@@ -96,6 +107,8 @@ namespace riscv {
 				if (P::log & proc_log_hist_inst) {
 					std::string filename = stats_dirname + "/" + "hist-inst.csv";
 					histogram_inst_save(*this, filename);
+					filename = stats_dirname + "/" + "hist-pair.csv";
+					histogram_ipair_save(*this, filename);
 				}
 			}
 		}
@@ -389,8 +402,8 @@ namespace riscv {
 		typename P::ux inst_priv(typename P::decode_type &dec, typename P::ux pc_offset)
 		{
 			switch (dec.op) {
-				case rv_op_fence:
-				case rv_op_fence_i: return pc_offset;
+				case rv_op_fence:  return pc_offset;
+				case rv_op_fence_i: P::blocks.flush(); return pc_offset;
 				case rv_op_ecall:  proxy_syscall(*this); return pc_offset;
 				case rv_op_csrrw:  return inst_csr(dec, csr_rw, dec.imm, P::ireg[dec.rs1], pc_offset);
 				case rv_op_csrrs:  return inst_csr(dec, csr_rs, dec.imm, P::ireg[dec.rs1], pc_offset);
@@ -403,7 +416,24 @@ namespace riscv {
 			return -1; /* illegal instruction */
 		}
 
-		void isr() {}
+		/* fork the clones at the clone checkpoint (the parent exits when they exit) */
+		void isr()
+		{
+			if (clone_instret && P::instret >= clone_instret) {
+				clone_instret = 0;
+				clone_group::fork_clones(num_clones, clone_output);
+			}
+		}
+
+		/* end the step at the clone checkpoint */
+		size_t step_budget(size_t count)
+		{
+			if (clone_instret > P::instret) {
+				count = size_t(std::min(u64(count), u64(clone_instret - P::instret)));
+			}
+			return count;
+		}
+		constexpr bool event_pending() { return false; }
 		void debug_enter() {}
 		void debug_leave() {}
 
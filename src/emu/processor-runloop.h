@@ -7,14 +7,16 @@
 
 namespace riscv {
 
-	/* Simple processor stepper with instruction cache */
+	/* Simple processor stepper with instruction and decoded block caches */
+
+	/* the processor of each host thread receives its synchronous signals */
 
 	struct processor_singleton
 	{
-		static processor_singleton *current;
+		static thread_local processor_singleton *current;
 	};
 
-	processor_singleton* processor_singleton::current = nullptr;
+	thread_local processor_singleton* processor_singleton::current = nullptr;
 
 	template <typename P>
 	struct processor_runloop : processor_singleton, P
@@ -31,9 +33,13 @@ namespace riscv {
 		};
 
 		rv_inst_cache_ent inst_cache[inst_cache_size];
+		typename P::decode_type *trap_dec;
 
-		processor_runloop() : cli(std::make_shared<debug_cli<P>>()), inst_cache() {}
-		processor_runloop(std::shared_ptr<debug_cli<P>> cli) : cli(cli), inst_cache() {}
+		processor_runloop() : processor_runloop(std::make_shared<debug_cli<P>>()) {}
+		processor_runloop(std::shared_ptr<debug_cli<P>> cli) : cli(cli), inst_cache(), trap_dec(nullptr)
+		{
+			P::blocks.fuse = &P::inst_fuse;
+		}
 
 		static void signal_handler(int signum, siginfo_t *info, void *)
 		{
@@ -43,6 +49,9 @@ namespace riscv {
 
 		void signal_dispatch(int signum, siginfo_t *info)
 		{
+			/* device accesses in the fastmem window longjmp to be retried */
+			if (signum == SIGSEGV && P::fastmem_fault(info)) return;
+
 			printf("SIGNAL   :%s pc:0x%0llx si_addr:0x%0llx\n",
 				signal_name(signum), (addr_t)P::pc, (addr_t)info->si_addr);
 
@@ -61,7 +70,8 @@ namespace riscv {
 			sigaddset(&set, SIGINT);
 			sigaddset(&set, SIGHUP);
 			sigaddset(&set, SIGUSR1);
-			if (pthread_sigmask(SIG_BLOCK, &set, NULL) != 0) {
+			sigset_t oldset;
+			if (pthread_sigmask(SIG_BLOCK, &set, &oldset) != 0) {
 				panic("can't set thread signal mask: %s", strerror(errno));
 			}
 
@@ -84,8 +94,8 @@ namespace riscv {
 			sigaction(SIGUSR1, &sigaction_handler, nullptr);
 			processor_singleton::current = this;
 
-			/* unblock signals */
-			if (pthread_sigmask(SIG_UNBLOCK, &set, NULL) != 0) {
+			/* restore the signal mask (secondary harts keep asynchronous signals blocked) */
+			if (pthread_sigmask(SIG_SETMASK, &oldset, NULL) != 0) {
 				panic("can't set thread signal mask: %s", strerror(errno));
 			}
 
@@ -125,19 +135,30 @@ namespace riscv {
 		exit_cause step(size_t count)
 		{
 			typename P::decode_type dec;
-			typename P::ux inststop = P::instret + count;
 			typename P::ux pc_offset, new_offset;
 			inst_t inst = 0, inst_cache_key;
 
 			/* interrupt service routine */
-			P::time = cpu_cycle_clock();
+			P::time = P::cycle_time();
 			P::isr();
+			if (!P::running) return exit_cause_poweroff;
+
+			/* run until the next event unless single stepping in the debugger */
+			typename P::ux inststop = P::instret + (P::debugging ? count : P::step_budget(count));
 
 			/* trap return path */
 			int cause;
 			if (unlikely((cause = setjmp(P::env)) > 0)) {
+				P::blocks.commit();
+				P::set_fastmem(true);
 				cause -= P::internal_cause_offset;
 				switch(cause) {
+					case P::internal_cause_fastmem:
+						/* retry the faulting instruction via the memory bus */
+						P::set_fastmem(false);
+						step_inst(dec);
+						P::set_fastmem(true);
+						return exit_cause_continue;
 					case P::internal_cause_cli:
 						return exit_cause_cli;
 					case P::internal_cause_fatal:
@@ -147,12 +168,19 @@ namespace riscv {
 					case P::internal_cause_poweroff:
 						return exit_cause_poweroff;
 				}
-				P::trap(dec, cause);
+				P::trap(*trap_dec, cause);
 				if (!P::running) return exit_cause_poweroff;
 			}
 
+			/* select the specialized loop when logging and breakpoints are off */
+			trap_dec = &dec;
+			if ((P::log & proc_log_per_inst) == 0 && P::breakpoint == 0) {
+				step_blocks(inststop);
+				return exit_cause_continue;
+			}
+
 			/* step the processor */
-			while (P::instret != inststop) {
+			while (P::instret != inststop && !P::event_pending()) {
 				if (P::pc == P::breakpoint && P::breakpoint != 0) {
 					return exit_cause_cli;
 				}
@@ -177,6 +205,95 @@ namespace riscv {
 			}
 			return exit_cause_continue;
 		}
+
+		/* execute one instruction without the instruction or block caches */
+		void step_inst(typename P::decode_type &dec)
+		{
+			typename P::ux pc_offset = 0, new_offset;
+			trap_dec = &dec;
+			inst_t inst = P::mmu.inst_fetch(*this, P::pc, pc_offset);
+			P::inst_decode(dec, inst);
+			if ((new_offset = P::inst_exec(dec, pc_offset)) != typename P::ux(-1)  ||
+				(new_offset = P::inst_priv(dec, pc_offset)) != typename P::ux(-1))
+			{
+				if (P::log) P::print_log(dec, inst);
+				P::pc += new_offset;
+				P::instret++;
+			} else {
+				P::raise(rv_cause_illegal_instruction, P::pc);
+			}
+		}
+
+		/*
+		 * step the processor using the decoded block cache
+		 *
+		 * logging, histogram and breakpoint checks are compiled out
+		 * of this loop and the block recorder; step only selects them
+		 * when no per instruction log option or breakpoint is set.
+		 * posted device events end the step at the next block boundary.
+		 */
+		void step_blocks(typename P::ux inststop)
+		{
+			typename P::ux new_offset;
+			while (P::instret != inststop && !P::event_pending()) {
+				addr_t key = P::mmu.template inst_translate<false>(*this, P::pc);
+				auto blk = P::blocks.lookup(key);
+				if (unlikely(!blk)) {
+					record_block(key, inststop);
+					continue;
+				}
+				for (auto bi = blk->insts, be = blk->insts + blk->count; bi != be; bi++) {
+					trap_dec = &bi->dec;
+					/* a pair without a handler executes as two instructions */
+					if (bi->fused && P::instret + 1 != inststop &&
+						(new_offset = P::inst_exec_fused(bi->fused, bi[0].dec, bi[1].dec,
+							bi[0].len, bi[1].len)) != typename P::ux(-1))
+					{
+						bi++;
+					}
+					else if ((new_offset = P::inst_exec(bi->dec, bi->len)) == typename P::ux(-1) &&
+						(new_offset = P::inst_priv(bi->dec, bi->len)) == typename P::ux(-1))
+					{
+						P::raise(rv_cause_illegal_instruction, P::pc);
+					}
+					P::pc += new_offset;
+					P::instret++;
+					if (new_offset != bi->len || P::instret == inststop) break;
+				}
+			}
+		}
+
+		void record_block(addr_t key, typename P::ux inststop)
+		{
+			typename P::ux pc_offset = 0, new_offset;
+			auto blk = P::blocks.begin(key);
+			for (;;) {
+				auto &bi = blk->insts[blk->count];
+				/* the slot may hold an evicted decode, which a fetch fault must not trap with */
+				bi.dec.op = rv_op_illegal;
+				trap_dec = &bi.dec;
+				bi.inst = P::mmu.template inst_fetch<false>(*this, P::pc, pc_offset);
+				bool straddle = P::blocks.straddles_page(P::pc, pc_offset);
+				if (straddle && blk->count > 0) break;
+				P::inst_decode(bi.dec, bi.inst);
+				if ((new_offset = P::inst_exec(bi.dec, pc_offset)) != typename P::ux(-1)  ||
+					(new_offset = P::inst_priv(bi.dec, pc_offset)) != typename P::ux(-1))
+				{
+					addr_t pc = P::pc;
+					P::pc += new_offset;
+					P::instret++;
+					if (straddle) {
+						P::blocks.abandon();
+						return;
+					}
+					if (P::blocks.append(pc, pc_offset) ||
+						new_offset != pc_offset || P::instret == inststop) break;
+				} else {
+					P::raise(rv_cause_illegal_instruction, P::pc);
+				}
+			}
+			P::blocks.commit();
+		}
 	};
 
 }
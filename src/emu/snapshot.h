@@ -0,0 +1,233 @@
+//
+//  snapshot.h
+//
+
+#ifndef rv_snapshot_h
+#define rv_snapshot_h
+
+namespace riscv {
+
+	/*
+	 * machine snapshots
+	 *
+	 * a snapshot file holds a header, a table of the host memory segments
+	 * (RAM and ELF mappings), the serialized processor and device state
+	 * and then the contents of each segment at a page aligned offset.
+	 * zero pages are left as holes so the file is sparse.
+	 *
+	 * restore maps the segments from the file MAP_PRIVATE, so guest memory
+	 * is copied on write and a restored machine starts without reading
+	 * RAM. saving writes a new file and renames it over the old one, as
+	 * running machines may still have the old file mapped.
+	 *
+	 * processor and device state is serialized by a snapshot template on
+	 * each component that passes every field to io, which either appends
+	 * the field (snapshot_writer) or reads it back (snapshot_reader).
+	 */
+
+	struct snapshot_header
+	{
+		char magic[8];
+		u32 version;
+		u32 xlen;
+		u32 num_segments;
+		u32 state_size;
+		u64 state_offset;
+	};
+
+	struct snapshot_segment
+	{
+		char name[16];
+		u64 mpa;
+		u64 size;
+		u64 flags;
+		u64 offset;
+	};
+
+	struct snapshot_writer
+	{
+		std::vector<u8> buf;
+
+		template <typename T>
+		void io(T &val)
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "snapshot field must be trivially copyable");
+			const u8 *p = reinterpret_cast<const u8*>(&val);
+			buf.insert(buf.end(), p, p + sizeof(T));
+		}
+	};
+
+	struct snapshot_reader
+	{
+		const u8 *ptr;
+		const u8 *end;
+
+		snapshot_reader(const u8 *ptr, size_t len) : ptr(ptr), end(ptr + len) {}
+
+		template <typename T>
+		void io(T &val)
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "snapshot field must be trivially copyable");
+			if (size_t(end - ptr) < sizeof(T)) {
+				panic("snapshot: restore: truncated state");
+			}
+			memcpy(&val, ptr, sizeof(T));
+			ptr += sizeof(T);
+		}
+	};
+
+	struct snapshot_file
+	{
+		enum : u32 {
+			version = 1
+		};
+
+		static const char* magic() { return "rvsnap\0"; }
+
+		/* the segments and state of a snapshot opened for restore */
+		int fd;
+		snapshot_header header;
+		std::vector<snapshot_segment> segments;
+		std::vector<u8> state;
+
+		snapshot_file() : fd(-1), header() {}
+
+		~snapshot_file()
+		{
+			if (fd >= 0) close(fd);
+		}
+
+		static bool zero_page(const u8 *page)
+		{
+			const u64 *p = reinterpret_cast<const u64*>(page);
+			for (size_t i = 0; i < page_size / sizeof(u64); i++) {
+				if (p[i]) return false;
+			}
+			return true;
+		}
+
+		static bool write_at(int fd, const void *buf, size_t len, off_t offset)
+		{
+			const u8 *p = static_cast<const u8*>(buf);
+			while (len > 0) {
+				ssize_t ret = pwrite(fd, p, len, offset);
+				if (ret < 0) {
+					if (errno == EINTR) continue;
+					return false;
+				}
+				p += ret;
+				len -= size_t(ret);
+				offset += ret;
+			}
+			return true;
+		}
+
+		/* write the direct segments of mem and the serialized state to filename */
+		template <typename UX>
+		static bool save(std::string filename, user_memory<UX> &mem, u32 xlen, std::vector<u8> &state)
+		{
+			std::vector<memory_segment<UX>*> segs;
+			for (auto &seg : mem.segments) {
+				if (seg->direct) segs.push_back(seg.get());
+			}
+
+			snapshot_header hdr{};
+			memcpy(hdr.magic, magic(), sizeof(hdr.magic));
+			hdr.version = version;
+			hdr.xlen = xlen;
+			hdr.num_segments = u32(segs.size());
+			hdr.state_size = u32(state.size());
+			hdr.state_offset = sizeof(snapshot_header) + segs.size() * sizeof(snapshot_segment);
+
+			std::vector<snapshot_segment> table;
+			u64 offset = round_up(hdr.state_offset + state.size(), u64(page_size));
+			for (auto seg : segs) {
+				snapshot_segment ent{};
+				strncpy(ent.name, seg->name, sizeof(ent.name) - 1);
+				ent.mpa = seg->mpa;
+				ent.size = seg->size;
+				ent.flags = seg->flags;
+				ent.offset = offset;
+				offset += round_up(u64(seg->size), u64(page_size));
+				table.push_back(ent);
+			}
+
+			std::string tmpname = filename + ".tmp";
+			int fd = open(tmpname.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+			if (fd < 0) {
+				debug("snapshot: open: %s: %s", tmpname.c_str(), strerror(errno));
+				return false;
+			}
+			bool ok = ftruncate(fd, off_t(offset)) == 0 &&
+				write_at(fd, &hdr, sizeof(hdr), 0) &&
+				write_at(fd, table.data(), table.size() * sizeof(snapshot_segment), sizeof(hdr)) &&
+				write_at(fd, state.data(), state.size(), off_t(hdr.state_offset));
+
+			/* write non-zero pages, leaving holes for the rest */
+			for (size_t i = 0; ok && i < segs.size(); i++) {
+				const u8 *base = reinterpret_cast<const u8*>(segs[i]->uva);
+				size_t size = segs[i]->size;
+				for (size_t pos = 0; ok && pos < size; pos += page_size) {
+					size_t len = std::min(size - pos, size_t(page_size));
+					if (len == page_size && zero_page(base + pos)) continue;
+					ok = write_at(fd, base + pos, len, off_t(table[i].offset + pos));
+				}
+			}
+			if (!ok) {
+				debug("snapshot: write: %s: %s", tmpname.c_str(), strerror(errno));
+			}
+			if (close(fd) < 0) ok = false;
+			if (ok && rename(tmpname.c_str(), filename.c_str()) < 0) {
+				debug("snapshot: rename: %s: %s", filename.c_str(), strerror(errno));
+				ok = false;
+			}
+			if (!ok) unlink(tmpname.c_str());
+			return ok;
+		}
+
+		/* read the header, segment table and state of a snapshot */
+		void open_file(std::string filename)
+		{
+			fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+			if (fd < 0) {
+				panic("snapshot: open: %s: %s", filename.c_str(), strerror(errno));
+			}
+			if (pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+				memcmp(header.magic, magic(), sizeof(header.magic)) != 0)
+			{
+				panic("snapshot: %s: not a snapshot file", filename.c_str());
+			}
+			if (header.version != version) {
+				panic("snapshot: %s: unsupported version %u", filename.c_str(), header.version);
+			}
+			segments.resize(header.num_segments);
+			state.resize(header.state_size);
+			size_t table_size = segments.size() * sizeof(snapshot_segment);
+			if (pread(fd, segments.data(), table_size, sizeof(header)) != ssize_t(table_size) ||
+				pread(fd, state.data(), state.size(), off_t(header.state_offset)) != ssize_t(state.size()))
+			{
+				panic("snapshot: %s: truncated file", filename.c_str());
+			}
+		}
+
+		/* map the segments copy-on-write into mem */
+		template <typename UX>
+		void map_segments(user_memory<UX> &mem)
+		{
+			for (auto &ent : segments) {
+				void *addr = mmap(nullptr, ent.size, PROT_READ | PROT_WRITE,
+					MAP_PRIVATE, fd, off_t(ent.offset));
+				if (addr == MAP_FAILED) {
+					panic("snapshot: mmap: %s", strerror(errno));
+				}
+				/* segment names must outlive the segment */
+				const char *name = strcmp(ent.name, "RAM") == 0 ? "RAM" : "ELF";
+				mem.add_segment(std::make_shared<mmap_memory_segment<UX>>(name,
+					UX(ent.mpa), addr_t(addr), size_t(ent.size), UX(ent.flags)));
+			}
+		}
+	};
+
+}
+
+#endif
@@ -0,0 +1,575 @@
+//
+//  superinst.h
+//
+//  Written by hand in the output format of rv-meta -U (gen-superinst)
+//  for its default pair list. Regenerating it from meta replaces this file.
+//
+
+#ifndef rv_superinst_h
+#define rv_superinst_h
+
+/* Superinstructions */
+
+enum rv_superinst
+{
+	rv_superinst_none                       = 0,
+	rv_superinst_addi_bne                   = 1, /* addi + bne */
+	rv_superinst_addi_blt                   = 2, /* addi + blt */
+	rv_superinst_addi_bltu                  = 3, /* addi + bltu */
+	rv_superinst_lui_addi                   = 4, /* lui + addi */
+	rv_superinst_auipc_addi                 = 5, /* auipc + addi */
+	rv_superinst_auipc_jalr                 = 6, /* auipc + jalr */
+	rv_superinst_slli_add                   = 7, /* slli + add */
+	rv_superinst_add_lw                     = 8, /* add + lw */
+	rv_superinst_add_ld                     = 9, /* add + ld */
+	rv_superinst_ld_add                     = 10, /* ld + add */
+	rv_superinst_lw_bne                     = 11, /* lw + bne */
+	rv_superinst_ld_bne                     = 12, /* ld + bne */
+	rv_superinst_addi_ld                    = 13, /* addi + ld */
+	rv_superinst_addi_sd                    = 14, /* addi + sd */
+	rv_superinst_ld_ld                      = 15, /* ld + ld */
+	rv_superinst_sd_sd                      = 16, /* sd + sd */
+};
+
+/* Fuse Instruction Pair RV32 */
+
+inline int fuse_inst_rv32(int op1, int op2)
+{
+	using namespace riscv;
+
+	switch (op1) {
+		case rv_op_addi:
+			switch (op2) {
+				case rv_op_bne: return rv_superinst_addi_bne;
+				case rv_op_blt: return rv_superinst_addi_blt;
+				case rv_op_bltu: return rv_superinst_addi_bltu;
+			}
+			break;
+		case rv_op_lui:
+			switch (op2) {
+				case rv_op_addi: return rv_superinst_lui_addi;
+			}
+			break;
+		case rv_op_auipc:
+			switch (op2) {
+				case rv_op_addi: return rv_superinst_auipc_addi;
+				case rv_op_jalr: return rv_superinst_auipc_jalr;
+			}
+			break;
+		case rv_op_slli:
+			switch (op2) {
+				case rv_op_add: return rv_superinst_slli_add;
+			}
+			break;
+		case rv_op_add:
+			switch (op2) {
+				case rv_op_lw: return rv_superinst_add_lw;
+			}
+			break;
+		case rv_op_lw:
+			switch (op2) {
+				case rv_op_bne: return rv_superinst_lw_bne;
+			}
+			break;
+	}
+	return rv_superinst_none;
+}
+
+/* Execute Superinstruction RV32 */
+
+template <bool rvi, bool rvm, bool rva, bool rvs, bool rvf, bool rvd, bool rvq, bool rvc, typename T, typename P>
+typename P::ux exec_superinst_rv32(int si, T &dec0, T &dec1, P &proc,
+	typename P::ux pc_offset0, typename P::ux pc_offset)
+{
+	using namespace riscv;
+	enum { xlen = 32 };
+	typedef s32 sx;
+	typedef u32 ux;
+
+	switch (si) {
+		case rv_superinst_addi_bne:
+			if (rvi) {
+				{ proc.ireg[dec0.rd] = (dec0.rd == 0) ? 0 : proc.ireg[dec0.rs1].r.x.val + sx(dec0.imm); }
+				proc.pc += pc_offset0;
+				proc.instret++;
+				{ if (proc.ireg[dec1.rs1].r.x.val != proc.ireg[dec1.rs2].r.x.val) pc_offset = dec1.imm; }
+			};
+			break;
+		case rv_superinst_addi_blt:
+			if (rvi) {
+				{ proc.ireg[dec0.rd] = (dec0.rd == 0) ? 0 : proc.ireg[dec0.rs1].r.x.val + sx(dec0.imm); }
+				proc.pc += pc_offset0;
+				proc.instret++;
+				{ if (proc.ireg[dec1.rs1].r.x.val < proc.ireg[dec1.rs2].r.x.val) pc_offset = dec1.imm; }
+			};
+			break;
+		case rv_superinst_addi_bltu:
+			if (rvi) {
+				{ proc.ireg[dec0.rd] = (dec0.rd == 0) ? 0 : proc.ireg[dec0.rs1].r.x.val + sx(dec0.imm); }
+				proc.pc += pc_offset0;
+				proc.instret++;
+				{ if (proc.ireg[dec1.rs1].r.xu.val < proc.ireg[dec1.rs2].r.xu.val) pc_offset = dec1.imm; }
+			};
+			break;
+		case rv_superinst_lui_addi:
+			if (rvi) {
+				{ proc.ireg[dec0.rd] = (dec0.rd == 0) ? 0 : dec0.imm; }
+				proc.pc += pc_offset0;
+				proc.instret++;
+				{ proc.ireg[dec1.rd] = (dec1.rd == 0) ? 0 : proc.ireg[dec1.rs1].r.x.val + sx(dec1.imm); }
+			};
+			break;
+		case rv_superinst_auipc_addi:
+			if (rvi) {
+				{ proc.ireg[dec0.rd] = (dec0.rd == 0) ? 0 : proc.pc + dec0.imm; }
+				proc.pc += pc_offset0;
+				proc.instret++;
+				{ proc.ireg[dec1.rd] = (dec1.rd == 0) ? 0 : proc.ireg[dec1.rs1].r.x.val + sx(dec1.imm); }
+			};
+			break;
+		case rv_superinst_auipc_jalr:
+			if (rvi) {
+				{ proc.ireg[dec0.rd] = (dec0.rd == 0) ? 0 : proc.pc + dec0.imm; }
+				proc.pc += pc_offset0;
+				proc.instret++;
+				{ ux new_offset = (proc.ireg[dec1.rs1] + dec1.imm - proc.pc) & ~1; proc.ireg[dec1.rd] = (dec1.rd == 0) ? 0 : proc.pc + pc_offset; pc_offset = new_offset; }
+			};
+			break;
+		case rv_superinst_slli_add:
+			if (rvi) {
+				{ proc.ireg[dec0.rd] = (dec0.rd == 0) ? 0 : proc.ireg[dec0.rs1].r.xu.val << dec0.imm; }
+				proc.pc += pc_offset0;
+				proc.instret++;
+				{ proc.ireg[dec1.rd] = (dec1.rd == 0) ? 0 : proc.ireg[dec1.rs1].r.x.val + proc.ireg[dec1.rs2].r.x.val; }
+			};
+			break;
+		case rv_superinst_add_lw:
+			if (rvi) {
+				{ proc.ireg[dec0.rd] = (dec0.rd == 0) ? 0 : proc.ireg[dec0.rs1].r.x.val + proc.ireg[dec0.rs2].r.x.val; }
+				proc.pc += pc_offset0;
+				proc.instret++;
+				{ s32 t; proc.mmu.template load<P,s32>(proc, proc.ireg[dec1.rs1] + dec1.imm, t); proc.ireg[dec1.rd] = (dec1.rd == 0) ? 0 : t; }
+			};
+			break;
+		case rv_superinst_lw_bne:
+			if (rvi) {
+				{ s32 t; proc.mmu.template load<P,s32>(proc, proc.ireg[dec0.rs1] + dec0.imm, t); proc.ireg[dec0.rd] = (dec0.rd == 0) ? 0 : t; }
+				proc.pc += pc_offset0;
+				proc.instret++;
+				{ if (proc.ireg[dec1.rs1].r.x.val != proc.ireg[dec1.rs2].r.x.val) pc_offset = dec1.imm; }
+			};
+			break;
+		default: return -1; /* illegal instruction */
+	}
+	return pc_offset;
+}
+
+/* Fuse Instruction Pair RV64 */
+
+inline int fuse_inst_rv64(int op1, int op2)
+{
+	using namespace riscv;
+
+	switch (op1) {
+		case rv_op_addi:
+			switch (op2) {
+				case rv_op_bne: return rv_superinst_addi_bne;
+				case rv_op_blt: return rv_superinst_addi_blt;
+				case rv_op_bltu: return rv_superinst_addi_bltu;
+				case rv_op_ld: return rv_superinst_addi_ld;
+				case rv_op_sd: return rv_superinst_addi_sd;
+			}
+			break;
+		case rv_op_lui:
+			switch (op2) {
+				case rv_op_addi: return rv_superinst_lui_addi;
+			}
+			break;
+		case rv_op_auipc:
+			switch (op2) {
+				case rv_op_addi: return rv_superinst_auipc_addi;
+				case rv_op_jalr: return rv_superinst_auipc_jalr;
+			}
+			break;
+		case rv_op_slli:
+			switch (op2) {
+				case rv_op_add: return rv_superinst_slli_add;
+			}
+			break;
+		case rv_op_add:
+			switch (op2) {
+				case rv_op_lw: return rv_superinst_add_lw;
+				case rv_op_ld: return rv_superinst_add_ld;
+			}
+			break;
+		case rv_op_ld:
+			switch (op2) {
+				case rv_op_add: return rv_superinst_ld_add;
+				case rv_op_bne: return rv_superinst_ld_bne;
+				case rv_op_ld: return rv_superinst_ld_ld;
+			}
+			break;
+		case rv_op_lw:
+			switch (op2) {
+				case rv_op_bne: return rv_superinst_lw_bne;
+			}
+			break;
+		case rv_op_sd:
+			switch (op2) {
+				case rv_op_sd: return rv_superinst_sd_sd;
+			}
+			break;
+	}
+	return rv_superinst_none;
+}
+
+/* Execute Superinstruction RV64 */
+
+template <bool rvi, bool rvm, bool rva, bool rvs, bool rvf, bool rvd, bool rvq, bool rvc, typename T, typename P>
+typename P::ux exec_superinst_rv64(int si, T &dec0, T &dec1, P &proc,
+	typename P::ux pc_offset0, typename P::ux pc_offset)
+{
+	using namespace riscv;
+	enum { xlen = 64 };
+	typedef s64 sx;
+	typedef u64 ux;
+
+	switch (si) {
+		case rv_superinst_addi_bne:
+			if (rvi) {
+				{ proc.ireg[dec0.rd] = (dec0.rd == 0) ? 0 : proc.ireg[dec0.rs1].r.x.val + sx(dec0.imm); }
+				proc.pc += pc_offset0;
+				proc.instret++;
+				{ if (proc.ireg[dec1.rs1].r.x.val != proc.ireg[dec1.rs2].r.x.val) pc_offset = dec1.imm; }
+			};
+			break;
+		case rv_superinst_addi_blt:
+			if (rvi) {
+				{ proc.ireg[dec0.rd] = (dec0.rd == 0) ? 0 : proc.ireg[dec0.rs1].r.x.val + sx(dec0.imm); }
+				proc.pc += pc_offset0;
+				proc.instret++;
+				{ if (proc.ireg[dec1.rs1].r.x.val < proc.ireg[dec1.rs2].r.x.val) pc_offset = dec1.imm; }
+			};
+			break;
+		case rv_superinst_addi_bltu:
+			if (rvi) {
+				{ proc.ireg[dec0.rd] = (dec0.rd == 0) ? 0 : proc.ireg[dec0.rs1].r.x.val + sx(dec0.imm); }
+				proc.pc += pc_offset0;
+				proc.instret++;
+				{ if (proc.ireg[dec1.rs1].r.xu.val < proc.ireg[dec1.rs2].r.xu.val) pc_offset = dec1.imm; }
+			};
+			break;
+		case rv_superinst_lui_addi:
+			if (rvi) {
+				{ proc.ireg[dec0.rd] = (dec0.rd == 0) ? 0 : dec0.imm; }
+				proc.pc += pc_offset0;
+				proc.instret++;
+				{ proc.ireg[dec1.rd] = (dec1.rd == 0) ? 0 : proc.ireg[dec1.rs1].r.x.val + sx(dec1.imm); }
+			};
+			break;
+		case rv_superinst_auipc_addi:
+			if (rvi) {
+				{ proc.ireg[dec0.rd] = (dec0.rd == 0) ? 0 : proc.pc + dec0.imm; }
+				proc.pc += pc_offset0;
+				proc.instret++;
+				{ proc.ireg[dec1.rd] = (dec1.rd == 0) ? 0 : proc.ireg[dec1.rs1].r.x.val + sx(dec1.imm); }
+			};
+			break;
+		case rv_superinst_auipc_jalr:
+			if (rvi) {
+				{ proc.ireg[dec0.rd] = (dec0.rd == 0) ? 0 : proc.pc + dec0.imm; }
+				proc.pc += pc_offset0;
+				proc.instret++;
+				{ ux new_offset = (proc.ireg[dec1.rs1] + dec1.imm - proc.pc) & ~1; proc.ireg[dec1.rd] = (dec1.rd == 0) ? 0 : proc.pc + pc_offset; pc_offset = new_offset; }
+			};
+			break;
+		case rv_superinst_slli_add:
+			if (rvi) {
+				{ proc.ireg[dec0.rd] = (dec0.rd == 0) ? 0 : proc.ireg[dec0.rs1].r.xu.val << dec0.imm; }
+				proc.pc += pc_offset0;
+				proc.instret++;
+				{ proc.ireg[dec1.rd] = (dec1.rd == 0) ? 0 : proc.ireg[dec1.rs1].r.x.val + proc.ireg[dec1.rs2].r.x.val; }
+			};
+			break;
+		case rv_superinst_add_lw:
+			if (rvi) {
+				{ proc.ireg[dec0.rd] = (dec0.rd == 0) ? 0 : proc.ireg[dec0.rs1].r.x.val + proc.ireg[dec0.rs2].r.x.val; }
+				proc.pc += pc_offset0;
+				proc.instret++;
+				{ s32 t; proc.mmu.template load<P,s32>(proc, proc.ireg[dec1.rs1] + dec1.imm, t); proc.ireg[dec1.rd] = (dec1.rd == 0) ? 0 : t; }
+			};
+			break;
+		case rv_superinst_add_ld:
+			if (rvi) {
+				{ proc.ireg[dec0.rd] = (dec0.rd == 0) ? 0 : proc.ireg[dec0.rs1].r.x.val + proc.ireg[dec0.rs2].r.x.val; }
+				proc.pc += pc_offset0;
+				proc.instret++;
+				{ s64 t; proc.mmu.template load<P,s64>(proc, proc.ireg[dec1.rs1] + dec1.imm, t); proc.ireg[dec1.rd] = (dec1.rd == 0) ? 0 : t; }
+			};
+			break;
+		case rv_superinst_ld_add:
+			if (rvi) {
+				{ s64 t; proc.mmu.template load<P,s64>(proc, proc.ireg[dec0.rs1] + dec0.imm, t); proc.ireg[dec0.rd] = (dec0.rd == 0) ? 0 : t; }
+				proc.pc += pc_offset0;
+				proc.instret++;
+				{ proc.ireg[dec1.rd] = (dec1.rd == 0) ? 0 : proc.ireg[dec1.rs1].r.x.val + proc.ireg[dec1.rs2].r.x.val; }
+			};
+			break;
+		case rv_superinst_lw_bne:
+			if (rvi) {
+				{ s32 t; proc.mmu.template load<P,s32>(proc, proc.ireg[dec0.rs1] + dec0.imm, t); proc.ireg[dec0.rd] = (dec0.rd == 0) ? 0 : t; }
+				proc.pc += pc_offset0;
+				proc.instret++;
+				{ if (proc.ireg[dec1.rs1].r.x.val != proc.ireg[dec1.rs2].r.x.val) pc_offset = dec1.imm; }
+			};
+			break;
+		case rv_superinst_ld_bne:
+			if (rvi) {
+				{ s64 t; proc.mmu.template load<P,s64>(proc, proc.ireg[dec0.rs1] + dec0.imm, t); proc.ireg[dec0.rd] = (dec0.rd == 0) ? 0 : t; }
+				proc.pc += pc_offset0;
+				proc.instret++;
+				{ if (proc.ireg[dec1.rs1].r.x.val != proc.ireg[dec1.rs2].r.x.val) pc_offset = dec1.imm; }
+			};
+			break;
+		case rv_superinst_addi_ld:
+			if (rvi) {
+				{ proc.ireg[dec0.rd] = (dec0.rd == 0) ? 0 : proc.ireg[dec0.rs1].r.x.val + sx(dec0.imm); }
+				proc.pc += pc_offset0;
+				proc.instret++;
+				{ s64 t; proc.mmu.template load<P,s64>(proc, proc.ireg[dec1.rs1] + dec1.imm, t); proc.ireg[dec1.rd] = (dec1.rd == 0) ? 0 : t; }
+			};
+			break;
+		case rv_superinst_addi_sd:
+			if (rvi) {
+				{ proc.ireg[dec0.rd] = (dec0.rd == 0) ? 0 : proc.ireg[dec0.rs1].r.x.val + sx(dec0.imm); }
+				proc.pc += pc_offset0;
+				proc.instret++;
+				{ proc.mmu.template store<P,s64>(proc, proc.ireg[dec1.rs1] + dec1.imm, proc.ireg[dec1.rs2].r.l.val); }
+			};
+			break;
+		case rv_superinst_ld_ld:
+			if (rvi) {
+				{ s64 t; proc.mmu.template load<P,s64>(proc, proc.ireg[dec0.rs1] + dec0.imm, t); proc.ireg[dec0.rd] = (dec0.rd == 0) ? 0 : t; }
+				proc.pc += pc_offset0;
+				proc.instret++;
+				{ s64 t; proc.mmu.template load<P,s64>(proc, proc.ireg[dec1.rs1] + dec1.imm, t); proc.ireg[dec1.rd] = (dec1.rd == 0) ? 0 : t; }
+			};
+			break;
+		case rv_superinst_sd_sd:
+			if (rvi) {
+				{ proc.mmu.template store<P,s64>(proc, proc.ireg[dec0.rs1] + dec0.imm, proc.ireg[dec0.rs2].r.l.val); }
+				proc.pc += pc_offset0;
+				proc.instret++;
+				{ proc.mmu.template store<P,s64>(proc, proc.ireg[dec1.rs1] + dec1.imm, proc.ireg[dec1.rs2].r.l.val); }
+			};
+			break;
+		default: return -1; /* illegal instruction */
+	}
+	return pc_offset;
+}
+
+/* Fuse Instruction Pair RV128 */
+
+inline int fuse_inst_rv128(int op1, int op2)
+{
+	using namespace riscv;
+
+	switch (op1) {
+		case rv_op_addi:
+			switch (op2) {
+				case rv_op_bne: return rv_superinst_addi_bne;
+				case rv_op_blt: return rv_superinst_addi_blt;
+				case rv_op_bltu: return rv_superinst_addi_bltu;
+				case rv_op_ld: return rv_superinst_addi_ld;
+				case rv_op_sd: return rv_superinst_addi_sd;
+			}
+			break;
+		case rv_op_lui:
+			switch (op2) {
+				case rv_op_addi: return rv_superinst_lui_addi;
+			}
+			break;
+		case rv_op_auipc:
+			switch (op2) {
+				case rv_op_addi: return rv_superinst_auipc_addi;
+				case rv_op_jalr: return rv_superinst_auipc_jalr;
+			}
+			break;
+		case rv_op_slli:
+			switch (op2) {
+				case rv_op_add: return rv_superinst_slli_add;
+			}
+			break;
+		case rv_op_add:
+			switch (op2) {
+				case rv_op_lw: return rv_superinst_add_lw;
+				case rv_op_ld: return rv_superinst_add_ld;
+			}
+			break;
+		case rv_op_ld:
+			switch (op2) {
+				case rv_op_add: return rv_superinst_ld_add;
+				case rv_op_bne: return rv_superinst_ld_bne;
+				case rv_op_ld: return rv_superinst_ld_ld;
+			}
+			break;
+		case rv_op_lw:
+			switch (op2) {
+				case rv_op_bne: return rv_superinst_lw_bne;
+			}
+			break;
+		case rv_op_sd:
+			switch (op2) {
+				case rv_op_sd: return rv_superinst_sd_sd;
+			}
+			break;
+	}
+	return rv_superinst_none;
+}
+
+/* Execute Superinstruction RV128 */
+
+template <bool rvi, bool rvm, bool rva, bool rvs, bool rvf, bool rvd, bool rvq, bool rvc, typename T, typename P>
+typename P::ux exec_superinst_rv128(int si, T &dec0, T &dec1, P &proc,
+	typename P::ux pc_offset0, typename P::ux pc_offset)
+{
+	using namespace riscv;
+	enum { xlen = 128 };
+	typedef s128 sx;
+	typedef u128 ux;
+
+	switch (si) {
+		case rv_superinst_addi_bne:
+			if (rvi) {
+				{ proc.ireg[dec0.rd] = (dec0.rd == 0) ? 0 : proc.ireg[dec0.rs1].r.x.val + sx(dec0.imm); }
+				proc.pc += pc_offset0;
+				proc.instret++;
+				{ if (proc.ireg[dec1.rs1].r.x.val != proc.ireg[dec1.rs2].r.x.val) pc_offset = dec1.imm; }
+			};
+			break;
+		case rv_superinst_addi_blt:
+			if (rvi) {
+				{ proc.ireg[dec0.rd] = (dec0.rd == 0) ? 0 : proc.ireg[dec0.rs1].r.x.val + sx(dec0.imm); }
+				proc.pc += pc_offset0;
+				proc.instret++;
+				{ if (proc.ireg[dec1.rs1].r.x.val < proc.ireg[dec1.rs2].r.x.val) pc_offset = dec1.imm; }
+			};
+			break;
+		case rv_superinst_addi_bltu:
+			if (rvi) {
+				{ proc.ireg[dec0.rd] = (dec0.rd == 0) ? 0 : proc.ireg[dec0.rs1].r.x.val + sx(dec0.imm); }
+				proc.pc += pc_offset0;
+				proc.instret++;
+				{ if (proc.ireg[dec1.rs1].r.xu.val < proc.ireg[dec1.rs2].r.xu.val) pc_offset = dec1.imm; }
+			};
+			break;
+		case rv_superinst_lui_addi:
+			if (rvi) {
+				{ proc.ireg[dec0.rd] = (dec0.rd == 0) ? 0 : dec0.imm; }
+				proc.pc += pc_offset0;
+				proc.instret++;
+				{ proc.ireg[dec1.rd] = (dec1.rd == 0) ? 0 : proc.ireg[dec1.rs1].r.x.val + sx(dec1.imm); }
+			};
+			break;
+		case rv_superinst_auipc_addi:
+			if (rvi) {
+				{ proc.ireg[dec0.rd] = (dec0.rd == 0) ? 0 : proc.pc + dec0.imm; }
+				proc.pc += pc_offset0;
+				proc.instret++;
+				{ proc.ireg[dec1.rd] = (dec1.rd == 0) ? 0 : proc.ireg[dec1.rs1].r.x.val + sx(dec1.imm); }
+			};
+			break;
+		case rv_superinst_auipc_jalr:
+			if (rvi) {
+				{ proc.ireg[dec0.rd] = (dec0.rd == 0) ? 0 : proc.pc + dec0.imm; }
+				proc.pc += pc_offset0;
+				proc.instret++;
+				{ ux new_offset = (proc.ireg[dec1.rs1] + dec1.imm - proc.pc) & ~1; proc.ireg[dec1.rd] = (dec1.rd == 0) ? 0 : proc.pc + pc_offset; pc_offset = new_offset; }
+			};
+			break;
+		case rv_superinst_slli_add:
+			if (rvi) {
+				{ proc.ireg[dec0.rd] = (dec0.rd == 0) ? 0 : proc.ireg[dec0.rs1].r.xu.val << dec0.imm; }
+				proc.pc += pc_offset0;
+				proc.instret++;
+				{ proc.ireg[dec1.rd] = (dec1.rd == 0) ? 0 : proc.ireg[dec1.rs1].r.x.val + proc.ireg[dec1.rs2].r.x.val; }
+			};
+			break;
+		case rv_superinst_add_lw:
+			if (rvi) {
+				{ proc.ireg[dec0.rd] = (dec0.rd == 0) ? 0 : proc.ireg[dec0.rs1].r.x.val + proc.ireg[dec0.rs2].r.x.val; }
+				proc.pc += pc_offset0;
+				proc.instret++;
+				{ s32 t; proc.mmu.template load<P,s32>(proc, proc.ireg[dec1.rs1] + dec1.imm, t); proc.ireg[dec1.rd] = (dec1.rd == 0) ? 0 : t; }
+			};
+			break;
+		case rv_superinst_add_ld:
+			if (rvi) {
+				{ proc.ireg[dec0.rd] = (dec0.rd == 0) ? 0 : proc.ireg[dec0.rs1].r.x.val + proc.ireg[dec0.rs2].r.x.val; }
+				proc.pc += pc_offset0;
+				proc.instret++;
+				{ s64 t; proc.mmu.template load<P,s64>(proc, proc.ireg[dec1.rs1] + dec1.imm, t); proc.ireg[dec1.rd] = (dec1.rd == 0) ? 0 : t; }
+			};
+			break;
+		case rv_superinst_ld_add:
+			if (rvi) {
+				{ s64 t; proc.mmu.template load<P,s64>(proc, proc.ireg[dec0.rs1] + dec0.imm, t); proc.ireg[dec0.rd] = (dec0.rd == 0) ? 0 : t; }
+				proc.pc += pc_offset0;
+				proc.instret++;
+				{ proc.ireg[dec1.rd] = (dec1.rd == 0) ? 0 : proc.ireg[dec1.rs1].r.x.val + proc.ireg[dec1.rs2].r.x.val; }
+			};
+			break;
+		case rv_superinst_lw_bne:
+			if (rvi) {
+				{ s32 t; proc.mmu.template load<P,s32>(proc, proc.ireg[dec0.rs1] + dec0.imm, t); proc.ireg[dec0.rd] = (dec0.rd == 0) ? 0 : t; }
+				proc.pc += pc_offset0;
+				proc.instret++;
+				{ if (proc.ireg[dec1.rs1].r.x.val != proc.ireg[dec1.rs2].r.x.val) pc_offset = dec1.imm; }
+			};
+			break;
+		case rv_superinst_ld_bne:
+			if (rvi) {
+				{ s64 t; proc.mmu.template load<P,s64>(proc, proc.ireg[dec0.rs1] + dec0.imm, t); proc.ireg[dec0.rd] = (dec0.rd == 0) ? 0 : t; }
+				proc.pc += pc_offset0;
+				proc.instret++;
+				{ if (proc.ireg[dec1.rs1].r.x.val != proc.ireg[dec1.rs2].r.x.val) pc_offset = dec1.imm; }
+			};
+			break;
+		case rv_superinst_addi_ld:
+			if (rvi) {
+				{ proc.ireg[dec0.rd] = (dec0.rd == 0) ? 0 : proc.ireg[dec0.rs1].r.x.val + sx(dec0.imm); }
+				proc.pc += pc_offset0;
+				proc.instret++;
+				{ s64 t; proc.mmu.template load<P,s64>(proc, proc.ireg[dec1.rs1] + dec1.imm, t); proc.ireg[dec1.rd] = (dec1.rd == 0) ? 0 : t; }
+			};
+			break;
+		case rv_superinst_addi_sd:
+			if (rvi) {
+				{ proc.ireg[dec0.rd] = (dec0.rd == 0) ? 0 : proc.ireg[dec0.rs1].r.x.val + sx(dec0.imm); }
+				proc.pc += pc_offset0;
+				proc.instret++;
+				{ proc.mmu.template store<P,s64>(proc, proc.ireg[dec1.rs1] + dec1.imm, proc.ireg[dec1.rs2].r.l.val); }
+			};
+			break;
+		case rv_superinst_ld_ld:
+			if (rvi) {
+				{ s64 t; proc.mmu.template load<P,s64>(proc, proc.ireg[dec0.rs1] + dec0.imm, t); proc.ireg[dec0.rd] = (dec0.rd == 0) ? 0 : t; }
+				proc.pc += pc_offset0;
+				proc.instret++;
+				{ s64 t; proc.mmu.template load<P,s64>(proc, proc.ireg[dec1.rs1] + dec1.imm, t); proc.ireg[dec1.rd] = (dec1.rd == 0) ? 0 : t; }
+			};
+			break;
+		case rv_superinst_sd_sd:
+			if (rvi) {
+				{ proc.mmu.template store<P,s64>(proc, proc.ireg[dec0.rs1] + dec0.imm, proc.ireg[dec0.rs2].r.l.val); }
+				proc.pc += pc_offset0;
+				proc.instret++;
+				{ proc.mmu.template store<P,s64>(proc, proc.ireg[dec1.rs1] + dec1.imm, proc.ireg[dec1.rs2].r.l.val); }
+			};
+			break;
+		default: return -1; /* illegal instruction */
+	}
+	return pc_offset;
+}
+
+#endif
@@ -12,7 +12,11 @@ namespace riscv {
 	 *
 	 * protection domain and address space tagged virtual to physical mapping with page attributes
 	 *
-	 * tlb[PDID:ASID:VPN] = PPN:PTE.bits:PMA
+	 * tlb[PDID:ASID:VPN] = PPN:PTE.bits:PMA:UVA
+	 *
+	 * uva caches the host address of main memory pages so that a hit
+	 * can access memory directly. it is zero for MMIO pages, which take
+	 * the memory bus slow path.
 	 */
 
 	template <typename PARAM>
@@ -43,6 +47,8 @@ namespace riscv {
 		UX      pteb : pteb_bits;      /* PTE Bits */
 		pdid_t  pdid;                  /* Protection Domain Identifier */
 		pma_t   pma;                   /* Physical Memory Attributes copy */
+		u32     gen;                   /* ASID generation (valid if current) */
+		addr_t  uva;                   /* User Virtual Address of the page (host) */
 
 		tagged_tlb_entry() :
 			ppn(ppn_limit),
@@ -51,39 +57,87 @@ namespace riscv {
 			ptel(0),
 			pteb(0),
 			pdid(0),
-			pma(0) {}
+			pma(0),
+			gen(0),
+			uva(0) {}
 
-		tagged_tlb_entry(UX pdid, UX asid, UX vpn, UX ptel, UX pteb, UX ppn) :
+		tagged_tlb_entry(UX pdid, UX asid, UX vpn, UX ptel, UX pteb, UX ppn, u32 gen = 0) :
 			ppn(ppn),
 			asid(asid),
 			vpn(vpn),
 			ptel(ptel),
 			pteb(pteb),
 			pdid(pdid),
-			pma(0) {}
+			pma(0),
+			gen(gen),
+			uva(0) {}
+	};
+
+
+	/*
+	 * tagged_tlb_stats
+	 *
+	 * tlb hit, miss, flush and eviction counters
+	 */
+
+	struct tagged_tlb_stats
+	{
+		size_t hits;                   /* lookup hits */
+		size_t misses;                 /* lookup misses */
+		size_t large_hits;             /* misses refilled from the large page tlb */
+		size_t flushes;                /* full flushes */
+		size_t asid_flushes;           /* single ASID flushes */
+		size_t evictions;              /* valid entries replaced by insert */
+
+		tagged_tlb_stats() :
+			hits(0), misses(0), large_hits(0), flushes(0), asid_flushes(0), evictions(0) {}
 	};
 
 
 	/*
 	 * tagged_tlb
 	 *
-	 * protection domain and address space tagged direct mapped tlb
+	 * protection domain and address space tagged set associative tlb
 	 *
 	 * tlb[PDID:ASID:VPN] = PPN:PTE.bits:PMA
+	 *
+	 * sets are indexed by the low bits of the VPN and replacement is
+	 * FIFO within a set, preferring invalid ways. tlb_ways=1 is direct
+	 * mapped and tlb_ways=tlb_size is fully associative.
+	 *
+	 * megapage and gigapage translations are also kept in a small fully
+	 * associative large page tlb, tagged with the superpage base VPN, so
+	 * that a miss within a superpage is refilled without walking the
+	 * page table.
+	 *
+	 * entries are tagged with the generation of their ASID slot. flushing
+	 * an ASID increments the generation of its slot, which invalidates its
+	 * entries without scanning the tlb. ASIDs that share a slot are
+	 * flushed together and a full flush increments every slot.
 	 */
 
-	template <const size_t tlb_size, typename PARAM>
+	template <const size_t tlb_size, typename PARAM, const size_t tlb_ways = 1,
+		const size_t large_tlb_size = 16>
 	struct tagged_tlb
 	{
 		static_assert(ispow2(tlb_size), "tlb_size must be a power of 2");
+		static_assert(ispow2(tlb_ways), "tlb_ways must be a power of 2");
+		static_assert(tlb_ways <= tlb_size, "tlb_ways must not exceed tlb_size");
+		static_assert(ispow2(large_tlb_size), "large_tlb_size must be a power of 2");
 
 		typedef typename PARAM::UX UX;
 		typedef tagged_tlb_entry<PARAM> tlb_entry_t;
 
 		enum : UX {
 			size = tlb_size,
-			shift = ctz_pow2(size),
+			num_ways = tlb_ways,
+			num_sets = size / num_ways,
+			large_size = large_tlb_size,
+			gen_slots = 256,
+			shift = ctz_pow2(num_sets),
+			ways_shift = ctz_pow2(num_ways),
 			mask = (1ULL << shift) - 1,
+			gen_mask = gen_slots - 1,
 			key_size = sizeof(tlb_entry_t),
 			asid_bits = PARAM::asid_bits,
 			ppn_bits = PARAM::ppn_bits
@@ -92,22 +146,53 @@ namespace riscv {
 		// TODO - map TLB to machine address space with user_memory::add_segment
 
 		tlb_entry_t tlb[size];
+		tlb_entry_t large_tlb[large_size];
+		u32 victim[num_sets];
+		u32 asid_gen[gen_slots];
+		size_t large_next;
+		tagged_tlb_stats stats;
 
-		tagged_tlb() : tlb() {}
+		tagged_tlb() : tlb(), large_tlb(), victim(), large_next(0)
+		{
+			std::fill(asid_gen, asid_gen + gen_slots, 1);
+		}
 
-		void flush(UX pdid)
+		bool valid(tlb_entry_t &ent)
+		{
+			return ent.gen == asid_gen[ent.asid & gen_mask];
+		}
+
+		/* clear all entries and generations (when a generation wraps) */
+		void reset()
+		{
+			std::fill(tlb, tlb + size, tlb_entry_t());
+			std::fill(large_tlb, large_tlb + large_size, tlb_entry_t());
+			std::fill(asid_gen, asid_gen + gen_slots, 1);
+		}
+
+		void flush_all()
 		{
-			for (size_t i = 0; i < size; i++) {
-				if (tlb[i].pdid != pdid) continue;
-				tlb[i] = tlb_entry_t();
+			for (size_t i = 0; i < gen_slots; i++) {
+				if (++asid_gen[i] == 0) {
+					reset();
+					break;
+				}
 			}
+			stats.flushes++;
+		}
+
+		void flush(UX pdid)
+		{
+			flush_all();
 		}
 
 		void flush(UX pdid, UX asid)
 		{
-			for (size_t i = 0; i < size; i++) {
-				if (asid != 0 && tlb[i].pdid != pdid && tlb[i].asid != asid) continue;
-				tlb[i] = tlb_entry_t();
+			if (asid == 0) {
+				flush_all();
+			} else {
+				if (++asid_gen[asid & gen_mask] == 0) reset();
+				stats.asid_flushes++;
 			}
 		}
 
@@ -115,24 +200,144 @@ namespace riscv {
 		tlb_entry_t* lookup(UX pdid, UX asid, UX va)
 		{
 			UX vpn = va >> page_shift;
-			size_t i = vpn & mask;
-			return tlb[i].pdid == pdid && tlb[i].asid == asid && tlb[i].vpn == vpn ?
-				tlb + i : nullptr;
+			u32 gen = asid_gen[asid & gen_mask];
+			tlb_entry_t *ent = tlb + ((vpn & mask) << ways_shift);
+			for (size_t i = 0; i < num_ways; i++, ent++) {
+				if (ent->vpn == vpn && ent->asid == asid && ent->pdid == pdid && ent->gen == gen) {
+					stats.hits++;
+					return ent;
+				}
+			}
+			stats.misses++;
+			return nullptr;
 		}
 
 		// insert TLB entry for the given PDID + ASID + X:12[VA] + 11:0[PTE.bits] <- PPN]
 		tlb_entry_t* insert(UX pdid, UX asid, UX va, UX ptel, UX pteb, UX ppn)
 		{
 			UX vpn = va >> page_shift;
-			size_t i = vpn & mask;
-			// we are implicitly evicting an entry by overwriting it
-			tlb[i] = tlb_entry_t(pdid, asid, vpn, ptel, pteb, ppn);
-			return &tlb[i];
+			size_t set = vpn & mask;
+			tlb_entry_t *ent = tlb + (set << ways_shift), *way = nullptr;
+
+			/* replace an entry for the same page or an invalid entry */
+			for (size_t i = 0; i < num_ways; i++) {
+				if ((ent[i].vpn == vpn && ent[i].asid == asid && ent[i].pdid == pdid) || !valid(ent[i])) {
+					way = ent + i;
+					break;
+				}
+			}
+
+			/* otherwise evict the oldest entry in the set */
+			if (!way) {
+				way = ent + (victim[set]++ & (num_ways - 1));
+				stats.evictions++;
+			}
+
+			*way = tlb_entry_t(pdid, asid, vpn, ptel, pteb, ppn, asid_gen[asid & gen_mask]);
+			return way;
+		}
+
+		// lookup superpage TLB entry for the given PDID + ASID + VA (level_bits is the VPN bits per level)
+		tlb_entry_t* lookup_large(UX pdid, UX asid, UX va, UX level_bits)
+		{
+			UX vpn = va >> page_shift;
+			u32 gen = asid_gen[asid & gen_mask];
+			for (size_t i = 0; i < large_size; i++) {
+				tlb_entry_t &ent = large_tlb[i];
+				if (ent.ptel == 0 || ent.pdid != pdid || ent.asid != asid || ent.gen != gen) continue;
+				UX level_mask = (UX(1) << (level_bits * ent.ptel)) - 1;
+				if ((vpn & ~level_mask) == ent.vpn) return &ent;
+			}
+			return nullptr;
+		}
+
+		// insert superpage TLB entry, replacing an entry for the same superpage or round robin
+		tlb_entry_t* insert_large(UX pdid, UX asid, UX va, UX ptel, UX level_bits, UX pteb, UX ppn)
+		{
+			UX vpn = (va >> page_shift) & ~((UX(1) << (level_bits * ptel)) - 1);
+			tlb_entry_t *ent = lookup_large(pdid, asid, va, level_bits);
+			if (!ent || ent->ptel != ptel) {
+				ent = &large_tlb[large_next++ & (large_size - 1)];
+			}
+			*ent = tlb_entry_t(pdid, asid, vpn, ptel, pteb, ppn, asid_gen[asid & gen_mask]);
+			return ent;
 		}
 	};
 
-	template <const size_t tlb_size> using tagged_tlb_rv32 = tagged_tlb<tlb_size,param_rv32>;
-	template <const size_t tlb_size> using tagged_tlb_rv64 = tagged_tlb<tlb_size,param_rv64>;
+	/*
+	 * page_walk_cache
+	 *
+	 * sptbr tagged cache of non-leaf page table entries
+	 *
+	 * pwc[SPTBR:LEVEL:VA>>(bits*(LEVEL+1)+page_shift)] = page table address
+	 *
+	 * each entry holds the machine physical address of the page table
+	 * used at a level, keyed by the VPN bits consumed by the levels above
+	 * it. a walk probes the deepest level first so that most tlb misses
+	 * load only the leaf PTE. entries are tagged with the full sptbr so
+	 * an sptbr write switches to a different set of entries and sfence.vm
+	 * flushes the cache.
+	 */
+
+	template <typename UX, const size_t pwc_size = 16, const size_t pwc_levels = 3>
+	struct page_walk_cache
+	{
+		static_assert(ispow2(pwc_size), "pwc_size must be a power of 2");
+
+		enum : UX {
+			size = pwc_size,
+			levels = pwc_levels,
+			invalid_prefix = UX(-1)
+		};
+
+		struct pwc_entry_t
+		{
+			UX sptbr;                  /* Supervisor Page Table Base Register */
+			UX prefix;                 /* VA bits above this level */
+			addr_t pt_mpa;             /* page table machine physical address */
+
+			pwc_entry_t() : sptbr(0), prefix(invalid_prefix), pt_mpa(0) {}
+		};
+
+		pwc_entry_t pwc[levels][size];
+		size_t hits;
+		size_t misses;
+		size_t flushes;
+
+		page_walk_cache() : hits(0), misses(0), flushes(0) {}
+
+		void flush()
+		{
+			for (size_t l = 0; l < levels; l++) {
+				std::fill(pwc[l], pwc[l] + size, pwc_entry_t());
+			}
+			flushes++;
+		}
+
+		// lookup the page table for VA at LEVEL (level_bits is the VPN bits per level)
+		addr_t lookup(UX sptbr, UX va, UX level, UX level_bits)
+		{
+			UX prefix = va >> (level_bits * (level + 1) + page_shift);
+			pwc_entry_t &ent = pwc[level][prefix & (size - 1)];
+			return (ent.prefix == prefix && ent.sptbr == sptbr) ? ent.pt_mpa : 0;
+		}
+
+		// insert the page table for VA at LEVEL
+		void insert(UX sptbr, UX va, UX level, UX level_bits, addr_t pt_mpa)
+		{
+			UX prefix = va >> (level_bits * (level + 1) + page_shift);
+			pwc_entry_t &ent = pwc[level][prefix & (size - 1)];
+			ent.sptbr = sptbr;
+			ent.prefix = prefix;
+			ent.pt_mpa = pt_mpa;
+		}
+	};
+
+	template <const size_t tlb_size, const size_t tlb_ways = 1>
+	using tagged_tlb_rv32 = tagged_tlb<tlb_size,param_rv32,tlb_ways>;
+
+	template <const size_t tlb_size, const size_t tlb_ways = 1>
+	using tagged_tlb_rv64 = tagged_tlb<tlb_size,param_rv64,tlb_ways>;
 
 }
 
@@ -0,0 +1,262 @@
+//
+//  gen-superinst.cc
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <set>
+
+#include "util.h"
+#include "cmdline.h"
+#include "model.h"
+#include "gen.h"
+
+/*
+ * Default instruction pairs used when no profile is given.
+ *
+ * Common RISC-V idioms: loop tails, address formation, constant
+ * materialization, indexed loads and register save/restore sequences.
+ */
+
+static const char* default_superinst_pairs[][2] = {
+	{ "addi",  "bne"   },
+	{ "addi",  "blt"   },
+	{ "addi",  "bltu"  },
+	{ "lui",   "addi"  },
+	{ "auipc", "addi"  },
+	{ "auipc", "jalr"  },
+	{ "slli",  "add"   },
+	{ "add",   "lw"    },
+	{ "add",   "ld"    },
+	{ "ld",    "add"   },
+	{ "lw",    "bne"   },
+	{ "ld",    "bne"   },
+	{ "addi",  "ld"    },
+	{ "addi",  "sd"    },
+	{ "ld",    "ld"    },
+	{ "sd",    "sd"    },
+	{ nullptr, nullptr }
+};
+
+std::vector<cmdline_option> rv_gen_superinst::get_cmdline_options()
+{
+	return std::vector<cmdline_option>{
+		{ "-U", "--print-superinst-h", cmdline_arg_type_none,
+			"Print superinstruction header",
+			[&](std::string s) { return gen->set_option("print_superinst_h"); } },
+		{ "-Up", "--superinst-profile", cmdline_arg_type_string,
+			"Read instruction pair profile (hist-pair.csv)",
+			[&](std::string s) { profile_filename = s; return true; } },
+		{ "-Un", "--superinst-count", cmdline_arg_type_string,
+			"Maximum number of superinstructions (default 16)",
+			[&](std::string s) { max_superinst = strtoul(s.c_str(), nullptr, 10); return true; } },
+	};
+}
+
+static rv_opcode_ptr lookup_opcode(rv_gen *gen, std::string name, size_t isa_width)
+{
+	for (auto &opcode : gen->all_opcodes) {
+		if (!opcode->include_isa(isa_width)) continue;
+		if (rv_meta_model::opcode_format("", opcode, ".") == name) return opcode;
+	}
+	return rv_opcode_ptr();
+}
+
+static bool is_control_transfer(rv_opcode_ptr opcode)
+{
+	return opcode->pseudocode_c.find("pc_offset =") != std::string::npos;
+}
+
+static bool superinst_eligible(rv_opcode_ptr first, rv_opcode_ptr second)
+{
+	/*
+	 * Both instructions must be implemented by the interpreter and the
+	 * first must fall through, as the pair executes from one dispatch.
+	 */
+	return first && second &&
+		first->pseudocode_c.size() > 0 &&
+		second->pseudocode_c.size() > 0 &&
+		!is_control_transfer(first);
+}
+
+static bool superinst_eligible(rv_gen *gen, std::string first, std::string second)
+{
+	for (auto isa_width : gen->isa_width_prefixes()) {
+		if (superinst_eligible(lookup_opcode(gen, first, isa_width.first),
+			lookup_opcode(gen, second, isa_width.first))) return true;
+	}
+	return false;
+}
+
+void rv_gen_superinst::read_profile()
+{
+	std::vector<std::string> line;
+	size_t total = 0;
+
+	FILE *file = fopen(profile_filename.c_str(), "r");
+	if (!file) {
+		panic("error opening %s", profile_filename.c_str());
+	}
+
+	char buf[1024];
+	while (fgets(buf, sizeof(buf), file)) {
+		line = split(rtrim(buf), "\t", false, false);
+		if (line.size() != 3 || line[0] == "first") continue;
+		size_t count = strtoull(line[2].c_str(), nullptr, 10);
+		total += count;
+		if (!superinst_eligible(gen, line[0], line[1])) continue;
+		pairs.push_back(rv_superinst_pair{line[0], line[1], count});
+	}
+	fclose(file);
+
+	std::stable_sort(pairs.begin(), pairs.end(), [] (const rv_superinst_pair &a, const rv_superinst_pair &b) {
+		return a.count > b.count;
+	});
+	if (pairs.size() > max_superinst) {
+		pairs.resize(max_superinst);
+	}
+	profile_total = total;
+}
+
+void rv_gen_superinst::default_profile()
+{
+	for (size_t i = 0; default_superinst_pairs[i][0] && pairs.size() < max_superinst; i++) {
+		std::string first = default_superinst_pairs[i][0];
+		std::string second = default_superinst_pairs[i][1];
+		if (!superinst_eligible(gen, first, second)) continue;
+		pairs.push_back(rv_superinst_pair{first, second, 0});
+	}
+}
+
+static std::string superinst_name(rv_superinst_pair &pair)
+{
+	return "rv_superinst_" + replace(pair.first, ".", "_") + "_" + replace(pair.second, ".", "_");
+}
+
+static std::string superinst_body(rv_opcode_ptr opcode, std::string dec, std::string pc_offset)
+{
+	std::string inst = rv_gen_interp::translate_pseudocode_c(opcode);
+	inst = replace(inst, "dec.", dec + ".");
+	inst = replace(inst, "pc_offset", pc_offset);
+	return inst;
+}
+
+void rv_gen_superinst::print_superinst_h()
+{
+	printf(kCHeader, "superinst.h");
+	printf("#ifndef rv_superinst_h\n");
+	printf("#define rv_superinst_h\n");
+	printf("\n");
+
+	printf("/* Superinstructions */\n\n");
+	printf("enum rv_superinst\n");
+	printf("{\n");
+	printf("\t%-40s= %d,\n", "rv_superinst_none", 0);
+	int num = 1;
+	for (auto &pair : pairs) {
+		std::string comment = pair.first + " + " + pair.second;
+		if (profile_total) {
+			comment += format_string(" (%5.2f%%)", (float)pair.count / (float)profile_total * 100.0f);
+		}
+		printf("\t%-40s= %d, /* %s */\n", superinst_name(pair).c_str(), num++, comment.c_str());
+	}
+	printf("};\n\n");
+
+	for (auto isa_width : gen->isa_width_prefixes()) {
+		std::vector<std::pair<rv_opcode_ptr,rv_opcode_ptr>> width_opcodes;
+		std::vector<rv_superinst_pair> width_pairs;
+		for (auto &pair : pairs) {
+			auto first = lookup_opcode(gen, pair.first, isa_width.first);
+			auto second = lookup_opcode(gen, pair.second, isa_width.first);
+			if (!superinst_eligible(first, second)) continue;
+			width_opcodes.push_back(std::pair<rv_opcode_ptr,rv_opcode_ptr>(first, second));
+			width_pairs.push_back(pair);
+		}
+
+		printf("/* Fuse Instruction Pair RV%lu */\n\n", isa_width.first);
+		printf("inline int fuse_inst_%s(int op1, int op2)\n", isa_width.second.c_str());
+		printf("{\n");
+		printf("\tusing namespace riscv;\n");
+		printf("\n");
+		printf("\tswitch (op1) {\n");
+		std::vector<rv_opcode_ptr> firsts;
+		for (auto &ops : width_opcodes) {
+			if (std::find(firsts.begin(), firsts.end(), ops.first) == firsts.end()) {
+				firsts.push_back(ops.first);
+			}
+		}
+		for (auto &first : firsts) {
+			printf("\t\tcase %s:\n", rv_meta_model::opcode_format("rv_op_", first, "_").c_str());
+			printf("\t\t\tswitch (op2) {\n");
+			for (size_t i = 0; i < width_pairs.size(); i++) {
+				if (width_opcodes[i].first != first) continue;
+				printf("\t\t\t\tcase %s: return %s;\n",
+					rv_meta_model::opcode_format("rv_op_", width_opcodes[i].second, "_").c_str(),
+					superinst_name(width_pairs[i]).c_str());
+			}
+			printf("\t\t\t}\n");
+			printf("\t\t\tbreak;\n");
+		}
+		printf("\t}\n");
+		printf("\treturn rv_superinst_none;\n");
+		printf("}\n\n");
+
+		printf("/* Execute Superinstruction RV%lu */\n\n", isa_width.first);
+		printf("template <");
+		std::vector<std::string> mnems = gen->get_inst_mnemonics(false, true);
+		for (auto mi = mnems.begin(); mi != mnems.end(); mi++) {
+			printf("bool %s, ", mi->c_str());
+		}
+		printf("typename T, typename P>\n");
+		printf("typename P::ux exec_superinst_%s(int si, T &dec0, T &dec1, P &proc,\n",
+			isa_width.second.c_str());
+		printf("\ttypename P::ux pc_offset0, typename P::ux pc_offset)\n");
+		printf("{\n");
+		printf("\tusing namespace riscv;\n");
+		printf("\tenum { xlen = %zu };\n", isa_width.first);
+		printf("\ttypedef s%zu sx;\n", isa_width.first);
+		printf("\ttypedef u%zu ux;\n", isa_width.first);
+		printf("\n");
+		printf("\tswitch (si) {\n");
+		for (size_t i = 0; i < width_pairs.size(); i++) {
+			auto &first = width_opcodes[i].first, &second = width_opcodes[i].second;
+			char ext0 = first->extensions.front()->alpha_code;
+			char ext1 = second->extensions.front()->alpha_code;
+			printf("\t\tcase %s:\n", superinst_name(width_pairs[i]).c_str());
+			if (ext0 == ext1) {
+				printf("\t\t\tif (rv%c) {\n", ext0);
+			} else {
+				printf("\t\t\tif (rv%c && rv%c) {\n", ext0, ext1);
+			}
+			printf("\t\t\t\t{ %s; }\n", superinst_body(first, "dec0", "pc_offset0").c_str());
+			printf("\t\t\t\tproc.pc += pc_offset0;\n");
+			printf("\t\t\t\tproc.instret++;\n");
+			printf("\t\t\t\t{ %s; }\n", superinst_body(second, "dec1", "pc_offset").c_str());
+			printf("\t\t\t};\n");
+			printf("\t\t\tbreak;\n");
+		}
+		printf("\t\tdefault: return -1; /* illegal instruction */\n");
+		printf("\t}\n");
+		printf("\treturn pc_offset;\n");
+		printf("}\n\n");
+	}
+	printf("#endif\n");
+}
+
+void rv_gen_superinst::generate()
+{
+	if (!gen->has_option("print_superinst_h")) return;
+	if (profile_filename.size() > 0) {
+		read_profile();
+	} else {
+		default_profile();
+	}
+	print_superinst_h();
+}
@@ -48,6 +48,8 @@ struct rv_gen_interp : rv_gen_abstract
 	rv_gen_interp(rv_gen *gen) : rv_gen_abstract(gen) {}
 	std::vector<cmdline_option> get_cmdline_options();
 	void generate();
+
+	static std::string translate_pseudocode_c(rv_opcode_ptr opcode);
 };
 
 struct rv_gen_jit : rv_gen_abstract
@@ -106,6 +108,29 @@ struct rv_gen_strings : rv_gen_abstract
 	void generate();
 };
 
+struct rv_superinst_pair
+{
+	std::string first;
+	std::string second;
+	size_t count;
+};
+
+struct rv_gen_superinst : rv_gen_abstract
+{
+	std::string profile_filename;
+	std::vector<rv_superinst_pair> pairs;
+	size_t max_superinst;
+	size_t profile_total;
+
+	rv_gen_superinst(rv_gen *gen) : rv_gen_abstract(gen), max_superinst(16), profile_total(0) {}
+	std::vector<cmdline_option> get_cmdline_options();
+	void generate();
+
+	void read_profile();
+	void default_profile();
+	void print_superinst_h();
+};
+
 struct rv_gen_switch : rv_gen_abstract
 {
 	rv_gen_switch(rv_gen *gen) : rv_gen_abstract(gen) {}
@@ -125,7 +125,7 @@ namespace riscv {
 			: proc(proc), as(&code), code(code), ops(ops),
 			  lookup_trace_slow(lookup_trace_slow),
 			  lookup_trace_fast(lookup_trace_fast),
-			  term_pc(0), instret(0), use_mmu(false)
+			  term_pc(0), instret(0), use_mmu(P::mmu_type::jit_use_mmu)
 		{}
 
 		void log_trace(const char* fmt, ...)
@@ -200,6 +200,23 @@ namespace riscv {
 			}
 		}
 
+		/* count the instructions retired before a faulting load or store */
+		void commit_fault_instret()
+		{
+			if (proc.update_instret && instret > 1) {
+				as.add(x86::qword_ptr(x86::rbp, proc_offset(instret)), Imm(instret - 1));
+			}
+		}
+
+		/* leave the trace at a branch target once the run loop budget is spent */
+		void emit_budget_check(addr_t pc)
+		{
+			auto etl = create_exit_tramp(pc);
+			as.mov(x86::rax, x86::qword_ptr(x86::rbp, proc_offset(instret)));
+			as.cmp(x86::rax, x86::qword_ptr(x86::rbp, proc_offset(jit_inststop)));
+			as.j(x86::kCondAE, etl->second);
+		}
+
 		void emit_prolog()
 		{
 			if (!proc.memory_registers) {
@@ -367,6 +384,105 @@ namespace riscv {
 			as.mov(x86::r11, rbp_reg_q(rv_ireg_a3));
 		}
 
+		/* load the store value into rcx */
+		void emit_store_value(decode_type &dec)
+		{
+			int rs2x = x86_reg(dec.rs2);
+			if (dec.rs2 == rv_ireg_zero) {
+				as.xor_(x86::ecx, x86::ecx);
+			} else if (rs2x > 0) {
+				as.mov(x86::rcx, x86::gpq(rs2x));
+			} else {
+				as.mov(x86::rcx, rbp_reg_q(dec.rs2));
+			}
+		}
+
+		const X86Mem jit_tlb_tag(bool store)
+		{
+			return x86::qword_ptr(x86::rbp, x86::rcx, 3,
+				store ? proc_offset(jit_tlb_write) : proc_offset(jit_tlb_read));
+		}
+
+		/*
+		 * inline JIT TLB probe
+		 *
+		 * rax holds the guest virtual address and rcx is clobbered. the
+		 * address is xored with the tag of its direct mapped slot so that
+		 * one test checks both the page number and the alignment, leaving
+		 * the page offset in rax. on a hit the host page address is added
+		 * to rax, otherwise control continues at the miss label with the
+		 * slot index in rcx so the tag can be xored back out of rax.
+		 */
+		void emit_tlb_probe(int size, bool store, Label &miss)
+		{
+			as.mov(x86::rcx, x86::rax);
+			as.shr(x86::rcx, Imm(page_shift));
+			as.and_(x86::ecx, Imm(P::jit_tlb_size - 1));
+			as.xor_(x86::rax, jit_tlb_tag(store));
+			as.test(x86::rax, Imm(s32(page_mask) | s32(size - 1)));
+			as.jnz(miss);
+			as.add(x86::rax, x86::qword_ptr(x86::rbp, x86::rcx, 3, proc_offset(jit_tlb_host)));
+		}
+
+		/* load zero extended into rax, calling the load stub on a TLB miss */
+		template <typename F> void emit_mmu_load(F fn, int size, addr_t pc)
+		{
+			auto miss = as.newLabel();
+			auto okay = as.newLabel();
+			emit_tlb_probe(size, false, miss);
+			switch (size) {
+				case 1: as.movzx(x86::eax, x86::byte_ptr(x86::rax)); break;
+				case 2: as.movzx(x86::eax, x86::word_ptr(x86::rax)); break;
+				case 4: as.mov(x86::eax, x86::dword_ptr(x86::rax)); break;
+				case 8: as.mov(x86::rax, x86::qword_ptr(x86::rax)); break;
+			}
+			as.jmp(okay);
+			as.bind(miss);
+			as.xor_(x86::rax, jit_tlb_tag(false));
+			as.call(Imm(func_address(fn)));
+			as.cmp(x86::qword_ptr(x86::rbp, proc_offset(cause)), Imm(0));
+			as.je(okay);
+			commit_fault_instret();
+			emit_pc(pc);
+			as.jmp(term);
+			as.bind(okay);
+		}
+
+		/*
+		 * store rs2, calling the store stub with the value in rcx on a TLB
+		 * miss. stores also take the stub while any hart holds an LR
+		 * reservation so that the soft MMU breaks it
+		 */
+		template <typename F> void emit_mmu_store(F fn, int size, decode_type &dec)
+		{
+			auto miss = as.newLabel();
+			auto stub = as.newLabel();
+			auto okay = as.newLabel();
+			as.mov(x86::rcx, x86::qword_ptr(x86::rbp, proc_offset(jit_reservations)));
+			as.cmp(x86::dword_ptr(x86::rcx), Imm(0));
+			as.jne(stub);
+			emit_tlb_probe(size, true, miss);
+			emit_store_value(dec);
+			switch (size) {
+				case 1: as.mov(x86::byte_ptr(x86::rax), x86::cl); break;
+				case 2: as.mov(x86::word_ptr(x86::rax), x86::cx); break;
+				case 4: as.mov(x86::dword_ptr(x86::rax), x86::ecx); break;
+				case 8: as.mov(x86::qword_ptr(x86::rax), x86::rcx); break;
+			}
+			as.jmp(okay);
+			as.bind(miss);
+			as.xor_(x86::rax, jit_tlb_tag(true));
+			as.bind(stub);
+			emit_store_value(dec);
+			as.call(Imm(func_address(fn)));
+			as.cmp(x86::qword_ptr(x86::rbp, proc_offset(cause)), Imm(0));
+			as.je(okay);
+			commit_fault_instret();
+			emit_pc(dec.pc);
+			as.jmp(term);
+			as.bind(okay);
+		}
+
 		mmu_ops create_load_store(JitRuntime &rt)
 		{
 			Label lb = as.newLabel();
@@ -476,6 +592,7 @@ namespace riscv {
 				emit_pc(term_pc);
 				log_trace("\t# 0x%016llx", term_pc);
 			}
+			commit_instret();
 			as.bind(term);
 		}
 
@@ -3003,13 +3120,7 @@ namespace riscv {
 						as.mov(x86::rcx, rbp_reg_q(dec.rs1));
 						as.lea(x86::rax, x86::qword_ptr(x86::rcx, dec.imm));
 					}
-					as.call(Imm(func_address(ops.ld)));
-					auto okay = as.newLabel();
-					as.cmp(x86::qword_ptr(x86::rbp, proc_offset(cause)), Imm(0));
-					as.je(okay);
-					emit_pc(dec.pc);
-					as.jmp(term);
-					as.bind(okay);
+					emit_mmu_load(ops.ld, 8, dec.pc);
 					if (rdx > 0) {
 						as.mov(x86::gpq(rdx), x86::rax);
 					} else {
@@ -3057,13 +3168,7 @@ namespace riscv {
 						as.mov(x86::rcx, rbp_reg_q(dec.rs1));
 						as.lea(x86::rax, x86::qword_ptr(x86::rcx, dec.imm));
 					}
-					as.call(Imm(func_address(ops.lw)));
-					auto okay = as.newLabel();
-					as.cmp(x86::qword_ptr(x86::rbp, proc_offset(cause)), Imm(0));
-					as.je(okay);
-					emit_pc(dec.pc);
-					as.jmp(term);
-					as.bind(okay);
+					emit_mmu_load(ops.lw, 4, dec.pc);
 					if (rdx > 0) {
 						as.movsxd(x86::gpq(rdx), x86::eax);
 					} else {
@@ -3112,13 +3217,7 @@ namespace riscv {
 						as.mov(x86::rcx, rbp_reg_q(dec.rs1));
 						as.lea(x86::rax, x86::qword_ptr(x86::rcx, dec.imm));
 					}
-					as.call(Imm(func_address(ops.lw)));
-					auto okay = as.newLabel();
-					as.cmp(x86::qword_ptr(x86::rbp, proc_offset(cause)), Imm(0));
-					as.je(okay);
-					emit_pc(dec.pc);
-					as.jmp(term);
-					as.bind(okay);
+					emit_mmu_load(ops.lw, 4, dec.pc);
 					if (rdx > 0) {
 						as.mov(x86::gpd(rdx), x86::eax);
 					} else {
@@ -3166,13 +3265,7 @@ namespace riscv {
 						as.mov(x86::rcx, rbp_reg_q(dec.rs1));
 						as.lea(x86::rax, x86::qword_ptr(x86::rcx, dec.imm));
 					}
-					as.call(Imm(func_address(ops.lh)));
-					auto okay = as.newLabel();
-					as.cmp(x86::qword_ptr(x86::rbp, proc_offset(cause)), Imm(0));
-					as.je(okay);
-					emit_pc(dec.pc);
-					as.jmp(term);
-					as.bind(okay);
+					emit_mmu_load(ops.lh, 2, dec.pc);
 					if (rdx > 0) {
 						as.movsx(x86::gpq(rdx), x86::ax);
 					} else {
@@ -3221,13 +3314,7 @@ namespace riscv {
 						as.mov(x86::rcx, rbp_reg_q(dec.rs1));
 						as.lea(x86::rax, x86::qword_ptr(x86::rcx, dec.imm));
 					}
-					as.call(Imm(func_address(ops.lh)));
-					auto okay = as.newLabel();
-					as.cmp(x86::qword_ptr(x86::rbp, proc_offset(cause)), Imm(0));
-					as.je(okay);
-					emit_pc(dec.pc);
-					as.jmp(term);
-					as.bind(okay);
+					emit_mmu_load(ops.lh, 2, dec.pc);
 					if (rdx > 0) {
 						as.mov(x86::gpd(rdx), x86::eax);
 					} else {
@@ -3275,13 +3362,7 @@ namespace riscv {
 						as.mov(x86::rcx, rbp_reg_q(dec.rs1));
 						as.lea(x86::rax, x86::qword_ptr(x86::rcx, dec.imm));
 					}
-					as.call(Imm(func_address(ops.lb)));
-					auto okay = as.newLabel();
-					as.cmp(x86::qword_ptr(x86::rbp, proc_offset(cause)), Imm(0));
-					as.je(okay);
-					emit_pc(dec.pc);
-					as.jmp(term);
-					as.bind(okay);
+					emit_mmu_load(ops.lb, 1, dec.pc);
 					if (rdx > 0) {
 						as.movsx(x86::gpq(rdx), x86::al);
 					} else {
@@ -3330,13 +3411,7 @@ namespace riscv {
 						as.mov(x86::rcx, rbp_reg_q(dec.rs1));
 						as.lea(x86::rax, x86::qword_ptr(x86::rcx, dec.imm));
 					}
-					as.call(Imm(func_address(ops.lb)));
-					auto okay = as.newLabel();
-					as.cmp(x86::qword_ptr(x86::rbp, proc_offset(cause)), Imm(0));
-					as.je(okay);
-					emit_pc(dec.pc);
-					as.jmp(term);
-					as.bind(okay);
+					emit_mmu_load(ops.lb, 1, dec.pc);
 					if (rdx > 0) {
 						as.mov(x86::gpd(rdx), x86::eax);
 					} else {
@@ -3377,14 +3452,7 @@ namespace riscv {
 						as.mov(x86::rcx, rbp_reg_q(dec.rs1));
 						as.lea(x86::rax, x86::qword_ptr(x86::rcx, dec.imm));
 					}
-					as.xor_(x86::ecx, x86::ecx);
-					as.call(Imm(func_address(ops.sd)));
-					auto okay = as.newLabel();
-					as.cmp(x86::qword_ptr(x86::rbp, proc_offset(cause)), Imm(0));
-					as.je(okay);
-					emit_pc(dec.pc);
-					as.jmp(term);
-					as.bind(okay);
+					emit_mmu_store(ops.sd, 8, dec);
 				}
 				else if (rs1x > 0) {
 					as.mov(x86::qword_ptr(x86::gpq(rs1x), dec.imm), Imm(0));
@@ -3401,18 +3469,7 @@ namespace riscv {
 						as.mov(x86::rcx, rbp_reg_q(dec.rs1));
 						as.lea(x86::rax, x86::qword_ptr(x86::rcx, dec.imm));
 					}
-					if (rs2x > 0) {
-						as.mov(x86::rcx, x86::gpq(rs2x));
-					} else {
-						as.mov(x86::rcx, rbp_reg_q(dec.rs2));
-					}
-					as.call(Imm(func_address(ops.sd)));
-					auto okay = as.newLabel();
-					as.cmp(x86::qword_ptr(x86::rbp, proc_offset(cause)), Imm(0));
-					as.je(okay);
-					emit_pc(dec.pc);
-					as.jmp(term);
-					as.bind(okay);
+					emit_mmu_store(ops.sd, 8, dec);
 				}
 				else if (rs2x > 0) {
 					if (rs1x > 0) {
@@ -3449,14 +3506,7 @@ namespace riscv {
 						as.mov(x86::rcx, rbp_reg_q(dec.rs1));
 						as.lea(x86::rax, x86::qword_ptr(x86::rcx, dec.imm));
 					}
-					as.xor_(x86::ecx, x86::ecx);
-					as.call(Imm(func_address(ops.sw)));
-					auto okay = as.newLabel();
-					as.cmp(x86::qword_ptr(x86::rbp, proc_offset(cause)), Imm(0));
-					as.je(okay);
-					emit_pc(dec.pc);
-					as.jmp(term);
-					as.bind(okay);
+					emit_mmu_store(ops.sw, 4, dec);
 				}
 				else if (rs1x > 0) {
 					as.mov(x86::dword_ptr(x86::gpq(rs1x), dec.imm), Imm(0));
@@ -3473,18 +3523,7 @@ namespace riscv {
 						as.mov(x86::rcx, rbp_reg_q(dec.rs1));
 						as.lea(x86::rax, x86::qword_ptr(x86::rcx, dec.imm));
 					}
-					if (rs2x > 0) {
-						as.mov(x86::ecx, x86::gpd(rs2x));
-					} else {
-						as.mov(x86::ecx, rbp_reg_d(dec.rs2));
-					}
-					as.call(Imm(func_address(ops.sw)));
-					auto okay = as.newLabel();
-					as.cmp(x86::qword_ptr(x86::rbp, proc_offset(cause)), Imm(0));
-					as.je(okay);
-					emit_pc(dec.pc);
-					as.jmp(term);
-					as.bind(okay);
+					emit_mmu_store(ops.sw, 4, dec);
 				}
 				else if (rs2x > 0) {
 					if (rs1x > 0) {
@@ -3520,14 +3559,7 @@ namespace riscv {
 						as.mov(x86::rcx, rbp_reg_q(dec.rs1));
 						as.lea(x86::rax, x86::qword_ptr(x86::rcx, dec.imm));
 					}
-					as.xor_(x86::ecx, x86::ecx);
-					as.call(Imm(func_address(ops.sh)));
-					auto okay = as.newLabel();
-					as.cmp(x86::qword_ptr(x86::rbp, proc_offset(cause)), Imm(0));
-					as.je(okay);
-					emit_pc(dec.pc);
-					as.jmp(term);
-					as.bind(okay);
+					emit_mmu_store(ops.sh, 2, dec);
 				}
 				else if (rs1x > 0) {
 					as.mov(x86::word_ptr(x86::gpq(rs1x), dec.imm), Imm(0));
@@ -3545,18 +3577,7 @@ namespace riscv {
 						as.mov(x86::rcx, rbp_reg_q(dec.rs1));
 						as.lea(x86::rax, x86::qword_ptr(x86::rcx, dec.imm));
 					}
-					if (rs2x > 0) {
-						as.mov(x86::ecx, x86::gpd(rs2x));
-					} else {
-						as.mov(x86::ecx, rbp_reg_d(dec.rs2));
-					}
-					as.call(Imm(func_address(ops.sh)));
-					auto okay = as.newLabel();
-					as.cmp(x86::qword_ptr(x86::rbp, proc_offset(cause)), Imm(0));
-					as.je(okay);
-					emit_pc(dec.pc);
-					as.jmp(term);
-					as.bind(okay);
+					emit_mmu_store(ops.sh, 2, dec);
 				}
 				else if (rs2x > 0) {
 					if (rs1x > 0) {
@@ -3592,14 +3613,7 @@ namespace riscv {
 						as.mov(x86::rcx, rbp_reg_q(dec.rs1));
 						as.lea(x86::rax, x86::qword_ptr(x86::rcx, dec.imm));
 					}
-					as.xor_(x86::ecx, x86::ecx);
-					as.call(Imm(func_address(ops.sb)));
-					auto okay = as.newLabel();
-					as.cmp(x86::qword_ptr(x86::rbp, proc_offset(cause)), Imm(0));
-					as.je(okay);
-					emit_pc(dec.pc);
-					as.jmp(term);
-					as.bind(okay);
+					emit_mmu_store(ops.sb, 1, dec);
 				}
 				else if (rs1x > 0) {
 					as.mov(x86::byte_ptr(x86::gpq(rs1x), dec.imm), Imm(0));
@@ -3617,18 +3631,7 @@ namespace riscv {
 						as.mov(x86::rcx, rbp_reg_q(dec.rs1));
 						as.lea(x86::rax, x86::qword_ptr(x86::rcx, dec.imm));
 					}
-					if (rs2x > 0) {
-						as.mov(x86::ecx, x86::gpd(rs2x));
-					} else {
-						as.mov(x86::ecx, rbp_reg_d(dec.rs2));
-					}
-					as.call(Imm(func_address(ops.sb)));
-					auto okay = as.newLabel();
-					as.cmp(x86::qword_ptr(x86::rbp, proc_offset(cause)), Imm(0));
-					as.je(okay);
-					emit_pc(dec.pc);
-					as.jmp(term);
-					as.bind(okay);
+					emit_mmu_store(ops.sb, 1, dec);
 				}
 				else if (rs2x > 0) {
 					if (rs1x > 0) {
@@ -4117,13 +4120,7 @@ namespace riscv {
 				u64 addr = dec.pc + dec.imm;
 				if (use_mmu) {
 					as.mov(x86::rax, Imm(addr));
-					as.call(Imm(func_address(ops.lw)));
-					auto okay = as.newLabel();
-					as.cmp(x86::qword_ptr(x86::rbp, proc_offset(cause)), Imm(0));
-					as.je(okay);
-					emit_pc(dec.pc);
-					as.jmp(term);
-					as.bind(okay);
+					emit_mmu_load(ops.lw, 4, dec.pc);
 					if (rdx > 0) {
 						as.movsxd(x86::gpq(rdx), x86::eax);
 					} else {
@@ -4171,13 +4168,7 @@ namespace riscv {
 				u64 addr = dec.pc + dec.imm;
 				if (use_mmu) {
 					as.mov(x86::rax, Imm(addr));
-					as.call(Imm(func_address(ops.ld)));
-					auto okay = as.newLabel();
-					as.cmp(x86::qword_ptr(x86::rbp, proc_offset(cause)), Imm(0));
-					as.je(okay);
-					emit_pc(dec.pc);
-					as.jmp(term);
-					as.bind(okay);
+					emit_mmu_load(ops.ld, 8, dec.pc);
 					if (rdx > 0) {
 						as.mov(x86::gpq(rdx), x86::rax);
 					} else {
@@ -4219,6 +4210,7 @@ namespace riscv {
 				Label l = as.newLabel();
 				labels[dec.pc] = l;
 				as.bind(l);
+				if (use_mmu) emit_budget_check(dec.pc);
 			}
 			switch(dec.op) {
 				case rv_op_auipc:     instret++;    return emit_auipc(dec);
@@ -7,12 +7,14 @@
 
 namespace riscv {
 
+	/* the processor of each host thread receives its synchronous signals */
+
 	struct jit_singleton
 	{
-		static jit_singleton *current;
+		static thread_local jit_singleton *current;
 	};
 
-	jit_singleton* jit_singleton::current = nullptr;
+	thread_local jit_singleton* jit_singleton::current = nullptr;
 
 	struct jit_logger : Logger
 	{
@@ -38,21 +40,30 @@ namespace riscv {
 			typename P::decode_type dec;
 		};
 
+		struct trace_cache_ent
+		{
+			TraceFunc fn;
+			addr_t pc;            /* virtual pc the trace was recorded at */
+		};
+
 		JitRuntime rt;
-		google::dense_hash_map<addr_t,TraceFunc> trace_cache_prolog;
+		google::dense_hash_map<addr_t,trace_cache_ent> trace_cache_prolog;
 		google::dense_hash_map<addr_t,TraceFunc> trace_cache_entry;
 		google::dense_hash_map<addr_t,TraceFunc> audit_trace_cache_prolog;
 		std::map<addr_t,std::vector<intptr_t>> jmp_fixup_addrs;
 		std::shared_ptr<debug_cli<P>> cli;
 		rv_inst_cache_ent inst_cache[inst_cache_size];
+		typename P::decode_type *trap_dec;
+		typename P::decode_type fault_dec;
 		TraceLookup lookup_trace_fast;
 		mmu_ops ops;
+		bool tracing;
 
 		jit_runloop() : jit_runloop(std::make_shared<debug_cli<P>>()) {}
-		jit_runloop(std::shared_ptr<debug_cli<P>> cli) : cli(cli), inst_cache(), ops{
+		jit_runloop(std::shared_ptr<debug_cli<P>> cli) : cli(cli), inst_cache(), trap_dec(nullptr), fault_dec(), ops{
 			.lb = mmu_lb, .lh = mmu_lh, .lw = mmu_lw, .ld = mmu_ld,
 			.sb = mmu_sb, .sh = mmu_sh, .sw = mmu_sw, .sd = mmu_sd
-		}
+		}, tracing(false)
 		{
 			trace_cache_prolog.set_empty_key(0);
 			trace_cache_prolog.set_deleted_key(-1);
@@ -60,6 +71,7 @@ namespace riscv {
 			trace_cache_entry.set_deleted_key(-1);
 			audit_trace_cache_prolog.set_empty_key(0);
 			audit_trace_cache_prolog.set_deleted_key(-1);
+			P::blocks.fuse = &P::inst_fuse;
 		}
 
 		virtual bool handleError(Error err, const char* message, CodeEmitter* origin)
@@ -76,6 +88,9 @@ namespace riscv {
 
 		void signal_dispatch(int signum, siginfo_t *info)
 		{
+			/* device accesses in the fastmem window longjmp to be retried */
+			if (signum == SIGSEGV && P::fastmem_fault(info)) return;
+
 			printf("SIGNAL   :%s pc:0x%0llx si_addr:0x%0llx\n",
 				signal_name(signum), (addr_t)P::pc, (addr_t)info->si_addr);
 
@@ -94,7 +109,8 @@ namespace riscv {
 			sigaddset(&set, SIGINT);
 			sigaddset(&set, SIGHUP);
 			sigaddset(&set, SIGUSR1);
-			if (pthread_sigmask(SIG_BLOCK, &set, NULL) != 0) {
+			sigset_t oldset;
+			if (pthread_sigmask(SIG_BLOCK, &set, &oldset) != 0) {
 				panic("can't set thread signal mask: %s", strerror(errno));
 			}
 
@@ -117,8 +133,8 @@ namespace riscv {
 			sigaction(SIGUSR1, &sigaction_handler, nullptr);
 			jit_singleton::current = this;
 
-			/* unblock signals */
-			if (pthread_sigmask(SIG_UNBLOCK, &set, NULL) != 0) {
+			/* restore the signal mask (secondary harts keep asynchronous signals blocked) */
+			if (pthread_sigmask(SIG_SETMASK, &oldset, NULL) != 0) {
 				panic("can't set thread signal mask: %s", strerror(errno));
 			}
 
@@ -185,6 +201,7 @@ namespace riscv {
 					return pc_offset;
 				case rv_op_fence_i:
 					clear_trace_cache();
+					P::blocks.flush();
 					return pc_offset;
 				default: break;
 			}
@@ -194,7 +211,7 @@ namespace riscv {
 		void clear_trace_cache()
 		{
 			for (auto ent : trace_cache_prolog) {
-				rt.release(ent.second);
+				rt.release(ent.second.fn);
 			}
 			trace_cache_prolog.clear_no_resize();
 			trace_cache_entry.clear_no_resize();
@@ -202,6 +219,9 @@ namespace riscv {
 
 		static uintptr_t lookup_trace(uintptr_t pc)
 		{
+			/* traces are not chained when the address space can change */
+			if (P::mmu_type::jit_use_mmu) return 0;
+
 			auto *proc = static_cast<jit_runloop<P,T,J>*>(jit_singleton::current);
 			auto ti = proc->trace_cache_entry.find(pc);
 			uintptr_t fn = func_address(ti != proc->trace_cache_entry.end() ? ti->second : nullptr);
@@ -213,6 +233,7 @@ namespace riscv {
 			u8 val;
 			auto *proc = static_cast<jit_runloop<P,T,J>*>(jit_singleton::current);
 			proc->mmu.template load<P,u8>(*proc, addr, val);
+			if (!proc->cause) proc->mmu.jit_tlb_fill(*proc, addr, false);
 			return val;
 		}
 
@@ -221,6 +242,7 @@ namespace riscv {
 			u16 val;
 			auto *proc = static_cast<jit_runloop<P,T,J>*>(jit_singleton::current);
 			proc->mmu.template load<P,u16>(*proc, addr, val);
+			if (!proc->cause) proc->mmu.jit_tlb_fill(*proc, addr, false);
 			return val;
 		}
 
@@ -229,6 +251,7 @@ namespace riscv {
 			u32 val;
 			auto *proc = static_cast<jit_runloop<P,T,J>*>(jit_singleton::current);
 			proc->mmu.template load<P,u32>(*proc, addr, val);
+			if (!proc->cause) proc->mmu.jit_tlb_fill(*proc, addr, false);
 			return val;
 		}
 
@@ -237,6 +260,7 @@ namespace riscv {
 			u64 val;
 			auto *proc = static_cast<jit_runloop<P,T,J>*>(jit_singleton::current);
 			proc->mmu.template load<P,u64>(*proc, addr, val);
+			if (!proc->cause) proc->mmu.jit_tlb_fill(*proc, addr, false);
 			return val;
 		}
 
@@ -244,24 +268,28 @@ namespace riscv {
 		{
 			auto *proc = static_cast<jit_runloop<P,T,J>*>(jit_singleton::current);
 			proc->mmu.template store<P,u8>(*proc, addr, val);
+			if (!proc->cause) proc->mmu.jit_tlb_fill(*proc, addr, true);
 		}
 
 		static void mmu_sh(uintptr_t addr, u16 val)
 		{
 			auto *proc = static_cast<jit_runloop<P,T,J>*>(jit_singleton::current);
 			proc->mmu.template store<P,u16>(*proc, addr, val);
+			if (!proc->cause) proc->mmu.jit_tlb_fill(*proc, addr, true);
 		}
 
 		static void mmu_sw(uintptr_t addr, u32 val)
 		{
 			auto *proc = static_cast<jit_runloop<P,T,J>*>(jit_singleton::current);
 			proc->mmu.template store<P,u32>(*proc, addr, val);
+			if (!proc->cause) proc->mmu.jit_tlb_fill(*proc, addr, true);
 		}
 
 		static void mmu_sd(uintptr_t addr, u64 val)
 		{
 			auto *proc = static_cast<jit_runloop<P,T,J>*>(jit_singleton::current);
 			proc->mmu.template store<P,u64>(*proc, addr, val);
+			if (!proc->cause) proc->mmu.jit_tlb_fill(*proc, addr, true);
 		}
 
 		void jit_apply_fixups(jit_emitter &emitter, addr_t pc, intptr_t entry_addr)
@@ -290,30 +318,61 @@ namespace riscv {
 			}
 		}
 
-		void jit_cache(jit_emitter &emitter, CodeHolder &code, addr_t pc)
+		void jit_cache(jit_emitter &emitter, CodeHolder &code, addr_t key, addr_t pc)
 		{
 			TraceFunc fn = nullptr;
 			Error err = rt.add(&fn, &code);
-			if (!err) {
+			if (!err && P::mmu_type::jit_use_mmu) {
+				/* unchained so a trace at another pc with the same key can be released */
+				auto ti = trace_cache_prolog.find(key);
+				if (ti != trace_cache_prolog.end()) {
+					rt.release(ti->second.fn);
+				}
+				trace_cache_prolog[key] = trace_cache_ent{ fn, pc };
+			} else if (!err) {
 				union { intptr_t i; TraceFunc fn; } r = { .fn = fn };
 				intptr_t prolog_addr = r.i;
 				r.i += code.getLabelOffset(emitter.start);
 				intptr_t entry_addr = r.i;
-				trace_cache_prolog[pc] = fn;
+				trace_cache_prolog[key] = trace_cache_ent{ fn, pc };
 				trace_cache_entry[pc] = r.fn;
 				jit_apply_fixups(emitter, pc, entry_addr);
 				jit_stash_fixups(emitter, code, prolog_addr);
 			}
 		}
 
-		bool jit_exec(P &proc, addr_t pc)
+		bool jit_exec(P &proc, addr_t pc, u64 inststop)
 		{
-			auto ti = trace_cache_prolog.find(pc);
-			if (ti != trace_cache_prolog.end()) {
-				ti->second(static_cast<typename P::processor_type *>(&proc));
+			/* sfence.vm and sptbr writes invalidate traces */
+			if (unlikely(P::trace_flush)) {
+				clear_trace_cache();
+				P::trace_flush = 0;
+			}
+
+			auto ti = trace_cache_prolog.find(P::mmu.trace_key(proc, pc));
+			if (ti == trace_cache_prolog.end() || ti->second.pc != pc) {
+				return false;
+			}
+			P::mmu.jit_tlb_sync(proc);
+			P::jit_inststop = inststop;
+			if (!P::mmu_type::jit_use_mmu) {
+				ti->second.fn(static_cast<typename P::processor_type *>(&proc));
 				return true;
 			}
-			return false;
+
+			/* translated code returns with the pc of a faulting load or store in cause */
+			P::exceptions = 0;
+			P::set_fastmem(false);
+			ti->second.fn(static_cast<typename P::processor_type *>(&proc));
+			P::set_fastmem(true);
+			P::exceptions = 1;
+			if (P::cause) {
+				int cause = P::cause;
+				P::cause = 0;
+				trap_dec = &fault_dec;
+				P::raise(cause, P::badaddr);
+			}
+			return true;
 		}
 
 		void jit_trace()
@@ -329,10 +388,13 @@ namespace riscv {
 			jit_regalloc<P> regalloc;
 
 			typename P::ux trace_pc = P::pc;
-			typename P::ux trace_instret = P::instret;
+			u64 trace_instret = P::instret;
+			addr_t trace_key = P::mmu.trace_key(*this, trace_pc);
+			addr_t hist_key = P::mmu.template inst_translate<false>(*this, trace_pc);
 
 			/* trace code and accumlate trace buffer */
 			P::log &= ~proc_log_jit_trap;
+			tracing = true;
 			tracer.begin();
 			for(;;) {
 				typename P::decode_type dec;
@@ -347,6 +409,7 @@ namespace riscv {
 				P::instret++;
 			}
 			tracer.end();
+			tracing = false;
 			P::log |= proc_log_jit_trap;
 
 			/* log register allocation */
@@ -376,10 +439,10 @@ namespace riscv {
 			}
 
 			if (P::instret == trace_instret) {
-				P::histogram_set_pc(trace_pc, P::hostspot_trace_skip);
+				P::histogram_set_pc(hist_key, P::hostspot_trace_skip);
 			}
 			else {
-				jit_cache(emitter, code, trace_pc);
+				jit_cache(emitter, code, trace_key, trace_pc);
 			}
 		}
 
@@ -490,19 +553,35 @@ namespace riscv {
 		exit_cause step(size_t count)
 		{
 			typename P::decode_type dec;
-			typename P::ux inststop = P::instret + count;
 			typename P::ux pc_offset, new_offset;
 			inst_t inst = 0, inst_cache_key;
 
 			/* interrupt service routine */
-			P::time = cpu_cycle_clock();
+			P::time = P::cycle_time();
 			P::isr();
+			if (!P::running) return exit_cause_poweroff;
+
+			/* run until the next event unless single stepping in the debugger */
+			u64 inststop = P::instret + (P::debugging ? count : P::step_budget(count));
 
 			/* trap return path */
 			int cause;
 			if (unlikely((cause = setjmp(P::env)) > 0)) {
+				P::blocks.commit();
+				P::set_fastmem(true);
+				if (tracing) {
+					/* a fault while tracing discards the trace */
+					tracing = false;
+					P::log |= proc_log_jit_trap;
+				}
 				cause -= P::internal_cause_offset;
 				switch(cause) {
+					case P::internal_cause_fastmem:
+						/* retry the faulting instruction via the memory bus */
+						P::set_fastmem(false);
+						step_inst(dec);
+						P::set_fastmem(true);
+						return exit_cause_continue;
 					case P::internal_cause_cli:
 						return exit_cause_cli;
 					case P::internal_cause_fatal:
@@ -515,13 +594,26 @@ namespace riscv {
 						jit_trace();
 						return exit_cause_continue;
 				}
-				P::trap(dec, cause);
+				P::trap(*trap_dec, cause);
 				if (!P::running) return exit_cause_poweroff;
 			}
 
+			/* select the specialized loop when logging and breakpoints are off */
+			u32 per_inst = P::log & proc_log_per_inst;
+			if (P::log & proc_log_jit_trap) per_inst &= ~proc_log_hist_pc;
+			trap_dec = &dec;
+			if (per_inst == 0 && P::breakpoint == 0) {
+				if (P::log & proc_log_jit_trap) {
+					step_blocks<true>(inststop);
+				} else {
+					step_blocks<false>(inststop);
+				}
+				return exit_cause_continue;
+			}
+
 			/* step the processor */
-			while (P::instret != inststop) {
-				if ((P::log & proc_log_jit_trap) && jit_exec(*this, P::pc)) {
+			while (P::instret < inststop && !P::event_pending()) {
+				if ((P::log & proc_log_jit_trap) && jit_exec(*this, P::pc, inststop)) {
 					continue;
 				}
 				if (P::pc == P::breakpoint && P::breakpoint != 0) {
@@ -552,6 +644,106 @@ namespace riscv {
 			}
 			return exit_cause_continue;
 		}
+
+		/* execute one instruction without the instruction or block caches */
+		void step_inst(typename P::decode_type &dec)
+		{
+			typename P::ux pc_offset = 0, new_offset;
+			trap_dec = &dec;
+			inst_t inst = P::mmu.inst_fetch(*this, P::pc, pc_offset);
+			P::inst_decode(dec, inst);
+			if ((new_offset = P::inst_exec(dec, pc_offset)) != typename P::ux(-1) ||
+				(new_offset = inst_fence_i(dec, pc_offset)) != typename P::ux(-1) ||
+				(new_offset = P::inst_priv(dec, pc_offset)) != typename P::ux(-1))
+			{
+				if (P::log & ~(proc_log_hist_pc | proc_log_jit_trap)) P::print_log(dec, inst);
+				P::pc += new_offset;
+				P::instret++;
+			} else {
+				P::raise(rv_cause_illegal_instruction, P::pc);
+			}
+		}
+
+		/*
+		 * step the processor using the decoded block cache
+		 *
+		 * logging, histogram and breakpoint checks are compiled out of
+		 * this loop. jit_trap=true enters traces at block boundaries and
+		 * counts block entries in the pc histogram used to find hotspots.
+		 * traces only check the instruction budget, so pending interrupts
+		 * are checked before entering a trace and returned to the caller
+		 * to be taken by the interrupt service routine. posted device
+		 * events end the step at the next block boundary.
+		 */
+		template <const bool jit_trap>
+		void step_blocks(u64 inststop)
+		{
+			typename P::ux new_offset;
+			while (P::instret < inststop && !P::event_pending()) {
+				if (jit_trap) {
+					if (P::interrupt_pending()) return;
+					if (jit_exec(*this, P::pc, inststop)) continue;
+				}
+				addr_t key = P::mmu.template inst_translate<jit_trap>(*this, P::pc);
+				auto blk = P::blocks.lookup(key);
+				if (unlikely(!blk)) {
+					record_block(key, inststop);
+					continue;
+				}
+				for (auto bi = blk->insts, be = blk->insts + blk->count; bi != be; bi++) {
+					trap_dec = &bi->dec;
+					/* a pair without a handler executes as two instructions */
+					if (bi->fused && P::instret + 1 != inststop &&
+						(new_offset = P::inst_exec_fused(bi->fused, bi[0].dec, bi[1].dec,
+							bi[0].len, bi[1].len)) != typename P::ux(-1))
+					{
+						bi++;
+					}
+					else if ((new_offset = P::inst_exec(bi->dec, bi->len)) == typename P::ux(-1) &&
+						(new_offset = inst_fence_i(bi->dec, bi->len)) == typename P::ux(-1) &&
+						(new_offset = P::inst_priv(bi->dec, bi->len)) == typename P::ux(-1))
+					{
+						P::raise(rv_cause_illegal_instruction, P::pc);
+					}
+					P::pc += new_offset;
+					P::instret++;
+					if (new_offset != bi->len || P::instret == inststop) break;
+				}
+			}
+		}
+
+		void record_block(addr_t key, u64 inststop)
+		{
+			typename P::ux pc_offset, new_offset;
+			auto blk = P::blocks.begin(key);
+			for (;;) {
+				auto &bi = blk->insts[blk->count];
+				/* the slot may hold an evicted decode, which a fetch fault must not trap with */
+				bi.dec.op = rv_op_illegal;
+				trap_dec = &bi.dec;
+				bi.inst = P::mmu.template inst_fetch<false>(*this, P::pc, pc_offset);
+				bool straddle = P::blocks.straddles_page(P::pc, pc_offset);
+				if (straddle && blk->count > 0) break;
+				P::inst_decode(bi.dec, bi.inst);
+				if ((new_offset = P::inst_exec(bi.dec, pc_offset)) != typename P::ux(-1) ||
+					(new_offset = inst_fence_i(bi.dec, pc_offset)) != typename P::ux(-1) ||
+					(new_offset = P::inst_priv(bi.dec, pc_offset)) != typename P::ux(-1))
+				{
+					addr_t pc = P::pc;
+					P::pc += new_offset;
+					P::instret++;
+					if (straddle) {
+						P::blocks.abandon();
+						return;
+					}
+					if (P::blocks.append(pc, pc_offset) ||
+						new_offset != pc_offset || P::instret == inststop) break;
+				} else {
+					P::raise(rv_cause_illegal_instruction, P::pc);
+				}
+			}
+			P::blocks.commit();
+		}
 	};
 
 }
@@ -102,6 +102,7 @@ PROGRAMS += \
 	$(BIN_DIR)/test-m-ecall-trap \
 	$(BIN_DIR)/test-m-hartid \
 	$(BIN_DIR)/test-m-mret-user \
+	$(BIN_DIR)/test-m-mmio-bench \
 	$(BIN_DIR)/test-m-mmio-htif \
 	$(BIN_DIR)/test-m-mmio-timer \
 	$(BIN_DIR)/test-m-mmio-uart \
@@ -274,6 +275,9 @@ $(BIN_DIR)/test-m-ecall-trap: $(OBJ_DIR)/test-m-ecall-trap.o ; $(LD) $^ -o $@
 $(OBJ_DIR)/test-m-hartid.o: $(SRC_DIR)/test-m-hartid.S ; $(CC) -c $^ -o $@
 $(BIN_DIR)/test-m-hartid: $(OBJ_DIR)/test-m-hartid.o ; $(LD) $^ -o $@
 
+$(OBJ_DIR)/test-m-mmio-bench.o: $(SRC_DIR)/test-m-mmio-bench.S ; $(CC) -c $^ -o $@
+$(BIN_DIR)/test-m-mmio-bench: $(OBJ_DIR)/test-m-mmio-bench.o ; $(LD) $^ -o $@
+
 $(OBJ_DIR)/test-m-mmio-htif.o: $(SRC_DIR)/test-m-mmio-htif.S ; $(CC) -c $^ -o $@
 $(BIN_DIR)/test-m-mmio-htif: $(OBJ_DIR)/test-m-mmio-htif.o ; $(LD) $^ -o $@
 